@@ -0,0 +1,56 @@
+/**
+ * @file bench_alloc.c
+ * @brief Small-object allocation throughput of the Geece heap against per-object calloc.
+ *
+ * Both paths allocate a batch of objects with mixed payload sizes and then release the whole
+ * batch, which mirrors the allocate/reclaim cycle of short-lived objects.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "heap.h"
+#include "timer.h"
+
+#define BATCH 4096
+#define ROUNDS 1000
+
+static const size_t payload_sizes[] = {8, 16, 24, 32, 48, 64, 96, 128};
+#define PAYLOAD_SIZE_COUNT (sizeof(payload_sizes) / sizeof(payload_sizes[0]))
+
+static Object *batch[BATCH];
+
+static double bench_calloc(void){
+    uint64_t start = timer_now_ns();
+    for (int round = 0; round < ROUNDS; ++round){
+        for (int i = 0; i < BATCH; ++i){
+            batch[i] = calloc(1, sizeof(Object) + payload_sizes[i % PAYLOAD_SIZE_COUNT]);
+        }
+        for (int i = 0; i < BATCH; ++i){
+            free(batch[i]);
+        }
+    }
+    return (double)timer_elapsed_ns(start);
+}
+
+static double bench_geece(void){
+    uint64_t start = timer_now_ns();
+    for (int round = 0; round < ROUNDS; ++round){
+        for (int i = 0; i < BATCH; ++i){
+            batch[i] = geece_malloc(payload_sizes[i % PAYLOAD_SIZE_COUNT], NULL);
+        }
+        for (int i = 0; i < BATCH; ++i){
+            geece_release(batch[i]);
+        }
+    }
+    return (double)timer_elapsed_ns(start);
+}
+
+int main(){
+    double operations = (double)BATCH * ROUNDS;
+    double calloc_ns = bench_calloc();
+    double geece_ns = bench_geece();
+    printf("%-12s %10s %12s\n", "path", "ns/alloc", "Mallocs/s");
+    printf("%-12s %10.2f %12.2f\n", "calloc", calloc_ns / operations, operations / calloc_ns * 1e3);
+    printf("%-12s %10.2f %12.2f\n", "geece_malloc", geece_ns / operations, operations / geece_ns * 1e3);
+    printf("speedup: %.2fx\n", calloc_ns / geece_ns);
+    return 0;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file bench_edges.c
+ * @brief Cost of adding and removing the edges of one high fan-out object.
+ *
+ * A rooted parent gets an edge to each of its children with `add_reference()`, which first checks
+ * that the edge is not there yet, then loses them again with `remove_reference()` in the order
+ * they were added, as many times as it takes to make a million of each. Both are reported per edge
+ * for 8, 1K and 100K children, along with the cost per edge of walking them with
+ * `object_references()`.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "geece.h"
+#include "timer.h"
+
+#define MAX_DEGREE (100 * 1000)
+#define MIN_EDITS (1000 * 1000)
+#define MIN_SCANNED (100 * 1000 * 1000)
+
+static Object *children[MAX_DEGREE];
+
+int main(void){
+    size_t degrees[] = {8, 1000, MAX_DEGREE};
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    for (size_t i = 0; i < MAX_DEGREE; ++i){
+        children[i] = geece_malloc(0, NULL);
+    }
+
+    printf("%-10s %14s %14s %14s\n", "edges", "add ns", "remove ns", "scan ns");
+    for (size_t d = 0; d < sizeof(degrees) / sizeof(degrees[0]); ++d){
+        size_t degree = degrees[d];
+        Object *parent = geece_malloc(0, NULL);
+        root_table_add(roots, parent);
+
+        size_t edits = MIN_EDITS / degree > 0 ? MIN_EDITS / degree : 1;
+        uint64_t add_ns = 0;
+        uint64_t remove_ns = 0;
+        uintptr_t checksum = 0;
+        for (size_t round = 0; round < edits; ++round){
+            uint64_t start = timer_now_ns();
+            for (size_t i = 0; i < degree; ++i){
+                add_reference(roots, parent, children[i]);
+            }
+            add_ns += timer_elapsed_ns(start);
+            if (round + 1 == edits){
+                break;
+            }
+            start = timer_now_ns();
+            for (size_t i = 0; i < degree; ++i){
+                remove_reference(roots, parent, children[i]);
+            }
+            remove_ns += timer_elapsed_ns(start);
+        }
+
+        size_t rounds = MIN_SCANNED / degree;
+        uint64_t start = timer_now_ns();
+        for (size_t round = 0; round < rounds; ++round){
+            size_t count;
+            Object **references = object_references(parent, &count);
+            for (size_t i = 0; i < count; ++i){
+                checksum ^= (uintptr_t)references[i];
+            }
+        }
+        double scan = (double)timer_elapsed_ns(start) / (double)(rounds * degree);
+
+        start = timer_now_ns();
+        for (size_t i = 0; i < degree; ++i){
+            remove_reference(roots, parent, children[i]);
+        }
+        remove_ns += timer_elapsed_ns(start);
+        double add = (double)add_ns / (double)(edits * degree);
+        double removal = (double)remove_ns / (double)(edits * degree);
+        if (get_reference_count(roots, parent) != 0 || checksum == 1){
+            fprintf(stderr, "Error: Edges left behind.\n");
+        }
+        root_table_remove(roots, parent);
+        printf("%-10zu %14.2f %14.2f %14.2f\n", degree, add, removal, scan);
+    }
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    return 0;
+}
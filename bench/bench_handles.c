@@ -0,0 +1,78 @@
+/**
+ * @file bench_handles.c
+ * @brief Cost of rooting short-lived locals with handles against the root table.
+ *
+ * Each round roots a batch of objects and unroots them again, as a function rooting its locals
+ * would on entry and exit: by string key with `add_to_root_table()`, formatting the key as callers
+ * did, by pointer with `root_table_add()`, and with handles pushed in a scope. The cost is reported
+ * per rooted object for batches of 1, 8 and 64 locals.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "geece.h"
+#include "timer.h"
+#include "bench_helpers.h"
+
+#define ROOTED (20 * 1000 * 1000)
+#define MAX_BATCH 64
+
+static Object objects[MAX_BATCH];
+static char keys[MAX_BATCH][ADDRESS_KEY_LENGTH];
+
+static double keyed(RootTable *table, size_t batch){
+    uint64_t start = timer_now_ns();
+    for (size_t round = 0; round < ROOTED / batch; ++round){
+        for (size_t i = 0; i < batch; ++i){
+            snprintf(keys[i], ADDRESS_KEY_LENGTH, "%llu", (unsigned long long)(uintptr_t)&objects[i]);
+            add_to_root_table(table, keys[i], &objects[i]);
+        }
+        for (size_t i = batch; i-- > 0;){
+            remove_from_root_table(table, keys[i]);
+        }
+    }
+    return (double)timer_elapsed_ns(start) / (double)(ROOTED / batch * batch);
+}
+
+static double pointers(RootTable *table, size_t batch){
+    uint64_t start = timer_now_ns();
+    for (size_t round = 0; round < ROOTED / batch; ++round){
+        for (size_t i = 0; i < batch; ++i){
+            root_table_add(table, &objects[i]);
+        }
+        for (size_t i = batch; i-- > 0;){
+            root_table_remove(table, &objects[i]);
+        }
+    }
+    return (double)timer_elapsed_ns(start) / (double)(ROOTED / batch * batch);
+}
+
+static double handles(size_t batch){
+    size_t pushed = 0;
+    uint64_t start = timer_now_ns();
+    for (size_t round = 0; round < ROOTED / batch; ++round){
+        GEECE_SCOPE_BEGIN
+            for (size_t i = 0; i < batch; ++i){
+                pushed += geece_handle(&objects[i]) != NULL;
+            }
+        GEECE_SCOPE_END
+    }
+    double elapsed = (double)timer_elapsed_ns(start);
+    if (pushed != ROOTED / batch * batch){
+        fprintf(stderr, "Error: %zu handles not pushed.\n", ROOTED / batch * batch - pushed);
+    }
+    return elapsed / (double)pushed;
+}
+
+int main(void){
+    size_t batches[] = {1, 8, MAX_BATCH};
+    printf("%-8s %14s %14s %14s\n", "batch", "key ns", "pointer ns", "handle ns");
+    for (size_t b = 0; b < sizeof(batches) / sizeof(batches[0]); ++b){
+        size_t batch = batches[b];
+        RootTable *table = init_root_table(NULL, 16);
+        double key = keyed(table, batch);
+        double pointer = pointers(table, batch);
+        destroy_root_table(table);
+        printf("%-8zu %14.2f %14.2f %14.2f\n", batch, key, pointer, handles(batch));
+    }
+    return 0;
+}
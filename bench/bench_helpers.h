@@ -0,0 +1,25 @@
+/**
+ * @file bench_helpers.h
+ * @brief Helpers shared by the benchmarks for linking objects.
+ */
+
+#ifndef GEECE_BENCH_HELPERS_H
+#define GEECE_BENCH_HELPERS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "geece.h"
+
+/* The 20 digits of the largest address and the NUL. */
+#define ADDRESS_KEY_LENGTH 21
+
+/* Roots the parent under its address only for as long as adding the edge takes. */
+static inline void link_objects(RootTable *roots, Object *parent, Object *child){
+    char key[ADDRESS_KEY_LENGTH];
+    snprintf(key, sizeof(key), "%llu", (unsigned long long)(uintptr_t)parent);
+    add_to_root_table(roots, key, parent);
+    add_reference(roots, parent, child);
+    remove_from_root_table(roots, key);
+}
+
+#endif /* GEECE_BENCH_HELPERS_H */
@@ -0,0 +1,94 @@
+/**
+ * @file bench_mark.c
+ * @brief Mark throughput of full collections, in MB of objects traced per second.
+ *
+ * Three graphs of N objects are traced: a list linked in allocation order, the same list linked in
+ * a shuffled order so that every step misses the cache, and a binary tree, which gives the
+ * prefetcher several objects to work ahead on. N defaults to 2M and can be overridden as the first
+ * argument.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "geece.h"
+#include "bench_helpers.h"
+
+#define DEFAULT_OBJECTS (2 * 1024 * 1024)
+#define PAYLOAD 16
+#define ROUNDS 5
+
+static RootTable *roots;
+
+static Object **allocate(size_t count){
+    Object **objects = malloc(count * sizeof(Object *));
+    for (size_t i = 0; i < count; ++i){
+        objects[i] = geece_malloc(PAYLOAD, NULL);
+    }
+    return objects;
+}
+
+static void shuffle(Object **objects, size_t count){
+    srand(42);
+    for (size_t i = count - 1; i > 0; --i){
+        size_t j = ((size_t)rand() * ((size_t)RAND_MAX + 1) + (size_t)rand()) % (i + 1);
+        Object *object = objects[i];
+        objects[i] = objects[j];
+        objects[j] = object;
+    }
+}
+
+static Object *build_list(Object **objects, size_t count){
+    for (size_t i = 1; i < count; ++i){
+        link_objects(roots, objects[i - 1], objects[i]);
+    }
+    return objects[0];
+}
+
+static Object *build_tree(Object **objects, size_t count){
+    for (size_t i = 1; i < count; ++i){
+        link_objects(roots, objects[(i - 1) / 2], objects[i]);
+    }
+    return objects[0];
+}
+
+static void report(const char *graph, Object *root){
+    add_to_root_table(roots, "root", root);
+    const GeeceStats *stats = geece_stats();
+    size_t marked = stats->marked_bytes;
+    uint64_t elapsed = stats->mark_ns;
+    for (int round = 0; round < ROUNDS; ++round){
+        geece_collect();
+    }
+    marked = stats->marked_bytes - marked;
+    elapsed = stats->mark_ns - elapsed;
+    printf("%-14s %12zu %12.2f %10.2f\n", graph, marked / ROUNDS, (double)elapsed / ROUNDS / 1e6,
+           (double)marked / 1e6 / ((double)elapsed / 1e9));
+    remove_from_root_table(roots, "root");
+    geece_collect();
+}
+
+int main(int argc, char **argv){
+    size_t count = argc > 1 ? (size_t)strtoull(argv[1], NULL, 10) : DEFAULT_OBJECTS;
+    if (count < 2){
+        count = 2;
+    }
+    roots = init_root_table(NULL, 1024);
+    geece_set_roots(roots);
+    printf("%-14s %12s %12s %10s\n", "graph", "bytes", "ms/mark", "MB/s");
+
+    Object **objects = allocate(count);
+    report("list", build_list(objects, count));
+    free(objects);
+
+    objects = allocate(count);
+    shuffle(objects, count);
+    report("shuffled list", build_list(objects, count));
+    free(objects);
+
+    objects = allocate(count);
+    report("binary tree", build_tree(objects, count));
+    free(objects);
+
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    return 0;
+}
@@ -0,0 +1,76 @@
+/**
+ * @file bench_parallel_mark.c
+ * @brief Full collection pause times with 1 to N marking threads.
+ *
+ * The heap holds a forest of binary trees of N objects in total, rooted in a spread of root set
+ * slots. Mark time and pause time are reported for 1, 2, 4, ... marking threads up to the number
+ * of online processors. N defaults to 4M and can be overridden as the first argument, the maximum
+ * thread count as the second.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "geece.h"
+#include "bench_helpers.h"
+
+#define DEFAULT_OBJECTS (4 * 1024 * 1024)
+#define TREES 256
+#define PAYLOAD 16
+#define ROUNDS 5
+
+static RootTable *roots;
+static char keys[TREES][20];
+
+static void build_forest(size_t count){
+    size_t tree_size = count / TREES;
+    Object **nodes = malloc(tree_size * sizeof(Object *));
+    for (int tree = 0; tree < TREES; ++tree){
+        for (size_t i = 0; i < tree_size; ++i){
+            nodes[i] = geece_malloc(PAYLOAD, NULL);
+            if (i > 0){
+                link_objects(roots, nodes[(i - 1) / 2], nodes[i]);
+            }
+        }
+        sprintf(keys[tree], "tree%d", tree);
+        add_to_root_table(roots, keys[tree], nodes[0]);
+    }
+    free(nodes);
+}
+
+int main(int argc, char **argv){
+    size_t count = argc > 1 ? (size_t)strtoull(argv[1], NULL, 10) : DEFAULT_OBJECTS;
+    long processors = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int max_threads = argc > 2 ? (unsigned int)atoi(argv[2]) : (unsigned int)(processors > 0 ? processors : 1);
+    if (count < TREES){
+        count = TREES;
+    }
+    roots = init_root_table(NULL, 4096);
+    geece_set_roots(roots);
+    build_forest(count);
+
+    const GeeceStats *stats = geece_stats();
+    double serial_pause = 0.0;
+    printf("%-8s %12s %12s %10s %10s\n", "threads", "ms/mark", "ms/pause", "MB/s", "speedup");
+    for (unsigned int threads = 1; threads <= max_threads; threads *= 2){
+        geece_config.mark_threads = threads;
+        geece_collect();
+        size_t marked = stats->marked_bytes;
+        uint64_t mark_ns = stats->mark_ns;
+        uint64_t pause_ns = stats->pause_ns;
+        for (int round = 0; round < ROUNDS; ++round){
+            geece_collect();
+        }
+        marked = stats->marked_bytes - marked;
+        double mark_ms = (double)(stats->mark_ns - mark_ns) / ROUNDS / 1e6;
+        double pause_ms = (double)(stats->pause_ns - pause_ns) / ROUNDS / 1e6;
+        if (threads == 1){
+            serial_pause = pause_ms;
+        }
+        printf("%-8u %12.2f %12.2f %10.2f %9.2fx\n", threads, mark_ms, pause_ms,
+               (double)marked / ROUNDS / 1e3 / mark_ms, serial_pause / pause_ms);
+    }
+
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    return 0;
+}
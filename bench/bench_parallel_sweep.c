@@ -0,0 +1,91 @@
+/**
+ * @file bench_parallel_sweep.c
+ * @brief Full collection sweep times with 1, 2, 4 and 8 sweeping threads.
+ *
+ * The heap holds a forest of binary trees of N objects in total, interleaved with as many dead
+ * objects of mixed sizes, a quarter of which have a destructor. The dead objects are allocated
+ * again before every collection, filling the holes the last sweep left. Sweep time, its share of
+ * the pause and the speedup over one thread are reported. N defaults to 2M and can be overridden
+ * as the first argument.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "geece.h"
+#include "bench_helpers.h"
+
+#define DEFAULT_OBJECTS (2 * 1024 * 1024)
+#define TREES 256
+#define PAYLOAD 16
+#define ROUNDS 5
+
+static const unsigned int thread_counts[] = {1, 2, 4, 8};
+#define THREAD_COUNT_COUNT (sizeof(thread_counts) / sizeof(thread_counts[0]))
+
+static RootTable *roots;
+static char keys[TREES][20];
+static size_t destroyed = 0;
+
+static void count_destroyed(void *object){
+    (void)object;
+    destroyed++;
+}
+
+static Object *allocate_dead(size_t i){
+    return geece_malloc(PAYLOAD * (1 + i % 4), i % 4 == 0 ? count_destroyed : NULL);
+}
+
+static void build_forest(size_t count){
+    size_t tree_size = count / TREES;
+    Object **nodes = malloc(tree_size * sizeof(Object *));
+    for (int tree = 0; tree < TREES; ++tree){
+        for (size_t i = 0; i < tree_size; ++i){
+            nodes[i] = geece_malloc(PAYLOAD * (1 + i % 4), NULL);
+            allocate_dead(i);
+            if (i > 0){
+                link_objects(roots, nodes[(i - 1) / 2], nodes[i]);
+            }
+        }
+        sprintf(keys[tree], "tree%d", tree);
+        add_to_root_table(roots, keys[tree], nodes[0]);
+    }
+    free(nodes);
+}
+
+int main(int argc, char **argv){
+    size_t count = argc > 1 ? (size_t)strtoull(argv[1], NULL, 10) : DEFAULT_OBJECTS;
+    if (count < TREES){
+        count = TREES;
+    }
+    roots = init_root_table(NULL, 1024);
+    geece_set_roots(roots);
+    build_forest(count);
+
+    const GeeceStats *stats = geece_stats();
+    double serial_sweep = 0.0;
+    printf("%-8s %12s %12s %10s\n", "threads", "ms/sweep", "ms/pause", "speedup");
+    for (size_t t = 0; t < THREAD_COUNT_COUNT; ++t){
+        geece_config.sweep_threads = thread_counts[t];
+        uint64_t sweep_ns = 0;
+        uint64_t pause_ns = 0;
+        for (int round = 0; round < ROUNDS; ++round){
+            uint64_t sweep = stats->sweep_ns;
+            uint64_t pause = stats->pause_ns;
+            geece_collect();
+            sweep_ns += stats->sweep_ns - sweep;
+            pause_ns += stats->pause_ns - pause;
+            for (size_t i = 0; i < count; ++i){
+                allocate_dead(i);
+            }
+        }
+        double sweep_ms = (double)sweep_ns / ROUNDS / 1e6;
+        if (t == 0){
+            serial_sweep = sweep_ms;
+        }
+        printf("%-8u %12.2f %12.2f %9.2fx\n", thread_counts[t], sweep_ms, (double)pause_ns / ROUNDS / 1e6,
+               serial_sweep / sweep_ms);
+    }
+
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    return 0;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file bench_pause.c
+ * @brief Full collection pause times, stop-the-world against incremental and concurrent.
+ *
+ * The heap holds a forest of binary trees of N objects in total. A stop-the-world collection is
+ * timed first, then incremental cycles driven by a mutator allocating short-lived objects, for a
+ * range of slice budgets, and last a cycle marked by the background thread while the mutator
+ * allocates. Each incremental row reports the number of pauses of the cycle and its longest and
+ * 99th percentile pause. N defaults to 1M and can be overridden as the first argument.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "geece.h"
+#include "bench_helpers.h"
+
+#define DEFAULT_OBJECTS (1024 * 1024)
+#define TREES 64
+#define PAYLOAD 16
+
+static const size_t slice_budgets[] = {64 * 1024, 256 * 1024, 1024 * 1024, 4 * 1024 * 1024};
+#define SLICE_BUDGET_COUNT (sizeof(slice_budgets) / sizeof(slice_budgets[0]))
+
+static RootTable *roots;
+static char keys[TREES][20];
+
+static void build_forest(size_t count){
+    size_t tree_size = count / TREES;
+    Object **nodes = malloc(tree_size * sizeof(Object *));
+    for (int tree = 0; tree < TREES; ++tree){
+        for (size_t i = 0; i < tree_size; ++i){
+            nodes[i] = geece_malloc(PAYLOAD, NULL);
+            if (i > 0){
+                link_objects(roots, nodes[(i - 1) / 2], nodes[i]);
+            }
+        }
+        sprintf(keys[tree], "tree%d", tree);
+        add_to_root_table(roots, keys[tree], nodes[0]);
+    }
+    free(nodes);
+}
+
+int main(int argc, char **argv){
+    size_t count = argc > 1 ? (size_t)strtoull(argv[1], NULL, 10) : DEFAULT_OBJECTS;
+    if (count < TREES){
+        count = TREES;
+    }
+    roots = init_root_table(NULL, 1024);
+    geece_set_roots(roots);
+    build_forest(count);
+
+    const GeeceStats *stats = geece_stats();
+    geece_collect();
+    uint64_t pause_ns = stats->pause_ns;
+    geece_collect();
+    printf("%-16s %8s %12s %12s\n", "mode", "pauses", "max ms", "p99 ms");
+    printf("%-16s %8d %12.2f %12.2f\n", "stop-the-world", 1, (double)(stats->pause_ns - pause_ns) / 1e6,
+           (double)(stats->pause_ns - pause_ns) / 1e6);
+
+    for (size_t i = 0; i < SLICE_BUDGET_COUNT; ++i){
+        geece_config.mark_slice_bytes = slice_budgets[i];
+        size_t cycles = stats->incremental_cycles;
+        geece_collect_start();
+        while (stats->incremental_cycles == cycles){
+            geece_release(geece_malloc(PAYLOAD, NULL));
+        }
+        char mode[32];
+        sprintf(mode, "slice %zuK", slice_budgets[i] / 1024);
+        printf("%-16s %8zu %12.2f %12.2f\n", mode, stats->cycle_slices,
+               (double)stats->cycle_max_pause_ns / 1e6, (double)stats->cycle_p99_pause_ns / 1e6);
+    }
+
+    geece_config.concurrent_marking = true;
+    geece_collect_start();
+    while (!geece_collect_step()){
+        geece_release(geece_malloc(PAYLOAD, NULL));
+    }
+    printf("%-16s %8zu %12.2f %12.2f\n", "concurrent", stats->cycle_slices,
+           (double)stats->cycle_max_pause_ns / 1e6, (double)stats->cycle_p99_pause_ns / 1e6);
+
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    return 0;
+}
@@ -0,0 +1,128 @@
+/**
+ * @file bench_refcount.c
+ * @brief Cost of reference counting operations with biased counts against plain atomic counts.
+ *
+ * Every operation is a `retain_object()` followed by a `geece_release()`. The uncontended part runs
+ * them on one thread, on an object it owns and on an object another thread allocated, against a
+ * counter changed with atomic read-modify-writes through functions of the same shape. The sharing
+ * part runs them on 1 up to N threads, N defaulting to the number of online processors and
+ * overridable as the first argument: each thread on an object of its own, all threads on one
+ * object none of them owns, and all threads on one atomic counter.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "geece.h"
+#include "timer.h"
+
+#define OPERATIONS (20 * 1000 * 1000)
+
+static pthread_barrier_t start_barrier;
+static Object *shared_object;
+static size_t atomic_count = 1;
+
+static __attribute__((noinline)) void atomic_retain(size_t *count){
+    __atomic_fetch_add(count, 1, __ATOMIC_RELAXED);
+}
+
+static __attribute__((noinline)) size_t atomic_release(size_t *count){
+    return __atomic_sub_fetch(count, 1, __ATOMIC_ACQ_REL);
+}
+
+static void count_object(Object *object, long operations){
+    for (long i = 0; i < operations; ++i){
+        retain_object(object);
+        geece_release(object);
+    }
+}
+
+static void count_atomically(size_t *count, long operations){
+    for (long i = 0; i < operations; ++i){
+        atomic_retain(count);
+        atomic_release(count);
+    }
+}
+
+static void *allocate_shared(void *arg){
+    (void)arg;
+    shared_object = geece_malloc(8, NULL);
+    return NULL;
+}
+
+/* What a sharing thread counts on. */
+typedef enum { OWN_OBJECT, SHARED_OBJECT, ATOMIC_COUNTER } Target;
+
+static void *share(void *arg){
+    Target target = *(Target *)arg;
+    Object *own = target == OWN_OBJECT ? geece_malloc(8, NULL) : NULL;
+    pthread_barrier_wait(&start_barrier);
+    if (target == OWN_OBJECT){
+        count_object(own, OPERATIONS);
+    } else if (target == SHARED_OBJECT){
+        count_object(shared_object, OPERATIONS);
+    } else {
+        count_atomically(&atomic_count, OPERATIONS);
+    }
+    pthread_barrier_wait(&start_barrier);
+    if (own != NULL){
+        geece_release(own);
+    }
+    return NULL;
+}
+
+static double run(int thread_count, Target target){
+    pthread_t threads[thread_count];
+    pthread_barrier_init(&start_barrier, NULL, (unsigned int)thread_count + 1);
+    for (int i = 0; i < thread_count; ++i){
+        pthread_create(&threads[i], NULL, share, &target);
+    }
+    pthread_barrier_wait(&start_barrier);
+    uint64_t start = timer_now_ns();
+    pthread_barrier_wait(&start_barrier);
+    uint64_t elapsed = timer_elapsed_ns(start);
+    for (int i = 0; i < thread_count; ++i){
+        pthread_join(threads[i], NULL);
+    }
+    pthread_barrier_destroy(&start_barrier);
+    return (double)thread_count * OPERATIONS / (double)elapsed * 1e3;
+}
+
+static void report_uncontended(const char *name, Object *object){
+    uint64_t start = timer_now_ns();
+    if (object != NULL){
+        count_object(object, OPERATIONS);
+    } else {
+        count_atomically(&atomic_count, OPERATIONS);
+    }
+    uint64_t elapsed = timer_elapsed_ns(start);
+    printf("%-16s %10.2f %10.2f\n", name, (double)elapsed / OPERATIONS, (double)OPERATIONS / (double)elapsed * 1e3);
+}
+
+int main(int argc, char **argv){
+    int max_threads = argc > 1 ? atoi(argv[1]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_threads < 1){
+        max_threads = 1;
+    }
+    pthread_t thread;
+    pthread_create(&thread, NULL, allocate_shared, NULL);
+    pthread_join(thread, NULL);
+
+    printf("%-16s %10s %10s\n", "uncontended", "ns/op", "Mops/s");
+    Object *own = geece_malloc(8, NULL);
+    report_uncontended("owner", own);
+    report_uncontended("other thread", shared_object);
+    report_uncontended("atomic", NULL);
+    geece_release(own);
+
+    printf("\n%-8s %12s %12s %12s\n", "threads", "own Mops/s", "shared", "atomic");
+    for (int threads = 1; threads <= max_threads; threads *= 2){
+        printf("%-8d %12.2f %12.2f %12.2f\n", threads, run(threads, OWN_OBJECT), run(threads, SHARED_OBJECT),
+               run(threads, ATOMIC_COUNTER));
+        if (threads < max_threads && threads * 2 > max_threads){
+            threads = max_threads / 2;
+        }
+    }
+    geece_release(shared_object);
+    return 0;
+}
@@ -0,0 +1,70 @@
+/**
+ * @file bench_referrers.c
+ * @brief Cost of in-degree queries against the size of the object graph.
+ *
+ * Every object of a rooted graph gets edges to four others picked at random, then
+ * `get_object_count()` is asked for the references to objects picked at random, as many times as
+ * it takes to spend a comparable time on each size. The cost of building the graph is reported per
+ * edge, and the cost of a query for graphs of 1K, 10K and 100K objects, first with the reverse
+ * index off, then with `geece_config.track_referrers` set.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "geece.h"
+#include "timer.h"
+
+#define MAX_OBJECTS (100 * 1000)
+#define DEGREE 4
+#define MIN_QUERIES 100
+#define QUERY_BUDGET (100 * 1000 * 1000)
+
+static Object *objects[MAX_OBJECTS];
+
+static void run(size_t size){
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    for (size_t i = 0; i < size; ++i){
+        objects[i] = geece_malloc(0, NULL);
+        root_table_add(roots, objects[i]);
+    }
+
+    uint64_t start = timer_now_ns();
+    for (size_t i = 0; i < size; ++i){
+        for (size_t d = 0; d < DEGREE; ++d){
+            add_reference(roots, objects[i], objects[(size_t)rand() % size]);
+        }
+    }
+    double edge = (double)timer_elapsed_ns(start) / (double)(size * DEGREE);
+
+    // A scan of the table costs about the size of the graph, the queries are scaled down with it
+    size_t queries = QUERY_BUDGET / size > MIN_QUERIES ? QUERY_BUDGET / size : MIN_QUERIES;
+    size_t counted = 0;
+    start = timer_now_ns();
+    for (size_t q = 0; q < queries; ++q){
+        counted += (size_t)get_object_count(roots, objects[(size_t)rand() % size]);
+    }
+    double query = (double)timer_elapsed_ns(start) / (double)queries;
+    // Every object is held once by the table, whatever its edges
+    if (counted < queries){
+        fprintf(stderr, "Error: %zu references counted for %zu queries.\n", counted, queries);
+    }
+    printf("%-6s %-10zu %14.2f %14.2f\n", geece_config.track_referrers ? "on" : "off", size, edge, query);
+
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    geece_collect();
+}
+
+int main(void){
+    size_t sizes[] = {1000, 10 * 1000, MAX_OBJECTS};
+    srand(42);
+    printf("%-6s %-10s %14s %14s\n", "index", "objects", "edge ns", "query ns");
+    // Every graph is collected before the next, so the index is turned on without edges to miss
+    for (int track = 0; track < 2; ++track){
+        geece_config.track_referrers = track;
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s){
+            run(sizes[s]);
+        }
+    }
+    return 0;
+}
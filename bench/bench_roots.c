@@ -0,0 +1,132 @@
+/**
+ * @file bench_roots.c
+ * @brief Insert and lookup cost of the root table at 1K, 1M and 10M roots.
+ *
+ * Each size fills an empty table, so inserts include every growth of the table, then looks the
+ * roots up again in a shuffled order, so that lookups miss the cache once the table outgrows it.
+ * Both the pointer-keyed root set and the string keys laid over it are measured, the string keys
+ * formatted up front as `add_reference()` used to format addresses. A separate fill times every
+ * insert on its own and reports the slowest, which an incremental resize keeps far from the cost
+ * of rehashing the whole table. The largest size can be lowered with the first argument, in
+ * millions of roots.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "geece.h"
+#include "timer.h"
+
+#define KEY_LENGTH 20
+#define MIN_LOOKUPS (10 * 1000 * 1000)
+
+static Object *objects;
+static char *keys;
+static size_t *order;
+
+static void shuffle(size_t count){
+    for (size_t i = 0; i < count; ++i){
+        order[i] = i;
+    }
+    for (size_t i = count - 1; i > 0; --i){
+        size_t j = (size_t)rand() % (i + 1);
+        size_t swap = order[i];
+        order[i] = order[j];
+        order[j] = swap;
+    }
+}
+
+static double insert_pointers(RootTable *table, size_t count){
+    uint64_t start = timer_now_ns();
+    for (size_t i = 0; i < count; ++i){
+        root_table_add(table, &objects[i]);
+    }
+    return (double)timer_elapsed_ns(start) / (double)count;
+}
+
+static double worst_insert(size_t count){
+    RootTable *table = init_root_table(NULL, 16);
+    uint64_t worst = 0;
+    for (size_t i = 0; i < count; ++i){
+        uint64_t start = timer_now_ns();
+        root_table_add(table, &objects[i]);
+        uint64_t elapsed = timer_elapsed_ns(start);
+        if (elapsed > worst){
+            worst = elapsed;
+        }
+    }
+    destroy_root_table(table);
+    return (double)worst / 1e3;
+}
+
+static double lookup_pointers(RootTable *table, size_t count){
+    size_t lookups = count < MIN_LOOKUPS ? MIN_LOOKUPS : count;
+    size_t found = 0;
+    uint64_t start = timer_now_ns();
+    for (size_t i = 0; i < lookups; ++i){
+        found += root_table_contains(table, &objects[order[i % count]]);
+    }
+    double elapsed = (double)timer_elapsed_ns(start);
+    if (found != lookups){
+        fprintf(stderr, "Error: %zu roots not found.\n", lookups - found);
+    }
+    return elapsed / (double)lookups;
+}
+
+static double insert_keys(RootTable *table, size_t count){
+    uint64_t start = timer_now_ns();
+    for (size_t i = 0; i < count; ++i){
+        add_to_root_table(table, &keys[i * KEY_LENGTH], &objects[i]);
+    }
+    return (double)timer_elapsed_ns(start) / (double)count;
+}
+
+static double lookup_keys(RootTable *table, size_t count){
+    size_t lookups = count < MIN_LOOKUPS ? MIN_LOOKUPS : count;
+    size_t found = 0;
+    uint64_t start = timer_now_ns();
+    for (size_t i = 0; i < lookups; ++i){
+        size_t index = order[i % count];
+        found += get_from_root_table(table, &keys[index * KEY_LENGTH]) == &objects[index];
+    }
+    double elapsed = (double)timer_elapsed_ns(start);
+    if (found != lookups){
+        fprintf(stderr, "Error: %zu keys not found.\n", lookups - found);
+    }
+    return elapsed / (double)lookups;
+}
+
+int main(int argc, char **argv){
+    size_t sizes[] = {1000, 1000 * 1000, 10 * 1000 * 1000};
+    size_t max_count = argc > 1 ? (size_t)atol(argv[1]) * 1000 * 1000 : sizes[2];
+    objects = calloc(max_count, sizeof(Object));
+    keys = malloc(max_count * KEY_LENGTH);
+    order = malloc(max_count * sizeof(size_t));
+    if (objects == NULL || keys == NULL || order == NULL){
+        fprintf(stderr, "Error: Failed to allocate %zu roots.\n", max_count);
+        return 1;
+    }
+    for (size_t i = 0; i < max_count; ++i){
+        snprintf(&keys[i * KEY_LENGTH], KEY_LENGTH, "%llu", (unsigned long long)(uintptr_t)&objects[i]);
+    }
+
+    printf("%-10s %14s %14s %14s %14s %14s\n", "roots", "ptr insert ns", "ptr lookup ns", "key insert ns", "key lookup ns",
+           "worst insert us");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]) && sizes[s] <= max_count; ++s){
+        size_t count = sizes[s];
+        shuffle(count);
+        RootTable *pointers = init_root_table(NULL, 16);
+        double pointer_insert = insert_pointers(pointers, count);
+        double pointer_lookup = lookup_pointers(pointers, count);
+        destroy_root_table(pointers);
+        RootTable *strings = init_root_table(NULL, 16);
+        double key_insert = insert_keys(strings, count);
+        double key_lookup = lookup_keys(strings, count);
+        destroy_root_table(strings);
+        double worst = worst_insert(count);
+        printf("%-10zu %14.2f %14.2f %14.2f %14.2f %14.2f\n", count, pointer_insert, pointer_lookup, key_insert, key_lookup,
+               worst);
+    }
+    free(objects);
+    free(keys);
+    free(order);
+    return 0;
+}
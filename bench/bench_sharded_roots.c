@@ -0,0 +1,124 @@
+/**
+ * @file bench_sharded_roots.c
+ * @brief Root table throughput of threads rooting objects by string key, against a global lock.
+ *
+ * Every thread roots its own objects under keys of its own, looks each one up a few times and
+ * unroots it again, in rounds. The same work runs on a plain root table behind one mutex, as
+ * threads had to share it before, and on a sharded table. Throughput is reported for 1 up to 32
+ * threads, or up to the first argument.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "geece.h"
+#include "timer.h"
+
+#define MAX_THREADS 32
+#define KEYS 256
+#define LOOKUPS 4
+#define ROUNDS 200
+#define SHARDS 64
+#define KEY_SIZE 24
+
+typedef struct {
+    RootTable *table;
+    pthread_mutex_t *lock; /* NULL for the sharded table. */
+    char keys[KEYS][KEY_SIZE];
+    Object objects[KEYS];
+    size_t missed;
+} Worker;
+
+static Worker workers[MAX_THREADS];
+static pthread_barrier_t start_barrier;
+
+static void enter(Worker *worker){
+    if (worker->lock != NULL){
+        pthread_mutex_lock(worker->lock);
+    }
+}
+
+static void leave(Worker *worker){
+    if (worker->lock != NULL){
+        pthread_mutex_unlock(worker->lock);
+    }
+}
+
+static void *churn(void *arg){
+    Worker *worker = arg;
+    pthread_barrier_wait(&start_barrier);
+    for (int round = 0; round < ROUNDS; ++round){
+        for (int i = 0; i < KEYS; ++i){
+            enter(worker);
+            add_to_root_table(worker->table, worker->keys[i], &worker->objects[i]);
+            leave(worker);
+        }
+        for (int l = 0; l < LOOKUPS; ++l){
+            for (int i = 0; i < KEYS; ++i){
+                enter(worker);
+                Object *object = get_from_root_table(worker->table, worker->keys[i]);
+                leave(worker);
+                worker->missed += object != &worker->objects[i];
+            }
+        }
+        for (int i = 0; i < KEYS; ++i){
+            enter(worker);
+            remove_from_root_table(worker->table, worker->keys[i]);
+            leave(worker);
+        }
+    }
+    return NULL;
+}
+
+/* Returns the throughput in millions of operations per second. */
+static double run(RootTable *table, pthread_mutex_t *lock, int thread_count){
+    pthread_t threads[MAX_THREADS];
+    pthread_barrier_init(&start_barrier, NULL, (unsigned int)thread_count + 1);
+    for (int i = 0; i < thread_count; ++i){
+        workers[i].table = table;
+        workers[i].lock = lock;
+        workers[i].missed = 0;
+        pthread_create(&threads[i], NULL, churn, &workers[i]);
+    }
+    pthread_barrier_wait(&start_barrier);
+    uint64_t start = timer_now_ns();
+    for (int i = 0; i < thread_count; ++i){
+        pthread_join(threads[i], NULL);
+    }
+    uint64_t elapsed = timer_elapsed_ns(start);
+    pthread_barrier_destroy(&start_barrier);
+    for (int i = 0; i < thread_count; ++i){
+        if (workers[i].missed != 0){
+            fprintf(stderr, "Error: thread %d missed %zu lookups.\n", i, workers[i].missed);
+        }
+    }
+    return (double)thread_count * ROUNDS * KEYS * (2 + LOOKUPS) / (double)elapsed * 1e3;
+}
+
+int main(int argc, char **argv){
+    int max_threads = argc > 1 ? atoi(argv[1]) : MAX_THREADS;
+    if (max_threads < 1 || max_threads > MAX_THREADS){
+        max_threads = MAX_THREADS;
+    }
+    for (int t = 0; t < MAX_THREADS; ++t){
+        for (int i = 0; i < KEYS; ++i){
+            snprintf(workers[t].keys[i], KEY_SIZE, "thread%d-key%d", t, i);
+        }
+    }
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    printf("%-8s %14s %14s %8s\n", "threads", "locked Mops/s", "sharded Mops/s", "speedup");
+    for (int threads = 1; threads <= max_threads; threads *= 2){
+        RootTable *locked = init_root_table(NULL, 16);
+        double global = run(locked, &lock, threads);
+        destroy_root_table(locked);
+
+        RootTable *sharded = init_sharded_root_table(NULL, SHARDS, 16);
+        double striped = run(sharded, NULL, threads);
+        destroy_root_table(sharded);
+
+        printf("%-8d %14.2f %14.2f %7.2fx\n", threads, global, striped, striped / global);
+        if (threads < max_threads && threads * 2 > max_threads){
+            threads = max_threads / 2;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,73 @@
+/**
+ * @file bench_threads.c
+ * @brief Multi-threaded allocation throughput of the Geece heap.
+ *
+ * Every thread allocates and releases batches of small objects through its own allocation
+ * buffer. Throughput is reported for 1 up to N threads, N defaulting to the number of online
+ * processors and overridable as the first argument.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "heap.h"
+#include "timer.h"
+
+#define BATCH 1024
+#define ROUNDS 2000
+
+static const size_t payload_sizes[] = {8, 16, 24, 32, 48, 64, 96, 128};
+#define PAYLOAD_SIZE_COUNT (sizeof(payload_sizes) / sizeof(payload_sizes[0]))
+
+static pthread_barrier_t start_barrier;
+
+static void *allocate(void *arg){
+    (void)arg;
+    Object *batch[BATCH];
+    pthread_barrier_wait(&start_barrier);
+    for (int round = 0; round < ROUNDS; ++round){
+        for (int i = 0; i < BATCH; ++i){
+            batch[i] = geece_malloc(payload_sizes[i % PAYLOAD_SIZE_COUNT], NULL);
+        }
+        for (int i = 0; i < BATCH; ++i){
+            geece_release(batch[i]);
+        }
+    }
+    return NULL;
+}
+
+static double run(int thread_count){
+    pthread_t threads[thread_count];
+    pthread_barrier_init(&start_barrier, NULL, (unsigned int)thread_count + 1);
+    for (int i = 0; i < thread_count; ++i){
+        pthread_create(&threads[i], NULL, allocate, NULL);
+    }
+    pthread_barrier_wait(&start_barrier);
+    uint64_t start = timer_now_ns();
+    for (int i = 0; i < thread_count; ++i){
+        pthread_join(threads[i], NULL);
+    }
+    uint64_t elapsed = timer_elapsed_ns(start);
+    pthread_barrier_destroy(&start_barrier);
+    return (double)thread_count * BATCH * ROUNDS / (double)elapsed * 1e3;
+}
+
+int main(int argc, char **argv){
+    int max_threads = argc > 1 ? atoi(argv[1]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (max_threads < 1){
+        max_threads = 1;
+    }
+    printf("%-8s %12s %8s\n", "threads", "Mallocs/s", "scaling");
+    double single = 0;
+    for (int threads = 1; threads <= max_threads; threads *= 2){
+        double throughput = run(threads);
+        if (threads == 1){
+            single = throughput;
+        }
+        printf("%-8d %12.2f %7.2fx\n", threads, throughput, throughput / single);
+        if (threads < max_threads && threads * 2 > max_threads){
+            threads = max_threads / 2;
+        }
+    }
+    return 0;
+}
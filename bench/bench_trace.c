@@ -0,0 +1,103 @@
+/**
+ * @file bench_trace.c
+ * @brief Mark throughput of objects whose references are edges against typed objects holding them
+ * in their payload.
+ *
+ * The same two graphs of N objects are built both ways, a list linked in a shuffled order and a
+ * binary tree, out of objects of the same size. Edges live in the linked lists of the root table,
+ * fields in the payload as described by the objects' type. N defaults to 2M and can be overridden
+ * as the first argument.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "geece.h"
+#include "bench_helpers.h"
+
+#define DEFAULT_OBJECTS (2 * 1024 * 1024)
+#define ROUNDS 5
+
+typedef struct {
+    Object *left;
+    Object *right;
+    long value;
+} Node;
+
+static RootTable *roots;
+static GeeceType node_type;
+
+static void link_fields(Object *parent, Object *child, int slot){
+    Node *node = geece_payload(parent);
+    geece_write_field(parent, slot == 0 ? &node->left : &node->right, child);
+}
+
+static Object **allocate(size_t count, bool typed){
+    Object **objects = malloc(count * sizeof(Object *));
+    for (size_t i = 0; i < count; ++i){
+        objects[i] = typed ? geece_malloc_typed(node_type, NULL) : geece_malloc(sizeof(Node), NULL);
+    }
+    return objects;
+}
+
+static void shuffle(Object **objects, size_t count){
+    srand(42);
+    for (size_t i = count - 1; i > 0; --i){
+        size_t j = ((size_t)rand() * ((size_t)RAND_MAX + 1) + (size_t)rand()) % (i + 1);
+        Object *object = objects[i];
+        objects[i] = objects[j];
+        objects[j] = object;
+    }
+}
+
+static Object *build(Object **objects, size_t count, bool typed, bool tree){
+    for (size_t i = 1; i < count; ++i){
+        Object *parent = tree ? objects[(i - 1) / 2] : objects[i - 1];
+        if (typed){
+            link_fields(parent, objects[i], tree ? (int)((i - 1) % 2) : 0);
+        } else {
+            link_objects(roots, parent, objects[i]);
+        }
+    }
+    return objects[0];
+}
+
+static void report(const char *graph, size_t count, bool typed, bool tree){
+    Object **objects = allocate(count, typed);
+    if (!tree){
+        shuffle(objects, count);
+    }
+    add_to_root_table(roots, "root", build(objects, count, typed, tree));
+    free(objects);
+
+    const GeeceStats *stats = geece_stats();
+    size_t marked = stats->marked_bytes;
+    uint64_t elapsed = stats->mark_ns;
+    for (int round = 0; round < ROUNDS; ++round){
+        geece_collect();
+    }
+    marked = stats->marked_bytes - marked;
+    elapsed = stats->mark_ns - elapsed;
+    printf("%-14s %-8s %12.2f %10.2f %10.2f\n", graph, typed ? "fields" : "edges", (double)elapsed / ROUNDS / 1e6,
+           (double)marked / 1e6 / ((double)elapsed / 1e9), (double)elapsed / ROUNDS / (double)count);
+    remove_from_root_table(roots, "root");
+    geece_collect();
+}
+
+int main(int argc, char **argv){
+    size_t count = argc > 1 ? (size_t)strtoull(argv[1], NULL, 10) : DEFAULT_OBJECTS;
+    if (count < 2){
+        count = 2;
+    }
+    roots = init_root_table(NULL, 1024);
+    geece_set_roots(roots);
+    node_type = GEECE_REGISTER_STRUCT(Node, left, right);
+    printf("%-14s %-8s %12s %10s %10s\n", "graph", "refs", "ms/mark", "MB/s", "ns/object");
+
+    report("shuffled list", count, false, false);
+    report("shuffled list", count, true, false);
+    report("binary tree", count, false, true);
+    report("binary tree", count, true, true);
+
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    return 0;
+}
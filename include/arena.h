@@ -0,0 +1,136 @@
+/**
+ * @file arena.h
+ * @brief Arenas of objects that share one lifetime.
+ *
+ * An arena bump-allocates its objects from raw heap pages, so allocation costs a pointer bump and
+ * `geece_arena_end()` hands the pages back without visiting dead objects one by one. Only the
+ * objects that registered a destructor or hold references are kept on a cleanup list.
+ *
+ * While an arena is open its objects are roots of the full collection. Arena objects that gain an
+ * edge from outside their arena are flagged as escaped by `add_reference()`, and arena objects in
+ * the root table are flagged as rooted by `add_to_root_table()` until they are removed again. When
+ * the arena ends, the escaped and rooted objects and every object of the arena they reach stay in
+ * place: the chunks holding them are retained, and the full collection frees each of these
+ * objects once it is unreachable and the chunk once it is empty.
+ *
+ * An arena belongs to the thread that opened it.
+ */
+
+#ifndef GEECE_ARENA_H
+#define GEECE_ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "object.h"
+#include "utils.h"
+#include "heap.h"
+
+/**
+ * @brief Header at the start of every arena chunk, found from an object through `page_of()`.
+ */
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;    /**< Next chunk of the arena, or of the retained list. */
+    struct ArenaChunk *prev;    /**< Previous chunk on the retained list. */
+    Arena *arena;               /**< Owning arena, NULL once the chunk is retained. */
+    char *top;                  /**< Bump pointer. */
+    char *end;                  /**< End of the chunk. */
+    PointerArray escaped;       /**< Escaped objects still alive in a retained chunk. */
+    uint64_t marks[GEECE_PAGE_BITMAP_WORDS]; /**< Mark bit of every 16-byte granule of the chunk. */
+} ArenaChunk;
+
+/**
+ * @brief Returns the arena an object was allocated in, or NULL once its arena has ended.
+ */
+static inline Arena *arena_of(const Object *object){
+    return ((ArenaChunk *)page_of(object))->arena;
+}
+
+/**
+ * @brief Returns the word of the chunk's mark bitmap holding an arena object's mark bit.
+ *
+ * @param object The arena object.
+ * @param mask Receives the mask of the object's bit in the word.
+ */
+static inline uint64_t *arena_mark_word(const Object *object, uint64_t *mask){
+    ArenaChunk *chunk = (ArenaChunk *)page_of(object);
+    size_t index = (size_t)((const char *)object - (const char *)chunk) / GEECE_MIN_BLOCK_SIZE;
+    *mask = (uint64_t)1 << (index % 64);
+    return &chunk->marks[index / 64];
+}
+
+/**
+ * @brief Puts an arena object on its arena's cleanup list.
+ *
+ * @param object The arena object, whose arena must still be open.
+ */
+void arena_track_cleanup(Object *object);
+
+/**
+ * @brief Flags an arena object as escaped.
+ *
+ * @param object The arena object that became reachable from outside its arena.
+ */
+void arena_escape(Object *object);
+
+/**
+ * @brief Flags an arena object as held by the root table.
+ *
+ * @param object The arena object added to the root table.
+ */
+void arena_root(Object *object);
+
+/**
+ * @brief Write barrier run whenever `object` gains an edge to `referenced_object`.
+ *
+ * @param object The object the edge starts from.
+ * @param referenced_object The object the edge points to.
+ */
+static inline void arena_record_reference(Object *object, Object *referenced_object){
+    if ((object->flags & (OBJECT_ARENA | OBJECT_TRACKED)) == OBJECT_ARENA && arena_of(object) != NULL){
+        // The edges of an arena object have to be freed when the arena ends
+        arena_track_cleanup(object);
+    }
+    if ((referenced_object->flags & (OBJECT_ARENA | OBJECT_ESCAPED)) == OBJECT_ARENA
+        && (!(object->flags & OBJECT_ARENA) || arena_of(object) != arena_of(referenced_object))){
+        arena_escape(referenced_object);
+    }
+}
+
+/**
+ * @brief Write barrier run whenever a field of the typed object `object` is set to `referenced_object`.
+ *
+ * @param object The object holding the field.
+ * @param referenced_object The object stored in the field.
+ */
+static inline void arena_record_field(Object *object, Object *referenced_object){
+    if ((referenced_object->flags & (OBJECT_ARENA | OBJECT_ESCAPED)) == OBJECT_ARENA
+        && (!(object->flags & OBJECT_ARENA) || arena_of(object) != arena_of(referenced_object))){
+        arena_escape(referenced_object);
+    }
+}
+
+/**
+ * @brief Marks the objects of every open arena, which are all roots.
+ *
+ * @param mark_function Called for every object of an open arena.
+ */
+void arena_mark_roots(void (*mark_function)(Object *object));
+
+/**
+ * @brief Calls `visit` for every object of an open arena and every escaped object of an ended one.
+ *
+ * @param visit The function to call.
+ */
+void arena_for_each(void (*visit)(Object *object));
+
+/**
+ * @brief Frees the escaped objects of ended arenas that were not marked, releases the chunks left
+ * empty, and clears the marks of every arena object.
+ *
+ * Must only be called while no other thread is allocating or mutating objects.
+ *
+ * @return The number of bytes released.
+ */
+size_t arena_sweep(void);
+
+#endif /* GEECE_ARENA_H */
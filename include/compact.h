@@ -0,0 +1,35 @@
+/**
+ * @file compact.h
+ * @brief Sliding compaction of the size-class pages.
+ *
+ * Run after a full collection has swept the heap, so that every block still handed out holds a
+ * live object. Within each size class, live objects slide towards the lowest addresses in their
+ * original order, filling the holes the sweep left behind, so that the pages at the end of the
+ * class empty out and go back to the heap. Compaction works in three passes: it computes the
+ * forwarding address of every object that moves, rewrites every edge, root table entry and
+ * remembered set entry pointing at a moving object, and then moves the objects.
+ *
+ * Pinned objects stay in place, and so do objects registered in the root table under their own
+ * address, since their key would go stale. Young, large and arena objects are never moved.
+ */
+
+#ifndef GEECE_COMPACT_H
+#define GEECE_COMPACT_H
+
+#include <stddef.h>
+#include "object.h"
+#include "root_table.h"
+
+/**
+ * @brief Compacts the size-class pages.
+ *
+ * Must only be called after a full collection, while no other thread is allocating or mutating
+ * objects. Object pointers held outside of the root table and the object edges are stale
+ * afterwards, unless the objects are pinned.
+ *
+ * @param roots The root table whose entries are updated, may be NULL.
+ * @return The number of bytes moved.
+ */
+size_t compact_heap(RootTable *roots);
+
+#endif /* GEECE_COMPACT_H */
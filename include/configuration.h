@@ -0,0 +1,58 @@
+/**
+ * @file configuration.h
+ * @brief Tunable settings of the GeeCe collector.
+ *
+ * Unless noted otherwise, the settings are read when the heap is first used, so they have to be
+ * changed before the first object is allocated.
+ */
+
+#ifndef GEECE_CONFIGURATION_H
+#define GEECE_CONFIGURATION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+    size_t nursery_size;            /**< Bytes reserved for the young generation, 0 disables it. */
+    unsigned int promotion_age;     /**< Minor collections an object survives before promotion. */
+    size_t large_object_threshold;  /**< Bigger blocks go to the large-object space, read per allocation. */
+    double compaction_threshold;    /**< Fragmentation above which a full collection compacts, 0 disables it. Read per collection. */
+    size_t mark_stack_limit;        /**< Entries the mark stack may grow to before it overflows, read per collection. */
+    unsigned int mark_threads;      /**< Threads marking in parallel, the collecting thread included, read per collection. */
+    size_t mark_slice_bytes;        /**< Bytes of objects an incremental marking slice traces, read per slice. */
+    unsigned int mark_rate;         /**< Bytes incremental marking traces per byte allocated, read per allocation. */
+    bool concurrent_marking;        /**< Incremental collections mark on a background thread instead of in slices, read per collection. */
+    bool lazy_sweep;                /**< Full collections leave size-class pages to be swept by the allocations needing them, read per collection. */
+    unsigned int sweep_threads;     /**< Threads sweeping the size-class pages when they are swept eagerly, the collecting thread included, read per collection. */
+    bool deferred_rc;               /**< Reference counts leave out local references and objects reaching zero wait in the zero-count table. */
+    size_t rc_table_limit;          /**< Objects entering the zero-count table before an allocation reconciles it, read per allocation. */
+    size_t rc_chunk_objects;        /**< Objects a reconciliation run by an allocation destroys at most, read per allocation. */
+    bool cycle_collection;          /**< Objects whose count drops without reaching zero are buffered for the cycle collector. */
+    size_t cycle_buffer_limit;      /**< Buffered candidates before an allocation collects cycles, read per allocation. */
+    bool track_referrers;           /**< Every edge is also recorded at its target, for in-degree queries without a scan. */
+} GeeceConfig;
+
+/**
+ * Global collector configuration, initialized with the defaults below.
+ */
+extern GeeceConfig geece_config;
+
+#define GEECE_DEFAULT_NURSERY_SIZE 0
+#define GEECE_DEFAULT_PROMOTION_AGE 2
+#define GEECE_DEFAULT_LARGE_OBJECT_THRESHOLD (8 * 1024)
+#define GEECE_DEFAULT_COMPACTION_THRESHOLD 0.0
+#define GEECE_DEFAULT_MARK_STACK_LIMIT ((size_t)1 << 24)
+#define GEECE_DEFAULT_MARK_THREADS 1
+#define GEECE_DEFAULT_MARK_SLICE_BYTES (1024 * 1024)
+#define GEECE_DEFAULT_MARK_RATE 4
+#define GEECE_DEFAULT_CONCURRENT_MARKING false
+#define GEECE_DEFAULT_LAZY_SWEEP false
+#define GEECE_DEFAULT_SWEEP_THREADS 1
+#define GEECE_DEFAULT_DEFERRED_RC false
+#define GEECE_DEFAULT_RC_TABLE_LIMIT 4096
+#define GEECE_DEFAULT_RC_CHUNK_OBJECTS 1024
+#define GEECE_DEFAULT_CYCLE_COLLECTION false
+#define GEECE_DEFAULT_CYCLE_BUFFER_LIMIT 4096
+#define GEECE_DEFAULT_TRACK_REFERRERS false
+
+#endif /* GEECE_CONFIGURATION_H */
@@ -0,0 +1,82 @@
+/**
+ * @file cycle_collector.h
+ * @brief Synchronous collection of garbage cycles for reference counting, by trial deletion.
+ *
+ * Reference counts never drop to zero for objects that reference each other, so with
+ * `geece_config.cycle_collection` set, every object whose count is decremented without reaching
+ * zero is buffered as a candidate root of a garbage cycle. Once the buffer holds
+ * `geece_config.cycle_buffer_limit` candidates, the next allocation collects the cycles, following
+ * Bacon and Rajan: the references internal to the subgraph reachable from the candidates are
+ * subtracted from the counts (mark gray), objects left with a count are live and give their
+ * references back to what they reach (scan), and whatever stays at zero is garbage and is destroyed
+ * (collect white). Only the edges of the root table and the fields of typed objects are followed;
+ * the heap is never traced as a whole.
+ *
+ * The references of the root table, the open arenas, the handles and the registered thread stacks
+ * are counted while the collection runs, so rooted cycles survive it. Young, arena and saturated objects are
+ * treated as live and never entered, so cycles through them are left to the full collections.
+ */
+
+#ifndef GEECE_CYCLE_COLLECTOR_H
+#define GEECE_CYCLE_COLLECTOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "configuration.h"
+#include "object.h"
+#include "root_table.h"
+
+/**
+ * @brief Buffers an object as a candidate root of a garbage cycle, unless it is already buffered.
+ *
+ * @param object The object.
+ */
+void cycle_buffer(Object *object);
+
+/**
+ * @brief Records that an object's count was decremented without reaching zero.
+ *
+ * @param object The object.
+ */
+static inline void cycle_candidate(Object *object){
+    if (geece_config.cycle_collection){
+        cycle_buffer(object);
+    }
+}
+
+/**
+ * @brief Returns whether the buffer of candidates is full enough for an allocation to collect.
+ */
+bool cycle_collect_due(void);
+
+/**
+ * @brief Returns the number of buffered candidates.
+ */
+size_t cycle_pending(void);
+
+/**
+ * @brief Collects the garbage cycles reachable from the buffered candidates and empties the buffer.
+ * Buffered objects whose count dropped to zero meanwhile are destroyed, or put in the zero-count
+ * table with deferred reference counting. Does nothing while a full collection is marking. Must
+ * only be called while no other thread is allocating or mutating objects.
+ *
+ * @param roots The root table, may be NULL.
+ * @return The number of objects destroyed.
+ */
+size_t cycle_collect(RootTable *roots);
+
+/**
+ * @brief Drops the objects a full collection is about to sweep from the buffer. Called once
+ * marking finished, before the sweep.
+ */
+void cycle_forget_unmarked(void);
+
+/**
+ * @brief Points the buffer at the new addresses of the objects compaction moves. Called before
+ * the objects move.
+ *
+ * @param forward Returns the new address of an object.
+ */
+void cycle_forward(Object *(*forward)(Object *object));
+
+#endif /* GEECE_CYCLE_COLLECTOR_H */
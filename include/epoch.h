@@ -0,0 +1,76 @@
+/**
+ * @file epoch.h
+ * @brief Epoch-based reclamation: memory that threads read without a lock is freed once none can
+ * still be reading it.
+ *
+ * A reader brackets its reads with `epoch_enter()` and `epoch_exit()`, which announce the global
+ * epoch it runs in. A writer that unlinks memory readers may still hold hands it to
+ * `epoch_retire()` instead of freeing it, tagged with the epoch of that moment. The epoch advances
+ * once every thread inside a read runs in the current one, and memory retired in an epoch is freed
+ * two advances later, when every read that could have found it ended.
+ *
+ * Each writer keeps its retired memory in a list of its own, under whatever lock guards the writes,
+ * and frees what became safe every `GEECE_EPOCH_COLLECT_EVERY` retirements. A thread entering a read
+ * for the first time registers itself; it is unregistered when it exits.
+ */
+
+#ifndef GEECE_EPOCH_H
+#define GEECE_EPOCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Number of retirements between two attempts at freeing a list of retired memory.
+ */
+#define GEECE_EPOCH_COLLECT_EVERY 64
+
+/**
+ * @brief Memory waiting for the reads that might hold it to end.
+ */
+typedef struct {
+    void *memory; /**< The memory, freed with free(). */
+    uint64_t epoch; /**< The epoch it was retired in. */
+} EpochRetired;
+
+/**
+ * @brief A list of retired memory, guarded by its writer.
+ */
+typedef struct EpochGarbage {
+    EpochRetired *items; /**< The retired memory, oldest first. */
+    size_t count; /**< The number of items. */
+    size_t capacity; /**< The number of items that fit in items. */
+} EpochGarbage;
+
+/**
+ * @brief Starts a read of memory guarded by epochs. Reads do not nest.
+ *
+ * @return False if the thread could not be registered, the read must then be done under the
+ * writers' lock.
+ */
+bool epoch_enter(void);
+
+/**
+ * @brief Ends a read started by `epoch_enter()`.
+ */
+void epoch_exit(void);
+
+/**
+ * @brief Frees memory once no read that might have found it runs anymore. Called once the memory
+ * is unreachable for reads starting from now on.
+ *
+ * @param garbage The list of the writer, guarded by the caller.
+ * @param memory The memory to free, may be NULL.
+ */
+void epoch_retire(EpochGarbage *garbage, void *memory);
+
+/**
+ * @brief Frees every item of a list at once, whatever its epoch. Only called once no thread can be
+ * reading the memory anymore, when the structure it belonged to is destroyed.
+ *
+ * @param garbage The list.
+ */
+void epoch_free_all(EpochGarbage *garbage);
+
+#endif /* GEECE_EPOCH_H */
@@ -0,0 +1,182 @@
+/**
+ * @file geece.h
+ * @brief Entry points of the GeeCe collector.
+ */
+
+#ifndef GEECE_GEECE_H
+#define GEECE_GEECE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "configuration.h"
+#include "cycle_collector.h"
+#include "handle_scope.h"
+#include "heap.h"
+#include "reference_counting.h"
+#include "root_table.h"
+#include "stack_roots.h"
+#include "type.h"
+
+/**
+ * @brief Counters describing the work done by the collector so far.
+ */
+typedef struct {
+    size_t minor_collections;       /**< Number of minor collections run. */
+    size_t promoted_bytes;          /**< Bytes promoted from the nursery into the old space. */
+    uint64_t minor_pause_ns;        /**< Total time spent in minor collections. */
+    uint64_t max_minor_pause_ns;    /**< Longest minor collection. */
+    size_t collections;             /**< Number of full collections run. */
+    size_t freed_bytes;             /**< Bytes reclaimed by full collections. */
+    uint64_t pause_ns;              /**< Total time spent in full collections. */
+    uint64_t max_pause_ns;          /**< Longest full collection. */
+    size_t marked_bytes;            /**< Bytes of the objects marked by full collections. */
+    uint64_t mark_ns;               /**< Total time spent marking, included in `pause_ns`. */
+    uint64_t sweep_ns;              /**< Total time spent sweeping, included in `pause_ns`. */
+    size_t compactions;             /**< Number of full collections that compacted the heap. */
+    size_t moved_bytes;             /**< Bytes moved by compactions. */
+    uint64_t compaction_ns;         /**< Total time spent compacting, included in `pause_ns`. */
+    size_t incremental_cycles;      /**< Number of full collections run incrementally, included in `collections`. */
+    size_t cycle_slices;            /**< Pauses of the last incremental cycle, its start and finish included. */
+    uint64_t cycle_max_pause_ns;    /**< Longest pause of the last incremental cycle. */
+    uint64_t cycle_p99_pause_ns;    /**< 99th percentile pause of the last incremental cycle. */
+    uint64_t concurrent_mark_ns;    /**< Total time the background thread spent marking, not included in `pause_ns`. */
+    size_t rc_reconciliations;      /**< Number of zero-count table reconciliations run. */
+    size_t rc_destroyed;            /**< Objects destroyed by reconciliations. */
+    uint64_t rc_pause_ns;           /**< Total time spent reconciling, not included in `pause_ns`. */
+    uint64_t max_rc_pause_ns;       /**< Longest reconciliation. */
+    size_t cycle_collections;       /**< Number of cycle collections run. */
+    size_t cycle_destroyed;         /**< Objects destroyed by cycle collections. */
+    uint64_t cycle_collect_ns;      /**< Total time spent collecting cycles, not included in `pause_ns`. */
+    uint64_t max_cycle_collect_ns;  /**< Longest cycle collection. */
+} GeeceStats;
+
+/**
+ * @brief Registers the root table that collections start from.
+ *
+ * @param roots The root table, or NULL to run without roots.
+ */
+void geece_set_roots(RootTable *roots);
+
+/**
+ * @brief Returns the root table registered with `geece_set_roots()`.
+ */
+RootTable *geece_get_roots(void);
+
+/**
+ * @brief Runs a minor collection of the nursery.
+ *
+ * Moves every young object reachable from the registered roots, the handles and the remembered
+ * set, so any young object pointer held outside of them is stale afterwards. Other threads must not be
+ * allocating or mutating objects while it runs.
+ */
+void geece_collect_minor(void);
+
+/**
+ * @brief Runs a full collection.
+ *
+ * Empties the nursery with a minor collection, marks everything reachable from the registered
+ * roots and sweeps the size-class pages and the large-object space. Unreachable objects are
+ * finalized and their memory is reused, dead large objects are unmapped. If the fragmentation of
+ * the heap exceeds `geece_config.compaction_threshold` afterwards, the heap is compacted as by
+ * `geece_compact()`. A running incremental collection is finished instead. Other threads must not
+ * be allocating or mutating objects while it runs.
+ *
+ * With `geece_config.lazy_sweep` set, the size-class pages are not swept by the collection. Each
+ * is swept by the first allocation that needs a page of its size class, and the destructors of
+ * the dead objects it held run at the end of that allocation; the next collection first sweeps
+ * whatever is left.
+ */
+void geece_collect(void);
+
+/**
+ * @brief Runs a full collection and compacts the heap.
+ *
+ * Live objects slide together so that the pages they leave empty are reused by any size class.
+ * Edges and the entries of the registered root table are updated, so any other pointer to an
+ * object that is not pinned with `geece_pin()` is stale afterwards.
+ */
+void geece_compact(void);
+
+/**
+ * @brief Starts an incremental full collection, unless one is already running.
+ *
+ * Runs a minor collection and shades the roots, then returns. Marking advances in slices run by
+ * `geece_malloc()` as allocations pile up `geece_config.mark_rate` times their size in marking
+ * debt, each slice tracing `geece_config.mark_slice_bytes` of objects; `geece_collect_step()` runs
+ * a slice directly. Once marking runs out of work, a last pause rescans the roots and sweeps.
+ *
+ * Objects allocated in the old space while the cycle runs survive it, and objects released while
+ * it runs are left to its sweep. Any object reachable only from a local variable may be freed by
+ * an allocation that finishes the cycle, as it would by `geece_collect()`. Slices run on the
+ * allocating thread, so only one thread may allocate or mutate objects while a cycle runs.
+ *
+ * With `geece_config.concurrent_marking` set, a background thread does all the marking instead and
+ * allocations run no slices, so any number of threads may allocate and mutate objects meanwhile.
+ * The cycle is finished by `geece_collect_step()` once the background thread ran out of work, or
+ * by `geece_collect()` at any time; both need the other threads to be quiet, as `geece_collect()`
+ * always does.
+ */
+void geece_collect_start(void);
+
+/**
+ * @brief Runs one slice of the running incremental collection. When marking runs on the
+ * background thread, finishes the collection if the thread ran out of work and does nothing
+ * otherwise.
+ *
+ * @return True if the collection is finished, or none was running.
+ */
+bool geece_collect_step(void);
+
+/**
+ * @brief Charges an allocation to the running incremental collection, which runs a slice once
+ * enough debt built up. Called by the allocator.
+ *
+ * @param size Bytes allocated.
+ */
+void geece_collect_allocated(size_t size);
+
+/**
+ * @brief Counts memory a lazy sweep freed after its collection returned. Called by the allocator
+ * with the heap lock held.
+ *
+ * @param size Bytes freed.
+ */
+void geece_collect_swept(size_t size);
+
+/**
+ * @brief Reconciles the zero-count table of deferred reference counting.
+ *
+ * Counts the references of the registered root table, the open arenas and the registered thread
+ * stacks, then destroys up to `budget` objects of the table that neither the heap nor a root
+ * holds; objects destroyed drop the counts of the objects they reference, which are destroyed by
+ * the same reconciliation while the budget lasts. Allocations run one with
+ * `geece_config.rc_chunk_objects` as budget once `geece_config.rc_table_limit` objects entered the
+ * table, or while the last one left objects behind. Does nothing while a full collection is
+ * marking. Other threads must not be allocating or mutating objects while it runs.
+ *
+ * @param budget The most objects to destroy.
+ * @return The number of objects destroyed.
+ */
+size_t geece_rc_reconcile(size_t budget);
+
+/**
+ * @brief Collects the garbage cycles among the candidates buffered by reference counting.
+ *
+ * With `geece_config.cycle_collection` set, objects whose count is dropped without reaching zero
+ * are buffered; this subtracts the references internal to what the candidates reach and destroys
+ * the objects that only the cycles among them held. The registered root table, the open arenas, the
+ * handles and the registered thread stacks are counted while it runs. Allocations run one once
+ * `geece_config.cycle_buffer_limit` candidates are buffered. Does nothing while a full collection
+ * is marking. Other threads must not be allocating or mutating objects while it runs.
+ *
+ * @return The number of objects destroyed.
+ */
+size_t geece_collect_cycles(void);
+
+/**
+ * @brief Returns the collector statistics.
+ */
+const GeeceStats *geece_stats(void);
+
+#endif /* GEECE_GEECE_H */
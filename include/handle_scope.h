@@ -0,0 +1,155 @@
+/**
+ * @file handle_scope.h
+ * @brief Handle scopes: a per-thread shadow stack of roots for local variables.
+ *
+ * A handle is a slot of the calling thread's shadow stack holding an object, which every
+ * collection treats as a root alongside the root table. Handles are pushed by `geece_handle()` and
+ * dropped together when the scope they were pushed in closes:
+ *
+ *     GEECE_SCOPE_BEGIN
+ *         Object **list = geece_handle(geece_malloc(16, NULL));
+ *         geece_collect();
+ *         use(*list);
+ *     GEECE_SCOPE_END
+ *
+ * Pushing a handle bumps a pointer and closing a scope puts it back, with no key, no allocation and
+ * no hashing, so short-lived locals cost far less than root table entries. The stack grows a block
+ * of slots at a time and a slot never moves, so the pointer `geece_handle()` returns stays valid
+ * until its scope closes. Collections that move objects, minor collections and compaction, update
+ * the slots rather than pinning the objects, so the object is read back through the handle after a
+ * collection. Leaving a scope without reaching `GEECE_SCOPE_END`, by a `return` or a `goto`, leaves
+ * its handles on the stack until an enclosing scope closes.
+ *
+ * Collections read the stacks of every thread, so, as for the root table, other threads must not
+ * be pushing handles or closing scopes while one runs. The stack of a thread is freed when it
+ * exits. Arena objects are kept alive by their arena, a handle does not keep one past its end.
+ */
+
+#ifndef GEECE_HANDLE_SCOPE_H
+#define GEECE_HANDLE_SCOPE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "object.h"
+
+/**
+ * @brief Number of slots in each block of a shadow stack.
+ */
+#define GEECE_HANDLE_BLOCK_SIZE 1024
+
+/**
+ * @brief A block of handle slots, linked to the block above it in the stack.
+ */
+typedef struct HandleBlock {
+    struct HandleBlock *next;
+    Object *slots[GEECE_HANDLE_BLOCK_SIZE];
+} HandleBlock;
+
+/**
+ * @brief The shadow stack of a thread. Blocks above the current one are kept for reuse.
+ */
+typedef struct HandleStack {
+    Object **top;               /**< Next free slot of the current block. */
+    Object **limit;             /**< End of the current block. */
+    HandleBlock *block;         /**< Current block, NULL while the stack is empty. */
+    HandleBlock *first;         /**< Bottom block. */
+    bool registered;            /**< The stack is known to the collections. */
+    struct HandleStack *next;
+} HandleStack;
+
+/**
+ * @brief The position of a shadow stack when a scope opened.
+ */
+typedef struct {
+    Object **top;
+    Object **limit;
+    HandleBlock *block;
+} HandleScope;
+
+/**
+ * @brief The shadow stack of the calling thread.
+ */
+extern _Thread_local HandleStack geece_handle_stack;
+
+/**
+ * @brief Pushes a handle once the current block is full, moving on to the next block and
+ * registering the stack on first use.
+ *
+ * @param object The object.
+ * @return The slot, or NULL if no block could be allocated.
+ */
+Object **handle_push_slow(Object *object);
+
+/**
+ * @brief Pushes a handle to an object on the calling thread's shadow stack, keeping the object
+ * alive until the enclosing scope closes.
+ *
+ * @param object The object, may be NULL.
+ * @return The slot holding the object, which collections update when the object moves and the
+ *         caller may overwrite, or NULL if the stack could not grow.
+ */
+static inline Object **geece_handle(Object *object){
+    HandleStack *stack = &geece_handle_stack;
+    if (stack->top == stack->limit){
+        return handle_push_slow(object);
+    }
+    *stack->top = object;
+    return stack->top++;
+}
+
+/**
+ * @brief Opens a scope on the calling thread's shadow stack.
+ *
+ * @return The scope, to close with `geece_scope_close()`.
+ */
+static inline HandleScope geece_scope_open(void){
+    HandleStack *stack = &geece_handle_stack;
+    return (HandleScope){stack->top, stack->limit, stack->block};
+}
+
+/**
+ * @brief Closes a scope, dropping the handles pushed since it opened, those of the scopes nested
+ * in it included.
+ *
+ * @param scope The scope returned by `geece_scope_open()`.
+ */
+static inline void geece_scope_close(HandleScope scope){
+    HandleStack *stack = &geece_handle_stack;
+    stack->top = scope.top;
+    stack->limit = scope.limit;
+    stack->block = scope.block;
+}
+
+/**
+ * @brief Opens a scope for the handles of a block of code, closed by `GEECE_SCOPE_END`.
+ */
+#define GEECE_SCOPE_BEGIN { HandleScope geece_scope_ = geece_scope_open();
+
+/**
+ * @brief Closes the scope opened by the matching `GEECE_SCOPE_BEGIN`.
+ */
+#define GEECE_SCOPE_END geece_scope_close(geece_scope_); }
+
+/**
+ * @brief Returns the number of handles on the shadow stacks of every thread.
+ */
+size_t geece_handle_count(void);
+
+/**
+ * @brief Calls `visit` for the object of every handle of every thread. Must only be called while
+ * no other thread is pushing handles or closing scopes.
+ *
+ * @param visit The function to call.
+ */
+void handle_scope_for_each(void (*visit)(Object *object));
+
+/**
+ * @brief Points every handle of every thread at the new address of its object, for collections
+ * that move objects. Must only be called while no other thread is pushing handles or closing
+ * scopes.
+ *
+ * @param forward Returns the new address of an object.
+ */
+void handle_scope_forward(Object *(*forward)(Object *object));
+
+#endif /* GEECE_HANDLE_SCOPE_H */
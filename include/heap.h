@@ -1,23 +1,199 @@
 #ifndef GEECE_HEAP_H
 #define GEECE_HEAP_H
 
+#include <pthread.h>
+#include <stdatomic.h>
+#include "configuration.h"
 #include "object.h"
+#include "page.h"
+#include "utils.h"
+
+/**
+ * Shared pages of one size class that no thread owns. Pages with free blocks sit on `available`
+ * and are handed to the next thread that runs out, pages without free blocks sit on `full`.
+ * Pages a lazily swept collection left behind sit on `unswept` until a thread needs one.
+ */
+typedef struct{
+    size_t block_size;
+    Page *available;
+    Page *full;
+    Page *unswept;
+} SizeClass;
 
 typedef struct{
-    size_t size;
+    size_t size;                //Total bytes of memory owned by the heap
+    size_t used;                //Bytes handed out, excluding what the allocation buffers count
     Object *top; //Points to the next free spot in objects
     Object *objects;
+    SizeClass classes[GEECE_SIZE_CLASS_COUNT];
+    Page *free_pages;           //Empty pages that can be formatted for any size class
+    struct Tlab *tlabs;         //Allocation buffers of every thread using the heap
+    PointerArray finalize_queue; //Dead objects found by lazy sweeping, waiting for their destructor
+    pthread_mutex_t lock;       //Guards everything above except what the buffers own
+    atomic_bool finalize_pending; //Set while `finalize_queue` may hold objects
 } Heap;
 
 /**
  * Pointer to the global heap instance. Initialized to NULL on program start and
- * allocated when `geece_malloc()` is called for the first time.
+ * set up when the first object is allocated.
+ */
+extern Heap *heap;
+
+/**
+ * Sets up the global heap, and the nursery when `geece_config.nursery_size` is not 0. Safe to
+ * call from several threads, only the first call has an effect.
+ */
+void heap_init(void);
+
+/**
+ * Acquires the heap lock.
+ */
+void heap_lock(void);
+
+/**
+ * Releases the heap lock.
+ */
+void heap_unlock(void);
+
+/**
+ * Takes a page with free blocks of a size class from the shared heap, mapping a new segment if
+ * none is left. Unswept pages of the class are swept and taken first. Must be called with the
+ * heap lock held.
+ *
+ * @param size_class The size class the page has to serve.
+ * @return The page, or NULL if memory allocation fails.
+ */
+Page *heap_acquire_page(unsigned int size_class);
+
+/**
+ * Hands an empty page back so that any size class can reuse it. Must be called with the heap lock
+ * held.
+ *
+ * @param page The empty page.
+ */
+void heap_release_page(Page *page);
+
+/**
+ * Hands a page that a thread stops allocating from back to the shared heap. Must be called with
+ * the heap lock held.
+ *
+ * @param page The page to retire.
+ */
+void heap_retire_page(Page *page);
+
+/**
+ * Returns whether a block of the given size belongs in the large-object space.
+ *
+ * @param size The size of the block in bytes, including the object header.
+ */
+static inline bool heap_is_large_size(size_t size){
+    return size > GEECE_MAX_SMALL_SIZE || size > geece_config.large_object_threshold;
+}
+
+/**
+ * Takes an unformatted, page-aligned chunk of GEECE_PAGE_SIZE bytes from the heap.
+ *
+ * @return The chunk, or NULL if memory allocation fails.
+ */
+void *heap_acquire_chunk(void);
+
+/**
+ * Hands a chunk taken with `heap_acquire_chunk()` back to the heap.
+ *
+ * @param chunk The chunk to release.
+ */
+void heap_release_chunk(void *chunk);
+
+/**
+ * Measures how fragmented the size-class pages are.
+ *
+ * The largest free block of a size-class heap is a whole empty page, so fragmentation is the share
+ * of free blocks in the pages that still hold objects: bytes that only compaction can turn back
+ * into empty pages.
+ *
+ * @return The free bytes of the non-empty pages divided by their capacity, between 0 and 1.
+ */
+double heap_fragmentation(void);
+
+/**
+ * Sweeps every page of the heap, shared or owned by a thread, and files each page on the list
+ * matching what is left in it afterwards. Must only be called while no other thread is allocating.
+ *
+ * @param sweep_page Frees the dead blocks of one page and returns the number of bytes freed.
+ * @return The number of bytes freed.
+ */
+size_t heap_sweep_pages(size_t (*sweep_page)(Page *page));
+
+/**
+ * Sweeps every page of the heap like `heap_sweep_pages()`, on up to `threads` threads. The pages
+ * are handed out to the threads in batches, each of which rebuilds the free lists of its own pages
+ * and keeps its own count of the bytes freed and batch of dead objects with a destructor. The
+ * counts are summed and the batches destroyed on the calling thread once all of them are done.
+ * Must only be called while no other thread is allocating.
+ *
+ * @param threads Number of threads to sweep on, the calling thread included.
+ * @return The number of bytes freed.
+ */
+size_t heap_sweep_pages_parallel(unsigned int threads);
+
+/**
+ * Leaves every size-class page for the allocator to sweep, instead of sweeping it now. Pages owned
+ * by threads are handed back to the shared heap and every page goes on its class's unswept list.
+ * A thread out of free blocks then sweeps the next unswept page of the class it allocates from,
+ * queueing the destructors of the dead objects for `heap_run_finalizers()`. Must only be called
+ * while no other thread is allocating.
  */
-Heap *heap = NULL;
+void heap_defer_sweep(void);
+
+/**
+ * Sweeps the pages `heap_defer_sweep()` left and runs the queued destructors. Called before the
+ * next collection marks, and before compacting, since both need every page swept. Must only be
+ * called while no other thread is allocating.
+ */
+void heap_finish_sweep(void);
+
+/**
+ * Destroys the dead objects lazy sweeping queued, running their destructors. Cheap when there is
+ * none, called by `geece_malloc()` once the allocation is done.
+ */
+void heap_run_finalizers(void);
+
+/**
+ * Calls `visit` for every page of the heap holding objects, shared or owned by a thread. Must only
+ * be called while no other thread is allocating.
+ *
+ * @param visit The function to call.
+ */
+void heap_for_each_page(void (*visit)(Page *page));
+
+/**
+ * Allocates a zeroed block of memory for an object from the Geece heap.
+ *
+ * Small blocks are served from the calling thread's page for their size class, large blocks are
+ * mapped individually in the large-object space and flagged with OBJECT_LARGE.
+ *
+ * @param size The size of the block in bytes, including the object header.
+ * @return A pointer to the block, or NULL if memory allocation fails.
+ */
+Object *heap_alloc_block(size_t size);
+
+/**
+ * Returns an object's block to the Geece heap.
+ *
+ * @param object A pointer to an object allocated with `heap_alloc_block()`.
+ */
+void heap_free_block(Object *object);
 
 /**
  * Allocates memory on the Geece heap.
  *
+ * Small objects are bump-allocated in the nursery when it is enabled, running a minor collection
+ * when eden is full. Large objects go to the large-object space and everything else is allocated
+ * in the old space.
+ *
+ * With `geece_config.deferred_rc` set, the object starts with a count of zero in the zero-count
+ * table, and the allocation first reconciles the table when it is due.
+ *
  * @param size The size of the object to be allocated.
  * @param destructor The destructor function for the object.
  * @return A pointer to the allocated object.
@@ -25,8 +201,65 @@ Heap *heap = NULL;
  */
 Object *geece_malloc(size_t size, Destructor destructor);
 
+/**
+ * Pins an object, so that compaction never moves it. Objects whose address is handed to native
+ * code must be pinned for as long as that code holds on to it.
+ *
+ * Young objects still move on minor collections until they are promoted.
+ *
+ * @param object The object to pin.
+ */
+void geece_pin(Object *object);
+
+/**
+ * Unpins an object pinned with `geece_pin()`.
+ *
+ * @param object The object to unpin.
+ */
+void geece_unpin(Object *object);
+
+/**
+ * A region whose objects are all released together by `geece_arena_end()`.
+ */
+typedef struct Arena Arena;
+
+/**
+ * Opens an arena for objects that share one lifetime, such as the data of a single request.
+ *
+ * @return The new arena.
+ * @throws An error message if memory allocation fails.
+ */
+Arena *geece_arena_begin(void);
+
+/**
+ * Allocates memory in an arena.
+ *
+ * Objects are bump-allocated from the arena's chunks and are never collected while the arena is
+ * open. Objects too big for an arena chunk are allocated with `geece_malloc()` instead.
+ *
+ * @param arena The arena to allocate in.
+ * @param size The size of the object to be allocated.
+ * @param destructor The destructor function for the object, run when the arena ends.
+ * @return A pointer to the allocated object.
+ * @throws An error message if memory allocation fails.
+ */
+Object *geece_malloc_in(Arena *arena, size_t size, Destructor destructor);
+
+/**
+ * Closes an arena and releases all of its objects in one step.
+ *
+ * Only objects that registered a destructor or hold references are visited. Objects that escaped
+ * the arena, because an object outside of it or the root table references them, stay valid along
+ * with everything in the arena they reference, and are collected like any other object.
+ *
+ * @param arena The arena to close.
+ */
+void geece_arena_end(Arena *arena);
+
 /**
  * Decrements the reference count of an object and destroys it if the reference count reaches 0.
+ * With `geece_config.deferred_rc` set, the reference being dropped was never counted, so nothing
+ * happens: the object is destroyed by a reconciliation once neither the heap nor a root holds it.
  *
  * @param object A pointer to the object to be released.
  */
@@ -41,10 +274,10 @@ void geece_release(Object *object);
 size_t geece_size(Object *object);
 
 /**
- * Returns the data stored in an object.
+ * Returns the objects with an edge to an object, see `reference_referrers()`.
  *
- * @param object A pointer to the object to get the data of.
- * @return The data stored in the object.
+ * @param object A pointer to the object to get the referrers of.
+ * @return The referrers of the object, NULL if it has none.
  */
 Object **geece_data(Object *object);
 
@@ -58,6 +291,8 @@ size_t geece_total_memory();
 /**
  * Returns the amount of available memory on the Geece heap.
  *
+ * Usage counted by the threads' allocation buffers is summed up on every call.
+ *
  * @return The amount of available memory on the Geece heap.
  */
 size_t geece_available_memory();
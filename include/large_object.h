@@ -0,0 +1,81 @@
+/**
+ * @file large_object.h
+ * @brief The large-object space of the GeeCe heap.
+ *
+ * Objects above `geece_config.large_object_threshold` bytes are mapped individually from the
+ * operating system, so they never fragment the size-class pages and are never moved. They are
+ * kept on a side list that the sweep walks, unmapping every large object it finds dead.
+ */
+
+#ifndef GEECE_LARGE_OBJECT_H
+#define GEECE_LARGE_OBJECT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "object.h"
+
+/**
+ * @brief Header placed in front of every large object's mapping.
+ */
+typedef struct LargeObject {
+    struct LargeObject *next;   /**< Next large object on the side list. */
+    struct LargeObject *prev;   /**< Previous large object on the side list. */
+    size_t mapped_size;         /**< Size of the mapping, including this header. */
+    uint64_t mark;              /**< Mark bit of the object, kept out of the object itself. */
+} LargeObject;
+
+/**
+ * @brief Maps a zeroed large object.
+ *
+ * @param size The size of the block in bytes, including the object header.
+ * @return The object, flagged with OBJECT_LARGE, or NULL if the mapping failed.
+ */
+Object *large_object_alloc(size_t size);
+
+/**
+ * @brief Unlinks a large object from the side list and unmaps it.
+ *
+ * @param object The large object to free.
+ */
+void large_object_free(Object *object);
+
+/**
+ * @brief Returns the header word holding a large object's mark bit.
+ *
+ * @param object The large object.
+ * @param mask Receives the mask of the object's bit in the word.
+ */
+uint64_t *large_object_mark_word(const Object *object, uint64_t *mask);
+
+/**
+ * @brief Frees every large object that was not marked and clears the marks of the others.
+ *
+ * Must only be called while no other thread is allocating or mutating objects.
+ *
+ * @return The number of bytes unmapped.
+ */
+size_t large_object_sweep(void);
+
+/**
+ * @brief Calls `visit` for every large object.
+ *
+ * @param visit The function to call.
+ */
+void large_object_for_each(void (*visit)(Object *object));
+
+/**
+ * @brief Returns the large object whose mapping holds an address, or NULL if there is none. Walks
+ * the side list, so it is meant for addresses the page directory already placed in a large
+ * object's granule.
+ *
+ * @param ptr The address to look up.
+ */
+Object *large_object_containing(const void *ptr);
+
+/**
+ * @brief Returns the number of large objects currently mapped.
+ */
+size_t large_object_count(void);
+
+#endif /* GEECE_LARGE_OBJECT_H */
@@ -1,6 +1,184 @@
+#ifndef GEECE_MARK_AND_SWEEP_H
+#define GEECE_MARK_AND_SWEEP_H
+
 #include "object.h"
 #include "root_table.h"
+#include "page.h"
+#include "utils.h"
+
+struct Tlab;
 
+/**
+ * Marks an object and everything reachable from it.
+ *
+ * The traversal runs off an explicit mark stack rather than the C stack, so arbitrarily deep
+ * structures such as long lists are safe to mark. The stack grows up to
+ * `geece_config.mark_stack_limit` entries; past that, objects that do not fit are left unmarked and
+ * found again by rescanning the marked objects of the heap once the stack drains.
+ *
+ * @param object The object to mark, may be NULL.
+ */
 void geece_mark(Object *object);
 
-void geece_ptr_scanner(Object *object, void (*mark_function)(Object *obj));
\ No newline at end of file
+/**
+ * Marks an object and hands every object it references to `mark_function`.
+ *
+ * @param object The object to scan, may be NULL.
+ * @param mark_function Called for every referenced object of a newly marked object.
+ */
+void geece_ptr_scanner(Object *object, void (*mark_function)(Object *obj));
+
+/**
+ * Returns whether the running full collection marked an object. Marks live in side bitmaps of the
+ * page, nursery, arena chunk or large-object header holding the object, never in the object.
+ *
+ * @param object The object to test.
+ */
+bool geece_is_marked(const Object *object);
+
+/**
+ * Marks everything reachable from the objects in a root table, in the open arenas and in the
+ * handles of every thread.
+ *
+ * With `geece_config.mark_threads` above 1, the root set slots are split between that many
+ * threads, which mark in parallel and steal work from each other's deques until all of them run
+ * out. Mark bits are then set with an atomic fetch-or, so each object is scanned by one thread.
+ *
+ * @param roots The root table to mark from, may be NULL.
+ * @return The number of bytes of the objects marked, headers included.
+ */
+size_t geece_mark_roots(RootTable *roots);
+
+/**
+ * Starts incremental marking: every root is shaded gray and nothing is traced yet.
+ *
+ * Until `geece_mark_finish()`, marking advances in `geece_mark_step()` slices while the mutator
+ * runs. The tri-color invariant is kept by shading the target of every new edge with
+ * `geece_shade()`, a Dijkstra insertion barrier, and by rescanning the roots when marking
+ * finishes. Young objects and objects of open arenas are not traced by the slices; they are
+ * scanned as roots when marking finishes instead.
+ *
+ * @param roots The root table to shade, may be NULL.
+ */
+void geece_mark_start(RootTable *roots);
+
+/**
+ * Hands incremental marking started by `geece_mark_start()` over to the background marking thread,
+ * starting the thread on first use.
+ *
+ * The marker traces until it runs out of work while other threads keep running. Marking then
+ * keeps a snapshot at the beginning: `geece_shade()` is called on the targets of removed edges as
+ * well as of new ones, and records them in the calling thread's SATB buffer, which is handed to
+ * the marker when full. Objects allocated black set their mark bit atomically. Minor collections
+ * and arena ends park the marker with `geece_mark_pause()` while they move or free objects.
+ *
+ * @return False if the thread could not be started, marking then stays in slices.
+ */
+bool geece_mark_start_concurrent(void);
+
+/**
+ * Returns whether the background marker ran out of work. It may get more until marking finishes.
+ */
+bool geece_mark_concurrent_done(void);
+
+/**
+ * Returns the total time the background marker spent tracing, in nanoseconds.
+ */
+uint64_t geece_mark_concurrent_ns(void);
+
+/**
+ * Waits for the background marker to stop tracing, and keeps it stopped until
+ * `geece_mark_resume()`. Does nothing when concurrent marking is not in progress.
+ */
+void geece_mark_pause(void);
+
+/**
+ * Lets the background marker go on after `geece_mark_pause()`.
+ */
+void geece_mark_resume(void);
+
+/**
+ * Hands the objects recorded in a thread's SATB buffer to the background marker.
+ *
+ * @param tlab The allocation buffer of the calling thread, or of a thread that is exiting.
+ */
+void geece_mark_flush(struct Tlab *tlab);
+
+/**
+ * Frees an array of edges an object no longer uses. During concurrent marking the background
+ * marker may still be reading it, so it is freed when marking finishes instead.
+ *
+ * @param memory The array.
+ */
+void geece_mark_retire(void *memory);
+
+/**
+ * Marks from the gray objects until they run out or `budget` bytes of objects are marked.
+ *
+ * @param budget Bytes of objects to mark at most, give or take the last object.
+ * @return True if no gray object is left.
+ */
+bool geece_mark_step(size_t budget);
+
+/**
+ * Returns whether incremental marking started and did not finish yet.
+ */
+bool geece_mark_in_progress(void);
+
+/**
+ * Write barrier of incremental marking: shades an object gray if it is still white. Does nothing
+ * when incremental marking is not in progress.
+ *
+ * @param object The target of a new edge, or of a removed one, may be NULL.
+ */
+void geece_shade(Object *object);
+
+/**
+ * Marks an object created or moved into the old space during incremental marking, and shades the
+ * objects it references. Does nothing when incremental marking is not in progress.
+ *
+ * @param object The object.
+ */
+void geece_mark_black(Object *object);
+
+/**
+ * Finishes incremental marking: parks the background marker if it ran and takes over every SATB
+ * buffer, marks from the roots, the open arenas, the handles and the young objects again and traces
+ * everything left.
+ *
+ * @param roots The root table to mark from, may be NULL.
+ * @return The number of bytes of the objects marked by the whole incremental marking.
+ */
+size_t geece_mark_finish(RootTable *roots);
+
+/**
+ * Frees the unmarked objects of a heap page and clears the marks of the others.
+ *
+ * @param page The page to sweep.
+ * @return The number of bytes freed.
+ */
+size_t geece_sweep_page(Page *page);
+
+/**
+ * Sweeps a page like `geece_sweep_page()` while the heap lock is held, or on one of several
+ * threads sweeping in parallel. Dead objects that have a destructor or sit in the nursery's
+ * remembered set keep their block and are queued instead, to be destroyed later by one thread with
+ * the lock released.
+ *
+ * @param page The page to sweep, which no other thread touches meanwhile.
+ * @param finalize Receives the dead objects left to destroy.
+ * @return The number of bytes freed, the queued objects excluded.
+ */
+size_t geece_sweep_page_deferred(Page *page, PointerArray *finalize);
+
+/**
+ * Frees every unmarked object in the size-class pages, the large-object space and the retained
+ * arena chunks, and clears the marks of the survivors. With `geece_config.lazy_sweep` set, the
+ * size-class pages are only handed to `heap_defer_sweep()`; otherwise they are swept on
+ * `geece_config.sweep_threads` threads.
+ *
+ * @return The number of bytes freed.
+ */
+size_t geece_sweep(void);
+
+#endif /* GEECE_MARK_AND_SWEEP_H */
@@ -0,0 +1,139 @@
+/**
+ * @file nursery.h
+ * @brief The young generation of the GeeCe heap.
+ *
+ * Objects are bump-allocated in a contiguous eden through `heap->top`. A minor collection copies
+ * the survivors of eden and the current survivor space into the other survivor space, and
+ * promotes objects that survived `geece_config.promotion_age` collections into the size-class
+ * pages. Old objects that gain an edge to a young object are recorded in a remembered set by
+ * `add_reference()`, so a minor collection never has to scan the old space.
+ *
+ * Survivors move, so after a minor collection the mutator must reload young objects through the
+ * roots or references it registered.
+ */
+
+#ifndef GEECE_NURSERY_H
+#define GEECE_NURSERY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "object.h"
+#include "root_table.h"
+
+/**
+ * @brief Maps the nursery and points the heap's bump allocator at eden.
+ *
+ * @param size The total size of the nursery in bytes, including both survivor spaces.
+ * @return True if the nursery was created, false otherwise.
+ */
+bool nursery_init(size_t size);
+
+/**
+ * @brief Returns whether the nursery has been created.
+ */
+bool nursery_enabled(void);
+
+/**
+ * @brief Bump-allocates a zeroed block from eden.
+ *
+ * @param size The size of the block in bytes, including the object header.
+ * @return The block, or NULL if eden does not have room for it.
+ */
+Object *nursery_alloc_block(size_t size);
+
+/**
+ * @brief Records a young object that has to be finalized if it dies in the nursery.
+ *
+ * @param object The young object owning a destructor or outgoing references.
+ */
+void nursery_track_cleanup(Object *object);
+
+/**
+ * @brief Records an old object that holds an edge into the nursery.
+ *
+ * @param object The old object to remember.
+ */
+void nursery_remember(Object *object);
+
+/**
+ * @brief Drops an old object from the remembered set before it is destroyed.
+ *
+ * @param object The object to forget.
+ */
+void nursery_forget(Object *object);
+
+/**
+ * @brief Write barrier run whenever `object` gains an edge to `referenced_object`.
+ *
+ * @param object The object the edge starts from.
+ * @param referenced_object The object the edge points to.
+ */
+static inline void nursery_record_reference(Object *object, Object *referenced_object){
+    if (object->flags & OBJECT_YOUNG){
+        // The edges of a young object have to be freed if the object dies young
+        if (!(object->flags & OBJECT_TRACKED)){
+            nursery_track_cleanup(object);
+        }
+        return;
+    }
+    if ((referenced_object->flags & OBJECT_YOUNG) && !(object->flags & OBJECT_REMEMBERED)){
+        nursery_remember(object);
+    }
+}
+
+/**
+ * @brief Write barrier run whenever a field of the typed object `object` is set to `referenced_object`.
+ * Unlike edges, fields need no cleanup when a young object dies.
+ *
+ * @param object The object holding the field.
+ * @param referenced_object The object stored in the field.
+ */
+static inline void nursery_record_field(Object *object, Object *referenced_object){
+    if (!(object->flags & (OBJECT_YOUNG | OBJECT_REMEMBERED)) && (referenced_object->flags & OBJECT_YOUNG)){
+        nursery_remember(object);
+    }
+}
+
+/**
+ * @brief Runs a minor collection.
+ *
+ * Everything reachable from the roots and the remembered set is copied out of eden and the
+ * current survivor space, and the root table entries and edges pointing at moved objects are
+ * updated. Young objects that did not survive are finalized.
+ *
+ * @param roots The root table to evacuate from, may be NULL.
+ * @return The number of bytes promoted into the old space.
+ */
+size_t nursery_collect(RootTable *roots);
+
+/**
+ * @brief Returns the word of the nursery mark bitmap holding a young object's mark bit.
+ *
+ * @param object The young object.
+ * @param mask Receives the mask of the object's bit in the word.
+ */
+uint64_t *nursery_mark_word(const Object *object, uint64_t *mask);
+
+/**
+ * @brief Clears the marks of the survivor space after a full collection.
+ */
+void nursery_clear_marks(void);
+
+/**
+ * @brief Calls `visit` for every object in the survivor space, which after a minor collection
+ * holds every young object.
+ *
+ * @param visit The function to call.
+ */
+void nursery_for_each(void (*visit)(Object *object));
+
+/**
+ * @brief Replaces every object in the remembered set with what `forward` returns for it, after
+ * old objects moved.
+ *
+ * @param forward Returns the new address of an object.
+ */
+void nursery_forward_remembered(Object *(*forward)(Object *object));
+
+#endif /* GEECE_NURSERY_H */
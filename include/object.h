@@ -6,7 +6,168 @@
 #define GEECE_OBJECT_H
 
 #include "stdlib.h"
+#include <stdbool.h>
+#include <stdint.h>
 #include "root_table.h"
+
+#define OBJECT_LARGE 0x01               // Object lives in the large-object space
+#define OBJECT_YOUNG 0x02               // Object lives in the nursery
+#define OBJECT_FORWARDED 0x04           // Stale nursery copy, its first data word holds the new address
+#define OBJECT_REMEMBERED 0x08          // Old object recorded in the nursery's remembered set
+#define OBJECT_TRACKED 0x10             // Object is on its nursery's or arena's cleanup list
+#define OBJECT_ARENA 0x20               // Object was allocated in an arena
+#define OBJECT_ESCAPED 0x40             // Arena object referenced from outside its arena
+#define OBJECT_ROOTED 0x80              // Arena object held by the root table
+#define OBJECT_PINNED 0x100             // Object is never moved by compaction
+#define OBJECT_META 0x200               // Compact header: object has a record in the metadata side table
+#define OBJECT_TYPED 0x400              // Compact header: object's record holds a type
+#define OBJECT_ZCT 0x800                // Object sits in the zero-count table of deferred reference counting
+#define OBJECT_BUFFERED 0x1000          // Object sits in the cycle collector's buffer of candidate roots
+#define OBJECT_GRAY 0x2000              // Cycle collection: the object's internal references were subtracted
+#define OBJECT_WHITE 0x4000             // Cycle collection: the object is garbage, unless a live object reaches it
+#define OBJECT_COLOR (OBJECT_GRAY | OBJECT_WHITE)
+
+typedef void (*Destructor)(void *);
+
+typedef struct Object Object;
+
+#define GEECE_INLINE_EDGES 2            // Edges an object holds itself before they spill to an array
+#define GEECE_EDGE_SET_MIN 16           // Spilled arrays of this many slots index their edges in a hash set
+
+/*
+ * EdgeSpill struct
+ *
+ * The edges of an object that outgrew its inline slots, in one allocation: the edges, then, once
+ * the array has GEECE_EDGE_SET_MIN slots, an open-addressing set of their indices used to find an
+ * edge without scanning the array.
+ */
+typedef struct EdgeSpill{
+    uint32_t count;                     // Number of edges
+    uint32_t capacity;                  // Slots of items, a power of two
+    uint32_t *set;                      // Indices of the edges plus one, 0 for an empty slot, NULL if too small
+    Object *items[];                    // The edges, in the order they were added but for removals
+} EdgeSpill;
+
+/*
+ * ObjectEdges struct
+ *
+ * The outgoing edges of an object added with add_reference(). The first GEECE_INLINE_EDGES live in
+ * the object, packed at the front and NULL after the last, so they need no count. Once there are
+ * more, all of them move to a spilled array, which stays until the edges are cleared; the inline
+ * slots are left as they were when the edges spilled.
+ */
+typedef struct ObjectEdges{
+    Object *inline_edges[GEECE_INLINE_EDGES];   // The edges while they fit
+    EdgeSpill *spill;                   // The edges once they spilled, NULL before
+} ObjectEdges;
+
+#ifdef GEECE_COMPACT_HEADER
+/*
+ * Object struct, compact header mode
+ *
+ * The whole header is one word holding the nursery age, the flags, a saturating reference count
+ * and the size. The destructor, the edges and the type live in a side table
+ * that only objects with a destructor, edges or a type have a record in, flagged by OBJECT_META. Object
+ * data starts 8 bytes into the block.
+ */
+#define OBJECT_REF_COUNT_MAX 255        // Reference counts stick once they reach this value
+typedef struct Object{
+    uint64_t age : 4;                   // Minor collections survived in the nursery, promotion_age must stay below 16
+    uint64_t flags : 15;                // OBJECT_* flags describing where the object lives
+    uint64_t ref_count : 8;             // Number of references to the object, saturating
+    uint64_t size : 37;                 // Size of the object
+} Object;
+
+/*
+ * ObjectMeta struct
+ *
+ * Side table record holding the parts of the header that most objects do not need.
+ */
+typedef struct ObjectMeta{
+    Destructor destructor;              // Destructor function pointer to handle object cleanup
+    ObjectEdges edges;                  // The objects this object points to
+    uint16_t type;                      // Type registered with geece_register_type(), 0 if untyped
+} ObjectMeta;
+
+/*
+ * object_meta - Returns the side table record of an Object, or NULL if it has none
+ */
+ObjectMeta *object_meta(const Object *object);
+
+/*
+ * object_meta_create - Returns the side table record of an Object, creating it if needed
+ */
+ObjectMeta *object_meta_create(Object *object);
+
+/*
+ * object_meta_move - Moves the side table record of an Object that was copied to `to`
+ */
+void object_meta_move(const Object *from, const Object *to);
+
+/*
+ * object_meta_drop - Frees the side table record of an Object
+ */
+void object_meta_drop(Object *object);
+
+static inline Destructor object_destructor(const Object *object){
+    return (object->flags & OBJECT_META) ? object_meta(object)->destructor : NULL;
+}
+
+static inline void object_set_destructor(Object *object, Destructor destructor){
+    if (destructor != NULL || (object->flags & OBJECT_META)){
+        object_meta_create(object)->destructor = destructor;
+    }
+}
+
+static inline ObjectEdges *object_edges(const Object *object){
+    return (object->flags & OBJECT_META) ? &object_meta(object)->edges : NULL;
+}
+
+static inline ObjectEdges *object_edges_create(Object *object){
+    return &object_meta_create(object)->edges;
+}
+
+static inline uint16_t object_type(const Object *object){
+    return (object->flags & OBJECT_TYPED) ? object_meta(object)->type : 0;
+}
+
+static inline void object_set_type(Object *object, uint16_t type){
+    if (type != 0){
+        object_meta_create(object)->type = type;
+        object->flags |= OBJECT_TYPED;
+    }
+}
+
+// No room is left for an owner, counts change with a compare-and-swap of the whole header word
+static inline void object_ref_increment(Object *object){
+    Object old;
+    Object new;
+    __atomic_load(object, &old, __ATOMIC_RELAXED);
+    do {
+        new = old;
+        if (new.ref_count < OBJECT_REF_COUNT_MAX){
+            new.ref_count++;
+        }
+    } while (!__atomic_compare_exchange(object, &old, &new, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+static inline size_t object_ref_decrement(Object *object){
+    Object old;
+    Object new;
+    __atomic_load(object, &old, __ATOMIC_RELAXED);
+    do {
+        new = old;
+        if (new.ref_count > 0 && new.ref_count < OBJECT_REF_COUNT_MAX){
+            new.ref_count--;
+        }
+    } while (!__atomic_compare_exchange(object, &old, &new, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    return new.ref_count;
+}
+
+static inline size_t object_ref_count(const Object *object){
+    return object->ref_count;
+}
+#else
 /*
  * Object struct
  *
@@ -14,18 +175,205 @@
  * It contains a reference count to keep track of the number of references to the object,
  * a size to store the size of the object, a destructor function pointer to handle object cleanup,
  * and a flexible array member to store the object data.
+ *
+ * The reference count is biased towards the thread that allocated the object, its owner: the owner
+ * counts in ref_count without atomics, other threads count in shared_count atomically. The two
+ * are merged once the owner's count drops to zero, or once the other threads dropped more
+ * references than they took and queued the object for its owner; from then on shared_count holds
+ * the whole count and the owner is OBJECT_OWNER_SHARED.
  */
+#define OBJECT_OWNER_SHARED UINT32_MAX  // Owner of an object whose counts were merged
+#define OBJECT_SHARED_MERGED 0x1        // shared_count: the owner's count was merged in
+#define OBJECT_SHARED_QUEUED 0x2        // shared_count: the object waits in its owner's queue
+#define OBJECT_SHARED_ONE 0x4           // shared_count: one reference, above the two flags
+
 typedef struct Object{
-    bool marked;
-    size_t ref_count;                   // Number of references to the object
+    uint16_t age : 4;                   // Minor collections survived in the nursery, promotion_age must stay below 16
+    uint16_t type : 12;                 // Type registered with geece_register_type(), 0 if untyped, below GEECE_MAX_TYPES
+    uint16_t flags;                     // OBJECT_* flags describing where the object lives
+    uint32_t owner;                     // Thread counting in ref_count, see object_owner_id
+    size_t ref_count;                   // Number of references counted by the owner
+    int64_t shared_count;               // References counted by other threads, and OBJECT_SHARED_* flags
     size_t size;                        // Size of the object
     void (*destructor)(void *);         // Destructor function pointer to handle object cleanup
-    ObjectNode *references;             // A linked list of objects this object points to
-    Object **referenced_ptrs;           //Array of pointers to the objects that are point to this object
-    int referenced_ptrs_count;          //Count of objects point to this object.
+    ObjectEdges edges;                  // The objects this object points to
 } Object;
 
-typedef void (*Destructor)(void *);
+static inline Destructor object_destructor(const Object *object){
+    return object->destructor;
+}
+
+static inline void object_set_destructor(Object *object, Destructor destructor){
+    object->destructor = destructor;
+}
+
+static inline ObjectEdges *object_edges(const Object *object){
+    return (ObjectEdges *)&object->edges;
+}
+
+static inline ObjectEdges *object_edges_create(Object *object){
+    return &object->edges;
+}
+
+static inline uint16_t object_type(const Object *object){
+    return object->type;
+}
+
+static inline void object_set_type(Object *object, uint16_t type){
+    object->type = type;
+}
+
+/*
+ * Owner id of the calling thread, 0 until it allocates an object. Defined in reference_counting.c.
+ */
+extern _Thread_local uint32_t object_owner_id;
+
+/*
+ * Slow paths of the biased reference count, taken by the threads that do not own the object and
+ * by the owner when its count drops to zero while other threads counted too. The decrements
+ * return 0 once the object is dead, and a non-zero count otherwise.
+ */
+void object_ref_increment_shared(Object *object);
+size_t object_ref_decrement_shared(Object *object);
+size_t object_ref_relinquish(Object *object);
+
+static inline bool object_ref_owned(const Object *object){
+    return __atomic_load_n(&object->owner, __ATOMIC_RELAXED) == object_owner_id;
+}
+
+static inline void object_ref_increment(Object *object){
+    if (object_ref_owned(object)){
+        object->ref_count++;
+    } else {
+        object_ref_increment_shared(object);
+    }
+}
+
+static inline size_t object_ref_decrement(Object *object){
+    if (!object_ref_owned(object)){
+        return object_ref_decrement_shared(object);
+    }
+    if (--object->ref_count > 0){
+        return object->ref_count;
+    }
+    // Nobody else ever counted, so the owner's count is the whole count
+    if (__atomic_load_n(&object->shared_count, __ATOMIC_ACQUIRE) == 0){
+        return 0;
+    }
+    return object_ref_relinquish(object);
+}
+
+/*
+ * object_ref_count - Returns the whole reference count of an Object, the owner's and the other
+ * threads' together. Only exact while no other thread changes it.
+ */
+size_t object_ref_count(const Object *object);
+
+// Full headers carry everything themselves, so there is no side table record to move or drop
+static inline void object_meta_move(const Object *from, const Object *to){
+    (void)from;
+    (void)to;
+}
+
+static inline void object_meta_drop(Object *object){
+    (void)object;
+}
+#endif
+
+/*
+ * object_references - Returns the edges of an Object as one array, with their number in *count
+ *
+ * The array is the object's inline slots or its spilled array, never a copy, and is only valid
+ * until the edges change. Safe to call while the mutator adds and removes edges, which the
+ * background marker does: a spilled array replaced meanwhile is not freed before marking ends, and
+ * an edge moved by a removal is shaded. Entries written concurrently are read with
+ * object_edge_load().
+ */
+static inline Object **object_references(const Object *object, size_t *count){
+    ObjectEdges *edges = object_edges(object);
+    if (edges == NULL){
+        *count = 0;
+        return NULL;
+    }
+    // Release and acquire, the array must not be seen before its entries and count
+    EdgeSpill *spill = __atomic_load_n(&edges->spill, __ATOMIC_ACQUIRE);
+    if (spill != NULL){
+        *count = __atomic_load_n(&spill->count, __ATOMIC_ACQUIRE);
+        return spill->items;
+    }
+    size_t inline_count = 0;
+    while (inline_count < GEECE_INLINE_EDGES && __atomic_load_n(&edges->inline_edges[inline_count], __ATOMIC_ACQUIRE) != NULL){
+        inline_count++;
+    }
+    *count = inline_count;
+    return edges->inline_edges;
+}
+
+/*
+ * object_edge_load - Reads an entry of the array returned by object_references() that another
+ * thread may be writing
+ */
+static inline Object *object_edge_load(Object *const *edge){
+    return __atomic_load_n(edge, __ATOMIC_RELAXED);
+}
+
+/*
+ * object_has_reference - Returns whether an Object has an edge to target, through the hash set of
+ * its spilled array once it has one
+ */
+bool object_has_reference(const Object *object, const Object *target);
+
+/*
+ * object_add_reference - Appends an edge to target, which must not be one already
+ *
+ * Returns: False if the edges could not grow
+ */
+bool object_add_reference(Object *object, Object *target);
+
+/*
+ * object_remove_reference - Removes the edge to target, moving the last edge into its place
+ *
+ * Returns: False if there was no such edge
+ */
+bool object_remove_reference(Object *object, Object *target);
+
+/*
+ * object_clear_references - Removes every edge of an Object and frees its spilled array
+ */
+void object_clear_references(Object *object);
+
+/*
+ * object_rehash_references - Rebuilds the hash set of an Object's edges after a collection
+ * rewrote the array returned by object_references() with the new addresses of moved objects
+ */
+void object_rehash_references(Object *object);
+
+/*
+ * spill_add_referrer - Appends referrer to an array of referrers, which it must not be in already,
+ * creating the array if *referrers is NULL
+ *
+ * Returns: False if the array could not grow
+ */
+bool spill_add_referrer(EdgeSpill **referrers, Object *referrer);
+
+/*
+ * spill_remove_referrer - Removes referrer from an array of referrers, moving the last one into
+ * its place
+ *
+ * Returns: False if it was not one
+ */
+bool spill_remove_referrer(EdgeSpill *referrers, Object *referrer);
+
+/*
+ * spill_replace_referrer - Replaces a referrer that moved by its new address
+ */
+void spill_replace_referrer(EdgeSpill *referrers, Object *from, Object *to);
+
+/*
+ * spill_rehash - Rebuilds the hash set of an array of referrers after a collection rewrote its
+ * items with the new addresses of moved objects
+ */
+void spill_rehash(EdgeSpill *referrers);
 
 /*
  * new_object - Creates a new Object
@@ -39,6 +387,25 @@ typedef void (*Destructor)(void *);
  */
 Object *new_object(size_t size, Destructor destructor);
 
+/*
+ * object_init - Initializes the header of a freshly allocated, zeroed Object
+ *
+ * object: The memory to initialize
+ * size: The size of the object's data
+ * destructor: The destructor function pointer to handle object cleanup
+ */
+void object_init(Object *object, size_t size, Destructor destructor);
+
+/*
+ * object_finalize - Releases the resources owned by an Object
+ *
+ * This function runs the Object's destructor and frees its outgoing references without
+ * releasing the Object's own memory. Finalizing an Object twice is harmless.
+ *
+ * object: The Object to finalize
+ */
+void object_finalize(Object *object);
+
 /*
  * destroy_object - Destroys an Object
  *
@@ -80,20 +447,47 @@ size_t get_refcount(Object *object);
 size_t object_get_size(Object *object);
 
 /*
- * object_get_data - Returns the data of an Object
+ * object_get_data - Returns the referrers of an Object
  *
- * This function returns a pointer to the data of an Object.
+ * This function returns the array of reference_referrers(), the objects with an edge to the Object,
+ * NULL unless geece_config.track_referrers is set.
  *
- * object: The Object to get the data of
+ * object: The Object to get the referrers of
  *
- * Returns: A pointer to the data of the Object
+ * Returns: The referrers of the Object, NULL if it has none
  */
 Object **object_get_data(Object *object);
 
+/*
+ * clear_reference_ptrs - Drops an Object from the reverse index and frees its referrers
+ *
+ * The edges to the Object are left as they are, so this is only for an Object that is dying.
+ *
+ * object: The Object whose referrers to drop
+ */
 void clear_reference_ptrs(Object *object);
 
-size_t object_get_references(const RootTable *table,const Object *object, Object ***out_references);
+/*
+ * object_get_references - Returns the edges of an Object without copying them
+ *
+ * table: Unused, kept for the callers of the old interface
+ * object: The Object whose edges to return
+ * out_references: Set to the array of object_references(), may be NULL to only count the edges
+ *
+ * Returns: The number of edges
+ */
+size_t object_get_references(const RootTable *table, const Object *object, Object ***out_references);
 
+/*
+ * object_get_reference_count_ptrs - Returns the number of objects with an edge to an Object
+ *
+ * table: The RootTable scanned for the rooted objects with an edge to the Object when the
+ *        reverse index is off
+ * object: The Object whose referrers to count
+ *
+ * Returns: The in-degree of the Object, read from the reverse index without a scan if
+ *          geece_config.track_referrers is set
+ */
 int object_get_reference_count_ptrs(RootTable *table, Object *object);
 
 #endif /* GEECE_OBJECT_H */
@@ -0,0 +1,270 @@
+/**
+ * @file page.h
+ * @brief Size-segregated pages that back the GeeCe heap.
+ *
+ * Small objects are carved out of fixed-size, size-aligned pages. Every page serves a single size
+ * class and threads its free blocks through an intrusive free list, so allocating or releasing a
+ * small object never has to go through the system allocator. Pages are mapped in segments
+ * directly from the operating system.
+ */
+
+#ifndef GEECE_PAGE_H
+#define GEECE_PAGE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define GEECE_PAGE_SIZE ((size_t)64 * 1024)              /**< Size and alignment of a heap page. */
+#define GEECE_PAGES_PER_SEGMENT 64                       /**< Pages mapped from the OS at once. */
+#define GEECE_SIZE_CLASS_COUNT 32                        /**< Number of small size classes. */
+#define GEECE_MAX_SMALL_SIZE ((size_t)8192)              /**< Largest block served from pages. */
+#define GEECE_MIN_BLOCK_SIZE ((size_t)16)                /**< Smallest block and block alignment. */
+#define GEECE_PAGE_BITMAP_WORDS (GEECE_PAGE_SIZE / GEECE_MIN_BLOCK_SIZE / 64) /**< Words of a per-block bitmap. */
+
+/**
+ * @brief A free block, linked through its first word.
+ */
+typedef struct FreeBlock {
+    struct FreeBlock *next;
+} FreeBlock;
+
+struct Tlab;
+
+/**
+ * @brief Header placed at the start of every heap page.
+ *
+ * A page is either owned by one thread's allocation buffer, which then allocates from and frees
+ * into `free_list` without synchronization, or sits on one of its size class's shared lists.
+ * Other threads hand blocks of an owned page back through `remote_free` and notify the owner
+ * through its `remote_pages` stack.
+ */
+typedef struct Page {
+    struct Page *next;          /**< Next page in the owning list. */
+    struct Page *prev;          /**< Previous page in the owning list. */
+    FreeBlock *free_list;       /**< Blocks of this page that are ready for reuse. */
+    _Atomic(FreeBlock *) remote_free; /**< Blocks freed by threads other than the owner. */
+    struct Tlab *owner;         /**< Allocation buffer owning the page, NULL for shared pages. */
+    struct Page *remote_next;   /**< Next page on the owner's `remote_pages` stack. */
+    atomic_bool remote_notified; /**< True while the page sits on the owner's `remote_pages`. */
+    char *blocks;               /**< Address of the first block. */
+    size_t block_size;          /**< Size in bytes of every block in the page. */
+    unsigned int size_class;    /**< Index of the size class served by the page. */
+    unsigned int block_count;   /**< Number of blocks carved out of the page. */
+    unsigned int used_count;    /**< Number of blocks currently handed out. */
+    bool full;                  /**< True while the page sits on a full list. */
+    bool unswept;               /**< True while the page waits on an unswept list for a lazy sweep. */
+    uint64_t marks[GEECE_PAGE_BITMAP_WORDS]; /**< Mark bit of every block, set by the full collection. */
+} Page;
+
+/**
+ * @brief Maps a block size to the index of the smallest size class that can hold it.
+ *
+ * Classes are spaced 16 bytes apart up to 128 bytes, then four classes per power of two up to
+ * GEECE_MAX_SMALL_SIZE, which bounds internal fragmentation at 25%.
+ *
+ * @param size The requested block size in bytes. Must be in (0, GEECE_MAX_SMALL_SIZE].
+ * @return The size class index.
+ */
+unsigned int page_size_class(size_t size);
+
+/**
+ * @brief Returns the block size served by a size class.
+ *
+ * @param size_class The size class index.
+ * @return The block size in bytes.
+ */
+size_t page_class_block_size(unsigned int size_class);
+
+/**
+ * @brief Returns the page containing an address that was handed out by the page allocator.
+ *
+ * @param ptr A pointer into a heap page.
+ * @return The page header.
+ */
+static inline Page *page_of(const void *ptr){
+    return (Page *)((uintptr_t)ptr & ~(uintptr_t)(GEECE_PAGE_SIZE - 1));
+}
+
+/* Page directory entry of a granule holding no heap memory, and of a formatted size-class page.
+ * Entries in between count the large objects whose mapping touches the granule. */
+#define PAGE_DIRECTORY_NONE 0
+#define PAGE_DIRECTORY_SMALL 0xFF
+#define PAGE_DIRECTORY_LEAF_BITS 16     /**< Granules covered by one leaf, as a power of two. */
+
+/**
+ * @brief Two-level map from every GEECE_PAGE_SIZE granule of the address space to what the heap
+ * keeps in it, so that any word can be checked for pointing into the heap in two loads. Leaves
+ * are allocated the first time a granule they cover is entered. Covers the lower 2^48 bytes of
+ * the address space, where user mappings live.
+ */
+extern _Atomic(uint8_t *) page_directory[(size_t)1 << (48 - 16 - PAGE_DIRECTORY_LEAF_BITS)];
+
+/**
+ * @brief Returns the page directory entry of the granule holding an address.
+ */
+static inline uint8_t page_directory_lookup(const void *ptr){
+    uintptr_t granule = (uintptr_t)ptr / GEECE_PAGE_SIZE;
+    if (granule >> (48 - 16) != 0){
+        return PAGE_DIRECTORY_NONE;
+    }
+    uint8_t *leaf = atomic_load_explicit(&page_directory[granule >> PAGE_DIRECTORY_LEAF_BITS], memory_order_acquire);
+    if (leaf == NULL){
+        return PAGE_DIRECTORY_NONE;
+    }
+    return __atomic_load_n(&leaf[granule & (((uintptr_t)1 << PAGE_DIRECTORY_LEAF_BITS) - 1)], __ATOMIC_RELAXED);
+}
+
+/**
+ * @brief Enters a page as a size-class page, or as no heap memory once it stops serving a size
+ * class.
+ */
+void page_directory_set_small(const Page *page, bool small);
+
+/**
+ * @brief Counts a large object's mapping in, or out with `delta` -1, of every granule it touches.
+ */
+void page_directory_add_large(const void *start, size_t size, int delta);
+
+/**
+ * @brief Maps a new segment from the operating system and returns its pages as a linked list.
+ *
+ * @return The first page of the segment, or NULL if the mapping failed.
+ */
+Page *page_map_segment(void);
+
+/**
+ * @brief Formats an empty page so it serves blocks of the given size class.
+ *
+ * @param page The page to format.
+ * @param size_class The size class the page will serve.
+ */
+void page_format(Page *page, unsigned int size_class);
+
+/**
+ * @brief Sets the bit of every block of a page that sits on its local or remote free list.
+ *
+ * @param page The page to inspect.
+ * @param bitmap GEECE_PAGE_BITMAP_WORDS words, cleared by the call before the bits are set.
+ */
+void page_free_bitmap(const Page *page, uint64_t *bitmap);
+
+/**
+ * @brief Tests the bit of a block in a per-block bitmap.
+ */
+static inline bool page_bitmap_test(const uint64_t *bitmap, size_t index){
+    return (bitmap[index / 64] >> (index % 64)) & 1;
+}
+
+/**
+ * @brief Sets the bit of a block in a per-block bitmap.
+ */
+static inline void page_bitmap_set(uint64_t *bitmap, size_t index){
+    bitmap[index / 64] |= (uint64_t)1 << (index % 64);
+}
+
+/**
+ * @brief Returns the index of the block holding an address in a page.
+ */
+static inline size_t page_block_index(const Page *page, const void *ptr){
+    return (size_t)((const char *)ptr - page->blocks) / page->block_size;
+}
+
+/**
+ * @brief Pops a block from a page's free list.
+ *
+ * @param page The page to allocate from.
+ * @return The block, or NULL if the page has no free blocks.
+ */
+static inline void *page_alloc_block(Page *page){
+    FreeBlock *block = page->free_list;
+    if (block == NULL){
+        return NULL;
+    }
+    page->free_list = block->next;
+    page->used_count++;
+    return block;
+}
+
+/**
+ * @brief Pushes a block back onto its page's free list.
+ *
+ * @param page The page owning the block.
+ * @param block The block to release.
+ */
+static inline void page_free_block(Page *page, void *block){
+    FreeBlock *free_block = block;
+    free_block->next = page->free_list;
+    page->free_list = free_block;
+    page->used_count--;
+}
+
+/**
+ * @brief Pushes a page onto the front of a doubly linked page list.
+ */
+static inline void page_list_push(Page **list, Page *page){
+    page->prev = NULL;
+    page->next = *list;
+    if (*list != NULL){
+        (*list)->prev = page;
+    }
+    *list = page;
+}
+
+/**
+ * @brief Unlinks a page from a doubly linked page list.
+ */
+static inline void page_list_remove(Page **list, Page *page){
+    if (page->prev != NULL){
+        page->prev->next = page->next;
+    } else {
+        *list = page->next;
+    }
+    if (page->next != NULL){
+        page->next->prev = page->prev;
+    }
+    page->next = NULL;
+    page->prev = NULL;
+}
+
+/**
+ * @brief Pushes a block freed by a thread that does not own its page onto the remote free list.
+ *
+ * @param page The page owning the block.
+ * @param block The block to release.
+ */
+static inline void page_free_remote(Page *page, void *block){
+    FreeBlock *free_block = block;
+    FreeBlock *head = atomic_load_explicit(&page->remote_free, memory_order_relaxed);
+    do {
+        free_block->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&page->remote_free, &head, free_block,
+                                                    memory_order_release, memory_order_relaxed));
+}
+
+/**
+ * @brief Moves the blocks on a page's remote free list onto its local free list.
+ *
+ * @param page The page to collect remote frees for. Must be called by the page's owner or with
+ *             the heap lock held.
+ * @return The number of blocks collected.
+ */
+static inline unsigned int page_collect_remote(Page *page){
+    if (atomic_load_explicit(&page->remote_free, memory_order_relaxed) == NULL){
+        return 0;
+    }
+    FreeBlock *block = atomic_exchange_explicit(&page->remote_free, NULL, memory_order_acquire);
+    unsigned int count = 0;
+    while (block != NULL){
+        FreeBlock *next = block->next;
+        block->next = page->free_list;
+        page->free_list = block;
+        block = next;
+        count++;
+    }
+    page->used_count -= count;
+    return count;
+}
+
+#endif /* GEECE_PAGE_H */
@@ -0,0 +1,109 @@
+/**
+ * @file reference.h
+ * @brief Reverse index of the edges: the referrers of every object, for O(1) in-degree queries.
+ *
+ * With `geece_config.track_referrers` set, every edge added with `add_reference()` is also recorded
+ * at its target, which has the objects pointing to it kept in the same kind of array as its own
+ * edges, hashed once it grows, so its in-degree is the length of that array and its referrers are
+ * listed without a scan of the root table. The arrays live outside of the objects, in a set of
+ * hash tables from targets to their referrers, so objects pay nothing for the index while it is
+ * off, when every function here does nothing; the setting must not change once edges were added.
+ * A target enters the index with its first referrer and leaves it with its last.
+ *
+ * A referrer that dies leaves the referrers of its targets, but not by itself: reference counting,
+ * the cycle collector, arenas and minor collections unlink every object they destroy while its
+ * targets are still there, and a full collection drops the objects it is about to sweep from the
+ * referrers of the objects it keeps, once marking finished, so the sweep touches none of them.
+ * Moving collections rekey the targets and forward the referrers.
+ *
+ * The index is split into `GEECE_REFERENCE_STRIPES` stripes, each with a lock of its own, picked by
+ * the target's address, so threads writing edges to different targets run side by side.
+ */
+
+#ifndef GEECE_REFERENCE_H
+#define GEECE_REFERENCE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "object.h"
+
+/**
+ * @brief Number of locks the referrers of the objects are spread over.
+ */
+#define GEECE_REFERENCE_STRIPES 32
+
+/**
+ * @brief Records an edge from `object` to `target` at the target. Called once the edge was added.
+ *
+ * @param object The object holding the edge.
+ * @param target The object it points to.
+ * @return False if the referrers of the target could not grow.
+ */
+bool reference_link(Object *object, Object *target);
+
+/**
+ * @brief Forgets an edge from `object` to `target` at the target. Called once the edge was removed.
+ *
+ * @param object The object that held the edge.
+ * @param target The object it pointed to.
+ */
+void reference_unlink(Object *object, Object *target);
+
+/**
+ * @brief Forgets every edge of an object at their targets, which must not have been freed. Called
+ * before the edges are cleared, or before an object dies outside of a full collection's sweep.
+ * Targets a running minor collection moved are found at their new address.
+ *
+ * @param object The object.
+ */
+void reference_unlink_all(Object *object);
+
+/**
+ * @brief Drops an object from the index and frees its referrers. Called when the object dies.
+ *
+ * @param object The object.
+ */
+void reference_forget(Object *object);
+
+/**
+ * @brief Follows an object a minor collection copied: its referrers, and its entries in the
+ * referrers of its targets. Called once `from` is forwarded to `to`.
+ *
+ * @param from The stale copy.
+ * @param to The new copy.
+ */
+void reference_moved(Object *from, Object *to);
+
+/**
+ * @brief Drops the objects a full collection is about to sweep from the index and from the
+ * referrers of the objects it keeps, and drops the objects left without referrers. Called once marking
+ * finished, before the sweep.
+ */
+void reference_forget_unmarked(void);
+
+/**
+ * @brief Points the index and the referrers at the new addresses of the objects compaction moves.
+ * Called before the objects move.
+ *
+ * @param forward Returns the new address of an object.
+ */
+void reference_forward(Object *(*forward)(Object *object));
+
+/**
+ * @brief Returns the objects with an edge to an object.
+ *
+ * The array belongs to the index and is only valid until an edge to the object is added or
+ * removed. Only the mutator reads it, so unlike `object_references()` it needs no atomics.
+ *
+ * @param object The object.
+ * @param count Set to the number of referrers.
+ * @return The referrers, NULL if the object has none or the index is off.
+ */
+Object **reference_referrers(const Object *object, size_t *count);
+
+/**
+ * @brief Returns the number of objects in the index, those with referrers.
+ */
+size_t reference_indexed(void);
+
+#endif /* GEECE_REFERENCE_H */
@@ -0,0 +1,181 @@
+/**
+ * @file reference_counting.h
+ * @brief Deferred reference counting with a zero-count table.
+ *
+ * With `geece_config.deferred_rc` set, reference counts only cover references from the heap: the
+ * edges added with `add_reference()` and the fields written with `geece_write_field()`. Local
+ * variables, stacks and the root table are not counted, so allocating an object leaves its count
+ * at zero and `geece_release()` has nothing to drop. An old object whose count is zero goes into
+ * the zero-count table instead of being destroyed, since a root may still hold it.
+ *
+ * A reconciliation counts the references of the root table, the open arenas, the handles and the
+ * registered thread stacks for as long as it runs, then destroys the objects of the table that are
+ * still at zero. Destroying an object drops the counts of the objects it references, which enter
+ * the table in turn. A reconciliation destroys a bounded number of objects and leaves the rest of the table
+ * to the next one, so a large structure is freed a chunk at a time by the allocations that follow
+ * rather than all at once by the release that dropped it.
+ *
+ * Young and arena objects stay with their minor collections and arenas, and objects whose counts
+ * never drop to zero again, cycles among them, are left to the full collections. Pointers held in
+ * local variables of threads that are not registered with `geece_register_thread()` are not seen
+ * by the root scan, so a reconciliation needs them kept in the root table, as a collection does.
+ *
+ * Counts are safe to change from any thread. With full headers they are biased towards the thread
+ * that allocated the object: its owner counts without atomics and the other threads count in a
+ * separate atomic count. When the other threads drop more references than they took, the object
+ * is queued for its owner, which merges both counts and destroys the object if they add up to
+ * zero when it calls `geece_rc_merge()`; allocations call it too. Compact headers have no room
+ * for an owner, every thread changes their count with a compare-and-swap of the header word.
+ */
+
+#ifndef GEECE_REFERENCE_COUNTING_H
+#define GEECE_REFERENCE_COUNTING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "configuration.h"
+#include "cycle_collector.h"
+#include "object.h"
+#include "root_table.h"
+
+#ifndef GEECE_COMPACT_HEADER
+/**
+ * @brief Gives the calling thread an owner id. Ids are not reused, so that the objects of a thread
+ * that exited are known to have no owner left.
+ *
+ * @return The id, never 0.
+ */
+uint32_t rc_register_owner(void);
+
+/**
+ * @brief Returns the owner id of the calling thread, giving it one first if needed.
+ */
+static inline uint32_t rc_owner(void){
+    return object_owner_id != 0 ? object_owner_id : rc_register_owner();
+}
+
+/**
+ * @brief Queues an object for its owner to merge its counts, after another thread dropped the
+ * shared count below zero.
+ *
+ * @param object The object.
+ * @param owner Its owner.
+ * @return False if the owner exited, in which case the caller merges the counts itself.
+ */
+bool rc_queue(Object *object, uint32_t owner);
+#endif
+
+/**
+ * @brief Merges the counts of the objects other threads queued for the calling thread, and
+ * destroys those that are dead, or puts them in the zero-count table with deferred reference
+ * counting. Cheap when nothing is queued, called by `geece_malloc()` and when a thread exits.
+ */
+void geece_rc_merge(void);
+
+/**
+ * @brief Records an object whose count dropped to zero in the zero-count table. Objects already in
+ * the table, young objects and arena objects are skipped.
+ *
+ * @param object The object.
+ */
+void rc_zero(Object *object);
+
+/**
+ * @brief Drops a heap reference to an object, moving it to the zero-count table once deferred
+ * reference counting is enabled and its count reaches zero.
+ *
+ * @param object The object.
+ */
+static inline void rc_decrement(Object *object){
+    if (object_ref_decrement(object) != 0){
+        cycle_candidate(object);
+    } else if (geece_config.deferred_rc){
+        rc_zero(object);
+    }
+}
+
+/**
+ * @brief Destroys an object whose count dropped to zero, unless it is buffered as a candidate of
+ * the cycle collector, which destroys it when it empties its buffer.
+ *
+ * @param object The object.
+ */
+void rc_destroy(Object *object);
+
+/**
+ * @brief Removes an object the cycle collector destroys from the zero-count table.
+ *
+ * @param object The object, flagged OBJECT_ZCT.
+ */
+void rc_table_remove(Object *object);
+
+/**
+ * @brief Merges the counts of the objects queued for every owner, as each owner would with
+ * `geece_rc_merge()`. Must only be called while no other thread is allocating or mutating objects.
+ */
+void rc_merge_all(void);
+
+/**
+ * @brief Counts the references of the root table, the open arenas, the handles and the registered
+ * thread stacks until `rc_release_roots()`, so that no rooted object drops to zero meanwhile. Objects allocated
+ * until then are held as well.
+ *
+ * @param roots The root table, may be NULL.
+ * @return False if the roots are already held, or could not all be counted.
+ */
+bool rc_hold_roots(RootTable *roots);
+
+/**
+ * @brief Drops the references counted by `rc_hold_roots()`.
+ */
+void rc_release_roots(void);
+
+/**
+ * @brief Drops the count a new object starts with, since the local variable it is returned to is
+ * not counted, and records it in the zero-count table. Called by the allocator when deferred
+ * reference counting is enabled.
+ *
+ * @param object The new object.
+ */
+void rc_allocated(Object *object);
+
+/**
+ * @brief Returns the number of objects in the zero-count table.
+ */
+size_t rc_pending(void);
+
+/**
+ * @brief Returns whether an allocation should reconcile the zero-count table: either the last
+ * reconciliation left objects it had no budget to look at, or `geece_config.rc_table_limit`
+ * objects entered the table since.
+ */
+bool rc_reconcile_due(void);
+
+/**
+ * @brief Reconciles the zero-count table against the roots and destroys up to `budget` of the
+ * objects no root holds, the ones entering the table meanwhile included. Does nothing while a full
+ * collection is marking. Must only be called while no other thread is allocating or mutating
+ * objects.
+ *
+ * @param roots The root table, may be NULL.
+ * @param budget The most objects to destroy.
+ * @return The number of objects destroyed.
+ */
+size_t rc_reconcile(RootTable *roots, size_t budget);
+
+/**
+ * @brief Drops the objects a full collection is about to sweep from the zero-count table. Called
+ * once marking finished, before the sweep.
+ */
+void rc_forget_unmarked(void);
+
+/**
+ * @brief Points the entries of the zero-count table at the new addresses of the objects
+ * compaction moves. Called before the objects move.
+ *
+ * @param forward Returns the new address of an object.
+ */
+void rc_forward(Object *(*forward)(Object *object));
+
+#endif /* GEECE_REFERENCE_COUNTING_H */
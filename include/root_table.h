@@ -11,42 +11,232 @@
 #define GEECE_ROOT_TABLE_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "object.h"
 
+typedef struct Object Object;
+
 /**
- * @brief A structure representing a bucket in a hash table.
+ * @brief The largest number of shards of a sharded RootTable.
  */
-typedef struct Bucket Bucket;
-typedef struct Object Object;
+#define GEECE_ROOT_TABLE_MAX_SHARDS 1024
+
+/**
+ * @brief A slot of the root set, keyed by the address of the object it holds.
+ */
+typedef struct {
+    Object *object; /**< The rooted object, NULL for an empty slot. */
+    size_t holds; /**< How many keys and registrations root the object, it leaves the set at zero. */
+} RootSlot;
+
+/**
+ * @brief A slot of the string keys laid over the root set.
+ */
+typedef struct {
+    char *key; /**< The key, owned by the caller or copied by a sharded table, NULL for an empty slot. */
+    unsigned int hash; /**< The hash of the key, kept so that rehashing never reads the key again. */
+    bool moved; /**< The entry of an old array that a resize already moved to the new one. */
+    Object *object; /**< The object registered under the key, may be NULL. */
+} RootKey;
+
 /**
  * @brief A structure representing a hash table for holding the root set of objects in GeeCe's mark-and-sweep garbage collector.
+ *
+ * The roots themselves are an open-addressed set of object pointers with linear probing, kept in
+ * one flat array without a heap allocation per root. The string keys of `add_to_root_table()` are
+ * a second open-addressed table whose entries root their object in the set, so an object
+ * registered under several keys is held once per key.
+ *
+ * Both tables double once three quarters full and halve once less than an eighth full, down to
+ * their initial capacity. A resize is incremental: the new array is allocated next to the old one
+ * and every insert and removal that follows moves a few old slots over, so that no single
+ * operation rehashes the whole table. Until then, lookups try both arrays.
+ *
+ * A table made by `init_sharded_root_table()` is safe to use from several threads at once. It is
+ * split into shards, each a table of its own under a lock: an object is rooted in the shard its
+ * address hashes to and a key lives in the shard its string hashes to, so threads working on
+ * different shards never wait for each other. `get_from_root_table()` takes no lock at all: it
+ * reads the keys of its shard optimistically and retries if a writer changed them meanwhile, and
+ * the keys and arrays the writers drop are freed only once no such read can still hold them. The
+ * keys of a sharded table are copied, the caller's strings are not kept. Collections walk a
+ * sharded table through a snapshot, see `root_table_snapshot()`, and only hold every shard at once
+ * to take it.
  */
 typedef struct RootTable {
-    Bucket **bucket_heads;
-    size_t bucket_count; /**< The number of buckets in the hash table. */
+    RootSlot *slots; /**< The root set, a power of two slots. */
+    size_t capacity; /**< The number of slots of the root set. */
+    size_t count; /**< The number of objects in the root set, both arrays together. */
+    RootSlot *old_slots; /**< The root set a resize moves away from, NULL when none runs. */
+    size_t old_capacity; /**< The number of slots of old_slots, 0 when no resize runs. */
+    size_t migrated; /**< Old slots below this index were moved to slots. */
+    RootKey *keys; /**< The string keys, a power of two slots. */
+    size_t key_capacity; /**< The number of slots of the string keys. */
+    size_t key_count; /**< The number of string keys, both arrays together. */
+    RootKey *old_keys; /**< The string keys a resize moves away from, NULL when none runs. */
+    size_t old_key_capacity; /**< The number of slots of old_keys, 0 when no resize runs. */
+    size_t keys_migrated; /**< Old keys below this index were moved to keys. */
+    size_t min_capacity; /**< Neither table shrinks below this many slots. */
+    struct RootShards *shards; /**< The shards of a table shared between threads, NULL otherwise. */
 } RootTable;
 
 /**
- * @brief A structure representing a bucket in a hash table.
+ * @brief Computes a hash value for a string key.
+ *
+ * @param key The key to compute the hash value for.
+ *
+ * @return The computed hash value.
  */
-struct Bucket {
-    char *key; /**< A string key that identifies the object stored in the bucket. */
-    Object *object; /**< A pointer to the object stored in the bucket. */
-    Bucket *next; /**< A pointer to the next bucket in the hash table's linked list. */
-};
+unsigned int geece_hash(const char *key);
 
-typedef struct ObjectNode{
-    Object *object;
-    struct ObjectNode *next;
-}ObjectNode;
 /**
- * @brief Computes a hash value for an object.
+ * @brief Mixes the bits of an object address into a hash value for the root set.
  *
  * @param object The object to compute the hash value for.
  *
  * @return The computed hash value.
  */
-unsigned int geece_hash(const char *key);
+static inline size_t geece_hash_pointer(const Object *object){
+    // Fibonacci hashing, the high bits of the product depend on every bit of the address
+    uint64_t hash = (uint64_t)(uintptr_t)object * UINT64_C(0x9E3779B97F4A7C15);
+    return (size_t)(hash ^ (hash >> 32));
+}
+
+/**
+ * @brief Roots an object in a RootTable by its address. An object rooted several times stays in
+ * the table until it was removed as many times.
+ *
+ * @param table The RootTable to add the object to.
+ * @param object The object to root, not NULL.
+ *
+ * @return True if the object was rooted, false if memory allocation failed.
+ */
+bool root_table_add(RootTable *table, Object *object);
+
+/**
+ * @brief Drops one hold of an object rooted with `root_table_add()` or under a key.
+ *
+ * @param table The RootTable to remove the object from.
+ * @param object The object to remove.
+ *
+ * @return True if the object was rooted, false otherwise.
+ */
+bool root_table_remove(RootTable *table, Object *object);
+
+/**
+ * @brief Returns whether an object is rooted in a RootTable, in constant expected time.
+ *
+ * @param table The RootTable to look in.
+ * @param object The object to look for.
+ */
+bool root_table_contains(const RootTable *table, const Object *object);
+
+/**
+ * @brief Returns whether a RootTable was made by `init_sharded_root_table()`.
+ *
+ * @param table The RootTable.
+ */
+static inline bool root_table_is_sharded(const RootTable *table){
+    return table->shards != NULL;
+}
+
+/**
+ * @brief Returns the number of slots of a RootTable's root set, those of a running resize's old
+ * array included. Slots are indexed from 0 to this count by `root_table_slot()`. A sharded table
+ * has none, its roots are walked with `root_table_for_each()`.
+ *
+ * @param table The RootTable.
+ */
+static inline size_t root_table_slot_count(const RootTable *table){
+    return table->capacity + table->old_capacity;
+}
+
+/**
+ * @brief Returns the object of a slot of a RootTable's root set, so that a walk can be split
+ * between threads by slot ranges.
+ *
+ * @param table The RootTable.
+ * @param index The slot, below `root_table_slot_count()`.
+ *
+ * @return The object, or NULL for an empty slot or an old slot already moved.
+ */
+static inline Object *root_table_slot(const RootTable *table, size_t index){
+    const RootSlot *slot = index < table->capacity ? &table->slots[index] : &table->old_slots[index - table->capacity];
+    return slot->holds > 0 ? slot->object : NULL;
+}
+
+/**
+ * @brief Moves whatever a running resize left in the old arrays of a RootTable, so that only
+ * `slots` and `keys` hold entries.
+ *
+ * @param table The RootTable, may be NULL.
+ */
+void root_table_finish_resize(RootTable *table);
+
+/**
+ * @brief Calls visit on every object of a RootTable once, whatever the number of its holds. A
+ * sharded table is walked through a snapshot taken for the walk.
+ *
+ * @param table The RootTable to walk, may be NULL.
+ * @param visit The function to call.
+ */
+void root_table_for_each(const RootTable *table, void (*visit)(Object *object));
+
+/**
+ * @brief Counts the objects of a RootTable with an edge to an object, by scanning the root set.
+ * This is the in-degree queries fall back to when `geece_config.track_referrers` is off.
+ *
+ * @param table The RootTable to scan, may be NULL.
+ * @param object The object whose referrers to count.
+ * @return The number of rooted objects with an edge to the object.
+ */
+size_t root_table_count_referrers(const RootTable *table, const Object *object);
+
+/**
+ * @brief Takes a snapshot of the root set of a sharded RootTable, as it is at one instant.
+ *
+ * The snapshot is taken in a handshake: every shard is locked just long enough to set its arrays
+ * aside, then writers go on. A writer that changes a shard while the snapshot is held copies the
+ * shard's arrays first and leaves the originals to the snapshot, so walking it never blocks them.
+ * One snapshot of a table is held at a time, a second waits for `root_table_release_snapshot()`.
+ * Does nothing for a table that is not sharded.
+ *
+ * @param table The RootTable, may be NULL.
+ */
+void root_table_snapshot(const RootTable *table);
+
+/**
+ * @brief Calls visit on every object of the snapshot of a RootTable once. A table that is not
+ * sharded is walked as it is.
+ *
+ * @param table The RootTable whose snapshot was taken, may be NULL.
+ * @param visit The function to call.
+ */
+void root_table_snapshot_for_each(const RootTable *table, void (*visit)(Object *object));
+
+/**
+ * @brief Drops the snapshot of a RootTable and frees the arrays writers left to it.
+ *
+ * @param table The RootTable, may be NULL.
+ */
+void root_table_release_snapshot(const RootTable *table);
+
+/**
+ * @brief Calls visit on every string key of a RootTable and the object registered under it.
+ *
+ * @param table The RootTable to walk, may be NULL.
+ * @param visit The function to call, the object may be NULL.
+ */
+void root_table_for_each_key(const RootTable *table, void (*visit)(const char *key, Object *object));
+
+/**
+ * @brief Replaces every object of a RootTable, keys included, with what forward returns for it,
+ * rehashing the objects whose address changed. forward is called once per object of the root set.
+ *
+ * @param table The RootTable to update, may be NULL.
+ * @param forward Returns the new address of an object.
+ */
+void root_table_forward(RootTable *table, Object *(*forward)(Object *object));
 
 /**
  * @brief Initializes a RootTable structure with the given initial capacity.
@@ -58,6 +248,21 @@ unsigned int geece_hash(const char *key);
  */
 RootTable *init_root_table(RootTable *table, size_t initial_capacity);
 
+/**
+ * @brief Initializes a RootTable that several threads may use at once, split into shards.
+ *
+ * Sharding is opt-in: a plain table behind a caller's mutex stays the default for threads sharing
+ * roots, as the sharded table has only been measured against it on a single CPU, where it is slower.
+ *
+ * @param table The RootTable structure to initialize, or NULL to allocate one.
+ * @param shard_count The number of shards, rounded up to a power of two of at most
+ * `GEECE_ROOT_TABLE_MAX_SHARDS`. A few times the number of threads keeps them from meeting.
+ * @param initial_capacity The initial capacity of the whole table, spread over the shards.
+ *
+ * @return The table, or NULL if memory allocation failed.
+ */
+RootTable *init_sharded_root_table(RootTable *table, size_t shard_count, size_t initial_capacity);
+
 /**
  * @brief Adds an object to a RootTable.
  *
@@ -108,7 +313,8 @@ bool clear_root_table(RootTable *table);
 bool destroy_root_table(RootTable *table);
 
 /**
- * @brief Rehashes a RootTable, increasing the number of buckets by a factor of 2.
+ * @brief Rehashes a RootTable at once, doubling the number of slots of both the root set and the
+ * keys. The table then never shrinks below its new size.
  *
  * @param table The RootTable to rehash.
  */
@@ -122,7 +328,7 @@ bool rehash_root_table(RootTable *table);
  * @param referenced_object The object being referenced.
  * @return True if the reference was successfully added, false otherwise.
  */
-bool add_referece(RootTable *table, Object *object, Object *referenced_object);
+bool add_reference(RootTable *table, Object *object, Object *referenced_object);
 
 /**
  * @brief Removes a reference to a referenced object from an object in the RootTable.
@@ -135,13 +341,15 @@ bool add_referece(RootTable *table, Object *object, Object *referenced_object);
 bool remove_reference(RootTable *table, Object *object, Object *reference);
 
 /**
- * @brief Returns a pointer to the list of objects referenced by the given object in the RootTable.
+ * @brief Returns the objects referenced by the given object in the RootTable, as the array the
+ * object keeps them in. The array is only valid until the object's references change.
  *
  * @param table The RootTable containing the objects.
  * @param object The object whose referenced objects are to be returned.
- * @return A pointer to the list of objects referenced by the given object, or NULL if the object was not found.
+ * @param count Set to the number of referenced objects, 0 if the object was not found.
+ * @return The referenced objects, or NULL if the object was not found.
  */
-ObjectNode *get_references(RootTable *table, Object *object);
+Object **get_references(RootTable *table, Object *object, size_t *count);
 
 /**
  * @brief Returns the number of references to a given object in the RootTable.
@@ -153,20 +361,25 @@ ObjectNode *get_references(RootTable *table, Object *object);
 int get_reference_count(RootTable *table, Object *object);
 
 /**
- * @brief Removes an object from the RootTable, including all references to the object.
+ * @brief Removes every edge of an object of the RootTable, dropping the count each one held on
+ * its target. The object itself stays in the table with its holds and keys, it leaves it with
+ * `root_table_remove()` or `remove_from_root_table()`.
  *
  * @param table The RootTable containing the object.
- * @param object The object to be removed.
- * @return True if the object was successfully removed, false otherwise.
+ * @param object The object whose edges are to be removed.
+ * @return True if the edges were removed, false if the object is not in the table.
  */
 bool remove_object(RootTable *table, Object *object);
 
 /**
- * @brief Returns the number of objects in the RootTable that reference the given object.
+ * @brief Returns the number of references to the given object: its holds in the RootTable plus
+ * the edges pointing to it. With `geece_config.track_referrers` set these are read from the
+ * reverse index in constant time, otherwise only the edges of rooted objects are counted, by a
+ * scan of the root set.
  *
  * @param table The RootTable containing the objects.
  * @param object The object whose count of references is to be returned.
- * @return The number of objects in the RootTable that reference the given object, or 0 if the object was not found.
+ * @return The number of references to the given object, or 0 if the object was not found.
  */
 int get_object_count(RootTable *table, Object *object);
 
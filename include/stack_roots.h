@@ -0,0 +1,49 @@
+/**
+ * @file stack_roots.h
+ * @brief Conservative scanning of thread stacks and registers for roots.
+ *
+ * Threads that register with `geece_register_thread()` have their stack scanned by every full
+ * collection, on top of the registered root table: any word from the stack pointer up to the base
+ * of the stack that points into a size-class page or a large object keeps that object alive, even
+ * if it only points into its middle. The registers of the collecting thread are spilled to its
+ * stack first; other registered threads are stopped with a signal while their stack is scanned, so
+ * their registers are saved on their stack by the kernel.
+ *
+ * The scan is conservative: an integer that happens to look like a pointer keeps an object alive,
+ * and objects it finds are never moved by compaction. Young objects move on every minor collection
+ * and objects of ended arenas are not in the page directory, so registering needs the nursery
+ * disabled and arena objects are only kept alive by their arena or by references from the heap.
+ */
+
+#ifndef GEECE_STACK_ROOTS_H
+#define GEECE_STACK_ROOTS_H
+
+#include <stdbool.h>
+#include "object.h"
+
+/**
+ * @brief Registers the calling thread, so that collections scan its stack for roots.
+ *
+ * The thread is unregistered when it exits, or by `geece_unregister_thread()`. Registering
+ * twice has no effect.
+ *
+ * @return True on success, false if the nursery is enabled, the stack could not be located or the
+ *         signals used to stop threads could not be installed.
+ */
+bool geece_register_thread(void);
+
+/**
+ * @brief Unregisters the calling thread, whose stack is no longer scanned.
+ */
+void geece_unregister_thread(void);
+
+/**
+ * @brief Calls `visit` for every object a word of a registered stack points into, each object
+ * once. Other registered threads are stopped for as long as their stacks are read. Must only be
+ * called while no other thread is allocating or mutating objects.
+ *
+ * @param visit The function to call.
+ */
+void stack_roots_scan(void (*visit)(Object *object));
+
+#endif /* GEECE_STACK_ROOTS_H */
@@ -0,0 +1,26 @@
+/**
+ * @file timer.h
+ * @brief Monotonic timing helpers used for collector statistics and benchmarks.
+ */
+
+#ifndef GEECE_TIMER_H
+#define GEECE_TIMER_H
+
+#include <stdint.h>
+
+/**
+ * @brief Returns the current value of the monotonic clock.
+ *
+ * @return The time in nanoseconds since an unspecified starting point.
+ */
+uint64_t timer_now_ns(void);
+
+/**
+ * @brief Returns the nanoseconds elapsed since a previous call to `timer_now_ns()`.
+ *
+ * @param start The value returned by `timer_now_ns()` at the start of the measured interval.
+ * @return The elapsed time in nanoseconds.
+ */
+uint64_t timer_elapsed_ns(uint64_t start);
+
+#endif /* GEECE_TIMER_H */
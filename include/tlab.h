@@ -0,0 +1,120 @@
+/**
+ * @file tlab.h
+ * @brief Thread-local allocation buffers.
+ *
+ * Every thread allocating from the GeeCe heap gets a Tlab. It owns the pages it allocated from and
+ * a chunk of eden when the nursery is enabled, and allocates from and frees into them without
+ * locks or atomic read-modify-write operations. The shared heap is only locked to hand out a fresh
+ * page or eden chunk once the thread's own run out, and for frees coming from other threads.
+ * Allocated and freed bytes are counted per thread and only summed up when the heap's usage is
+ * queried. Owned pages go back to the shared heap when the thread exits.
+ */
+
+#ifndef GEECE_TLAB_H
+#define GEECE_TLAB_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include "page.h"
+
+#define GEECE_SATB_BUFFER_SIZE 256   /**< Shaded objects a thread buffers before handing them to the marker. */
+
+typedef struct Tlab {
+    Page *pages[GEECE_SIZE_CLASS_COUNT];    /**< Page each size class allocates from. */
+    Page *partial[GEECE_SIZE_CLASS_COUNT];  /**< Other owned pages with free blocks. */
+    Page *full[GEECE_SIZE_CLASS_COUNT];     /**< Owned pages without free blocks. */
+    Page *spare[GEECE_SIZE_CLASS_COUNT];    /**< One empty page kept back per class. */
+    _Atomic(Page *) remote_pages;           /**< Owned pages other threads freed blocks into. */
+    char *nursery_top;                      /**< Bump pointer into the thread's eden chunk. */
+    char *nursery_end;                      /**< End of the thread's eden chunk. */
+    _Atomic size_t allocated;               /**< Bytes allocated by the thread, written only by it. */
+    _Atomic size_t freed;                   /**< Bytes freed by the thread, written only by it. */
+    void *satb[GEECE_SATB_BUFFER_SIZE];     /**< Objects the thread shaded during concurrent marking. */
+    size_t satb_count;                      /**< Entries of `satb` not handed to the marker yet. */
+    atomic_bool satb_busy;                  /**< Swapped to true by the thread recording into `satb` or the collector taking it. */
+    struct Tlab *next;                      /**< Next buffer in the heap's registry. */
+} Tlab;
+
+#define GEECE_TLAB_NURSERY_CHUNK ((size_t)32 * 1024)   /**< Eden carved out per refill. */
+
+/**
+ * @brief Returns the calling thread's allocation buffer, creating and registering it on first use.
+ *
+ * The buffer is released automatically when the thread exits.
+ *
+ * @return The calling thread's allocation buffer, or NULL if it could not be created.
+ */
+Tlab *tlab_current(void);
+
+/**
+ * @brief Replaces the exhausted page a buffer allocates from for a size class.
+ *
+ * Blocks other threads freed into the current page are reclaimed first. Otherwise the page moves
+ * to the buffer's full list and the next owned page with free blocks takes over, and only when
+ * there is none a page is taken from the shared heap.
+ *
+ * @param tlab The calling thread's allocation buffer.
+ * @param size_class The size class to refill.
+ * @return The page to allocate from, or NULL if memory allocation failed.
+ */
+Page *tlab_refill(Tlab *tlab, unsigned int size_class);
+
+/**
+ * @brief Returns a block to a page owned by the calling thread.
+ *
+ * @param tlab The calling thread's allocation buffer, which owns the page.
+ * @param page The page owning the block.
+ * @param block The block to release.
+ */
+void tlab_free_block(Tlab *tlab, Page *page, void *block);
+
+/**
+ * @brief Notifies a page's owner that another thread freed a block into it.
+ *
+ * Must be called with the heap lock held, after pushing the block onto `remote_free`.
+ *
+ * @param page The page the block was freed into.
+ */
+void tlab_notify_remote_free(Page *page);
+
+/**
+ * @brief Counts bytes handed out by the calling thread.
+ */
+static inline void tlab_count_allocated(Tlab *tlab, size_t bytes){
+    size_t allocated = atomic_load_explicit(&tlab->allocated, memory_order_relaxed);
+    atomic_store_explicit(&tlab->allocated, allocated + bytes, memory_order_relaxed);
+}
+
+/**
+ * @brief Counts bytes returned by the calling thread.
+ */
+static inline void tlab_count_freed(Tlab *tlab, size_t bytes){
+    size_t freed = atomic_load_explicit(&tlab->freed, memory_order_relaxed);
+    atomic_store_explicit(&tlab->freed, freed + bytes, memory_order_relaxed);
+}
+
+/**
+ * @brief Hands every page of every registered buffer back to the shared heap, so that a
+ * compaction sees all pages on the size class lists. Threads refill their buffers afterwards.
+ *
+ * Must only be called while no other thread is allocating.
+ */
+void tlab_retire_all(void);
+
+/**
+ * @brief Drops the eden chunks of every registered buffer, used when eden is emptied.
+ *
+ * Must only be called while no other thread is allocating.
+ */
+void tlab_reset_nursery_chunks(void);
+
+/**
+ * @brief Sums the bytes allocated minus the bytes freed across every registered buffer.
+ *
+ * Must be called with the heap lock held.
+ *
+ * @return The net number of bytes handed out through allocation buffers.
+ */
+size_t tlab_net_allocated(void);
+
+#endif /* GEECE_TLAB_H */
@@ -0,0 +1,134 @@
+/**
+ * @file type.h
+ * @brief Type descriptors telling the collector which payload words of an object are references.
+ *
+ * A typed object keeps its references in its own payload instead of in the edge lists of the root
+ * table: the type lists the byte offsets of the payload words holding an `Object *`, and the marker,
+ * minor collections and compaction read and update those words directly. Typed and untyped objects
+ * reference each other freely, and a typed object may have edges on top of its fields.
+ *
+ * Fields are read directly, but every store to a field, the first one included, must go through
+ * `geece_write_field()`, which runs the write barriers of the nursery, arenas and incremental marking.
+ */
+
+#ifndef GEECE_TYPE_H
+#define GEECE_TYPE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "object.h"
+
+/* Types that can be registered, the untyped id 0 included. */
+#define GEECE_MAX_TYPES 1024
+
+/**
+ * Identifies a registered type, 0 stands for untyped objects.
+ */
+typedef uint16_t GeeceType;
+
+typedef struct {
+    const char *name;           /**< Name the type was registered under. */
+    size_t size;                /**< Payload bytes of an object of the type. */
+    uint32_t *offsets;          /**< Byte offsets of the payload words holding references, ascending. */
+    size_t field_count;         /**< Number of entries in `offsets`. */
+} TypeInfo;
+
+/**
+ * Registered types, indexed by type id. Entries never change once registered.
+ */
+extern TypeInfo type_table[GEECE_MAX_TYPES];
+
+/**
+ * @brief Registers a type from a bitmap of the payload words holding references.
+ *
+ * @param name Name of the type, kept for diagnostics.
+ * @param size Payload bytes of an object of the type.
+ * @param pointer_map One bit per pointer-sized payload word, bit `i % 64` of `pointer_map[i / 64]`
+ *        set if word `i` holds an `Object *`. May be NULL for a type without references.
+ * @return The id of the new type, or 0 if the registry is full or memory allocation failed.
+ */
+GeeceType geece_register_type(const char *name, size_t size, const uint64_t *pointer_map);
+
+/**
+ * @brief Registers a type from a list of the payload offsets holding references.
+ *
+ * @param name Name of the type, kept for diagnostics.
+ * @param size Payload bytes of an object of the type.
+ * @param offsets Byte offsets of the fields holding an `Object *`, pointer-aligned, in any order.
+ * @param count Number of offsets.
+ * @return The id of the new type, or 0 if an offset is invalid, the registry is full or memory
+ *         allocation failed.
+ */
+GeeceType geece_register_type_fields(const char *name, size_t size, const size_t *offsets, size_t count);
+
+/* Maps the field names after the struct type to their offsets, up to 8 of them. */
+#define GEECE_FIELD_COUNT(...) GEECE_FIELD_COUNT_(__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1)
+#define GEECE_FIELD_COUNT_(_1, _2, _3, _4, _5, _6, _7, _8, count, ...) count
+#define GEECE_FIELD_CONCAT(a, b) GEECE_FIELD_CONCAT_(a, b)
+#define GEECE_FIELD_CONCAT_(a, b) a##b
+#define GEECE_FIELD_OFFSETS_1(T, f) offsetof(T, f)
+#define GEECE_FIELD_OFFSETS_2(T, f, ...) offsetof(T, f), GEECE_FIELD_OFFSETS_1(T, __VA_ARGS__)
+#define GEECE_FIELD_OFFSETS_3(T, f, ...) offsetof(T, f), GEECE_FIELD_OFFSETS_2(T, __VA_ARGS__)
+#define GEECE_FIELD_OFFSETS_4(T, f, ...) offsetof(T, f), GEECE_FIELD_OFFSETS_3(T, __VA_ARGS__)
+#define GEECE_FIELD_OFFSETS_5(T, f, ...) offsetof(T, f), GEECE_FIELD_OFFSETS_4(T, __VA_ARGS__)
+#define GEECE_FIELD_OFFSETS_6(T, f, ...) offsetof(T, f), GEECE_FIELD_OFFSETS_5(T, __VA_ARGS__)
+#define GEECE_FIELD_OFFSETS_7(T, f, ...) offsetof(T, f), GEECE_FIELD_OFFSETS_6(T, __VA_ARGS__)
+#define GEECE_FIELD_OFFSETS_8(T, f, ...) offsetof(T, f), GEECE_FIELD_OFFSETS_7(T, __VA_ARGS__)
+#define GEECE_FIELD_OFFSETS(T, ...) GEECE_FIELD_CONCAT(GEECE_FIELD_OFFSETS_, GEECE_FIELD_COUNT(__VA_ARGS__))(T, __VA_ARGS__)
+
+/**
+ * @brief Registers a struct type, given the names of its `Object *` members.
+ *
+ * The offset list is built at compile time, e.g. `GEECE_REGISTER_STRUCT(struct Node, left, right)`
+ * for `struct Node { Object *left; Object *right; long value; }`. Up to 8 members can be listed,
+ * bigger types are registered with `geece_register_type()`.
+ */
+#define GEECE_REGISTER_STRUCT(T, ...) \
+    geece_register_type_fields(#T, sizeof(T), (const size_t[]){GEECE_FIELD_OFFSETS(T, __VA_ARGS__)}, \
+                               GEECE_FIELD_COUNT(__VA_ARGS__))
+
+/**
+ * @brief Allocates a typed object, as `geece_malloc()` does, with a zeroed payload of the type's size.
+ *
+ * @param type A registered type.
+ * @param destructor The destructor function for the object.
+ * @return A pointer to the allocated object.
+ * @throws An error message if the type is not registered or memory allocation fails.
+ */
+Object *geece_malloc_typed(GeeceType type, Destructor destructor);
+
+/**
+ * @brief Returns the payload of an object, where the fields of a typed object live.
+ */
+static inline void *geece_payload(Object *object){
+    return object + 1;
+}
+
+/**
+ * @brief Stores a reference into a field of a typed object.
+ *
+ * Keeps the reference counts of the old and the new value up to date and runs the write barriers,
+ * so the store is seen by minor collections, arenas and a running incremental or concurrent cycle.
+ *
+ * @param object The typed object holding the field.
+ * @param field Address of the field, inside the payload of `object`.
+ * @param value The object to store, or NULL.
+ */
+void geece_write_field(Object *object, Object **field, Object *value);
+
+/**
+ * @brief Returns the type of an object, or NULL if it is untyped.
+ */
+static inline const TypeInfo *object_type_info(const Object *object){
+    GeeceType type = object_type(object);
+    return type != 0 ? &type_table[type] : NULL;
+}
+
+/**
+ * @brief Returns the address of the `index`th reference field of a typed object.
+ */
+static inline Object **type_field(const Object *object, const TypeInfo *info, size_t index){
+    return (Object **)((char *)(object + 1) + info->offsets[index]);
+}
+
+#endif /* GEECE_TYPE_H */
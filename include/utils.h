@@ -0,0 +1,51 @@
+/**
+ * @file utils.h
+ * @brief Small helpers shared by the collector modules.
+ */
+
+#ifndef GEECE_UTILS_H
+#define GEECE_UTILS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Rounds a size up to a multiple of a power-of-two alignment.
+ */
+#define GEECE_ALIGN_UP(size, alignment) (((size) + (alignment) - 1) & ~((size_t)(alignment) - 1))
+
+/**
+ * @brief A growable array of pointers used for collector worklists and side tables.
+ */
+typedef struct {
+    void **items;
+    size_t count;
+    size_t capacity;
+} PointerArray;
+
+/**
+ * @brief Appends a pointer to a PointerArray, growing it when full.
+ *
+ * @param array The array to append to.
+ * @param item The pointer to append.
+ * @return True if the pointer was appended, false if memory allocation failed.
+ */
+bool pointer_array_push(PointerArray *array, void *item);
+
+/**
+ * @brief Removes the first occurrence of a pointer, moving the last item into its slot.
+ *
+ * @param array The array to remove from.
+ * @param item The pointer to remove.
+ * @return True if the pointer was found and removed, false otherwise.
+ */
+bool pointer_array_remove(PointerArray *array, const void *item);
+
+/**
+ * @brief Frees the storage of a PointerArray and resets it to empty.
+ *
+ * @param array The array to free.
+ */
+void pointer_array_free(PointerArray *array);
+
+#endif /* GEECE_UTILS_H */
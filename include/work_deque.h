@@ -0,0 +1,73 @@
+/**
+ * @file work_deque.h
+ * @brief Chase-Lev work-stealing deques.
+ *
+ * The owning thread pushes and takes items at the bottom of its deque without locking, while other
+ * threads steal items from the top with a single compare-and-swap. The circular array grows when
+ * full; arrays it outgrew stay allocated until the deque is destroyed, since a thief may still be
+ * reading from them. Follows the C11 formulation of Lê, Pop, Cohen and Zappa Nardelli.
+ */
+
+#ifndef GEECE_WORK_DEQUE_H
+#define GEECE_WORK_DEQUE_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct WorkDequeArray {
+    size_t capacity;                        /**< Number of slots, a power of two. */
+    struct WorkDequeArray *previous;        /**< Array this one replaced, freed with the deque. */
+    _Atomic(void *) items[];                /**< The slots, indexed modulo `capacity`. */
+} WorkDequeArray;
+
+typedef struct {
+    _Atomic int64_t top;                    /**< Index of the next item to steal. */
+    _Atomic int64_t bottom;                 /**< Index of the next item to push. */
+    _Atomic(WorkDequeArray *) array;        /**< The current circular array. */
+    size_t limit;                           /**< Slots the array may grow to. */
+} WorkDeque;
+
+/**
+ * @brief Initializes an empty deque.
+ *
+ * @param deque The deque to initialize.
+ * @param capacity Initial number of slots, rounded up to a power of two.
+ * @param limit Number of slots the deque may grow to.
+ * @return True on success, false if memory allocation failed.
+ */
+bool work_deque_init(WorkDeque *deque, size_t capacity, size_t limit);
+
+/**
+ * @brief Frees the arrays of a deque.
+ */
+void work_deque_destroy(WorkDeque *deque);
+
+/**
+ * @brief Pushes an item at the bottom. Only the owner may call this.
+ *
+ * @return True if the item was pushed, false if the deque is at its limit or failed to grow.
+ */
+bool work_deque_push(WorkDeque *deque, void *item);
+
+/**
+ * @brief Takes the most recently pushed item. Only the owner may call this.
+ *
+ * @return The item, or NULL if the deque is empty.
+ */
+void *work_deque_take(WorkDeque *deque);
+
+/**
+ * @brief Steals the oldest item. Any thread may call this.
+ *
+ * @return The item, or NULL if the deque is empty or another thread won the race for the item.
+ */
+void *work_deque_steal(WorkDeque *deque);
+
+/**
+ * @brief Returns whether a deque looked empty, which may be stale by the time it returns.
+ */
+bool work_deque_empty(WorkDeque *deque);
+
+#endif /* GEECE_WORK_DEQUE_H */
@@ -0,0 +1,37 @@
+/**
+ * @file workers.h
+ * @brief Pool of collector worker threads.
+ *
+ * Parallel collector phases run a task on several threads at once: the collecting thread and up
+ * to `count - 1` pool threads. Pool threads are started on first use and then sleep between runs.
+ */
+
+#ifndef GEECE_WORKERS_H
+#define GEECE_WORKERS_H
+
+/**
+ * @brief A task run by every thread taking part in a parallel phase.
+ *
+ * @param index Index of the thread, 0 for the collecting thread.
+ * @param arg The argument given to `workers_run()`.
+ */
+typedef void (*WorkerTask)(unsigned int index, void *arg);
+
+/**
+ * @brief Starts enough pool threads for `count` threads to take part in a run.
+ *
+ * @param count Number of threads wanted, the collecting thread included.
+ * @return Number of threads available, between 1 and `count`, lower if threads failed to start.
+ */
+unsigned int workers_start(unsigned int count);
+
+/**
+ * @brief Runs a task on `count` threads and returns once every one of them is done.
+ *
+ * @param count Number of threads, at most what `workers_start()` returned.
+ * @param task The task to run, with indices 0 to `count - 1`.
+ * @param arg Passed to the task.
+ */
+void workers_run(unsigned int count, WorkerTask task, void *arg);
+
+#endif /* GEECE_WORKERS_H */
@@ -0,0 +1,288 @@
+/**
+ * @file arena.c
+ * @brief Implementation of the arena allocator.
+ */
+#include "arena.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "mark_and_sweep.h"
+#include "nursery.h"
+#include "reference.h"
+
+#define CHUNK_HEADER_SIZE GEECE_ALIGN_UP(sizeof(ArenaChunk), GEECE_MIN_BLOCK_SIZE)
+#define ARENA_SIZE GEECE_ALIGN_UP(sizeof(Arena), GEECE_MIN_BLOCK_SIZE)
+
+struct Arena {
+    ArenaChunk *chunks;     /**< Chunks of the arena, the one being bump-allocated first. */
+    PointerArray cleanup;   /**< Objects that need finalizing when the arena ends. */
+    size_t escaped_count;   /**< Objects flagged as escaped or rooted while the arena was open. */
+    Arena *next;            /**< Next open arena. */
+    Arena *prev;            /**< Previous open arena. */
+};
+
+static Arena *open_arenas = NULL;
+static ArenaChunk *retained_chunks = NULL;
+
+static inline size_t block_size_of(const Object *object){
+    return GEECE_ALIGN_UP(sizeof(Object) + object->size, GEECE_MIN_BLOCK_SIZE);
+}
+
+static inline char *chunk_objects(ArenaChunk *chunk, Arena *arena){
+    // The arena itself lives at the start of its first chunk
+    char *objects = (char *)chunk + CHUNK_HEADER_SIZE;
+    return (char *)arena == objects ? objects + ARENA_SIZE : objects;
+}
+
+static ArenaChunk *new_chunk(Arena *arena){
+    ArenaChunk *chunk = heap_acquire_chunk();
+    if (chunk == NULL){
+        return NULL;
+    }
+    memset(chunk, 0, sizeof(ArenaChunk));
+    chunk->arena = arena;
+    chunk->top = (char *)chunk + CHUNK_HEADER_SIZE;
+    chunk->end = (char *)chunk + GEECE_PAGE_SIZE;
+    return chunk;
+}
+
+Arena *geece_arena_begin(void){
+    ArenaChunk *chunk = new_chunk(NULL);
+    if (chunk == NULL){
+        fprintf(stderr, "Error: Failed to allocate arena.\n");
+        exit(EXIT_FAILURE);
+    }
+    Arena *arena = (Arena *)chunk->top;
+    chunk->top += ARENA_SIZE;
+    chunk->arena = arena;
+    memset(arena, 0, sizeof(Arena));
+    arena->chunks = chunk;
+
+    heap_lock();
+    arena->next = open_arenas;
+    if (open_arenas != NULL){
+        open_arenas->prev = arena;
+    }
+    open_arenas = arena;
+    heap_unlock();
+    return arena;
+}
+
+Object *geece_malloc_in(Arena *arena, size_t size, Destructor destructor){
+    size_t block_size = GEECE_ALIGN_UP(sizeof(Object) + size, GEECE_MIN_BLOCK_SIZE);
+    if (block_size > GEECE_PAGE_SIZE - CHUNK_HEADER_SIZE){
+        return geece_malloc(size, destructor);
+    }
+    ArenaChunk *chunk = arena->chunks;
+    if (block_size > (size_t)(chunk->end - chunk->top)){
+        chunk = new_chunk(arena);
+        if (chunk == NULL){
+            fprintf(stderr, "Error: Failed to allocate arena chunk.\n");
+            exit(EXIT_FAILURE);
+        }
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+    }
+    Object *object = (Object *)chunk->top;
+    chunk->top += block_size;
+    memset(object, 0, block_size);
+    object->flags = OBJECT_ARENA;
+    object_init(object, size, destructor);
+    if (destructor != NULL){
+        arena_track_cleanup(object);
+    }
+    return object;
+}
+
+void arena_track_cleanup(Object *object){
+    if (pointer_array_push(&arena_of(object)->cleanup, object)){
+        object->flags |= OBJECT_TRACKED;
+    }
+}
+
+void arena_escape(Object *object){
+    object->flags |= OBJECT_ESCAPED;
+    Arena *arena = arena_of(object);
+    if (arena != NULL){
+        arena->escaped_count++;
+    }
+}
+
+void arena_root(Object *object){
+    object->flags |= OBJECT_ROOTED;
+    Arena *arena = arena_of(object);
+    if (arena != NULL){
+        arena->escaped_count++;
+    }
+}
+
+/* Flags every rooted object and every object of the arena reachable from an escaped or rooted one
+ * as escaped, so that they stay in place. */
+static void propagate_escapes(Arena *arena){
+    PointerArray pending = {0};
+    for (ArenaChunk *chunk = arena->chunks; chunk != NULL; chunk = chunk->next){
+        for (char *scan = chunk_objects(chunk, arena); scan < chunk->top; scan += block_size_of((Object *)scan)){
+            Object *object = (Object *)scan;
+            if (object->flags & (OBJECT_ESCAPED | OBJECT_ROOTED)){
+                object->flags |= OBJECT_ESCAPED;
+                pointer_array_push(&pending, object);
+            }
+        }
+    }
+    while (pending.count > 0){
+        Object *object = pending.items[--pending.count];
+        size_t count;
+        Object **references = object_references(object, &count);
+        for (size_t i = 0; i < count; ++i){
+            Object *target = references[i];
+            if ((target->flags & (OBJECT_ARENA | OBJECT_ESCAPED)) == OBJECT_ARENA && arena_of(target) == arena){
+                target->flags |= OBJECT_ESCAPED;
+                pointer_array_push(&pending, target);
+            }
+        }
+    }
+    pointer_array_free(&pending);
+}
+
+/* Collects the escaped objects of a chunk, returning true if there were any. */
+static bool collect_escaped(ArenaChunk *chunk, Arena *arena){
+    for (char *scan = chunk_objects(chunk, arena); scan < chunk->top; scan += block_size_of((Object *)scan)){
+        if (((Object *)scan)->flags & OBJECT_ESCAPED){
+            pointer_array_push(&chunk->escaped, scan);
+        }
+    }
+    return chunk->escaped.count > 0;
+}
+
+static void finalize(Object *object){
+    object_finalize(object);
+    if (object->flags & OBJECT_REMEMBERED){
+        nursery_forget(object);
+    }
+}
+
+void geece_arena_end(Arena *arena){
+    // The background marker must not be reading the objects and chunks this frees
+    geece_mark_pause();
+    heap_lock();
+    if (arena->prev != NULL){
+        arena->prev->next = arena->next;
+    } else {
+        open_arenas = arena->next;
+    }
+    if (arena->next != NULL){
+        arena->next->prev = arena->prev;
+    }
+    heap_unlock();
+
+    bool escaped = arena->escaped_count > 0;
+    if (escaped){
+        propagate_escapes(arena);
+    }
+    for (size_t i = 0; i < arena->cleanup.count; ++i){
+        Object *object = arena->cleanup.items[i];
+        if (!(object->flags & OBJECT_ESCAPED)){
+            // Chunks are released once all of them are finalized, dying targets can still be unlinked from
+            reference_unlink_all(object);
+            finalize(object);
+        }
+    }
+    pointer_array_free(&arena->cleanup);
+
+    // The arena lives in its last chunk, so nothing may touch it once that chunk is released
+    ArenaChunk *chunk = arena->chunks;
+    while (chunk != NULL){
+        ArenaChunk *next = chunk->next;
+        if (escaped && collect_escaped(chunk, arena)){
+            heap_lock();
+            chunk->arena = NULL;
+            chunk->prev = NULL;
+            chunk->next = retained_chunks;
+            if (retained_chunks != NULL){
+                retained_chunks->prev = chunk;
+            }
+            retained_chunks = chunk;
+            heap_unlock();
+            // Incremental marking never traced them while the arena was open
+            for (size_t i = 0; i < chunk->escaped.count; ++i){
+                geece_mark_black(chunk->escaped.items[i]);
+            }
+        } else {
+            heap_release_chunk(chunk);
+        }
+        chunk = next;
+    }
+    geece_mark_resume();
+}
+
+static void visit_open_arenas(void (*visit)(Object *object)){
+    for (Arena *arena = open_arenas; arena != NULL; arena = arena->next){
+        for (ArenaChunk *chunk = arena->chunks; chunk != NULL; chunk = chunk->next){
+            for (char *scan = chunk_objects(chunk, arena); scan < chunk->top; scan += block_size_of((Object *)scan)){
+                visit((Object *)scan);
+            }
+        }
+    }
+}
+
+void arena_mark_roots(void (*mark_function)(Object *object)){
+    visit_open_arenas(mark_function);
+}
+
+void arena_for_each(void (*visit)(Object *object)){
+    visit_open_arenas(visit);
+    for (ArenaChunk *chunk = retained_chunks; chunk != NULL; chunk = chunk->next){
+        for (size_t i = 0; i < chunk->escaped.count; ++i){
+            visit(chunk->escaped.items[i]);
+        }
+    }
+}
+
+static void unlink_retained(ArenaChunk *chunk){
+    if (chunk->prev != NULL){
+        chunk->prev->next = chunk->next;
+    } else {
+        retained_chunks = chunk->next;
+    }
+    if (chunk->next != NULL){
+        chunk->next->prev = chunk->prev;
+    }
+}
+
+static inline bool is_marked(const Object *object){
+    uint64_t mask;
+    return (*arena_mark_word(object, &mask) & mask) != 0;
+}
+
+size_t arena_sweep(void){
+    for (Arena *arena = open_arenas; arena != NULL; arena = arena->next){
+        for (ArenaChunk *chunk = arena->chunks; chunk != NULL; chunk = chunk->next){
+            memset(chunk->marks, 0, sizeof(chunk->marks));
+        }
+    }
+
+    size_t released = 0;
+    ArenaChunk *chunk = retained_chunks;
+    while (chunk != NULL){
+        ArenaChunk *next = chunk->next;
+        size_t kept = 0;
+        for (size_t i = 0; i < chunk->escaped.count; ++i){
+            Object *object = chunk->escaped.items[i];
+            if (is_marked(object)){
+                chunk->escaped.items[kept++] = object;
+            } else {
+                finalize(object);
+            }
+        }
+        chunk->escaped.count = kept;
+        memset(chunk->marks, 0, sizeof(chunk->marks));
+        if (kept == 0){
+            pointer_array_free(&chunk->escaped);
+            unlink_retained(chunk);
+            heap_release_chunk(chunk);
+            released += GEECE_PAGE_SIZE;
+        }
+        chunk = next;
+    }
+    return released;
+}
@@ -0,0 +1,310 @@
+/**
+ * @file compact.c
+ * @brief Implementation of the sliding compaction.
+ */
+#include "compact.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "arena.h"
+#include "cycle_collector.h"
+#include "handle_scope.h"
+#include "heap.h"
+#include "large_object.h"
+#include "nursery.h"
+#include "reference.h"
+#include "reference_counting.h"
+#include "stack_roots.h"
+#include "tlab.h"
+#include "type.h"
+#include "utils.h"
+
+typedef struct {
+    Page *page;
+    uint64_t live[GEECE_PAGE_BITMAP_WORDS];     /**< Blocks holding an object before the compaction. */
+    uint64_t occupied[GEECE_PAGE_BITMAP_WORDS]; /**< Blocks holding an object after the compaction. */
+    Object **forwarding;                        /**< New address of every moving block, NULL if none moves. */
+} CompactPage;
+
+static CompactPage *pages = NULL;       /* Pages being compacted, by size class and then by address. */
+static CompactPage **by_address = NULL; /* The same pages by address, for forwarding lookups. */
+static size_t page_count = 0;
+
+static int compare_by_class(const void *a, const void *b){
+    const Page *left = ((const CompactPage *)a)->page;
+    const Page *right = ((const CompactPage *)b)->page;
+    if (left->size_class != right->size_class){
+        return left->size_class < right->size_class ? -1 : 1;
+    }
+    return left < right ? -1 : left > right;
+}
+
+static int compare_by_address(const void *a, const void *b){
+    const Page *left = (*(CompactPage *const *)a)->page;
+    const Page *right = (*(CompactPage *const *)b)->page;
+    return left < right ? -1 : left > right;
+}
+
+static CompactPage *find_page(const Page *page){
+    size_t low = 0;
+    size_t high = page_count;
+    while (low < high){
+        size_t middle = low + (high - low) / 2;
+        if (by_address[middle]->page < page){
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low < page_count && by_address[low]->page == page ? by_address[low] : NULL;
+}
+
+static inline Object *block_at(const Page *page, size_t index){
+    return (Object *)(page->blocks + index * page->block_size);
+}
+
+/* Returns the address an object will have once the compaction is done. */
+static Object *forward(Object *object){
+    if (object == NULL || (object->flags & (OBJECT_YOUNG | OBJECT_LARGE | OBJECT_ARENA))){
+        return object;
+    }
+    CompactPage *compact_page = find_page(page_of(object));
+    if (compact_page == NULL || compact_page->forwarding == NULL){
+        return object;
+    }
+    Page *page = compact_page->page;
+    Object *target = compact_page->forwarding[(size_t)((char *)object - page->blocks) / page->block_size];
+    return target != NULL ? target : object;
+}
+
+static void forward_edges(Object *object){
+    size_t count;
+    Object **references = object_references(object, &count);
+    for (size_t i = 0; i < count; ++i){
+        references[i] = forward(references[i]);
+    }
+    object_rehash_references(object);
+    const TypeInfo *info = object_type_info(object);
+    for (size_t i = 0; info != NULL && i < info->field_count; ++i){
+        Object **field = type_field(object, info, i);
+        *field = forward(*field);
+    }
+}
+
+/* Takes every page off the size class lists, which are rebuilt once the objects moved. */
+static bool gather_pages(void){
+    size_t count = 0;
+    for (unsigned int i = 0; i < GEECE_SIZE_CLASS_COUNT; ++i){
+        for (Page *page = heap->classes[i].available; page != NULL; page = page->next){
+            count++;
+        }
+        for (Page *page = heap->classes[i].full; page != NULL; page = page->next){
+            count++;
+        }
+    }
+    pages = calloc(count, sizeof(CompactPage));
+    by_address = calloc(count, sizeof(CompactPage *));
+    if (count > 0 && (pages == NULL || by_address == NULL)){
+        free(pages);
+        free(by_address);
+        return false;
+    }
+    page_count = 0;
+    for (unsigned int i = 0; i < GEECE_SIZE_CLASS_COUNT; ++i){
+        for (Page *page = heap->classes[i].available; page != NULL; page = page->next){
+            pages[page_count++].page = page;
+        }
+        for (Page *page = heap->classes[i].full; page != NULL; page = page->next){
+            pages[page_count++].page = page;
+        }
+        heap->classes[i].available = NULL;
+        heap->classes[i].full = NULL;
+    }
+    qsort(pages, page_count, sizeof(CompactPage), compare_by_class);
+    for (size_t i = 0; i < page_count; ++i){
+        by_address[i] = &pages[i];
+        page_free_bitmap(pages[i].page, pages[i].live);
+        for (size_t word = 0; word < GEECE_PAGE_BITMAP_WORDS; ++word){
+            pages[i].live[word] = ~pages[i].live[word];
+        }
+    }
+    qsort(by_address, page_count, sizeof(CompactPage *), compare_by_address);
+    return true;
+}
+
+static PointerArray *pinning = NULL;
+
+/* Objects registered under their own address would lose their key if they moved. */
+static void pin_address_key(const char *key, Object *object){
+    char address[21];
+    if (object == NULL || (object->flags & OBJECT_PINNED)){
+        return;
+    }
+    snprintf(address, sizeof(address), "%llu", (unsigned long long)(uintptr_t)object);
+    if (strcmp(address, key) == 0 && pointer_array_push(pinning, object)){
+        object->flags |= OBJECT_PINNED;
+    }
+}
+
+/* The words of a stack only look like pointers, so the objects they point to must stay put. */
+static void pin_stack_root(Object *object){
+    if (!(object->flags & (OBJECT_PINNED | OBJECT_LARGE)) && pointer_array_push(pinning, object)){
+        object->flags |= OBJECT_PINNED;
+    }
+}
+
+/* Slides the live objects of the pages [first, end) of one size class towards the lowest addresses. */
+static size_t plan_class(size_t first, size_t end){
+    size_t moved = 0;
+    size_t to_page = first;
+    size_t to_index = 0;
+    for (size_t from_page = first; from_page < end; ++from_page){
+        CompactPage *source = &pages[from_page];
+        for (size_t index = 0; index < source->page->block_count; ++index){
+            if (!page_bitmap_test(source->live, index)){
+                continue;
+            }
+            Object *object = block_at(source->page, index);
+            if (object->flags & OBJECT_PINNED){
+                page_bitmap_set(source->occupied, index);
+                continue;
+            }
+            // The destination never passes the object itself, skip the slots pinned objects hold
+            while (page_bitmap_test(pages[to_page].occupied, to_index)){
+                if (++to_index == pages[to_page].page->block_count){
+                    to_page++;
+                    to_index = 0;
+                }
+            }
+            CompactPage *target = &pages[to_page];
+            page_bitmap_set(target->occupied, to_index);
+            if (target != source || to_index != index){
+                if (source->forwarding == NULL){
+                    source->forwarding = calloc(source->page->block_count, sizeof(Object *));
+                    if (source->forwarding == NULL){
+                        fprintf(stderr, "Error: Failed to allocate forwarding table.\n");
+                        exit(EXIT_FAILURE);
+                    }
+                }
+                source->forwarding[index] = block_at(target->page, to_index);
+                moved += source->page->block_size;
+            }
+            if (++to_index == target->page->block_count){
+                to_page++;
+                to_index = 0;
+            }
+        }
+    }
+    return moved;
+}
+
+static void move_objects(void){
+    // Targets always lie below their sources, so moving in address order never overwrites a live object
+    for (size_t i = 0; i < page_count; ++i){
+        CompactPage *compact_page = &pages[i];
+        if (compact_page->forwarding == NULL){
+            continue;
+        }
+        Page *page = compact_page->page;
+        for (size_t index = 0; index < page->block_count; ++index){
+            if (compact_page->forwarding[index] != NULL){
+                memcpy(compact_page->forwarding[index], block_at(page, index), page->block_size);
+                object_meta_move(block_at(page, index), compact_page->forwarding[index]);
+            }
+        }
+    }
+}
+
+/* Rethreads the free list of a page in address order and files the page on its class's lists. */
+static void refile_page(CompactPage *compact_page){
+    Page *page = compact_page->page;
+    FreeBlock *next = NULL;
+    unsigned int used = 0;
+    for (size_t index = page->block_count; index > 0; --index){
+        if (page_bitmap_test(compact_page->occupied, index - 1)){
+            used++;
+            continue;
+        }
+        FreeBlock *block = (FreeBlock *)block_at(page, index - 1);
+        block->next = next;
+        next = block;
+    }
+    page->free_list = next;
+    page->used_count = used;
+    page->full = next == NULL;
+    if (used == 0){
+        heap_release_page(page);
+    } else {
+        SizeClass *shared = &heap->classes[page->size_class];
+        page_list_push(page->full ? &shared->full : &shared->available, page);
+    }
+}
+
+size_t compact_heap(RootTable *roots){
+    if (heap == NULL){
+        return 0;
+    }
+    tlab_retire_all();
+    heap_lock();
+    bool gathered = gather_pages();
+    heap_unlock();
+    if (!gathered){
+        fprintf(stderr, "Error: Failed to allocate compaction tables.\n");
+        return 0;
+    }
+    PointerArray pinned = {0};
+    root_table_finish_resize(roots);
+    pinning = &pinned;
+    root_table_for_each_key(roots, pin_address_key);
+    stack_roots_scan(pin_stack_root);
+    pinning = NULL;
+
+    size_t moved = 0;
+    for (size_t first = 0; first < page_count;){
+        size_t end = first + 1;
+        while (end < page_count && pages[end].page->size_class == pages[first].page->size_class){
+            end++;
+        }
+        moved += plan_class(first, end);
+        first = end;
+    }
+
+    if (moved > 0){
+        // Every object with edges is visited at its old address, before anything moves
+        for (size_t i = 0; i < page_count; ++i){
+            for (size_t index = 0; index < pages[i].page->block_count; ++index){
+                if (page_bitmap_test(pages[i].live, index)){
+                    forward_edges(block_at(pages[i].page, index));
+                }
+            }
+        }
+        large_object_for_each(forward_edges);
+        arena_for_each(forward_edges);
+        nursery_for_each(forward_edges);
+        root_table_forward(roots, forward);
+        handle_scope_forward(forward);
+        nursery_forward_remembered(forward);
+        rc_forward(forward);
+        cycle_forward(forward);
+        reference_forward(forward);
+        move_objects();
+    }
+
+    heap_lock();
+    for (size_t i = 0; i < page_count; ++i){
+        refile_page(&pages[i]);
+        free(pages[i].forwarding);
+    }
+    heap_unlock();
+    free(pages);
+    free(by_address);
+    pages = NULL;
+    by_address = NULL;
+    page_count = 0;
+
+    for (size_t i = 0; i < pinned.count; ++i){
+        ((Object *)pinned.items[i])->flags &= (uint16_t)~OBJECT_PINNED;
+    }
+    pointer_array_free(&pinned);
+    return moved;
+}
@@ -0,0 +1,25 @@
+/**
+ * @file configuration.c
+ * @brief Default collector configuration.
+ */
+#include "configuration.h"
+
+GeeceConfig geece_config = {
+    .nursery_size = GEECE_DEFAULT_NURSERY_SIZE,
+    .promotion_age = GEECE_DEFAULT_PROMOTION_AGE,
+    .large_object_threshold = GEECE_DEFAULT_LARGE_OBJECT_THRESHOLD,
+    .compaction_threshold = GEECE_DEFAULT_COMPACTION_THRESHOLD,
+    .mark_stack_limit = GEECE_DEFAULT_MARK_STACK_LIMIT,
+    .mark_threads = GEECE_DEFAULT_MARK_THREADS,
+    .mark_slice_bytes = GEECE_DEFAULT_MARK_SLICE_BYTES,
+    .mark_rate = GEECE_DEFAULT_MARK_RATE,
+    .concurrent_marking = GEECE_DEFAULT_CONCURRENT_MARKING,
+    .lazy_sweep = GEECE_DEFAULT_LAZY_SWEEP,
+    .sweep_threads = GEECE_DEFAULT_SWEEP_THREADS,
+    .deferred_rc = GEECE_DEFAULT_DEFERRED_RC,
+    .rc_table_limit = GEECE_DEFAULT_RC_TABLE_LIMIT,
+    .rc_chunk_objects = GEECE_DEFAULT_RC_CHUNK_OBJECTS,
+    .cycle_collection = GEECE_DEFAULT_CYCLE_COLLECTION,
+    .cycle_buffer_limit = GEECE_DEFAULT_CYCLE_BUFFER_LIMIT,
+    .track_referrers = GEECE_DEFAULT_TRACK_REFERRERS,
+};
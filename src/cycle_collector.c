@@ -0,0 +1,282 @@
+/**
+ * @file cycle_collector.c
+ * @brief Implementation of the cycle collector.
+ */
+#include "cycle_collector.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "heap.h"
+#include "mark_and_sweep.h"
+#include "nursery.h"
+#include "reference.h"
+#include "reference_counting.h"
+#include "type.h"
+#include "utils.h"
+
+static pthread_mutex_t buffer_lock = PTHREAD_MUTEX_INITIALIZER;
+static PointerArray buffer;         /* Candidate roots of garbage cycles, flagged OBJECT_BUFFERED. */
+static bool collecting = false;     /* Destructors run by a collection must not start another. */
+static PointerArray stack;          /* Objects whose children the current pass still has to visit. */
+static PointerArray whites;         /* Garbage found by the collection, destroyed once it is all found. */
+
+/* Objects whose count the collection must not touch, they are left to other collectors. */
+static inline bool external(const Object *object){
+#ifdef GEECE_COMPACT_HEADER
+    if (object->ref_count == OBJECT_REF_COUNT_MAX){
+        return true;
+    }
+#endif
+    return (object->flags & (OBJECT_YOUNG | OBJECT_ARENA)) != 0;
+}
+
+/* Subtracts a reference internal to the subgraph, without disposing of the object at zero. */
+static inline void trial_decrement(Object *object){
+#ifdef GEECE_COMPACT_HEADER
+    object_ref_decrement(object);
+#else
+    __atomic_fetch_sub(&object->shared_count, OBJECT_SHARED_ONE, __ATOMIC_RELAXED);
+#endif
+}
+
+static inline void trial_increment(Object *object){
+#ifdef GEECE_COMPACT_HEADER
+    object_ref_increment(object);
+#else
+    __atomic_fetch_add(&object->shared_count, OBJECT_SHARED_ONE, __ATOMIC_RELAXED);
+#endif
+}
+
+/* Calls visit on the children of an object, edges and typed fields alike. */
+static void visit_children(Object *object, void (*visit)(Object *child)){
+    size_t count;
+    Object **references = object_references(object, &count);
+    for (size_t i = 0; i < count; ++i){
+        if (references[i] != NULL){
+            visit(references[i]);
+        }
+    }
+    const TypeInfo *info = object_type_info(object);
+    for (size_t i = 0; info != NULL && i < info->field_count; ++i){
+        Object *child = *type_field(object, info, i);
+        if (child != NULL){
+            visit(child);
+        }
+    }
+}
+
+/* A pass cut short would leave counts subtracted for good, so there is no way back. */
+static void push_to(PointerArray *array, Object *object){
+    if (!pointer_array_push(array, object)){
+        fprintf(stderr, "Error: Failed to allocate memory for the cycle collector.\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void push(Object *object){
+    push_to(&stack, object);
+}
+
+static void gray_child(Object *child){
+    if (external(child)){
+        return;
+    }
+    trial_decrement(child);
+    if (!(child->flags & OBJECT_GRAY)){
+        child->flags |= OBJECT_GRAY;
+        push(child);
+    }
+}
+
+/* Subtracts the references internal to the subgraph reachable from an object. */
+static void mark_gray(Object *object){
+    if (object->flags & OBJECT_GRAY){
+        return;
+    }
+    object->flags |= OBJECT_GRAY;
+    push(object);
+    while (stack.count > 0){
+        visit_children(stack.items[--stack.count], gray_child);
+    }
+}
+
+static void black_child(Object *child){
+    if (external(child)){
+        return;
+    }
+    trial_increment(child);
+    if (child->flags & OBJECT_COLOR){
+        child->flags &= (uint16_t)~OBJECT_COLOR;
+        push(child);
+    }
+}
+
+/* Gives back the references of a live object and of everything it reaches. */
+static void scan_black(Object *object){
+    object->flags &= (uint16_t)~OBJECT_COLOR;
+    size_t bottom = stack.count;
+    push(object);
+    while (stack.count > bottom){
+        visit_children(stack.items[--stack.count], black_child);
+    }
+}
+
+static void scan_child(Object *child){
+    if (!external(child) && (child->flags & OBJECT_GRAY)){
+        push(child);
+    }
+}
+
+/* Whatever a reference from outside the subgraph still holds is live, the rest is white. */
+static void scan(Object *object){
+    push(object);
+    while (stack.count > 0){
+        Object *next = stack.items[--stack.count];
+        if (!(next->flags & OBJECT_GRAY)){
+            continue;
+        }
+        if (object_ref_count(next) > 0){
+            scan_black(next);
+        } else {
+            next->flags = (uint16_t)((next->flags & ~OBJECT_GRAY) | OBJECT_WHITE);
+            visit_children(next, scan_child);
+        }
+    }
+}
+
+static void white_child(Object *child){
+    if (external(child)){
+        // Never subtracted, the garbage's reference is dropped for real
+        rc_decrement(child);
+    } else if ((child->flags & (OBJECT_WHITE | OBJECT_BUFFERED)) == OBJECT_WHITE){
+        child->flags &= (uint16_t)~OBJECT_WHITE;
+        push_to(&whites, child);
+        push(child);
+    }
+}
+
+/* Gathers the garbage reachable from a white object, buffered objects are left to their own turn. */
+static void collect_white(Object *object){
+    if (!(object->flags & OBJECT_WHITE)){
+        return;
+    }
+    object->flags &= (uint16_t)~OBJECT_WHITE;
+    push_to(&whites, object);
+    push(object);
+    while (stack.count > 0){
+        visit_children(stack.items[--stack.count], white_child);
+    }
+}
+
+/* Destructors of one white object may still read another, so all are finalized before any is freed. */
+static size_t free_whites(void){
+    for (size_t i = 0; i < whites.count; ++i){
+        reference_unlink_all(whites.items[i]);
+        object_finalize(whites.items[i]);
+    }
+    for (size_t i = 0; i < whites.count; ++i){
+        Object *object = whites.items[i];
+        if (object->flags & OBJECT_ZCT){
+            rc_table_remove(object);
+        }
+        if (object->flags & OBJECT_REMEMBERED){
+            nursery_forget(object);
+        }
+        heap_free_block(object);
+    }
+    size_t freed = whites.count;
+    whites.count = 0;
+    return freed;
+}
+
+void cycle_buffer(Object *object){
+    if (object->flags & (OBJECT_YOUNG | OBJECT_ARENA | OBJECT_BUFFERED)){
+        return;
+    }
+    pthread_mutex_lock(&buffer_lock);
+    // Left to the full collections if it cannot be recorded
+    if (!(object->flags & OBJECT_BUFFERED) && pointer_array_push(&buffer, object)){
+        object->flags |= OBJECT_BUFFERED;
+    }
+    pthread_mutex_unlock(&buffer_lock);
+}
+
+bool cycle_collect_due(void){
+    return !collecting && buffer.count >= geece_config.cycle_buffer_limit;
+}
+
+size_t cycle_pending(void){
+    return buffer.count;
+}
+
+size_t cycle_collect(RootTable *roots){
+    if (collecting || geece_mark_in_progress() || buffer.count == 0){
+        return 0;
+    }
+    collecting = true;
+    // Counts other threads left queued would look like references from outside
+    rc_merge_all();
+    if (!rc_hold_roots(roots)){
+        collecting = false;
+        return 0;
+    }
+    pthread_mutex_lock(&buffer_lock);
+    PointerArray candidates = buffer;
+    buffer = (PointerArray){0};
+    pthread_mutex_unlock(&buffer_lock);
+
+    // Candidates that reached zero meanwhile are disposed of as their last release would have
+    size_t kept = 0;
+    for (size_t i = 0; i < candidates.count; ++i){
+        Object *object = candidates.items[i];
+        if (object_ref_count(object) > 0){
+            candidates.items[kept++] = object;
+            continue;
+        }
+        object->flags &= (uint16_t)~OBJECT_BUFFERED;
+        if (geece_config.deferred_rc){
+            rc_zero(object);
+        } else {
+            reference_unlink_all(object);
+            destroy_object(object);
+        }
+    }
+    candidates.count = kept;
+    for (size_t i = 0; i < candidates.count; ++i){
+        mark_gray(candidates.items[i]);
+    }
+    for (size_t i = 0; i < candidates.count; ++i){
+        scan(candidates.items[i]);
+    }
+    for (size_t i = 0; i < candidates.count; ++i){
+        Object *object = candidates.items[i];
+        object->flags &= (uint16_t)~OBJECT_BUFFERED;
+        collect_white(object);
+    }
+    size_t freed = free_whites();
+
+    rc_release_roots();
+    pointer_array_free(&candidates);
+    collecting = false;
+    return freed;
+}
+
+void cycle_forget_unmarked(void){
+    size_t kept = 0;
+    for (size_t i = 0; i < buffer.count; ++i){
+        Object *object = buffer.items[i];
+        if (geece_is_marked(object)){
+            buffer.items[kept++] = object;
+        } else {
+            object->flags &= (uint16_t)~OBJECT_BUFFERED;
+        }
+    }
+    buffer.count = kept;
+}
+
+void cycle_forward(Object *(*forward)(Object *object)){
+    for (size_t i = 0; i < buffer.count; ++i){
+        buffer.items[i] = forward(buffer.items[i]);
+    }
+}
@@ -0,0 +1,139 @@
+/**
+ * @file epoch.c
+ * @brief Implementation of the epoch-based reclamation.
+ */
+#include "epoch.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+/* The epoch a registered thread reads in, 0 outside of a read. */
+typedef struct EpochRecord {
+    uint64_t announced;
+    bool registered;
+    struct EpochRecord *next;
+} EpochRecord;
+
+static _Thread_local EpochRecord record;
+
+static uint64_t global_epoch = 1;
+static pthread_mutex_t records_lock = PTHREAD_MUTEX_INITIALIZER;
+static EpochRecord *records = NULL;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t record_key;
+static bool key_created = false;
+
+static void unregister_at_exit(void *arg){
+    EpochRecord *exiting = arg;
+    pthread_mutex_lock(&records_lock);
+    EpochRecord **link = &records;
+    while (*link != exiting){
+        link = &(*link)->next;
+    }
+    *link = exiting->next;
+    pthread_mutex_unlock(&records_lock);
+    *exiting = (EpochRecord){0};
+}
+
+static void create_key(void){
+    key_created = pthread_key_create(&record_key, unregister_at_exit) == 0;
+}
+
+static bool register_record(void){
+    pthread_once(&key_once, create_key);
+    if (!key_created || pthread_setspecific(record_key, &record) != 0){
+        return false;
+    }
+    pthread_mutex_lock(&records_lock);
+    record.next = records;
+    records = &record;
+    record.registered = true;
+    pthread_mutex_unlock(&records_lock);
+    return true;
+}
+
+bool epoch_enter(void){
+    if (!record.registered && !register_record()){
+        return false;
+    }
+    // The epoch is announced before anything is read, and read again in case it moved meanwhile
+    uint64_t epoch = __atomic_load_n(&global_epoch, __ATOMIC_RELAXED);
+    for (;;){
+        __atomic_store_n(&record.announced, epoch, __ATOMIC_SEQ_CST);
+        uint64_t current = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+        if (current == epoch){
+            return true;
+        }
+        epoch = current;
+    }
+}
+
+void epoch_exit(void){
+    __atomic_store_n(&record.announced, 0, __ATOMIC_RELEASE);
+}
+
+/* Moves to the next epoch if every thread inside a read runs in the current one. */
+static uint64_t try_advance(void){
+    uint64_t epoch = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+    pthread_mutex_lock(&records_lock);
+    for (EpochRecord *reader = records; reader != NULL; reader = reader->next){
+        uint64_t announced = __atomic_load_n(&reader->announced, __ATOMIC_SEQ_CST);
+        if (announced != 0 && announced != epoch){
+            pthread_mutex_unlock(&records_lock);
+            return epoch;
+        }
+    }
+    pthread_mutex_unlock(&records_lock);
+    // Another writer may have advanced it first, which is as good
+    __atomic_compare_exchange_n(&global_epoch, &epoch, epoch + 1, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+}
+
+static void collect(EpochGarbage *garbage){
+    uint64_t epoch = try_advance();
+    size_t kept = 0;
+    for (size_t i = 0; i < garbage->count; ++i){
+        if (garbage->items[i].epoch + 2 <= epoch){
+            free(garbage->items[i].memory);
+        } else {
+            garbage->items[kept++] = garbage->items[i];
+        }
+    }
+    garbage->count = kept;
+}
+
+void epoch_retire(EpochGarbage *garbage, void *memory){
+    if (memory == NULL){
+        return;
+    }
+    // Whatever unlinked the memory is ordered before the epoch it is tagged with
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    uint64_t epoch = __atomic_load_n(&global_epoch, __ATOMIC_SEQ_CST);
+    if (garbage->count == garbage->capacity){
+        size_t capacity = garbage->capacity == 0 ? GEECE_EPOCH_COLLECT_EVERY : garbage->capacity * 2;
+        EpochRetired *grown = realloc(garbage->items, capacity * sizeof(EpochRetired));
+        if (grown == NULL){
+            // Without room to wait in, the writer waits for the reads itself
+            while (try_advance() < epoch + 2){
+                sched_yield();
+            }
+            free(memory);
+            return;
+        }
+        garbage->items = grown;
+        garbage->capacity = capacity;
+    }
+    garbage->items[garbage->count++] = (EpochRetired){memory, epoch};
+    if (garbage->count % GEECE_EPOCH_COLLECT_EVERY == 0){
+        collect(garbage);
+    }
+}
+
+void epoch_free_all(EpochGarbage *garbage){
+    for (size_t i = 0; i < garbage->count; ++i){
+        free(garbage->items[i].memory);
+    }
+    free(garbage->items);
+    *garbage = (EpochGarbage){0};
+}
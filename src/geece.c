@@ -0,0 +1,256 @@
+/**
+ * @file geece.c
+ * @brief Implementation of the collector entry points.
+ */
+#include "geece.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "compact.h"
+#include "heap.h"
+#include "mark_and_sweep.h"
+#include "nursery.h"
+#include "reference_counting.h"
+#include "timer.h"
+
+static RootTable *roots = NULL;
+static GeeceStats stats;
+
+typedef struct {
+    bool active;                /**< A cycle started and did not finish yet. */
+    bool drained;               /**< Marking ran out of gray objects, the next slice finishes the cycle. */
+    bool concurrent;            /**< Marking runs on the background thread rather than in slices. */
+    size_t debt;                /**< Bytes of objects to trace, built up by allocations. */
+    uint64_t *pauses;           /**< Length of every pause of the cycle so far. */
+    size_t pause_count;
+    size_t pause_capacity;
+} IncrementalCycle;
+
+static IncrementalCycle cycle;
+
+void geece_set_roots(RootTable *table){
+    roots = table;
+}
+
+RootTable *geece_get_roots(void){
+    return roots;
+}
+
+void geece_collect_minor(void){
+    uint64_t start = timer_now_ns();
+    // Old objects' edges are redirected to the promoted copies under the background marker's feet
+    geece_mark_pause();
+    stats.promoted_bytes += nursery_collect(roots);
+    geece_mark_resume();
+    uint64_t pause = timer_elapsed_ns(start);
+    stats.minor_collections++;
+    stats.minor_pause_ns += pause;
+    if (pause > stats.max_minor_pause_ns){
+        stats.max_minor_pause_ns = pause;
+    }
+}
+
+static void record_pause(uint64_t start){
+    if (cycle.pause_count == cycle.pause_capacity){
+        size_t capacity = cycle.pause_capacity == 0 ? 64 : cycle.pause_capacity * 2;
+        uint64_t *pauses = realloc(cycle.pauses, capacity * sizeof(uint64_t));
+        if (pauses == NULL){
+            fprintf(stderr, "Error: Failed to record a collection pause.\n");
+            return;
+        }
+        cycle.pauses = pauses;
+        cycle.pause_capacity = capacity;
+    }
+    cycle.pauses[cycle.pause_count++] = timer_elapsed_ns(start);
+}
+
+static int compare_pauses(const void *a, const void *b){
+    uint64_t left = *(const uint64_t *)a;
+    uint64_t right = *(const uint64_t *)b;
+    return left < right ? -1 : left > right;
+}
+
+/* Folds the pauses of a finished cycle into the statistics. */
+static void record_cycle(void){
+    uint64_t total = 0;
+    for (size_t i = 0; i < cycle.pause_count; ++i){
+        total += cycle.pauses[i];
+    }
+    qsort(cycle.pauses, cycle.pause_count, sizeof(uint64_t), compare_pauses);
+    uint64_t longest = cycle.pause_count > 0 ? cycle.pauses[cycle.pause_count - 1] : 0;
+    size_t rank = (cycle.pause_count * 99 + 99) / 100;
+    stats.incremental_cycles++;
+    stats.cycle_slices = cycle.pause_count;
+    stats.cycle_max_pause_ns = longest;
+    stats.cycle_p99_pause_ns = rank > 0 ? cycle.pauses[rank - 1] : 0;
+    stats.collections++;
+    stats.pause_ns += total;
+    if (longest > stats.max_pause_ns){
+        stats.max_pause_ns = longest;
+    }
+}
+
+static void finish_cycle(uint64_t start){
+    stats.marked_bytes += geece_mark_finish(roots);
+    stats.mark_ns += timer_elapsed_ns(start);
+    stats.concurrent_mark_ns = geece_mark_concurrent_ns();
+    // Destructors run by the sweep may allocate, which must not charge the finished cycle
+    cycle.active = false;
+    uint64_t sweep_start = timer_now_ns();
+    stats.freed_bytes += geece_sweep();
+    stats.sweep_ns += timer_elapsed_ns(sweep_start);
+    record_pause(start);
+    record_cycle();
+}
+
+void geece_collect_start(void){
+    if (cycle.active){
+        return;
+    }
+    heap_finish_sweep();
+    if (nursery_enabled()){
+        geece_collect_minor();
+    }
+    uint64_t start = timer_now_ns();
+    cycle.active = true;
+    cycle.drained = false;
+    cycle.debt = 0;
+    cycle.pause_count = 0;
+    geece_mark_start(roots);
+    cycle.concurrent = geece_config.concurrent_marking && geece_mark_start_concurrent();
+    stats.mark_ns += timer_elapsed_ns(start);
+    record_pause(start);
+}
+
+bool geece_collect_step(void){
+    if (!cycle.active){
+        return true;
+    }
+    uint64_t start = timer_now_ns();
+    if (cycle.concurrent){
+        if (!geece_mark_concurrent_done()){
+            return false;
+        }
+        finish_cycle(start);
+        return true;
+    }
+    if (cycle.drained){
+        finish_cycle(start);
+        return true;
+    }
+    cycle.drained = geece_mark_step(geece_config.mark_slice_bytes);
+    stats.mark_ns += timer_elapsed_ns(start);
+    record_pause(start);
+    return false;
+}
+
+void geece_collect_swept(size_t size){
+    stats.freed_bytes += size;
+}
+
+void geece_collect_allocated(size_t size){
+    if (!cycle.active || cycle.concurrent){
+        return;
+    }
+    cycle.debt += size * geece_config.mark_rate;
+    if (cycle.debt >= geece_config.mark_slice_bytes){
+        cycle.debt = 0;
+        geece_collect_step();
+    }
+}
+
+static void collect(bool compact){
+    if (cycle.active){
+        uint64_t start = timer_now_ns();
+        finish_cycle(start);
+        if (compact || geece_config.compaction_threshold > 0.0){
+            heap_finish_sweep();
+        }
+        if (compact || (geece_config.compaction_threshold > 0.0
+                        && heap_fragmentation() > geece_config.compaction_threshold)){
+            // Compaction only updates the survivor space, what the cycle allocated in eden moves there
+            // first, into swept pages
+            if (nursery_enabled()){
+                geece_collect_minor();
+            }
+            uint64_t compaction_start = timer_now_ns();
+            stats.moved_bytes += compact_heap(roots);
+            uint64_t compaction = timer_elapsed_ns(compaction_start);
+            stats.compaction_ns += compaction;
+            stats.pause_ns += compaction;
+            stats.compactions++;
+            // The cycle's last pause and the compaction are one pause to the caller
+            uint64_t pause = timer_elapsed_ns(start);
+            if (pause > stats.max_pause_ns){
+                stats.max_pause_ns = pause;
+            }
+        }
+        return;
+    }
+    // What the last collection left unswept holds its marks, which must not mix with new ones
+    heap_finish_sweep();
+    if (nursery_enabled()){
+        geece_collect_minor();
+    }
+    uint64_t start = timer_now_ns();
+    stats.marked_bytes += geece_mark_roots(roots);
+    stats.mark_ns += timer_elapsed_ns(start);
+    uint64_t sweep_start = timer_now_ns();
+    stats.freed_bytes += geece_sweep();
+    stats.sweep_ns += timer_elapsed_ns(sweep_start);
+    if (compact || geece_config.compaction_threshold > 0.0){
+        // Fragmentation is only known, and pages only move, once every page is swept
+        heap_finish_sweep();
+    }
+    if (compact || (geece_config.compaction_threshold > 0.0
+                    && heap_fragmentation() > geece_config.compaction_threshold)){
+        uint64_t compaction_start = timer_now_ns();
+        stats.moved_bytes += compact_heap(roots);
+        stats.compaction_ns += timer_elapsed_ns(compaction_start);
+        stats.compactions++;
+    }
+    uint64_t pause = timer_elapsed_ns(start);
+    stats.collections++;
+    stats.pause_ns += pause;
+    if (pause > stats.max_pause_ns){
+        stats.max_pause_ns = pause;
+    }
+}
+
+void geece_collect(void){
+    collect(false);
+}
+
+void geece_compact(void){
+    collect(true);
+}
+
+size_t geece_rc_reconcile(size_t budget){
+    uint64_t start = timer_now_ns();
+    size_t destroyed = rc_reconcile(roots, budget);
+    uint64_t pause = timer_elapsed_ns(start);
+    stats.rc_reconciliations++;
+    stats.rc_destroyed += destroyed;
+    stats.rc_pause_ns += pause;
+    if (pause > stats.max_rc_pause_ns){
+        stats.max_rc_pause_ns = pause;
+    }
+    return destroyed;
+}
+
+size_t geece_collect_cycles(void){
+    uint64_t start = timer_now_ns();
+    size_t destroyed = cycle_collect(roots);
+    uint64_t pause = timer_elapsed_ns(start);
+    stats.cycle_collections++;
+    stats.cycle_destroyed += destroyed;
+    stats.cycle_collect_ns += pause;
+    if (pause > stats.max_cycle_collect_ns){
+        stats.max_cycle_collect_ns = pause;
+    }
+    return destroyed;
+}
+
+const GeeceStats *geece_stats(void){
+    return &stats;
+}
@@ -0,0 +1,147 @@
+/**
+ * @file handle_scope.c
+ * @brief Implementation of the handle scopes.
+ */
+#include "handle_scope.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+_Thread_local HandleStack geece_handle_stack;
+
+static pthread_mutex_t stacks_lock = PTHREAD_MUTEX_INITIALIZER;
+static HandleStack *stacks = NULL;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t stack_key;
+static bool key_created = false;
+
+/* Drops the stack of an exiting thread, its handles go with it. */
+static void unregister_at_exit(void *arg){
+    HandleStack *stack = arg;
+    pthread_mutex_lock(&stacks_lock);
+    HandleStack **link = &stacks;
+    while (*link != stack){
+        link = &(*link)->next;
+    }
+    *link = stack->next;
+    pthread_mutex_unlock(&stacks_lock);
+    HandleBlock *block = stack->first;
+    while (block != NULL){
+        HandleBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    *stack = (HandleStack){0};
+}
+
+static void create_key(void){
+    key_created = pthread_key_create(&stack_key, unregister_at_exit) == 0;
+}
+
+static bool register_stack(HandleStack *stack){
+    pthread_once(&key_once, create_key);
+    if (!key_created || pthread_setspecific(stack_key, stack) != 0){
+        return false;
+    }
+    pthread_mutex_lock(&stacks_lock);
+    stack->next = stacks;
+    stacks = stack;
+    stack->registered = true;
+    pthread_mutex_unlock(&stacks_lock);
+    return true;
+}
+
+Object **handle_push_slow(Object *object){
+    HandleStack *stack = &geece_handle_stack;
+    if (!stack->registered && !register_stack(stack)){
+        fprintf(stderr, "Error: Failed to register the handle stack of the thread.\n");
+        return NULL;
+    }
+    // Blocks a closed scope left above the current one are reused before allocating another
+    HandleBlock *block = stack->block != NULL ? stack->block->next : stack->first;
+    if (block == NULL){
+        block = malloc(sizeof(HandleBlock));
+        if (block == NULL){
+            fprintf(stderr, "Error: Failed to grow the handle stack.\n");
+            return NULL;
+        }
+        block->next = NULL;
+        if (stack->block != NULL){
+            stack->block->next = block;
+        } else {
+            stack->first = block;
+        }
+    }
+    stack->block = block;
+    stack->top = block->slots;
+    stack->limit = block->slots + GEECE_HANDLE_BLOCK_SIZE;
+    *stack->top = object;
+    return stack->top++;
+}
+
+/* Calls visit on every live slot of a stack, from the bottom block up to the top. */
+static void for_each_slot(HandleStack *stack, void (*visit)(Object **slot)){
+    if (stack->block == NULL){
+        return;
+    }
+    for (HandleBlock *block = stack->first;; block = block->next){
+        Object **end = block == stack->block ? stack->top : block->slots + GEECE_HANDLE_BLOCK_SIZE;
+        for (Object **slot = block->slots; slot < end; ++slot){
+            visit(slot);
+        }
+        if (block == stack->block){
+            return;
+        }
+    }
+}
+
+size_t geece_handle_count(void){
+    size_t count = 0;
+    pthread_mutex_lock(&stacks_lock);
+    for (HandleStack *stack = stacks; stack != NULL; stack = stack->next){
+        for (HandleBlock *block = stack->first; stack->block != NULL; block = block->next){
+            if (block == stack->block){
+                count += (size_t)(stack->top - block->slots);
+                break;
+            }
+            count += GEECE_HANDLE_BLOCK_SIZE;
+        }
+    }
+    pthread_mutex_unlock(&stacks_lock);
+    return count;
+}
+
+static void (*visit_object)(Object *object);
+
+static void visit_slot(Object **slot){
+    if (*slot != NULL){
+        visit_object(*slot);
+    }
+}
+
+void handle_scope_for_each(void (*visit)(Object *object)){
+    pthread_mutex_lock(&stacks_lock);
+    visit_object = visit;
+    for (HandleStack *stack = stacks; stack != NULL; stack = stack->next){
+        for_each_slot(stack, visit_slot);
+    }
+    pthread_mutex_unlock(&stacks_lock);
+}
+
+static Object *(*forward_object)(Object *object);
+
+static void forward_slot(Object **slot){
+    if (*slot != NULL){
+        *slot = forward_object(*slot);
+    }
+}
+
+void handle_scope_forward(Object *(*forward)(Object *object)){
+    pthread_mutex_lock(&stacks_lock);
+    forward_object = forward;
+    for (HandleStack *stack = stacks; stack != NULL; stack = stack->next){
+        for_each_slot(stack, forward_slot);
+    }
+    pthread_mutex_unlock(&stacks_lock);
+}
@@ -1,29 +1,564 @@
 #include <stdio.h>
+#include <string.h>
 #include "heap.h"
+#include "configuration.h"
+#include "geece.h"
+#include "large_object.h"
+#include "mark_and_sweep.h"
+#include "nursery.h"
+#include "reference_counting.h"
+#include "tlab.h"
+#include "workers.h"
+
+static Heap heap_instance;
+Heap *heap = NULL;
+static pthread_once_t heap_once = PTHREAD_ONCE_INIT;
+
+static void heap_setup(void){
+    memset(&heap_instance, 0, sizeof(Heap));
+    for (unsigned int i = 0; i < GEECE_SIZE_CLASS_COUNT; ++i){
+        heap_instance.classes[i].block_size = page_class_block_size(i);
+    }
+    pthread_mutex_init(&heap_instance.lock, NULL);
+    heap = &heap_instance;
+    if (geece_config.nursery_size > 0 && !nursery_init(geece_config.nursery_size)){
+        fprintf(stderr, "Error: Running without a nursery.\n");
+    }
+}
+
+void heap_init(void){
+    pthread_once(&heap_once, heap_setup);
+}
+
+void heap_lock(void){
+    pthread_mutex_lock(&heap->lock);
+}
+
+void heap_unlock(void){
+    pthread_mutex_unlock(&heap->lock);
+}
+
+static Page *heap_take_free_page(void){
+    if (heap->free_pages == NULL){
+        Page *segment = page_map_segment();
+        if (segment == NULL){
+            return NULL;
+        }
+        heap->free_pages = segment;
+        heap->size += GEECE_PAGE_SIZE * GEECE_PAGES_PER_SEGMENT;
+    }
+    Page *page = heap->free_pages;
+    heap->free_pages = page->next;
+    return page;
+}
+
+static Page *heap_take_page(unsigned int size_class){
+    Page *page = heap_take_free_page();
+    if (page != NULL){
+        page_format(page, size_class);
+    }
+    return page;
+}
+
+void heap_release_page(Page *page){
+    page_directory_set_small(page, false);
+    page->next = heap->free_pages;
+    heap->free_pages = page;
+}
+
+/* Sweeps a page left by `heap_defer_sweep()`, with the heap lock held. */
+static void sweep_deferred_page(Page *page){
+    page->unswept = false;
+    size_t freed = geece_sweep_page_deferred(page, &heap->finalize_queue);
+    heap->used -= freed;
+    geece_collect_swept(freed);
+    if (heap->finalize_queue.count > 0){
+        atomic_store_explicit(&heap->finalize_pending, true, memory_order_relaxed);
+    }
+}
+
+/* Files a swept page that no thread owns on the list matching what is left in it. */
+static void file_swept_page(SizeClass *shared, Page *page){
+    page->full = page->free_list == NULL;
+    if (page->used_count == 0){
+        heap_release_page(page);
+    } else {
+        page_list_push(page->full ? &shared->full : &shared->available, page);
+    }
+}
+
+Page *heap_acquire_page(unsigned int size_class){
+    SizeClass *shared = &heap->classes[size_class];
+    // Swept on demand, so the blocks the sweep frees are reused while they are still in cache
+    while (shared->unswept != NULL){
+        Page *page = shared->unswept;
+        page_list_remove(&shared->unswept, page);
+        sweep_deferred_page(page);
+        if (page->free_list != NULL){
+            return page;
+        }
+        page->full = true;
+        page_list_push(&shared->full, page);
+    }
+    Page *page = shared->available;
+    if (page != NULL){
+        page_list_remove(&shared->available, page);
+        return page;
+    }
+    return heap_take_page(size_class);
+}
+
+void heap_retire_page(Page *page){
+    SizeClass *shared = &heap->classes[page->size_class];
+    page_collect_remote(page);
+    page->owner = NULL;
+    atomic_store(&page->remote_notified, false);
+    page->full = page->free_list == NULL;
+    if (page->used_count == 0){
+        heap_release_page(page);
+    } else if (page->full){
+        page_list_push(&shared->full, page);
+    } else {
+        page_list_push(&shared->available, page);
+    }
+}
+
+void *heap_acquire_chunk(void){
+    if (heap == NULL){
+        heap_init();
+    }
+    heap_lock();
+    Page *page = heap_take_free_page();
+    if (page != NULL){
+        heap->used += GEECE_PAGE_SIZE;
+    }
+    heap_unlock();
+    return page;
+}
+
+void heap_release_chunk(void *chunk){
+    heap_lock();
+    heap_release_page(chunk);
+    heap->used -= GEECE_PAGE_SIZE;
+    heap_unlock();
+}
+
+static size_t sweep_shared_list(SizeClass *shared, Page **list, size_t (*sweep_page)(Page *page)){
+    size_t freed = 0;
+    Page *page = *list;
+    while (page != NULL){
+        Page *next = page->next;
+        freed += sweep_page(page);
+        page_list_remove(list, page);
+        file_swept_page(shared, page);
+        page = next;
+    }
+    return freed;
+}
+
+static size_t sweep_owned_list(Tlab *tlab, Page **list, size_t (*sweep_page)(Page *page)){
+    size_t freed = 0;
+    Page *page = *list;
+    while (page != NULL){
+        Page *next = page->next;
+        freed += sweep_page(page);
+        if (page->full && page->free_list != NULL){
+            page->full = false;
+            page_list_remove(list, page);
+            page_list_push(&tlab->partial[page->size_class], page);
+        }
+        page = next;
+    }
+    return freed;
+}
+
+size_t heap_sweep_pages(size_t (*sweep_page)(Page *page)){
+    if (heap == NULL){
+        return 0;
+    }
+    // The world is stopped, the lock is left free for destructors run by the sweep
+    size_t freed = 0;
+    for (unsigned int i = 0; i < GEECE_SIZE_CLASS_COUNT; ++i){
+        // Available pages first, so pages moving there from the full list are not swept twice
+        SizeClass *shared = &heap->classes[i];
+        freed += sweep_shared_list(shared, &shared->available, sweep_page);
+        freed += sweep_shared_list(shared, &shared->full, sweep_page);
+    }
+    for (Tlab *tlab = heap->tlabs; tlab != NULL; tlab = tlab->next){
+        for (unsigned int i = 0; i < GEECE_SIZE_CLASS_COUNT; ++i){
+            if (tlab->pages[i] != NULL){
+                freed += sweep_page(tlab->pages[i]);
+            }
+            freed += sweep_owned_list(tlab, &tlab->partial[i], sweep_page);
+            freed += sweep_owned_list(tlab, &tlab->full[i], sweep_page);
+        }
+    }
+    heap_lock();
+    heap->used -= freed;
+    heap_unlock();
+    return freed;
+}
+
+static void defer_list(SizeClass *shared, Page **list){
+    while (*list != NULL){
+        Page *page = *list;
+        page_list_remove(list, page);
+        page->full = false;
+        page->unswept = true;
+        page_list_push(&shared->unswept, page);
+    }
+}
+
+void heap_defer_sweep(void){
+    if (heap == NULL){
+        return;
+    }
+    // Threads take their pages back swept, one refill at a time
+    tlab_retire_all();
+    heap_lock();
+    for (unsigned int i = 0; i < GEECE_SIZE_CLASS_COUNT; ++i){
+        SizeClass *shared = &heap->classes[i];
+        defer_list(shared, &shared->available);
+        defer_list(shared, &shared->full);
+    }
+    heap_unlock();
+}
+
+void heap_finish_sweep(void){
+    if (heap == NULL){
+        return;
+    }
+    heap_lock();
+    for (unsigned int i = 0; i < GEECE_SIZE_CLASS_COUNT; ++i){
+        SizeClass *shared = &heap->classes[i];
+        while (shared->unswept != NULL){
+            Page *page = shared->unswept;
+            page_list_remove(&shared->unswept, page);
+            sweep_deferred_page(page);
+            file_swept_page(shared, page);
+        }
+    }
+    heap_unlock();
+    heap_run_finalizers();
+}
+
+void heap_run_finalizers(void){
+    if (heap == NULL || !atomic_load_explicit(&heap->finalize_pending, memory_order_relaxed)){
+        return;
+    }
+    // One at a time, the lock is released while destructors run since they may allocate
+    for (;;){
+        heap_lock();
+        if (heap->finalize_queue.count == 0){
+            atomic_store_explicit(&heap->finalize_pending, false, memory_order_relaxed);
+            heap_unlock();
+            return;
+        }
+        Object *object = heap->finalize_queue.items[--heap->finalize_queue.count];
+        geece_collect_swept(page_of(object)->block_size);
+        heap_unlock();
+        destroy_object(object);
+    }
+}
+
+/* Pages a parallel sweep claims at a time. */
+#define SWEEP_PAGE_BATCH 8
+
+typedef struct {
+    PointerArray finalize;      /**< Dead objects with a destructor or in the remembered set. */
+    size_t freed;               /**< Bytes of the blocks this worker freed. */
+} SweepWorker;
+
+typedef struct {
+    PointerArray pages;         /**< Every page holding objects. */
+    atomic_size_t next_page;    /**< First page no worker claimed yet. */
+    SweepWorker *workers;
+} ParallelSweep;
+
+static ParallelSweep *current_sweep = NULL;
+
+static void collect_sweep_page(Page *page){
+    if (!pointer_array_push(&current_sweep->pages, page)){
+        // Swept here, before the workers start, rather than not at all
+        current_sweep->workers[0].freed += geece_sweep_page_deferred(page, &current_sweep->workers[0].finalize);
+    }
+}
+
+static void sweep_worker(unsigned int index, void *arg){
+    ParallelSweep *sweep = arg;
+    SweepWorker *worker = &sweep->workers[index];
+    for (;;){
+        size_t first = atomic_fetch_add(&sweep->next_page, SWEEP_PAGE_BATCH);
+        if (first >= sweep->pages.count){
+            return;
+        }
+        size_t end = first + SWEEP_PAGE_BATCH < sweep->pages.count ? first + SWEEP_PAGE_BATCH : sweep->pages.count;
+        for (size_t i = first; i < end; ++i){
+            worker->freed += geece_sweep_page_deferred(sweep->pages.items[i], &worker->finalize);
+        }
+    }
+}
+
+/* Destroys the objects a sweep worker left, returns the bytes freed. */
+static size_t finalize_batch(PointerArray *batch){
+    size_t freed = 0;
+    for (size_t i = 0; i < batch->count; ++i){
+        Object *object = batch->items[i];
+        Page *page = page_of(object);
+        object_finalize(object);
+        if (object->flags & OBJECT_REMEMBERED){
+            nursery_forget(object);
+        }
+        page_free_block(page, object);
+        freed += page->block_size;
+    }
+    pointer_array_free(batch);
+    return freed;
+}
+
+/* Passed to heap_sweep_pages() to only file the pages, which the workers swept already. */
+static size_t swept_already(Page *page){
+    (void)page;
+    return 0;
+}
+
+size_t heap_sweep_pages_parallel(unsigned int threads){
+    if (heap == NULL){
+        return 0;
+    }
+    unsigned int count = threads > 1 ? workers_start(threads) : 1;
+    ParallelSweep sweep = {.workers = calloc(count, sizeof(SweepWorker))};
+    if (count <= 1 || sweep.workers == NULL){
+        free(sweep.workers);
+        return heap_sweep_pages(geece_sweep_page);
+    }
+    atomic_init(&sweep.next_page, 0);
+    current_sweep = &sweep;
+    heap_for_each_page(collect_sweep_page);
+    current_sweep = NULL;
+    workers_run(count, sweep_worker, &sweep);
+    pointer_array_free(&sweep.pages);
+
+    // Every page was swept by one worker, so only the counters and the batches need merging.
+    // Destructors run on the collecting thread, with the heap lock free since they may allocate
+    size_t freed = 0;
+    for (unsigned int i = 0; i < count; ++i){
+        freed += sweep.workers[i].freed + finalize_batch(&sweep.workers[i].finalize);
+    }
+    free(sweep.workers);
+    heap_lock();
+    heap->used -= freed;
+    heap_unlock();
+    // Files every page on the list matching what is left in it
+    heap_sweep_pages(swept_already);
+    return freed;
+}
+
+static void visit_page_list(Page *page, void (*visit)(Page *page)){
+    for (; page != NULL; page = page->next){
+        visit(page);
+    }
+}
+
+void heap_for_each_page(void (*visit)(Page *page)){
+    if (heap == NULL){
+        return;
+    }
+    for (unsigned int i = 0; i < GEECE_SIZE_CLASS_COUNT; ++i){
+        visit_page_list(heap->classes[i].available, visit);
+        visit_page_list(heap->classes[i].full, visit);
+        visit_page_list(heap->classes[i].unswept, visit);
+    }
+    for (Tlab *tlab = heap->tlabs; tlab != NULL; tlab = tlab->next){
+        for (unsigned int i = 0; i < GEECE_SIZE_CLASS_COUNT; ++i){
+            if (tlab->pages[i] != NULL){
+                visit(tlab->pages[i]);
+            }
+            visit_page_list(tlab->partial[i], visit);
+            visit_page_list(tlab->full[i], visit);
+        }
+    }
+}
+
+static void count_free_bytes(const Page *page, size_t *capacity, size_t *free_bytes){
+    for (; page != NULL; page = page->next){
+        *capacity += (size_t)page->block_count * page->block_size;
+        *free_bytes += (size_t)(page->block_count - page->used_count) * page->block_size;
+    }
+}
+
+double heap_fragmentation(void){
+    if (heap == NULL){
+        return 0.0;
+    }
+    size_t capacity = 0;
+    size_t free_bytes = 0;
+    heap_lock();
+    for (unsigned int i = 0; i < GEECE_SIZE_CLASS_COUNT; ++i){
+        count_free_bytes(heap->classes[i].available, &capacity, &free_bytes);
+        count_free_bytes(heap->classes[i].full, &capacity, &free_bytes);
+    }
+    for (Tlab *tlab = heap->tlabs; tlab != NULL; tlab = tlab->next){
+        for (unsigned int i = 0; i < GEECE_SIZE_CLASS_COUNT; ++i){
+            if (tlab->pages[i] != NULL){
+                capacity += (size_t)tlab->pages[i]->block_count * tlab->pages[i]->block_size;
+                free_bytes += (size_t)(tlab->pages[i]->block_count - tlab->pages[i]->used_count)
+                              * tlab->pages[i]->block_size;
+            }
+            count_free_bytes(tlab->partial[i], &capacity, &free_bytes);
+            count_free_bytes(tlab->full[i], &capacity, &free_bytes);
+        }
+    }
+    heap_unlock();
+    return capacity > 0 ? (double)free_bytes / (double)capacity : 0.0;
+}
+
+Object *heap_alloc_block(size_t size){
+    if (heap == NULL){
+        heap_init();
+    }
+    if (heap_is_large_size(size)){
+        return large_object_alloc(size);
+    }
+
+    Tlab *tlab = tlab_current();
+    if (tlab == NULL){
+        return NULL;
+    }
+    unsigned int index = page_size_class(size);
+    Page *page = tlab->pages[index];
+    void *block = page != NULL ? page_alloc_block(page) : NULL;
+    if (block == NULL){
+        page = tlab_refill(tlab, index);
+        if (page == NULL){
+            return NULL;
+        }
+        block = page_alloc_block(page);
+    }
+    memset(block, 0, page->block_size);
+    tlab_count_allocated(tlab, page->block_size);
+    return block;
+}
+
+void heap_free_block(Object *object){
+    if (object->flags & OBJECT_YOUNG){
+        // Nursery memory is reclaimed wholesale by the next minor collection
+        return;
+    }
+    if (object->flags & OBJECT_ARENA){
+        // Arena memory is released by the end of the arena or the sweep of its retained chunks
+        return;
+    }
+    if (object->flags & OBJECT_LARGE){
+        large_object_free(object);
+        return;
+    }
+
+    Page *page = page_of(object);
+    Tlab *tlab = tlab_current();
+    tlab_count_freed(tlab, page->block_size);
+    if (page->owner == tlab){
+        tlab_free_block(tlab, page, object);
+        return;
+    }
+
+    heap_lock();
+    if (page->owner != NULL){
+        page_free_remote(page, object);
+        tlab_notify_remote_free(page);
+        heap_unlock();
+        return;
+    }
+    SizeClass *shared = &heap->classes[page->size_class];
+    page_free_block(page, object);
+    if (page->unswept){
+        // Filed by its sweep, which leaves the block alone since it is free
+        heap_unlock();
+        return;
+    }
+    if (page->full){
+        page->full = false;
+        page_list_remove(&shared->full, page);
+        page_list_push(&shared->available, page);
+    }
+    if (page->used_count == 0){
+        page_list_remove(&shared->available, page);
+        heap_release_page(page);
+    }
+    heap_unlock();
+}
+
+static Object *nursery_malloc(size_t size, Destructor destructor){
+    Object *obj = nursery_alloc_block(sizeof(Object) + size);
+    if (obj == NULL){
+        geece_collect_minor();
+        obj = nursery_alloc_block(sizeof(Object) + size);
+        if (obj == NULL){
+            return NULL;
+        }
+    }
+    object_init(obj, size, destructor);
+    if (destructor != NULL){
+        nursery_track_cleanup(obj);
+    }
+    return obj;
+}
+
+/* Runs the collection work an allocation is charged with, then hands the object out. */
+static Object *allocated(Object *obj, size_t size){
+    geece_collect_allocated(sizeof(Object) + size);
+    heap_run_finalizers();
+    geece_rc_merge();
+    if (geece_config.cycle_collection && cycle_collect_due()){
+        geece_collect_cycles();
+    }
+    if (geece_config.deferred_rc){
+        // The new object keeps its allocation's count through the reconciliation
+        if (rc_reconcile_due()){
+            geece_rc_reconcile(geece_config.rc_chunk_objects);
+        }
+        rc_allocated(obj);
+    }
+    return obj;
+}
 
 Object *geece_malloc(size_t size, Destructor destructor){
+    if (heap == NULL){
+        heap_init();
+    }
+    if (nursery_enabled() && !heap_is_large_size(sizeof(Object) + size)){
+        Object *obj = nursery_malloc(size, destructor);
+        if (obj != NULL){
+            return allocated(obj, size);
+        }
+    }
     Object *obj = new_object(size, destructor);
     if (obj == NULL){
         fprintf(stderr, "Error: Failed to allocate memory for object.\n");
         exit(EXIT_FAILURE);
     }
-    if (heap == NULL){
-        heap = malloc(sizeof(Heap));
-        heap->size = size;
-        heap->objects[0] = *obj;
-        heap->top = &heap->objects[0] + sizeof(Object);
-        return obj;
-    } else {
-        heap->size = heap->size + size;
-        heap->top = heap->top + sizeof(Object);
-        return obj;
-    }
+    // Objects allocated during incremental marking are black, so the cycle cannot free them
+    geece_mark_black(obj);
+    return allocated(obj, size);
+}
+
+void geece_pin(Object *object){
+    object->flags |= OBJECT_PINNED;
+}
+
+void geece_unpin(Object *object){
+    object->flags &= (uint16_t)~OBJECT_PINNED;
 }
 
 void geece_release(Object *object){
-    object->ref_count = object->ref_count - 1;
-    if (get_refcount(object) == 0){
-        destroy_object(object);
+    if (geece_config.deferred_rc){
+        return;
+    }
+    if (object_ref_decrement(object) != 0){
+        cycle_candidate(object);
+    } else if (!geece_mark_in_progress()){
+        // Incremental marking may still hold the object gray, its sweep frees it instead
+        rc_destroy(object);
     }
 }
 
@@ -32,10 +567,13 @@ size_t geece_size(Object *object){
 }
 
 Object **geece_data(Object *object){
-    return object->referenced_ptrs;
+    return object_get_data(object);
 }
 
 size_t geece_total_memory(){
+    if (heap == NULL){
+        return 0;
+    }
     return heap->size;
 }
 
@@ -43,7 +581,9 @@ size_t geece_available_memory(){
     if (heap == NULL){
         return 0;
     }
-    size_t used_memory = heap->top - heap->objects;
-    size_t available_memory = heap->size - used_memory;
-    return available_memory;
-}
\ No newline at end of file
+    heap_lock();
+    size_t used = heap->used + tlab_net_allocated();
+    size_t available = heap->size - used;
+    heap_unlock();
+    return available;
+}
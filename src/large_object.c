@@ -0,0 +1,125 @@
+/**
+ * @file large_object.c
+ * @brief Implementation of the large-object space.
+ */
+#include "large_object.h"
+
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "heap.h"
+#include "nursery.h"
+#include "utils.h"
+
+#define LARGE_OBJECT_HEADER_SIZE GEECE_ALIGN_UP(sizeof(LargeObject), GEECE_MIN_BLOCK_SIZE)
+
+static LargeObject *large_objects = NULL;
+static size_t count = 0;
+
+static inline LargeObject *header_of(const Object *object){
+    return (LargeObject *)((char *)object - LARGE_OBJECT_HEADER_SIZE);
+}
+
+static inline Object *object_of(LargeObject *large_object){
+    return (Object *)((char *)large_object + LARGE_OBJECT_HEADER_SIZE);
+}
+
+static void unlink_large_object(LargeObject *large_object){
+    if (large_object->prev != NULL){
+        large_object->prev->next = large_object->next;
+    } else {
+        large_objects = large_object->next;
+    }
+    if (large_object->next != NULL){
+        large_object->next->prev = large_object->prev;
+    }
+    count--;
+    page_directory_add_large(large_object, large_object->mapped_size, -1);
+    heap->size -= large_object->mapped_size;
+    heap->used -= large_object->mapped_size;
+}
+
+Object *large_object_alloc(size_t size){
+    size_t mapped_size = GEECE_ALIGN_UP(LARGE_OBJECT_HEADER_SIZE + size, (size_t)sysconf(_SC_PAGESIZE));
+    LargeObject *large_object = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (large_object == MAP_FAILED){
+        fprintf(stderr, "Error: Failed to map large object.\n");
+        return NULL;
+    }
+    large_object->mapped_size = mapped_size;
+    large_object->prev = NULL;
+
+    heap_lock();
+    large_object->next = large_objects;
+    if (large_objects != NULL){
+        large_objects->prev = large_object;
+    }
+    large_objects = large_object;
+    count++;
+    page_directory_add_large(large_object, mapped_size, 1);
+    heap->size += mapped_size;
+    heap->used += mapped_size;
+    heap_unlock();
+
+    Object *object = object_of(large_object);
+    object->flags = OBJECT_LARGE;
+    return object;
+}
+
+void large_object_free(Object *object){
+    LargeObject *large_object = header_of(object);
+    heap_lock();
+    unlink_large_object(large_object);
+    heap_unlock();
+    munmap(large_object, large_object->mapped_size);
+}
+
+uint64_t *large_object_mark_word(const Object *object, uint64_t *mask){
+    *mask = 1;
+    return &header_of(object)->mark;
+}
+
+size_t large_object_sweep(void){
+    size_t freed = 0;
+    LargeObject *large_object = large_objects;
+    while (large_object != NULL){
+        LargeObject *next = large_object->next;
+        Object *object = object_of(large_object);
+        if (large_object->mark){
+            large_object->mark = 0;
+        } else {
+            object_finalize(object);
+            if (object->flags & OBJECT_REMEMBERED){
+                nursery_forget(object);
+            }
+            size_t mapped_size = large_object->mapped_size;
+            heap_lock();
+            unlink_large_object(large_object);
+            heap_unlock();
+            munmap(large_object, mapped_size);
+            freed += mapped_size;
+        }
+        large_object = next;
+    }
+    return freed;
+}
+
+void large_object_for_each(void (*visit)(Object *object)){
+    for (LargeObject *large_object = large_objects; large_object != NULL; large_object = large_object->next){
+        visit(object_of(large_object));
+    }
+}
+
+Object *large_object_containing(const void *ptr){
+    for (LargeObject *large_object = large_objects; large_object != NULL; large_object = large_object->next){
+        Object *object = object_of(large_object);
+        if ((const char *)ptr >= (const char *)object && (const char *)ptr < (char *)large_object + large_object->mapped_size){
+            return object;
+        }
+    }
+    return NULL;
+}
+
+size_t large_object_count(void){
+    return count;
+}
@@ -1,16 +1,805 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
 #include "object.h"
+#include "type.h"
 #include "mark_and_sweep.h"
+#include "heap.h"
+#include "tlab.h"
+#include "timer.h"
+#include "utils.h"
+#include "large_object.h"
+#include "nursery.h"
+#include "cycle_collector.h"
+#include "reference.h"
+#include "reference_counting.h"
+#include "handle_scope.h"
+#include "stack_roots.h"
+#include "arena.h"
+#include "configuration.h"
+#include "work_deque.h"
+#include "workers.h"
+
+/* Objects popped off the mark stack wait this many scans in a FIFO, giving their prefetch time to land. */
+#define PREFETCH_DEPTH 8
+#define INITIAL_MARK_STACK_CAPACITY 1024
+
+typedef struct {
+    Object **items;             /**< Objects waiting to be marked, referenced by marked objects. */
+    size_t count;               /**< Number of objects on the stack. */
+    size_t capacity;            /**< Number of objects the stack has room for. */
+    bool overflowed;            /**< An object could not be pushed, marked objects must be rescanned. */
+    size_t marked_bytes;        /**< Bytes of the objects marked since the last `geece_mark_roots()`. */
+} MarkStack;
+
+static MarkStack stack;
+
+/* An incremental cycle is marking between slices. Young objects and objects of open arenas are
+ * then kept off the mark stack, since minor collections move the former and ending an arena frees
+ * the latter; both are scanned as roots when the cycle finishes. Read by every thread shading. */
+static atomic_bool incremental = false;
+
+/* The incremental cycle marks on the background thread. The mark stack is then the marker's alone:
+ * other threads set mark bits atomically and hand the objects they shade over through their SATB
+ * buffers. Only changed while the marker is parked. */
+static atomic_bool concurrent = false;
+
+/* Finds the side bitmap word holding an object's mark bit, so marking never writes to objects. */
+static inline uint64_t *mark_word(const Object *object, uint64_t *mask){
+    if (object->flags & (OBJECT_YOUNG | OBJECT_LARGE | OBJECT_ARENA)){
+        if (object->flags & OBJECT_YOUNG){
+            return nursery_mark_word(object, mask);
+        }
+        if (object->flags & OBJECT_LARGE){
+            return large_object_mark_word(object, mask);
+        }
+        return arena_mark_word(object, mask);
+    }
+    Page *page = page_of(object);
+    size_t index = page_block_index(page, object);
+    *mask = (uint64_t)1 << (index % 64);
+    return &page->marks[index / 64];
+}
+
+bool geece_is_marked(const Object *object){
+    uint64_t mask;
+    return (__atomic_load_n(mark_word(object, &mask), __ATOMIC_RELAXED) & mask) != 0;
+}
+
+/* Sets the mark bit of an object, returns false if it was already set. */
+static inline bool test_and_mark(Object *object){
+    uint64_t mask;
+    uint64_t *word = mark_word(object, &mask);
+    if (__atomic_load_n(word, __ATOMIC_RELAXED) & mask){
+        return false;
+    }
+    if (concurrent){
+        // The marker and allocating threads set bits of the same words
+        return !(__atomic_fetch_or(word, mask, __ATOMIC_RELAXED) & mask);
+    }
+    *word |= mask;
+    return true;
+}
+
+static bool grow_stack(void){
+    size_t limit = geece_config.mark_stack_limit;
+    if (stack.capacity >= limit){
+        return false;
+    }
+    size_t capacity = stack.capacity == 0 ? INITIAL_MARK_STACK_CAPACITY : stack.capacity * 2;
+    if (capacity > limit){
+        capacity = limit;
+    }
+    Object **items = realloc(stack.items, capacity * sizeof(Object *));
+    if (items == NULL){
+        return false;
+    }
+    stack.items = items;
+    stack.capacity = capacity;
+    return true;
+}
+
+/* Gives back a stack grown past a limit that was lowered since. */
+static void apply_stack_limit(void){
+    if (stack.capacity > geece_config.mark_stack_limit){
+        free(stack.items);
+        stack.items = NULL;
+        stack.capacity = 0;
+    }
+}
+
+static inline void push(Object *object){
+    if (stack.count == stack.capacity && !grow_stack()){
+        // The object stays unmarked behind a marked referrer, the rescan finds it again
+        stack.overflowed = true;
+        return;
+    }
+    stack.items[stack.count++] = object;
+}
+
+static inline bool deferred(const Object *object){
+    return (object->flags & OBJECT_YOUNG) || ((object->flags & OBJECT_ARENA) && arena_of(object) != NULL);
+}
+
+static inline void push_references(const Object *object){
+    size_t count;
+    Object **references = object_references(object, &count);
+    for (size_t i = 0; i < count; ++i){
+        Object *reference = object_edge_load(&references[i]);
+        if (reference != NULL && !(incremental && deferred(reference))){
+            push(reference);
+        }
+    }
+    // Fields are read atomically, the mutator may be storing to them while the marker scans
+    const TypeInfo *info = object_type_info(object);
+    for (size_t i = 0; info != NULL && i < info->field_count; ++i){
+        Object *field = __atomic_load_n(type_field(object, info, i), __ATOMIC_RELAXED);
+        if (field != NULL && !(incremental && deferred(field))){
+            push(field);
+        }
+    }
+}
+
+static inline void mark_object(Object *object){
+    if (test_and_mark(object)){
+        stack.marked_bytes += sizeof(Object) + object->size;
+        push_references(object);
+    }
+}
+
+/* Marks from the stack until it is empty or `budget` more bytes are marked, returns whether it
+ * emptied. Popped objects go through a small FIFO and are prefetched on the way in, so their
+ * header is in cache by the time they are marked. */
+static bool drain_budget(size_t budget){
+    Object *pending[PREFETCH_DEPTH];
+    size_t head = 0;
+    size_t count = 0;
+    size_t target = stack.marked_bytes + budget < stack.marked_bytes ? SIZE_MAX : stack.marked_bytes + budget;
+    for (;;){
+        while (count < PREFETCH_DEPTH && stack.count > 0){
+            Object *object = stack.items[--stack.count];
+            __builtin_prefetch(object, 1);
+            pending[(head + count++) % PREFETCH_DEPTH] = object;
+        }
+        if (count == 0){
+            return true;
+        }
+        if (stack.marked_bytes >= target){
+            // Out of budget, the objects in flight go back where they came from
+            while (count > 0){
+                stack.items[stack.count++] = pending[(head + --count) % PREFETCH_DEPTH];
+            }
+            return false;
+        }
+        Object *object = pending[head];
+        head = (head + 1) % PREFETCH_DEPTH;
+        count--;
+        mark_object(object);
+    }
+}
+
+static void drain(void){
+    drain_budget(SIZE_MAX);
+}
+
+static void push_unmarked_references(Object *object){
+    if (!geece_is_marked(object)){
+        return;
+    }
+    size_t count;
+    Object **references = object_references(object, &count);
+    for (size_t i = 0; i < count; ++i){
+        if (references[i] != NULL && !geece_is_marked(references[i])){
+            push(references[i]);
+        }
+    }
+    const TypeInfo *info = object_type_info(object);
+    for (size_t i = 0; info != NULL && i < info->field_count; ++i){
+        Object *field = *type_field(object, info, i);
+        if (field != NULL && !geece_is_marked(field)){
+            push(field);
+        }
+    }
+}
+
+static void rescan_page(Page *page){
+    for (size_t word = 0; word < GEECE_PAGE_BITMAP_WORDS; ++word){
+        for (uint64_t marks = page->marks[word]; marks != 0; marks &= marks - 1){
+            size_t index = word * 64 + (size_t)__builtin_ctzll(marks);
+            push_unmarked_references((Object *)(page->blocks + index * page->block_size));
+        }
+    }
+}
+
+/* Drains the stack, and after an overflow walks the heap for marked objects with unmarked
+ * references until an overflow-free drain completes the marking. */
+static void finish_marking(void){
+    drain();
+    while (stack.overflowed){
+        stack.overflowed = false;
+        heap_for_each_page(rescan_page);
+        large_object_for_each(push_unmarked_references);
+        arena_for_each(push_unmarked_references);
+        nursery_for_each(push_unmarked_references);
+        drain();
+    }
+}
 
 void geece_mark(Object *object){
+    if (object == NULL){
+        return;
+    }
+    apply_stack_limit();
+    mark_object(object);
+    finish_marking();
 }
 
 void geece_ptr_scanner(Object *object, void (*mark_function)(Object *obj)){
-    if (object == NULL){
+    if (object == NULL || !test_and_mark(object)){
+        return;
+    }
+    size_t count;
+    Object **references = object_references(object, &count);
+    for (size_t i = 0; i < count; ++i){
+        mark_function(references[i]);
+    }
+    const TypeInfo *info = object_type_info(object);
+    for (size_t i = 0; info != NULL && i < info->field_count; ++i){
+        mark_function(*type_field(object, info, i));
+    }
+}
+
+/* Root set slots a parallel marker claims at a time, empty ones included. */
+#define ROOT_SLOT_BATCH 256
+
+typedef struct {
+    WorkDeque deque;            /**< Objects waiting to be marked, taken by the owner and stolen by the others. */
+    size_t marked_bytes;        /**< Bytes of the objects this worker marked. */
+    bool overflowed;            /**< An object could not be pushed, marked objects must be rescanned. */
+} MarkWorker;
+
+typedef struct {
+    MarkWorker *workers;
+    unsigned int count;
+    RootTable *roots;
+    atomic_size_t next_slot;    /**< First root set slot no worker claimed yet. */
+    atomic_uint idle;           /**< Workers that found no work to do or steal. */
+} ParallelMark;
+
+static _Thread_local MarkWorker *current_worker = NULL;
+
+static inline void push_parallel(MarkWorker *worker, Object *object){
+    if (!work_deque_push(&worker->deque, object)){
+        worker->overflowed = true;
+    }
+}
+
+static inline void mark_parallel(MarkWorker *worker, Object *object){
+    uint64_t mask;
+    uint64_t *word = mark_word(object, &mask);
+    if (__atomic_load_n(word, __ATOMIC_RELAXED) & mask){
+        return;
+    }
+    // Workers race for the bit, whoever sets it scans the object
+    if (__atomic_fetch_or(word, mask, __ATOMIC_RELAXED) & mask){
+        return;
+    }
+    worker->marked_bytes += sizeof(Object) + object->size;
+    size_t count;
+    Object **references = object_references(object, &count);
+    for (size_t i = 0; i < count; ++i){
+        if (references[i] != NULL){
+            __builtin_prefetch(references[i], 1);
+            push_parallel(worker, references[i]);
+        }
+    }
+    const TypeInfo *info = object_type_info(object);
+    for (size_t i = 0; info != NULL && i < info->field_count; ++i){
+        Object *field = *type_field(object, info, i);
+        if (field != NULL){
+            __builtin_prefetch(field, 1);
+            push_parallel(worker, field);
+        }
+    }
+}
+
+static void drain_parallel(MarkWorker *worker){
+    Object *object;
+    while ((object = work_deque_take(&worker->deque)) != NULL){
+        mark_parallel(worker, object);
+    }
+}
+
+static bool steal(ParallelMark *mark, unsigned int thief){
+    for (unsigned int i = 1; i < mark->count; ++i){
+        Object *object = work_deque_steal(&mark->workers[(thief + i) % mark->count].deque);
+        if (object != NULL){
+            mark_parallel(&mark->workers[thief], object);
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Returns false once every worker is idle. Work only comes from the deques of busy workers, so
+ * when all of them are idle at once, none is left anywhere. */
+static bool find_work(ParallelMark *mark, unsigned int thief){
+    if (steal(mark, thief)){
+        return true;
+    }
+    atomic_fetch_add(&mark->idle, 1);
+    for (;;){
+        if (atomic_load(&mark->idle) == mark->count){
+            return false;
+        }
+        for (unsigned int i = 1; i < mark->count; ++i){
+            if (!work_deque_empty(&mark->workers[(thief + i) % mark->count].deque)){
+                atomic_fetch_sub(&mark->idle, 1);
+                if (steal(mark, thief)){
+                    return true;
+                }
+                atomic_fetch_add(&mark->idle, 1);
+                break;
+            }
+        }
+        sched_yield();
+    }
+}
+
+static void push_root(Object *object){
+    // A root nothing marked points to would never be rescanned, so one that does not fit is marked here
+    if (object != NULL && !work_deque_push(&current_worker->deque, object)){
+        mark_parallel(current_worker, object);
+    }
+}
+
+static void mark_worker(unsigned int index, void *arg){
+    ParallelMark *mark = arg;
+    MarkWorker *worker = &mark->workers[index];
+    current_worker = worker;
+    RootTable *roots = mark->roots;
+    size_t slot_count = roots != NULL ? root_table_slot_count(roots) : 0;
+    for (;;){
+        size_t first = atomic_fetch_add(&mark->next_slot, ROOT_SLOT_BATCH);
+        if (first >= slot_count){
+            break;
+        }
+        size_t end = first + ROOT_SLOT_BATCH < slot_count ? first + ROOT_SLOT_BATCH : slot_count;
+        for (size_t i = first; i < end; ++i){
+            push_root(root_table_slot(roots, i));
+        }
+        drain_parallel(worker);
+    }
+    if (index == 0){
+        // A sharded table has no slots to split, one worker walks its snapshot
+        if (roots != NULL && root_table_is_sharded(roots)){
+            root_table_for_each(roots, push_root);
+        }
+        arena_mark_roots(push_root);
+        handle_scope_for_each(push_root);
+    }
+    do {
+        drain_parallel(worker);
+    } while (find_work(mark, index));
+    current_worker = NULL;
+}
+
+/* Marks from the roots on `count` threads, returns false if the workers could not be set up. */
+static bool mark_roots_parallel(RootTable *roots, unsigned int count){
+    ParallelMark mark = {.count = count, .roots = roots};
+    atomic_init(&mark.next_slot, 0);
+    atomic_init(&mark.idle, 0);
+    mark.workers = calloc(count, sizeof(MarkWorker));
+    if (mark.workers == NULL){
+        return false;
+    }
+    size_t limit = geece_config.mark_stack_limit;
+    size_t capacity = INITIAL_MARK_STACK_CAPACITY < limit ? INITIAL_MARK_STACK_CAPACITY : limit;
+    unsigned int initialized = 0;
+    while (initialized < count && work_deque_init(&mark.workers[initialized].deque, capacity, limit)){
+        initialized++;
+    }
+    if (initialized == count){
+        workers_run(count, mark_worker, &mark);
+    }
+    for (unsigned int i = 0; i < initialized; ++i){
+        stack.marked_bytes += mark.workers[i].marked_bytes;
+        stack.overflowed |= mark.workers[i].overflowed;
+        work_deque_destroy(&mark.workers[i].deque);
+    }
+    free(mark.workers);
+    return initialized == count;
+}
+
+static void mark_root(Object *object){
+    if (object != NULL){
+        mark_object(object);
+        drain();
+    }
+}
+
+/* Bytes of objects the background marker traces between looks at its SATB queue and at threads
+ * waiting for it to park. */
+#define CONCURRENT_MARK_CHUNK (64 * 1024)
+
+static pthread_mutex_t marker_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t marker_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t marker_parked = PTHREAD_COND_INITIALIZER;
+static bool marker_started = false;
+static bool marker_active = false;          /* The marker has a cycle to mark. */
+static bool marker_busy = false;            /* The marker is tracing with the lock released. */
+static unsigned int marker_pauses = 0;      /* Threads that need the marker parked. */
+static atomic_bool marker_done;             /* The marker ran out of work. */
+static uint64_t marker_ns = 0;              /* Time the marker spent tracing. */
+static PointerArray satb_queue;             /* Objects shaded by other threads, waiting for the marker. */
+static bool satb_overflowed = false;        /* An object was marked without being traced, see `queue_satb()`. */
+static atomic_bool satb_closed;             /* The collector takes the thread buffers, shaded objects go to the queue. */
+static PointerArray retired;                /* Edge arrays replaced while the marker may read them. */
+static atomic_size_t black_bytes;           /* Bytes of the objects other threads marked black. */
+
+/* Queues an object for the marker, with the marker lock held. */
+static void queue_satb(Object *object){
+    if (!pointer_array_push(&satb_queue, object)){
+        // Marked here instead, the overflow rescan at the finish traces its references
+        test_and_mark(object);
+        satb_overflowed = true;
+    }
+}
+
+/* Moves the queued objects onto the mark stack, with the marker lock held. */
+static void take_satb_queue(void){
+    for (size_t i = 0; i < satb_queue.count; ++i){
+        Object *object = satb_queue.items[i];
+        if (!geece_is_marked(object)){
+            push(object);
+        }
+    }
+    satb_queue.count = 0;
+}
+
+static void *marker_main(void *arg){
+    (void)arg;
+    pthread_mutex_lock(&marker_lock);
+    for (;;){
+        if (marker_active && marker_pauses == 0){
+            take_satb_queue();
+            if (stack.count > 0){
+                marker_busy = true;
+                pthread_mutex_unlock(&marker_lock);
+                uint64_t start = timer_now_ns();
+                drain_budget(CONCURRENT_MARK_CHUNK);
+                uint64_t elapsed = timer_elapsed_ns(start);
+                pthread_mutex_lock(&marker_lock);
+                marker_busy = false;
+                marker_ns += elapsed;
+                pthread_cond_broadcast(&marker_parked);
+                continue;
+            }
+            atomic_store(&marker_done, true);
+        }
+        pthread_cond_wait(&marker_wake, &marker_lock);
+    }
+    return NULL;
+}
+
+/* Waits for the marker to finish its chunk, with the marker lock held. */
+static void park_marker(void){
+    while (marker_busy){
+        pthread_cond_wait(&marker_parked, &marker_lock);
+    }
+}
+
+/* Claims the SATB buffer of a thread: its owner recording into it and the collector taking it
+ * never touch it at the same time. */
+static void claim_satb(Tlab *tlab){
+    while (atomic_exchange_explicit(&tlab->satb_busy, true, memory_order_acquire)){
+        sched_yield();
+    }
+}
+
+static void release_satb(Tlab *tlab){
+    atomic_store_explicit(&tlab->satb_busy, false, memory_order_release);
+}
+
+/* Moves the SATB buffers of every thread onto the mark stack, once the marker is parked for good.
+ * Threads keep running: whoever claims its buffer after the collector finds it closed. */
+static void take_satb_buffers(void){
+    atomic_store(&satb_closed, true);
+    heap_lock();
+    for (Tlab *tlab = heap->tlabs; tlab != NULL; tlab = tlab->next){
+        claim_satb(tlab);
+        for (size_t i = 0; i < tlab->satb_count; ++i){
+            Object *object = tlab->satb[i];
+            if (!geece_is_marked(object)){
+                push(object);
+            }
+        }
+        tlab->satb_count = 0;
+        release_satb(tlab);
+    }
+    heap_unlock();
+}
+
+/* Records an object shaded during concurrent marking in the calling thread's SATB buffer, or in
+ * the queue once the collector took the buffers. */
+static void record_satb(Object *object){
+    Tlab *tlab = tlab_current();
+    if (tlab != NULL){
+        claim_satb(tlab);
+        if (!atomic_load(&satb_closed)){
+            tlab->satb[tlab->satb_count++] = object;
+            bool full = tlab->satb_count == GEECE_SATB_BUFFER_SIZE;
+            release_satb(tlab);
+            if (full){
+                geece_mark_flush(tlab);
+            }
+            return;
+        }
+        release_satb(tlab);
+    }
+    pthread_mutex_lock(&marker_lock);
+    queue_satb(object);
+    pthread_mutex_unlock(&marker_lock);
+}
+
+void geece_mark_start(RootTable *roots){
+    apply_stack_limit();
+    stack.marked_bytes = 0;
+    incremental = true;
+    root_table_for_each(roots, geece_shade);
+    handle_scope_for_each(geece_shade);
+    stack_roots_scan(geece_shade);
+}
+
+bool geece_mark_start_concurrent(void){
+    pthread_mutex_lock(&marker_lock);
+    if (!marker_started){
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, marker_main, NULL) != 0){
+            pthread_mutex_unlock(&marker_lock);
+            fprintf(stderr, "Error: Failed to start the background marking thread.\n");
+            return false;
+        }
+        pthread_detach(thread);
+        marker_started = true;
+    }
+    concurrent = true;
+    marker_active = true;
+    // What the last cycle queued after its remark is stale, the objects may be gone
+    satb_queue.count = 0;
+    atomic_store(&satb_closed, false);
+    atomic_store(&marker_done, false);
+    pthread_cond_signal(&marker_wake);
+    pthread_mutex_unlock(&marker_lock);
+    return true;
+}
+
+bool geece_mark_concurrent_done(void){
+    return atomic_load(&marker_done);
+}
+
+uint64_t geece_mark_concurrent_ns(void){
+    pthread_mutex_lock(&marker_lock);
+    uint64_t ns = marker_ns;
+    pthread_mutex_unlock(&marker_lock);
+    return ns;
+}
+
+void geece_mark_pause(void){
+    if (!concurrent){
+        return;
+    }
+    pthread_mutex_lock(&marker_lock);
+    marker_pauses++;
+    park_marker();
+    pthread_mutex_unlock(&marker_lock);
+}
+
+void geece_mark_resume(void){
+    if (!concurrent){
+        return;
+    }
+    pthread_mutex_lock(&marker_lock);
+    marker_pauses--;
+    pthread_cond_signal(&marker_wake);
+    pthread_mutex_unlock(&marker_lock);
+}
+
+void geece_mark_flush(Tlab *tlab){
+    claim_satb(tlab);
+    if (tlab->satb_count > 0){
+        pthread_mutex_lock(&marker_lock);
+        for (size_t i = 0; i < tlab->satb_count; ++i){
+            queue_satb(tlab->satb[i]);
+        }
+        tlab->satb_count = 0;
+        atomic_store(&marker_done, false);
+        pthread_cond_signal(&marker_wake);
+        pthread_mutex_unlock(&marker_lock);
+    }
+    release_satb(tlab);
+}
+
+void geece_mark_retire(void *memory){
+    if (!concurrent){
+        free(memory);
+        return;
+    }
+    // The marker may be reading the edges, so the array lives until the cycle finishes; if it
+    // cannot be recorded it is leaked rather than freed under the marker
+    pthread_mutex_lock(&marker_lock);
+    bool finished = !concurrent;
+    if (!finished){
+        pointer_array_push(&retired, memory);
+    }
+    pthread_mutex_unlock(&marker_lock);
+    if (finished){
+        free(memory);
+    }
+}
+
+bool geece_mark_step(size_t budget){
+    return drain_budget(budget);
+}
+
+bool geece_mark_in_progress(void){
+    return incremental;
+}
+
+void geece_shade(Object *object){
+    // Read first: the remark clears incremental before concurrent, so a thread seeing the cycle
+    // still incremental after this never takes it for one marking on the collecting thread
+    bool marking_concurrently = concurrent;
+    if (!incremental || object == NULL || deferred(object) || geece_is_marked(object)){
+        return;
+    }
+    if (marking_concurrently){
+        record_satb(object);
+        return;
+    }
+    // Dropped on overflow like any push, the rescan finds it behind its referrer or root
+    push(object);
+}
+
+void geece_mark_black(Object *object){
+    if (!incremental || !test_and_mark(object)){
         return;
     }
-    if (object->marked == true){
+    if (concurrent){
+        // The mark stack is the marker's, the references are shaded through the buffer instead
+        atomic_fetch_add_explicit(&black_bytes, sizeof(Object) + object->size, memory_order_relaxed);
+        size_t count;
+        Object **references = object_references(object, &count);
+        for (size_t i = 0; i < count; ++i){
+            geece_shade(object_edge_load(&references[i]));
+        }
+        const TypeInfo *info = object_type_info(object);
+        for (size_t i = 0; info != NULL && i < info->field_count; ++i){
+            geece_shade(*type_field(object, info, i));
+        }
         return;
     }
-    object->marked = true;
+    stack.marked_bytes += sizeof(Object) + object->size;
+    push_references(object);
+}
+
+/* Parks the marker for the rest of the cycle and takes over what it and the other threads left. */
+static void stop_marker(void){
+    pthread_mutex_lock(&marker_lock);
+    marker_active = false;
+    park_marker();
+    pthread_mutex_unlock(&marker_lock);
+    // The queue goes last, it gets what threads shade once their buffers are closed
+    take_satb_buffers();
+    pthread_mutex_lock(&marker_lock);
+    take_satb_queue();
+    stack.overflowed |= satb_overflowed;
+    satb_overflowed = false;
+    pthread_mutex_unlock(&marker_lock);
+    stack.marked_bytes += atomic_exchange(&black_bytes, 0);
+}
+
+size_t geece_mark_finish(RootTable *roots){
+    if (concurrent){
+        stop_marker();
+    }
+    // Everything stays put from here on, so the deferred objects are traced like any other. Threads
+    // that saw the cycle still incremental go to the SATB queue and read the marks, so they are set
+    // atomically until the end
+    incremental = false;
+    root_table_for_each(roots, mark_root);
+    arena_mark_roots(mark_root);
+    handle_scope_for_each(mark_root);
+    nursery_for_each(mark_root);
+    stack_roots_scan(mark_root);
+    finish_marking();
+    if (concurrent){
+        // Edge arrays other threads replaced may have been read until now
+        pthread_mutex_lock(&marker_lock);
+        for (size_t i = 0; i < retired.count; ++i){
+            free(retired.items[i]);
+        }
+        retired.count = 0;
+        concurrent = false;
+        pthread_mutex_unlock(&marker_lock);
+    }
+    return stack.marked_bytes;
+}
 
-}
\ No newline at end of file
+size_t geece_mark_roots(RootTable *roots){
+    apply_stack_limit();
+    stack.marked_bytes = 0;
+    unsigned int threads = geece_config.mark_threads > 1 ? workers_start(geece_config.mark_threads) : 1;
+    if (threads <= 1 || !mark_roots_parallel(roots, threads)){
+        root_table_for_each(roots, mark_root);
+        arena_mark_roots(mark_root);
+        handle_scope_for_each(mark_root);
+    }
+    stack_roots_scan(mark_root);
+    // Overflows of the parallel workers are recovered from here, on the collecting thread
+    finish_marking();
+    return stack.marked_bytes;
+}
+
+/* Frees the dead objects of a page. With `finalize` given, dead objects that run a destructor or
+ * sit in the remembered set are queued there and keep their block, since neither may happen
+ * under the heap lock; the ones that cannot be queued stay for the next sweep to find. */
+static size_t sweep_page(Page *page, PointerArray *finalize){
+    // Blocks on the free lists are not objects, collect them in a bitmap first
+    uint64_t free_blocks[GEECE_PAGE_BITMAP_WORDS];
+    page_free_bitmap(page, free_blocks);
+
+    // Dead blocks are allocated and unmarked, found a word of 64 blocks at a time
+    size_t freed = 0;
+    size_t words = (page->block_count + 63) / 64;
+    for (size_t word = 0; word < words; ++word){
+        uint64_t blocks = word + 1 < words || page->block_count % 64 == 0
+                          ? ~(uint64_t)0 : ((uint64_t)1 << (page->block_count % 64)) - 1;
+        uint64_t dead = blocks & ~free_blocks[word] & ~page->marks[word];
+        while (dead != 0){
+            size_t index = word * 64 + (size_t)__builtin_ctzll(dead);
+            dead &= dead - 1;
+            Object *object = (Object *)(page->blocks + index * page->block_size);
+            if (finalize != NULL && (object_destructor(object) != NULL || (object->flags & OBJECT_REMEMBERED))){
+                pointer_array_push(finalize, object);
+                continue;
+            }
+            object_finalize(object);
+            if (object->flags & OBJECT_REMEMBERED){
+                nursery_forget(object);
+            }
+            page_free_block(page, object);
+            freed += page->block_size;
+        }
+    }
+    memset(page->marks, 0, sizeof(page->marks));
+    return freed;
+}
+
+size_t geece_sweep_page(Page *page){
+    return sweep_page(page, NULL);
+}
+
+size_t geece_sweep_page_deferred(Page *page, PointerArray *finalize){
+    return sweep_page(page, finalize);
+}
+
+size_t geece_sweep(void){
+    size_t freed = 0;
+    rc_forget_unmarked();
+    cycle_forget_unmarked();
+    reference_forget_unmarked();
+    if (geece_config.lazy_sweep){
+        heap_defer_sweep();
+    } else if (geece_config.sweep_threads > 1){
+        freed = heap_sweep_pages_parallel(geece_config.sweep_threads);
+    } else {
+        freed = heap_sweep_pages(geece_sweep_page);
+    }
+    freed += large_object_sweep();
+    freed += arena_sweep();
+    nursery_clear_marks();
+    return freed;
+}
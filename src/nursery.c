@@ -0,0 +1,331 @@
+/**
+ * @file nursery.c
+ * @brief Implementation of the bump-allocated young generation.
+ */
+#include "nursery.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "configuration.h"
+#include "handle_scope.h"
+#include "heap.h"
+#include "mark_and_sweep.h"
+#include "reference.h"
+#include "tlab.h"
+#include "type.h"
+#include "utils.h"
+
+/* Eden gets this share of the nursery in eighths, the rest is split between the survivor spaces. */
+#define EDEN_EIGHTHS 6
+
+typedef struct {
+    char *start;                /**< Start of the nursery mapping. */
+    size_t size;                /**< Size of the nursery mapping. */
+    char *eden_end;             /**< End of eden, which starts at `heap->objects`. */
+    char *from_space;           /**< Survivor space holding the survivors of the last collection. */
+    char *from_top;             /**< End of the live data in `from_space`. */
+    char *to_space;             /**< Survivor space the next collection copies into. */
+    char *to_top;               /**< Copy pointer into `to_space` during a collection. */
+    size_t survivor_size;       /**< Size of each survivor space. */
+    size_t used;                /**< Young bytes accounted in `heap->used`. */
+    PointerArray remembered;    /**< Old objects with edges into the nursery. */
+    PointerArray cleanup;       /**< Young objects that need finalizing if they die young. */
+    PointerArray promoted;      /**< Objects promoted by the running collection, still to be scanned. */
+    size_t promoted_bytes;      /**< Bytes promoted by the running collection. */
+    uint64_t *marks;            /**< Mark bits of the full collection, one per granule of the mapping. */
+} Nursery;
+
+static Nursery nursery;
+
+/* Blocks always have room for the forwarding address, which empty objects would otherwise lack. */
+static inline size_t block_size_for(size_t size){
+    return GEECE_ALIGN_UP(size > sizeof(Object) + sizeof(Object *) ? size : sizeof(Object) + sizeof(Object *), GEECE_MIN_BLOCK_SIZE);
+}
+
+static inline size_t block_size_of(const Object *object){
+    return block_size_for(sizeof(Object) + object->size);
+}
+
+/* A stale copy stores the address of its replacement in its first data word. */
+static inline Object *forwardee(const Object *object){
+    return *(Object *const *)(object + 1);
+}
+
+static inline bool in_to_space(const Object *object){
+    const char *address = (const char *)object;
+    return address >= nursery.to_space && address < nursery.to_space + nursery.survivor_size;
+}
+
+bool nursery_init(size_t size){
+    size = GEECE_ALIGN_UP(size, GEECE_PAGE_SIZE);
+    char *start = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (start == MAP_FAILED){
+        fprintf(stderr, "Error: Failed to map the nursery.\n");
+        return false;
+    }
+    uint64_t *marks = calloc(size / GEECE_MIN_BLOCK_SIZE / 64, sizeof(uint64_t));
+    if (marks == NULL){
+        fprintf(stderr, "Error: Failed to allocate the nursery mark bitmap.\n");
+        munmap(start, size);
+        return false;
+    }
+    memset(&nursery, 0, sizeof(Nursery));
+    nursery.start = start;
+    nursery.marks = marks;
+    nursery.size = size;
+    nursery.survivor_size = GEECE_ALIGN_UP(size * (8 - EDEN_EIGHTHS) / 16, GEECE_MIN_BLOCK_SIZE);
+    nursery.eden_end = start + size - 2 * nursery.survivor_size;
+    nursery.from_space = nursery.eden_end;
+    nursery.from_top = nursery.from_space;
+    nursery.to_space = nursery.from_space + nursery.survivor_size;
+
+    heap->objects = (Object *)start;
+    heap->top = (Object *)start;
+    heap->size += size;
+    return true;
+}
+
+bool nursery_enabled(void){
+    return nursery.start != NULL;
+}
+
+/* Carves a fresh eden chunk for an allocation buffer, large enough for at least `size` bytes. */
+static bool nursery_refill_chunk(Tlab *tlab, size_t size){
+    size_t chunk = size > GEECE_TLAB_NURSERY_CHUNK ? size : GEECE_TLAB_NURSERY_CHUNK;
+    heap_lock();
+    char *top = (char *)heap->top;
+    size_t left = (size_t)(nursery.eden_end - top);
+    if (left < size){
+        heap_unlock();
+        return false;
+    }
+    if (chunk > left){
+        chunk = left;
+    }
+    heap->top = (Object *)(top + chunk);
+    nursery.used += chunk;
+    heap->used += chunk;
+    heap_unlock();
+    tlab->nursery_top = top;
+    tlab->nursery_end = top + chunk;
+    return true;
+}
+
+Object *nursery_alloc_block(size_t size){
+    size = block_size_for(size);
+    Tlab *tlab = tlab_current();
+    if (tlab == NULL){
+        return NULL;
+    }
+    if (size > (size_t)(tlab->nursery_end - tlab->nursery_top) && !nursery_refill_chunk(tlab, size)){
+        return NULL;
+    }
+    Object *object = (Object *)tlab->nursery_top;
+    tlab->nursery_top += size;
+    object->flags = OBJECT_YOUNG;
+    return object;
+}
+
+void nursery_track_cleanup(Object *object){
+    heap_lock();
+    if (pointer_array_push(&nursery.cleanup, object)){
+        object->flags |= OBJECT_TRACKED;
+    }
+    heap_unlock();
+}
+
+void nursery_remember(Object *object){
+    heap_lock();
+    if (pointer_array_push(&nursery.remembered, object)){
+        object->flags |= OBJECT_REMEMBERED;
+    }
+    heap_unlock();
+}
+
+void nursery_forget(Object *object){
+    heap_lock();
+    pointer_array_remove(&nursery.remembered, object);
+    object->flags &= (uint16_t)~OBJECT_REMEMBERED;
+    heap_unlock();
+}
+
+/* Copies a young object into to-space, or into the old space once it is old enough. */
+static Object *evacuate(Object *object){
+    if (object->flags & OBJECT_FORWARDED){
+        return forwardee(object);
+    }
+    if (in_to_space(object)){
+        return object;
+    }
+    size_t block_size = block_size_of(object);
+    uint8_t age = object->age + 1;
+    Object *copy = NULL;
+    if (age < geece_config.promotion_age
+        && block_size <= (size_t)(nursery.to_space + nursery.survivor_size - nursery.to_top)){
+        copy = (Object *)nursery.to_top;
+        nursery.to_top += block_size;
+        memcpy(copy, object, sizeof(Object) + object->size);
+    } else {
+        copy = heap_alloc_block(sizeof(Object) + object->size);
+        if (copy == NULL){
+            fprintf(stderr, "Error: Failed to promote object.\n");
+            exit(EXIT_FAILURE);
+        }
+        memcpy(copy, object, sizeof(Object) + object->size);
+        copy->flags &= (uint16_t)~(OBJECT_YOUNG | OBJECT_TRACKED);
+        pointer_array_push(&nursery.promoted, copy);
+        nursery.promoted_bytes += page_of(copy)->block_size;
+    }
+    copy->age = age;
+    object_meta_move(object, copy);
+    if (!(copy->flags & OBJECT_YOUNG)){
+        // Promoted during incremental marking, it must survive the cycle like a new allocation
+        geece_mark_black(copy);
+    }
+
+    object->flags |= OBJECT_FORWARDED;
+    *(Object **)(object + 1) = copy;
+    reference_moved(object, copy);
+    return copy;
+}
+
+/* Evacuates the young targets of an object's edges and fields and remembers old objects still pointing young. */
+static void scan_object(Object *object){
+    bool points_young = false;
+    bool moved = false;
+    size_t count;
+    Object **references = object_references(object, &count);
+    for (size_t i = 0; i < count; ++i){
+        if (references[i]->flags & OBJECT_YOUNG){
+            references[i] = evacuate(references[i]);
+            points_young |= (references[i]->flags & OBJECT_YOUNG) != 0;
+            moved = true;
+        }
+    }
+    if (moved){
+        object_rehash_references(object);
+    }
+    const TypeInfo *info = object_type_info(object);
+    for (size_t i = 0; info != NULL && i < info->field_count; ++i){
+        Object **field = type_field(object, info, i);
+        if (*field != NULL && ((*field)->flags & OBJECT_YOUNG)){
+            *field = evacuate(*field);
+            points_young |= ((*field)->flags & OBJECT_YOUNG) != 0;
+        }
+    }
+    if (points_young && !(object->flags & (OBJECT_YOUNG | OBJECT_REMEMBERED))){
+        nursery_remember(object);
+    }
+}
+
+static Object *evacuate_root(Object *object){
+    return (object->flags & OBJECT_YOUNG) ? evacuate(object) : object;
+}
+
+static void evacuate_roots(RootTable *roots){
+    root_table_forward(roots, evacuate_root);
+    handle_scope_forward(evacuate_root);
+}
+
+/* Finalizes tracked objects that died and follows the ones that moved. */
+static void process_cleanup(void){
+    size_t kept = 0;
+    for (size_t i = 0; i < nursery.cleanup.count; ++i){
+        Object *object = nursery.cleanup.items[i];
+        if (object->flags & OBJECT_FORWARDED){
+            Object *copy = forwardee(object);
+            if (copy->flags & OBJECT_YOUNG){
+                nursery.cleanup.items[kept++] = copy;
+            }
+        } else {
+            reference_unlink_all(object);
+            object_finalize(object);
+        }
+    }
+    nursery.cleanup.count = kept;
+}
+
+size_t nursery_collect(RootTable *roots){
+    if (!nursery_enabled()){
+        return 0;
+    }
+    nursery.to_top = nursery.to_space;
+    nursery.promoted.count = 0;
+    nursery.promoted_bytes = 0;
+
+    evacuate_roots(roots);
+
+    // Old objects are rescanned from the remembered set, which is rebuilt along the way
+    PointerArray remembered = nursery.remembered;
+    memset(&nursery.remembered, 0, sizeof(PointerArray));
+    for (size_t i = 0; i < remembered.count; ++i){
+        Object *object = remembered.items[i];
+        object->flags &= (uint16_t)~OBJECT_REMEMBERED;
+        scan_object(object);
+    }
+    pointer_array_free(&remembered);
+
+    // Cheney scan over to-space, interleaved with the objects promoted in the meantime
+    char *scan = nursery.to_space;
+    size_t promoted_scanned = 0;
+    while (scan < nursery.to_top || promoted_scanned < nursery.promoted.count){
+        while (scan < nursery.to_top){
+            Object *object = (Object *)scan;
+            scan += block_size_of(object);
+            scan_object(object);
+        }
+        while (promoted_scanned < nursery.promoted.count){
+            scan_object(nursery.promoted.items[promoted_scanned++]);
+        }
+    }
+    process_cleanup();
+
+    // Flip the survivor spaces and empty eden
+    tlab_reset_nursery_chunks();
+    char *eden = (char *)heap->objects;
+    memset(eden, 0, (size_t)((char *)heap->top - eden));
+    heap->top = heap->objects;
+    char *survivors = nursery.to_space;
+    nursery.to_space = nursery.from_space;
+    nursery.from_space = survivors;
+    nursery.from_top = nursery.to_top;
+
+    size_t survivor_bytes = (size_t)(nursery.from_top - nursery.from_space);
+    heap_lock();
+    heap->used = heap->used - nursery.used + survivor_bytes;
+    heap_unlock();
+    nursery.used = survivor_bytes;
+    return nursery.promoted_bytes;
+}
+
+uint64_t *nursery_mark_word(const Object *object, uint64_t *mask){
+    size_t index = (size_t)((const char *)object - nursery.start) / GEECE_MIN_BLOCK_SIZE;
+    *mask = (uint64_t)1 << (index % 64);
+    return &nursery.marks[index / 64];
+}
+
+void nursery_clear_marks(void){
+    if (!nursery_enabled()){
+        return;
+    }
+    // Only the survivor space holds objects after a full collection
+    size_t first = (size_t)(nursery.from_space - nursery.start) / GEECE_MIN_BLOCK_SIZE / 64;
+    size_t last = (size_t)(nursery.from_top - nursery.start + GEECE_MIN_BLOCK_SIZE * 64 - 1) / GEECE_MIN_BLOCK_SIZE / 64;
+    memset(nursery.marks + first, 0, (last - first) * sizeof(uint64_t));
+}
+
+void nursery_for_each(void (*visit)(Object *object)){
+    if (!nursery_enabled()){
+        return;
+    }
+    for (char *scan = nursery.from_space; scan < nursery.from_top; scan += block_size_of((Object *)scan)){
+        visit((Object *)scan);
+    }
+}
+
+void nursery_forward_remembered(Object *(*forward)(Object *object)){
+    for (size_t i = 0; i < nursery.remembered.count; ++i){
+        nursery.remembered.items[i] = forward(nursery.remembered.items[i]);
+    }
+}
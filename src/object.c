@@ -7,45 +7,87 @@
  * as well as getting the size and data stored within an object.
  */
 #include "object.h"
+#include "configuration.h"
+#include "heap.h"
+#include "mark_and_sweep.h"
+#include "nursery.h"
+#include "reference.h"
+#include "reference_counting.h"
+#include "root_table.h"
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /**
  * @brief Creates a new Object with the specified size and destructor.
  * 
- * This function creates a new Object with the specified size and destructor. The Object's data field
- * is initialized to 0 using calloc.
+ * This function creates a new Object with the specified size and destructor. The Object is carved
+ * out of the Geece heap and its data field is initialized to 0.
  * 
  * @param size The size of the Object's data field in bytes.
  * @param destructor A pointer to the destructor function for the Object.
  * @return A pointer to the newly created Object.
  */
 Object *new_object(size_t size, Destructor destructor){
-    Object *object = calloc(1, sizeof(Object) + size);
+    Object *object = heap_alloc_block(sizeof(Object) + size);
     if (object == NULL){
         fprintf(stderr, "Error: Failed to allocate memory for object.\n");
         exit(EXIT_FAILURE);
     }
-    object->marked = false;
-    object->ref_count++;
-    object->size = sizeof(Object) * size;
-    object->destructor = destructor;
-    object->referenced_ptrs = NULL;
-    object->referenced_ptrs_count = 0;
+    object_init(object, size, destructor);
     return object;
 }
 
+void object_init(Object *object, size_t size, Destructor destructor){
+#ifndef GEECE_COMPACT_HEADER
+    object->owner = rc_owner();
+#endif
+    object_ref_increment(object);
+    object->size = size;
+    object_set_destructor(object, destructor);
+}
+
+/**
+ * @brief Runs an Object's destructor and frees its outgoing references.
+ *
+ * The destructor, edges and referrers are cleared afterwards, so a finalized Object whose memory
+ * has not been reclaimed yet can be finalized again without effect. With compact headers, the
+ * Object's side table record is dropped as well. The objects it points to keep it as a referrer,
+ * see reference_unlink_all().
+ *
+ * @param object A pointer to the Object to be finalized.
+ */
+void object_finalize(Object *object){
+    Destructor destructor = object_destructor(object);
+    if (destructor != NULL){
+        destructor(object);
+        object_set_destructor(object, NULL);
+    }
+    object_clear_references(object);
+    clear_reference_ptrs(object);
+    object_meta_drop(object);
+}
+
 /**
  * @brief Destroys an Object and frees the memory allocated for it.
  * 
- * This function destroys an Object and frees the memory allocated for it. It calls the destructor
- * function for the Object if it exists.
+ * This function destroys an Object and returns its memory to the Geece heap. It calls the
+ * destructor function for the Object if it exists, so the destructor must only release resources
+ * owned by the Object and never the Object itself.
  * 
  * @param object A pointer to the Object to be destroyed.
  */
 void destroy_object(Object *object){
-    object->destructor(object);
+    if (object == NULL){
+        return;
+    }
+    object_finalize(object);
+    if (object->flags & OBJECT_REMEMBERED){
+        nursery_forget(object);
+    }
+    heap_free_block(object);
 }
 
 /**
@@ -56,11 +98,11 @@ void destroy_object(Object *object){
  * @param object A pointer to the Object to be retained.
  */
 void retain_object(Object *object){
-    object->ref_count++;
+    object_ref_increment(object);
 }
 
 size_t get_refcount(Object *object){
-    return object->ref_count;
+    return object_ref_count(object);
 }
 
 /**
@@ -76,45 +118,426 @@ size_t object_get_size(Object *object){
 }
 
 /**
- * @brief Gets a pointer to an Object's data field.
+ * @brief Gets the objects with an edge to an Object.
  * 
- * This function gets a pointer to an Object's data field.
+ * This function gets the array of reference_referrers(), kept by the reverse index.
  * 
- * @param object A pointer to the Object whose data field is being requested.
- * @return A pointer to the Object's data field.
+ * @param object A pointer to the Object whose referrers are being requested.
+ * @return The referrers of the Object, NULL if it has none.
  */
 Object **object_get_data(Object *object){
     if (object == NULL){
         return NULL;
     }
-    return object->referenced_ptrs;
+    size_t count;
+    return reference_referrers(object, &count);
 }
 
 void clear_reference_ptrs(Object *object){
     if (object == NULL){
         return;
     }
-    for (size_t i = 0; i < object->referenced_ptrs_count; ++i){
-        Object *currentReference = object->referenced_ptrs[i];
-        free(currentReference);
-    }
-    free(object->referenced_ptrs);
-    object->referenced_ptrs = NULL;
-    object->referenced_ptrs_count = 0;
+    reference_forget(object);
 }
 
 size_t object_get_references(const RootTable *table, const Object *object, Object ***out_references) {
+    (void)table;
     if (object == NULL) {
         return 0;
     }
-    if (out_references == NULL) {
-        return object->referenced_ptrs_count;
+    size_t count;
+    Object **references = object_references(object, &count);
+    if (out_references != NULL) {
+        *out_references = references;
     }
-    *out_references = object->referenced_ptrs;
-    return (object->referenced_ptrs != NULL) ? object->referenced_ptrs_count : 0;
+    return count;
 }
 
 int object_get_reference_count_ptrs(RootTable *table, Object *object){
-    return object->referenced_ptrs_count;
+    if (!geece_config.track_referrers){
+        return (int)root_table_count_referrers(table, object);
+    }
+    size_t count;
+    reference_referrers(object, &count);
+    return (int)count;
+}
+
+/* Bytes of a spilled array of `capacity` edges, its hash set included. */
+static size_t spill_size(uint32_t capacity){
+    size_t size = sizeof(EdgeSpill) + capacity * sizeof(Object *);
+    if (capacity >= GEECE_EDGE_SET_MIN){
+        size += 2 * (size_t)capacity * sizeof(uint32_t);
+    }
+    return size;
+}
+
+/* Returns the set slot holding the index of `target`, or the empty slot it would go into. */
+static size_t set_find(const EdgeSpill *spill, const Object *target){
+    size_t mask = 2 * (size_t)spill->capacity - 1;
+    size_t slot = geece_hash_pointer(target) & mask;
+    while (spill->set[slot] != 0 && spill->items[spill->set[slot] - 1] != target){
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/* Empties a set slot, shifting later entries of the probe sequence back into the hole. */
+static void set_remove(EdgeSpill *spill, size_t slot){
+    size_t mask = 2 * (size_t)spill->capacity - 1;
+    spill->set[slot] = 0;
+    for (size_t next = (slot + 1) & mask; spill->set[next] != 0; next = (next + 1) & mask){
+        size_t home = geece_hash_pointer(spill->items[spill->set[next] - 1]) & mask;
+        if (((next - home) & mask) >= ((next - slot) & mask)){
+            spill->set[slot] = spill->set[next];
+            spill->set[next] = 0;
+            slot = next;
+        }
+    }
+}
+
+static void set_build(EdgeSpill *spill){
+    if (spill->set == NULL){
+        return;
+    }
+    memset(spill->set, 0, 2 * (size_t)spill->capacity * sizeof(uint32_t));
+    for (uint32_t i = 0; i < spill->count; ++i){
+        spill->set[set_find(spill, spill->items[i])] = i + 1;
+    }
+}
+
+static EdgeSpill *spill_create(uint32_t capacity, Object *const *items, uint32_t count){
+    EdgeSpill *spill = malloc(spill_size(capacity));
+    if (spill == NULL){
+        return NULL;
+    }
+    spill->count = count;
+    spill->capacity = capacity;
+    spill->set = capacity >= GEECE_EDGE_SET_MIN ? (uint32_t *)(spill->items + capacity) : NULL;
+    if (count > 0){
+        memcpy(spill->items, items, count * sizeof(Object *));
+    }
+    set_build(spill);
+    return spill;
+}
+
+static uint32_t inline_count(const ObjectEdges *edges){
+    uint32_t count = 0;
+    while (count < GEECE_INLINE_EDGES && edges->inline_edges[count] != NULL){
+        count++;
+    }
+    return count;
+}
+
+bool object_has_reference(const Object *object, const Object *target){
+    ObjectEdges *edges = object_edges(object);
+    if (edges == NULL){
+        return false;
+    }
+    EdgeSpill *spill = edges->spill;
+    if (spill != NULL && spill->set != NULL){
+        return spill->set[set_find(spill, target)] != 0;
+    }
+    size_t count;
+    Object **references = object_references(object, &count);
+    for (size_t i = 0; i < count; ++i){
+        if (references[i] == target){
+            return true;
+        }
+    }
+    return false;
+}
+
+bool object_add_reference(Object *object, Object *target){
+    ObjectEdges *edges = object_edges_create(object);
+    EdgeSpill *spill = edges->spill;
+    uint32_t count = spill == NULL ? inline_count(edges) : 0;
+    // The background marker may be reading the edges, an entry is written before it is counted
+    if (spill == NULL && count < GEECE_INLINE_EDGES){
+        __atomic_store_n(&edges->inline_edges[count], target, __ATOMIC_RELEASE);
+        return true;
+    }
+    if (spill != NULL && spill->count < spill->capacity){
+        uint32_t index = spill->count;
+        __atomic_store_n(&spill->items[index], target, __ATOMIC_RELAXED);
+        if (spill->set != NULL){
+            spill->set[set_find(spill, target)] = index + 1;
+        }
+        __atomic_store_n(&spill->count, index + 1, __ATOMIC_RELEASE);
+        return true;
+    }
+    EdgeSpill *grown = spill == NULL
+            ? spill_create(2 * GEECE_INLINE_EDGES, edges->inline_edges, count)
+            : spill_create(spill->capacity * 2, spill->items, spill->count);
+    if (grown == NULL){
+        return false;
+    }
+    grown->items[grown->count++] = target;
+    if (grown->set != NULL){
+        grown->set[set_find(grown, target)] = grown->count;
+    }
+    __atomic_store_n(&edges->spill, grown, __ATOMIC_RELEASE);
+    if (spill != NULL){
+        geece_mark_retire(spill);
+    }
+    return true;
+}
+
+bool object_remove_reference(Object *object, Object *target){
+    ObjectEdges *edges = object_edges(object);
+    if (edges == NULL){
+        return false;
+    }
+    EdgeSpill *spill = edges->spill;
+    Object **items = spill != NULL ? spill->items : edges->inline_edges;
+    uint32_t count = spill != NULL ? spill->count : inline_count(edges);
+    uint32_t index = 0;
+    if (spill != NULL && spill->set != NULL){
+        size_t slot = set_find(spill, target);
+        if (spill->set[slot] == 0){
+            return false;
+        }
+        index = spill->set[slot] - 1;
+        set_remove(spill, slot);
+    } else {
+        while (index < count && items[index] != target){
+            index++;
+        }
+        if (index == count){
+            return false;
+        }
+    }
+    uint32_t last = count - 1;
+    if (index != last){
+        Object *moved = items[last];
+        // A marker already past the hole but short of the end would miss the moved edge
+        geece_shade(moved);
+        __atomic_store_n(&items[index], moved, __ATOMIC_RELAXED);
+        if (spill != NULL && spill->set != NULL){
+            spill->set[set_find(spill, moved)] = index + 1;
+        }
+    }
+    if (spill != NULL){
+        __atomic_store_n(&spill->count, last, __ATOMIC_RELEASE);
+    } else {
+        __atomic_store_n(&edges->inline_edges[last], NULL, __ATOMIC_RELEASE);
+    }
+    return true;
+}
+
+void object_clear_references(Object *object){
+    ObjectEdges *edges = object_edges(object);
+    if (edges == NULL){
+        return;
+    }
+    // The inline slots go first, a marker finding no spilled array must not read them as they were
+    EdgeSpill *spill = edges->spill;
+    for (size_t i = 0; i < GEECE_INLINE_EDGES; ++i){
+        __atomic_store_n(&edges->inline_edges[i], NULL, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&edges->spill, NULL, __ATOMIC_RELEASE);
+    if (spill != NULL){
+        geece_mark_retire(spill);
+    }
 }
 
+void object_rehash_references(Object *object){
+    ObjectEdges *edges = object_edges(object);
+    if (edges != NULL && edges->spill != NULL){
+        set_build(edges->spill);
+    }
+}
+
+// Referrers are kept in the same arrays as edges, without inline slots: the marker never reads them
+bool spill_add_referrer(EdgeSpill **referrers, Object *referrer){
+    EdgeSpill *spill = *referrers;
+    if (spill == NULL || spill->count == spill->capacity){
+        EdgeSpill *grown = spill == NULL
+                ? spill_create(2 * GEECE_INLINE_EDGES, NULL, 0)
+                : spill_create(spill->capacity * 2, spill->items, spill->count);
+        if (grown == NULL){
+            return false;
+        }
+        free(spill);
+        *referrers = grown;
+        spill = grown;
+    }
+    spill->items[spill->count++] = referrer;
+    if (spill->set != NULL){
+        spill->set[set_find(spill, referrer)] = spill->count;
+    }
+    return true;
+}
+
+/* Returns the index of a referrer, or the number of referrers if it is not one. */
+static uint32_t referrer_index(const EdgeSpill *referrers, const Object *referrer){
+    if (referrers->set != NULL){
+        size_t slot = set_find(referrers, referrer);
+        return referrers->set[slot] != 0 ? referrers->set[slot] - 1 : referrers->count;
+    }
+    uint32_t index = 0;
+    while (index < referrers->count && referrers->items[index] != referrer){
+        index++;
+    }
+    return index;
+}
+
+bool spill_remove_referrer(EdgeSpill *referrers, Object *referrer){
+    uint32_t index = referrer_index(referrers, referrer);
+    if (index == referrers->count){
+        return false;
+    }
+    if (referrers->set != NULL){
+        set_remove(referrers, set_find(referrers, referrer));
+    }
+    uint32_t last = --referrers->count;
+    if (index != last){
+        Object *moved = referrers->items[last];
+        referrers->items[index] = moved;
+        if (referrers->set != NULL){
+            referrers->set[set_find(referrers, moved)] = index + 1;
+        }
+    }
+    return true;
+}
+
+void spill_replace_referrer(EdgeSpill *referrers, Object *from, Object *to){
+    uint32_t index = referrer_index(referrers, from);
+    if (index == referrers->count){
+        return;
+    }
+    if (referrers->set != NULL){
+        set_remove(referrers, set_find(referrers, from));
+        referrers->items[index] = to;
+        referrers->set[set_find(referrers, to)] = index + 1;
+    } else {
+        referrers->items[index] = to;
+    }
+}
+
+void spill_rehash(EdgeSpill *referrers){
+    set_build(referrers);
+}
+
+#ifdef GEECE_COMPACT_HEADER
+/*
+ * Side table of the compact header mode: an open-addressing hash table from Object addresses to
+ * their ObjectMeta records. Removals use backward shifting, so lookups never see tombstones.
+ */
+typedef struct {
+    const Object *object;
+    ObjectMeta *meta;
+} MetaSlot;
+
+static MetaSlot *meta_slots = NULL;
+static size_t meta_capacity = 0;
+static size_t meta_count = 0;
+static pthread_mutex_t meta_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline size_t meta_hash(const Object *object){
+    return (size_t)(((uintptr_t)object >> 3) * UINT64_C(0x9E3779B97F4A7C15) >> 17);
+}
+
+static size_t meta_find(const Object *object){
+    size_t mask = meta_capacity - 1;
+    size_t index = meta_hash(object) & mask;
+    while (meta_slots[index].object != NULL && meta_slots[index].object != object){
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+static bool meta_grow(void){
+    size_t capacity = meta_capacity == 0 ? 64 : meta_capacity * 2;
+    MetaSlot *old_slots = meta_slots;
+    size_t old_capacity = meta_capacity;
+    meta_slots = calloc(capacity, sizeof(MetaSlot));
+    if (meta_slots == NULL){
+        meta_slots = old_slots;
+        return false;
+    }
+    meta_capacity = capacity;
+    for (size_t i = 0; i < old_capacity; ++i){
+        if (old_slots[i].object != NULL){
+            meta_slots[meta_find(old_slots[i].object)] = old_slots[i];
+        }
+    }
+    free(old_slots);
+    return true;
+}
+
+static void meta_insert(const Object *object, ObjectMeta *meta){
+    if ((meta_count + 1) * 4 > meta_capacity * 3 && !meta_grow()){
+        fprintf(stderr, "Error: Failed to grow the object metadata table.\n");
+        exit(EXIT_FAILURE);
+    }
+    size_t index = meta_find(object);
+    meta_slots[index].object = object;
+    meta_slots[index].meta = meta;
+    meta_count++;
+}
+
+static ObjectMeta *meta_remove(const Object *object){
+    size_t mask = meta_capacity - 1;
+    size_t index = meta_find(object);
+    ObjectMeta *meta = meta_slots[index].meta;
+    meta_slots[index].object = NULL;
+    meta_slots[index].meta = NULL;
+    meta_count--;
+    // Shift later entries of the probe sequence back into the hole
+    for (size_t next = (index + 1) & mask; meta_slots[next].object != NULL; next = (next + 1) & mask){
+        size_t home = meta_hash(meta_slots[next].object) & mask;
+        if (((next - home) & mask) >= ((next - index) & mask)){
+            meta_slots[index] = meta_slots[next];
+            meta_slots[next].object = NULL;
+            meta_slots[next].meta = NULL;
+            index = next;
+        }
+    }
+    return meta;
+}
+
+ObjectMeta *object_meta(const Object *object){
+    if (!(object->flags & OBJECT_META)){
+        return NULL;
+    }
+    pthread_mutex_lock(&meta_lock);
+    ObjectMeta *meta = meta_slots[meta_find(object)].meta;
+    pthread_mutex_unlock(&meta_lock);
+    return meta;
+}
+
+ObjectMeta *object_meta_create(Object *object){
+    if (object->flags & OBJECT_META){
+        return object_meta(object);
+    }
+    ObjectMeta *meta = calloc(1, sizeof(ObjectMeta));
+    if (meta == NULL){
+        fprintf(stderr, "Error: Failed to allocate object metadata.\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_lock(&meta_lock);
+    meta_insert(object, meta);
+    pthread_mutex_unlock(&meta_lock);
+    object->flags |= OBJECT_META;
+    return meta;
+}
+
+void object_meta_move(const Object *from, const Object *to){
+    if (!(from->flags & OBJECT_META)){
+        return;
+    }
+    pthread_mutex_lock(&meta_lock);
+    meta_insert(to, meta_remove(from));
+    pthread_mutex_unlock(&meta_lock);
+}
+
+void object_meta_drop(Object *object){
+    if (!(object->flags & OBJECT_META)){
+        return;
+    }
+    pthread_mutex_lock(&meta_lock);
+    free(meta_remove(object));
+    pthread_mutex_unlock(&meta_lock);
+    object->flags &= (uint16_t)~(OBJECT_META | OBJECT_TYPED);
+}
+#endif
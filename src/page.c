@@ -0,0 +1,132 @@
+/**
+ * @file page.c
+ * @brief Implementation of the size-segregated heap pages.
+ */
+#include "page.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/* Offset of the first block in a page, rounded so that blocks stay 16-byte aligned. */
+#define PAGE_HEADER_SIZE ((sizeof(Page) + GEECE_MIN_BLOCK_SIZE - 1) & ~(GEECE_MIN_BLOCK_SIZE - 1))
+
+_Atomic(uint8_t *) page_directory[(size_t)1 << (48 - 16 - PAGE_DIRECTORY_LEAF_BITS)];
+
+/* Returns the directory entry of a granule, creating its leaf if needed. */
+static uint8_t *directory_entry(uintptr_t granule){
+    if (granule >> (48 - 16) != 0){
+        fprintf(stderr, "Error: Heap memory mapped outside of the page directory.\n");
+        exit(EXIT_FAILURE);
+    }
+    _Atomic(uint8_t *) *slot = &page_directory[granule >> PAGE_DIRECTORY_LEAF_BITS];
+    uint8_t *leaf = atomic_load_explicit(slot, memory_order_acquire);
+    if (leaf == NULL){
+        uint8_t *fresh = calloc((size_t)1 << PAGE_DIRECTORY_LEAF_BITS, 1);
+        if (fresh == NULL){
+            fprintf(stderr, "Error: Failed to allocate a page directory leaf.\n");
+            exit(EXIT_FAILURE);
+        }
+        // Threads entering pages under different locks may race for the leaf
+        if (atomic_compare_exchange_strong_explicit(slot, &leaf, fresh, memory_order_acq_rel, memory_order_acquire)){
+            leaf = fresh;
+        } else {
+            free(fresh);
+        }
+    }
+    return &leaf[granule & (((uintptr_t)1 << PAGE_DIRECTORY_LEAF_BITS) - 1)];
+}
+
+void page_directory_set_small(const Page *page, bool small){
+    __atomic_store_n(directory_entry((uintptr_t)page / GEECE_PAGE_SIZE),
+                     small ? PAGE_DIRECTORY_SMALL : PAGE_DIRECTORY_NONE, __ATOMIC_RELAXED);
+}
+
+void page_directory_add_large(const void *start, size_t size, int delta){
+    uintptr_t last = ((uintptr_t)start + size - 1) / GEECE_PAGE_SIZE;
+    for (uintptr_t granule = (uintptr_t)start / GEECE_PAGE_SIZE; granule <= last; ++granule){
+        __atomic_fetch_add(directory_entry(granule), (uint8_t)delta, __ATOMIC_RELAXED);
+    }
+}
+
+unsigned int page_size_class(size_t size){
+    if (size <= 128){
+        return (unsigned int)((size + 15) / 16) - (size == 0 ? 0 : 1);
+    }
+    // size lies in (2^lg, 2^(lg + 1)], which is split into four evenly spaced classes
+    unsigned int lg = (unsigned int)(sizeof(unsigned long) * 8 - 1 - __builtin_clzl(size - 1));
+    return 8 + (lg - 7) * 4 + (unsigned int)((size - 1 - ((size_t)1 << lg)) >> (lg - 2));
+}
+
+size_t page_class_block_size(unsigned int size_class){
+    if (size_class < 8){
+        return (size_class + 1) * 16;
+    }
+    size_t base = (size_t)128 << ((size_class - 8) / 4);
+    return base + ((size_class - 8) % 4 + 1) * (base / 4);
+}
+
+Page *page_map_segment(void){
+    size_t segment_size = GEECE_PAGE_SIZE * GEECE_PAGES_PER_SEGMENT;
+    // Over-map by one page so that the segment can be trimmed to page alignment
+    size_t mapped_size = segment_size + GEECE_PAGE_SIZE;
+    char *mapping = mmap(NULL, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED){
+        fprintf(stderr, "Error: Failed to map heap segment.\n");
+        return NULL;
+    }
+    char *start = (char *)(((uintptr_t)mapping + GEECE_PAGE_SIZE - 1) & ~(uintptr_t)(GEECE_PAGE_SIZE - 1));
+    size_t head = (size_t)(start - mapping);
+    if (head > 0){
+        munmap(mapping, head);
+    }
+    size_t tail = mapped_size - head - segment_size;
+    if (tail > 0){
+        munmap(start + segment_size, tail);
+    }
+
+    Page *first = NULL;
+    for (size_t i = GEECE_PAGES_PER_SEGMENT; i > 0; --i){
+        Page *page = (Page *)(start + (i - 1) * GEECE_PAGE_SIZE);
+        page->next = first;
+        page->prev = NULL;
+        first = page;
+    }
+    return first;
+}
+
+void page_format(Page *page, unsigned int size_class){
+    page->size_class = size_class;
+    page->block_size = page_class_block_size(size_class);
+    page->blocks = (char *)page + PAGE_HEADER_SIZE;
+    page->block_count = (unsigned int)((GEECE_PAGE_SIZE - PAGE_HEADER_SIZE) / page->block_size);
+    page->used_count = 0;
+    page->full = false;
+    page->unswept = false;
+    page->owner = NULL;
+    atomic_init(&page->remote_free, NULL);
+    atomic_init(&page->remote_notified, false);
+    page->remote_next = NULL;
+    memset(page->marks, 0, sizeof(page->marks));
+
+    // Thread the free list in address order so that consecutive allocations are adjacent
+    FreeBlock *next = NULL;
+    for (unsigned int i = page->block_count; i > 0; --i){
+        FreeBlock *block = (FreeBlock *)(page->blocks + (size_t)(i - 1) * page->block_size);
+        block->next = next;
+        next = block;
+    }
+    page->free_list = next;
+    page_directory_set_small(page, true);
+}
+
+void page_free_bitmap(const Page *page, uint64_t *bitmap){
+    memset(bitmap, 0, GEECE_PAGE_BITMAP_WORDS * sizeof(uint64_t));
+    for (FreeBlock *block = page->free_list; block != NULL; block = block->next){
+        page_bitmap_set(bitmap, (size_t)((char *)block - page->blocks) / page->block_size);
+    }
+    for (FreeBlock *block = atomic_load(&page->remote_free); block != NULL; block = block->next){
+        page_bitmap_set(bitmap, (size_t)((char *)block - page->blocks) / page->block_size);
+    }
+}
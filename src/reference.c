@@ -0,0 +1,364 @@
+/**
+ * @file reference.c
+ * @brief Implementation of the reverse index of the edges.
+ */
+#include "reference.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "arena.h"
+#include "configuration.h"
+#include "mark_and_sweep.h"
+#include "nursery.h"
+#include "utils.h"
+
+/*
+ * The referrers of the objects are kept in a set of stripes, each an open-addressing hash table
+ * from targets to their arrays of referrers with a lock of its own, picked by the target's
+ * address, so edge writes to different targets rarely wait for each other. Removals use backward
+ * shifting, so lookups never see tombstones. No edge is written while a collection moves objects,
+ * so a target changing stripe with its address is never still guarded by the old stripe.
+ */
+typedef struct {
+    Object *target;                 /* NULL for an empty entry. */
+    EdgeSpill *referrers;
+} ReferrerEntry;
+
+typedef struct {
+    pthread_mutex_t lock;
+    ReferrerEntry *entries;
+    size_t capacity;                /* A power of two, 0 before the first target. */
+    size_t count;
+} ReferrerStripe;
+
+#define REFERRER_STRIPE_MIN_CAPACITY 16
+
+static ReferrerStripe stripes[GEECE_REFERENCE_STRIPES];
+static pthread_once_t stripes_once = PTHREAD_ONCE_INIT;
+
+static void init_stripes(void){
+    for (size_t i = 0; i < GEECE_REFERENCE_STRIPES; ++i){
+        pthread_mutex_init(&stripes[i].lock, NULL);
+    }
+}
+
+static ReferrerStripe *lock_stripe(const Object *target){
+    pthread_once(&stripes_once, init_stripes);
+    ReferrerStripe *stripe = &stripes[geece_hash_pointer(target) % GEECE_REFERENCE_STRIPES];
+    pthread_mutex_lock(&stripe->lock);
+    return stripe;
+}
+
+/* What walks every target holds every stripe, in order. */
+static void lock_all(void){
+    pthread_once(&stripes_once, init_stripes);
+    for (size_t i = 0; i < GEECE_REFERENCE_STRIPES; ++i){
+        pthread_mutex_lock(&stripes[i].lock);
+    }
+}
+
+static void unlock_all(void){
+    for (size_t i = GEECE_REFERENCE_STRIPES; i-- > 0;){
+        pthread_mutex_unlock(&stripes[i].lock);
+    }
+}
+
+/* The stripe takes the low bits of the hash, the position within it the ones above. */
+static size_t entry_home(const ReferrerStripe *stripe, const Object *target){
+    return (geece_hash_pointer(target) / GEECE_REFERENCE_STRIPES) & (stripe->capacity - 1);
+}
+
+/* Returns the entry of a target, or the empty entry it would go into. The stripe must have entries. */
+static ReferrerEntry *probe(const ReferrerStripe *stripe, const Object *target){
+    size_t mask = stripe->capacity - 1;
+    size_t slot = entry_home(stripe, target);
+    while (stripe->entries[slot].target != NULL && stripe->entries[slot].target != target){
+        slot = (slot + 1) & mask;
+    }
+    return &stripe->entries[slot];
+}
+
+static ReferrerEntry *find_entry(const ReferrerStripe *stripe, const Object *target){
+    if (stripe->capacity == 0){
+        return NULL;
+    }
+    ReferrerEntry *entry = probe(stripe, target);
+    return entry->target != NULL ? entry : NULL;
+}
+
+static bool grow_stripe(ReferrerStripe *stripe){
+    size_t capacity = stripe->capacity == 0 ? REFERRER_STRIPE_MIN_CAPACITY : stripe->capacity * 2;
+    ReferrerEntry *entries = calloc(capacity, sizeof(ReferrerEntry));
+    if (entries == NULL){
+        return false;
+    }
+    ReferrerEntry *old = stripe->entries;
+    size_t old_capacity = stripe->capacity;
+    stripe->entries = entries;
+    stripe->capacity = capacity;
+    for (size_t i = 0; i < old_capacity; ++i){
+        if (old[i].target != NULL){
+            *probe(stripe, old[i].target) = old[i];
+        }
+    }
+    free(old);
+    return true;
+}
+
+/* Adds an entry without referrers for a target that has none, NULL if the stripe could not grow. */
+static ReferrerEntry *insert_entry(ReferrerStripe *stripe, Object *target){
+    if (4 * (stripe->count + 1) > 3 * stripe->capacity && !grow_stripe(stripe)){
+        return NULL;
+    }
+    ReferrerEntry *entry = probe(stripe, target);
+    *entry = (ReferrerEntry){target, NULL};
+    stripe->count++;
+    return entry;
+}
+
+/* Empties an entry, shifting later entries of the probe sequence back into the hole. */
+static void erase_entry(ReferrerStripe *stripe, ReferrerEntry *entry){
+    size_t mask = stripe->capacity - 1;
+    size_t slot = (size_t)(entry - stripe->entries);
+    stripe->entries[slot].target = NULL;
+    for (size_t next = (slot + 1) & mask; stripe->entries[next].target != NULL; next = (next + 1) & mask){
+        size_t home = entry_home(stripe, stripe->entries[next].target);
+        if (((next - home) & mask) >= ((next - slot) & mask)){
+            stripe->entries[slot] = stripe->entries[next];
+            stripe->entries[next].target = NULL;
+            slot = next;
+        }
+    }
+    stripe->count--;
+}
+
+/* A stale nursery copy stores the address of its replacement in its first data word. */
+static inline Object *current(Object *object){
+    return (object->flags & OBJECT_FORWARDED) ? *(Object **)(object + 1) : object;
+}
+
+/* Drops a referrer from the entry of a target, and the entry once it has none left. */
+static void unlink_referrer(Object *object, Object *target){
+    ReferrerStripe *stripe = lock_stripe(target);
+    ReferrerEntry *entry = find_entry(stripe, target);
+    if (entry != NULL && spill_remove_referrer(entry->referrers, object) && entry->referrers->count == 0){
+        free(entry->referrers);
+        erase_entry(stripe, entry);
+    }
+    pthread_mutex_unlock(&stripe->lock);
+}
+
+bool reference_link(Object *object, Object *target){
+    if (!geece_config.track_referrers){
+        return true;
+    }
+    ReferrerStripe *stripe = lock_stripe(target);
+    ReferrerEntry *entry = find_entry(stripe, target);
+    if (entry == NULL){
+        entry = insert_entry(stripe, target);
+    }
+    if (entry == NULL || !spill_add_referrer(&entry->referrers, object)){
+        if (entry != NULL && entry->referrers == NULL){
+            erase_entry(stripe, entry);
+        }
+        pthread_mutex_unlock(&stripe->lock);
+        return false;
+    }
+    pthread_mutex_unlock(&stripe->lock);
+
+    // The referrers of a young or arena object have to be freed if it dies with its nursery or arena
+    if ((target->flags & (OBJECT_YOUNG | OBJECT_TRACKED)) == OBJECT_YOUNG){
+        nursery_track_cleanup(target);
+    } else if ((target->flags & (OBJECT_ARENA | OBJECT_TRACKED)) == OBJECT_ARENA && arena_of(target) != NULL){
+        arena_track_cleanup(target);
+    }
+    return true;
+}
+
+void reference_unlink(Object *object, Object *target){
+    if (geece_config.track_referrers){
+        unlink_referrer(object, target);
+    }
+}
+
+void reference_unlink_all(Object *object){
+    if (!geece_config.track_referrers){
+        return;
+    }
+    size_t count;
+    Object **references = object_references(object, &count);
+    for (size_t i = 0; i < count; ++i){
+        unlink_referrer(object, current(references[i]));
+    }
+}
+
+void reference_forget(Object *object){
+    if (!geece_config.track_referrers){
+        return;
+    }
+    ReferrerStripe *stripe = lock_stripe(object);
+    ReferrerEntry *entry = find_entry(stripe, object);
+    EdgeSpill *referrers = NULL;
+    if (entry != NULL){
+        referrers = entry->referrers;
+        erase_entry(stripe, entry);
+    }
+    pthread_mutex_unlock(&stripe->lock);
+    free(referrers);
+}
+
+void reference_moved(Object *from, Object *to){
+    if (!geece_config.track_referrers){
+        return;
+    }
+    ReferrerStripe *stripe = lock_stripe(from);
+    ReferrerEntry *entry = find_entry(stripe, from);
+    EdgeSpill *referrers = NULL;
+    if (entry != NULL){
+        referrers = entry->referrers;
+        erase_entry(stripe, entry);
+    }
+    pthread_mutex_unlock(&stripe->lock);
+    if (referrers != NULL){
+        stripe = lock_stripe(to);
+        entry = insert_entry(stripe, to);
+        if (entry == NULL){
+            fprintf(stderr, "Error: Failed to allocate memory for moved referrers.\n");
+            exit(EXIT_FAILURE);
+        }
+        entry->referrers = referrers;
+        pthread_mutex_unlock(&stripe->lock);
+    }
+
+    size_t count;
+    Object **references = object_references(to, &count);
+    for (size_t i = 0; i < count; ++i){
+        Object *target = current(references[i]);
+        stripe = lock_stripe(target);
+        entry = find_entry(stripe, target);
+        if (entry != NULL){
+            spill_replace_referrer(entry->referrers, from, to);
+        }
+        pthread_mutex_unlock(&stripe->lock);
+    }
+}
+
+/* Drops the unmarked referrers of an entry, returns whether it stays: a marked target with referrers. */
+static bool keep_marked(ReferrerEntry *entry){
+    if (!geece_is_marked(entry->target)){
+        return false;
+    }
+    EdgeSpill *referrers = entry->referrers;
+    uint32_t live = 0;
+    for (uint32_t j = 0; j < referrers->count; ++j){
+        if (geece_is_marked(referrers->items[j])){
+            referrers->items[live++] = referrers->items[j];
+        }
+    }
+    if (live != referrers->count){
+        referrers->count = live;
+        spill_rehash(referrers);
+    }
+    return live > 0;
+}
+
+void reference_forget_unmarked(void){
+    lock_all();
+    for (size_t s = 0; s < GEECE_REFERENCE_STRIPES; ++s){
+        ReferrerStripe *stripe = &stripes[s];
+        size_t i = 0;
+        while (i < stripe->capacity){
+            ReferrerEntry *entry = &stripe->entries[i];
+            if (entry->target == NULL || keep_marked(entry)){
+                i++;
+                continue;
+            }
+            // Unmarked objects die in the sweep, which finds them without referrers to free
+            free(entry->referrers);
+            // The shift may pull a later entry into this one, so it is looked at again
+            erase_entry(stripe, entry);
+        }
+    }
+    unlock_all();
+}
+
+void reference_forward(Object *(*forward)(Object *object)){
+    ReferrerEntry *moved = NULL;
+    size_t moved_count = 0;
+    size_t moved_capacity = 0;
+    for (size_t s = 0; s < GEECE_REFERENCE_STRIPES; ++s){
+        ReferrerStripe *stripe = &stripes[s];
+        size_t i = 0;
+        while (i < stripe->capacity){
+            ReferrerEntry *entry = &stripe->entries[i];
+            if (entry->target == NULL || entry->target == forward(entry->target)){
+                i++;
+                continue;
+            }
+            if (moved_count == moved_capacity){
+                moved_capacity = moved_capacity == 0 ? 64 : moved_capacity * 2;
+                ReferrerEntry *grown = realloc(moved, moved_capacity * sizeof(ReferrerEntry));
+                if (grown == NULL){
+                    fprintf(stderr, "Error: Failed to allocate memory for moved referrers.\n");
+                    exit(EXIT_FAILURE);
+                }
+                moved = grown;
+            }
+            moved[moved_count++] = (ReferrerEntry){forward(entry->target), entry->referrers};
+            // The shift may pull a later entry into this one, so it is looked at again
+            erase_entry(stripe, entry);
+        }
+    }
+    // A new address may hash to another stripe, so the moved targets go back once all are out
+    for (size_t i = 0; i < moved_count; ++i){
+        ReferrerStripe *stripe = &stripes[geece_hash_pointer(moved[i].target) % GEECE_REFERENCE_STRIPES];
+        ReferrerEntry *entry = insert_entry(stripe, moved[i].target);
+        if (entry == NULL){
+            fprintf(stderr, "Error: Failed to allocate memory for moved referrers.\n");
+            exit(EXIT_FAILURE);
+        }
+        entry->referrers = moved[i].referrers;
+    }
+    free(moved);
+    // The referrers move as well
+    for (size_t s = 0; s < GEECE_REFERENCE_STRIPES; ++s){
+        ReferrerStripe *stripe = &stripes[s];
+        for (size_t i = 0; i < stripe->capacity; ++i){
+            if (stripe->entries[i].target == NULL){
+                continue;
+            }
+            EdgeSpill *referrers = stripe->entries[i].referrers;
+            for (uint32_t j = 0; j < referrers->count; ++j){
+                referrers->items[j] = forward(referrers->items[j]);
+            }
+            spill_rehash(referrers);
+        }
+    }
+}
+
+Object **reference_referrers(const Object *object, size_t *count){
+    *count = 0;
+    if (!geece_config.track_referrers){
+        return NULL;
+    }
+    ReferrerStripe *stripe = lock_stripe(object);
+    ReferrerEntry *entry = find_entry(stripe, object);
+    Object **referrers = NULL;
+    if (entry != NULL){
+        *count = entry->referrers->count;
+        referrers = entry->referrers->items;
+    }
+    pthread_mutex_unlock(&stripe->lock);
+    return referrers;
+}
+
+size_t reference_indexed(void){
+    lock_all();
+    size_t count = 0;
+    for (size_t s = 0; s < GEECE_REFERENCE_STRIPES; ++s){
+        count += stripes[s].count;
+    }
+    unlock_all();
+    return count;
+}
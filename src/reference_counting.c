@@ -0,0 +1,387 @@
+/**
+ * @file reference_counting.c
+ * @brief Implementation of deferred reference counting.
+ */
+#include "reference_counting.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "handle_scope.h"
+#include "heap.h"
+#include "mark_and_sweep.h"
+#include "reference.h"
+#include "stack_roots.h"
+#include "type.h"
+#include "utils.h"
+
+static pthread_mutex_t table_lock = PTHREAD_MUTEX_INITIALIZER;
+static PointerArray table;          /* Objects whose count dropped to zero, flagged OBJECT_ZCT. */
+static size_t arrivals = 0;         /* Objects the mutator put in the table since the last reconciliation. */
+static bool backlog = false;        /* The last reconciliation ran out of budget before the end of the table. */
+static bool reconciling = false;    /* Destructors run by a reconciliation must not start another. */
+static PointerArray held;           /* Objects a root pointed to, counted while the table or the cycles are collected. */
+static bool holding = false;
+static bool held_overflowed = false;
+
+#ifndef GEECE_COMPACT_HEADER
+/* Objects other threads queued for one owner. */
+typedef struct {
+    PointerArray objects;
+    bool pending;                   /* Read by the owner without the lock. */
+} OwnerQueue;
+
+_Thread_local uint32_t object_owner_id = 0;
+static pthread_mutex_t owners_lock = PTHREAD_MUTEX_INITIALIZER;
+static OwnerQueue **queues = NULL;  /* Indexed by owner id, NULL once the owner exited, owners_lock held. */
+static uint32_t owner_count = 0;
+static pthread_once_t owner_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t owner_key;
+static _Thread_local OwnerQueue *own_queue = NULL;
+
+/* The shared count without its flags. */
+static inline int64_t shared_references(int64_t shared){
+    return (shared - (shared & (OBJECT_SHARED_ONE - 1))) / OBJECT_SHARED_ONE;
+}
+
+/* Folds the owner's count into the shared count of a queued object, returns whether it is dead. */
+static bool merge(Object *object){
+    int64_t old = __atomic_load_n(&object->shared_count, __ATOMIC_RELAXED);
+    int64_t new;
+    do {
+        new = old & ~(int64_t)OBJECT_SHARED_QUEUED;
+        if (!(old & OBJECT_SHARED_MERGED)){
+            new = (new + (int64_t)object->ref_count * OBJECT_SHARED_ONE) | OBJECT_SHARED_MERGED;
+        }
+    } while (!__atomic_compare_exchange_n(&object->shared_count, &old, new, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    if (!(old & OBJECT_SHARED_MERGED)){
+        object->ref_count = 0;
+        __atomic_store_n(&object->owner, OBJECT_OWNER_SHARED, __ATOMIC_RELEASE);
+    }
+    return shared_references(new) <= 0;
+}
+
+bool rc_queue(Object *object, uint32_t owner){
+    pthread_mutex_lock(&owners_lock);
+    OwnerQueue *queue = queues[owner];
+    bool queued = queue != NULL && pointer_array_push(&queue->objects, object);
+    if (queued){
+        __atomic_store_n(&queue->pending, true, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&owners_lock);
+    return queued;
+}
+
+void object_ref_increment_shared(Object *object){
+    __atomic_fetch_add(&object->shared_count, OBJECT_SHARED_ONE, __ATOMIC_RELAXED);
+}
+
+size_t object_ref_decrement_shared(Object *object){
+    // Read first, the owner clears it after merging and the object is queued for the one before
+    uint32_t owner = __atomic_load_n(&object->owner, __ATOMIC_ACQUIRE);
+    int64_t old = __atomic_load_n(&object->shared_count, __ATOMIC_RELAXED);
+    int64_t new;
+    do {
+        new = old - OBJECT_SHARED_ONE;
+        if (!(new & OBJECT_SHARED_MERGED) && shared_references(new) < 0){
+            new |= OBJECT_SHARED_QUEUED;
+        }
+    } while (!__atomic_compare_exchange_n(&object->shared_count, &old, new, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    if ((new & OBJECT_SHARED_QUEUED) && !(old & OBJECT_SHARED_QUEUED) && !rc_queue(object, owner)){
+        // Nobody changes the owner's count anymore, so its exit leaves the merge to this thread
+        return merge(object) ? 0 : 1;
+    }
+    // Until merged, and while queued, only the owner can tell whether the object is dead
+    if (!(new & OBJECT_SHARED_MERGED) || (new & OBJECT_SHARED_QUEUED)){
+        return 1;
+    }
+    int64_t references = shared_references(new);
+    return references > 0 ? (size_t)references : 0;
+}
+
+size_t object_ref_relinquish(Object *object){
+    int64_t old = __atomic_fetch_or(&object->shared_count, OBJECT_SHARED_MERGED, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&object->owner, OBJECT_OWNER_SHARED, __ATOMIC_RELEASE);
+    // The queue it waits in makes the decision
+    if (old & OBJECT_SHARED_QUEUED){
+        return 1;
+    }
+    int64_t references = shared_references(old);
+    return references > 0 ? (size_t)references : 0;
+}
+
+size_t object_ref_count(const Object *object){
+    int64_t shared = __atomic_load_n(&object->shared_count, __ATOMIC_ACQUIRE);
+    int64_t references = shared_references(shared);
+    if (!(shared & OBJECT_SHARED_MERGED)){
+        references += (int64_t)object->ref_count;
+    }
+    return references > 0 ? (size_t)references : 0;
+}
+
+/* Disposes of a queued object whose merged count is zero, as the release dropping it would have. */
+static void merged_dead(Object *object){
+    if (geece_config.deferred_rc){
+        rc_zero(object);
+    } else if (!geece_mark_in_progress()){
+        rc_destroy(object);
+    }
+}
+
+static void owner_exit(void *arg){
+    (void)arg;
+    // Whatever is queued from here on is merged by the thread queuing it
+    pthread_mutex_lock(&owners_lock);
+    OwnerQueue *queue = own_queue;
+    queues[object_owner_id] = NULL;
+    pthread_mutex_unlock(&owners_lock);
+    for (size_t i = 0; i < queue->objects.count; ++i){
+        if (merge(queue->objects.items[i])){
+            merged_dead(queue->objects.items[i]);
+        }
+    }
+    pointer_array_free(&queue->objects);
+    free(queue);
+    own_queue = NULL;
+}
+
+static void create_owner_key(void){
+    pthread_key_create(&owner_key, owner_exit);
+}
+
+uint32_t rc_register_owner(void){
+    pthread_once(&owner_key_once, create_owner_key);
+    pthread_mutex_lock(&owners_lock);
+    OwnerQueue **grown = realloc(queues, (owner_count + 2) * sizeof(OwnerQueue *));
+    OwnerQueue *queue = calloc(1, sizeof(OwnerQueue));
+    if (grown != NULL){
+        queues = grown;
+    }
+    if (grown == NULL || queue == NULL || owner_count + 1 == OBJECT_OWNER_SHARED){
+        fprintf(stderr, "Error: Failed to register the thread as an object owner.\n");
+        exit(EXIT_FAILURE);
+    }
+    uint32_t id = ++owner_count;
+    queues[id] = queue;
+    own_queue = queue;
+    pthread_mutex_unlock(&owners_lock);
+    object_owner_id = id;
+    pthread_setspecific(owner_key, (void *)(uintptr_t)id);
+    return id;
+}
+
+void geece_rc_merge(void){
+    OwnerQueue *queue = own_queue;
+    if (queue == NULL || !__atomic_load_n(&queue->pending, __ATOMIC_ACQUIRE)){
+        return;
+    }
+    pthread_mutex_lock(&owners_lock);
+    PointerArray objects = queue->objects;
+    queue->objects = (PointerArray){0};
+    __atomic_store_n(&queue->pending, false, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&owners_lock);
+
+    for (size_t i = 0; i < objects.count; ++i){
+        if (merge(objects.items[i])){
+            merged_dead(objects.items[i]);
+        }
+    }
+    pointer_array_free(&objects);
+}
+
+void rc_merge_all(void){
+    for (uint32_t id = 1; id <= owner_count; ++id){
+        pthread_mutex_lock(&owners_lock);
+        OwnerQueue *queue = queues[id];
+        PointerArray objects = {0};
+        if (queue != NULL){
+            objects = queue->objects;
+            queue->objects = (PointerArray){0};
+            __atomic_store_n(&queue->pending, false, __ATOMIC_RELAXED);
+        }
+        pthread_mutex_unlock(&owners_lock);
+        for (size_t i = 0; i < objects.count; ++i){
+            if (merge(objects.items[i])){
+                merged_dead(objects.items[i]);
+            }
+        }
+        pointer_array_free(&objects);
+    }
+}
+#else
+void geece_rc_merge(void){
+}
+
+void rc_merge_all(void){
+}
+#endif
+
+void rc_destroy(Object *object){
+    if (!(object->flags & OBJECT_BUFFERED)){
+        reference_unlink_all(object);
+        destroy_object(object);
+    }
+}
+
+void rc_table_remove(Object *object){
+    pthread_mutex_lock(&table_lock);
+    pointer_array_remove(&table, object);
+    object->flags &= (uint16_t)~OBJECT_ZCT;
+    pthread_mutex_unlock(&table_lock);
+}
+
+void rc_zero(Object *object){
+    if (object->flags & (OBJECT_YOUNG | OBJECT_ARENA | OBJECT_ZCT)){
+        return;
+    }
+    pthread_mutex_lock(&table_lock);
+    // Left to the full collections if it cannot be recorded
+    if (pointer_array_push(&table, object)){
+        object->flags |= OBJECT_ZCT;
+        arrivals += !reconciling;
+    }
+    pthread_mutex_unlock(&table_lock);
+}
+
+void rc_allocated(Object *object){
+    if (holding){
+        // Held like a root until the collection whose destructor allocated it ends, the
+        // allocation's count stays for the full collections if it cannot be
+        pointer_array_push(&held, object);
+        return;
+    }
+    rc_decrement(object);
+}
+
+size_t rc_pending(void){
+    return table.count;
+}
+
+bool rc_reconcile_due(void){
+    return !reconciling && (backlog || arrivals >= geece_config.rc_table_limit);
+}
+
+/* Counts a root's reference, so that the object cannot reach zero while the table is processed. */
+static void hold(Object *object){
+    if (object == NULL){
+        return;
+    }
+    if (!pointer_array_push(&held, object)){
+        held_overflowed = true;
+        return;
+    }
+    object_ref_increment(object);
+}
+
+bool rc_hold_roots(RootTable *roots){
+    if (holding){
+        return false;
+    }
+    holding = true;
+    held.count = 0;
+    held_overflowed = false;
+    root_table_for_each(roots, hold);
+    arena_mark_roots(hold);
+    handle_scope_for_each(hold);
+    stack_roots_scan(hold);
+    if (held_overflowed){
+        // A root that could not be counted might be destroyed, so nothing may be
+        rc_release_roots();
+        return false;
+    }
+    return true;
+}
+
+void rc_release_roots(void){
+    for (size_t i = 0; i < held.count; ++i){
+        // Objects only roots hold go back into the table, they are no candidates of a cycle
+        Object *object = held.items[i];
+        if (object_ref_decrement(object) == 0 && geece_config.deferred_rc){
+            rc_zero(object);
+        }
+    }
+    held.count = 0;
+    holding = false;
+}
+
+/* Drops the references of an object about to be destroyed, edges and typed fields alike. */
+static void release_children(Object *object){
+    size_t count;
+    Object **references = object_references(object, &count);
+    for (size_t i = 0; i < count; ++i){
+        if (references[i] != NULL){
+            rc_decrement(references[i]);
+        }
+    }
+    const TypeInfo *info = object_type_info(object);
+    for (size_t i = 0; info != NULL && i < info->field_count; ++i){
+        Object *child = *type_field(object, info, i);
+        if (child != NULL){
+            rc_decrement(child);
+        }
+    }
+}
+
+size_t rc_reconcile(RootTable *roots, size_t budget){
+    if (reconciling || geece_mark_in_progress()){
+        return 0;
+    }
+    if (table.count == 0){
+        arrivals = 0;
+        return 0;
+    }
+    if (!rc_hold_roots(roots)){
+        return 0;
+    }
+    reconciling = true;
+
+    // Every root is counted, so whatever reaches zero meanwhile, children included, is garbage
+    size_t destroyed = 0;
+    size_t next = 0;
+    while (next < table.count && destroyed < budget){
+        Object *object = table.items[next++];
+        object->flags &= (uint16_t)~OBJECT_ZCT;
+        // A buffered object is destroyed by the cycle collector, which hands it back to the table
+        if (object_ref_count(object) > 0 || (object->flags & OBJECT_BUFFERED)){
+            continue;
+        }
+        // Children are released after, once one of them is destroyed it is no place to unlink from
+        reference_unlink_all(object);
+        release_children(object);
+        destroy_object(object);
+        destroyed++;
+    }
+
+    pthread_mutex_lock(&table_lock);
+    table.count -= next;
+    memmove(table.items, table.items + next, table.count * sizeof(void *));
+    backlog = table.count > 0;
+    pthread_mutex_unlock(&table_lock);
+
+    rc_release_roots();
+    arrivals = 0;
+    reconciling = false;
+    return destroyed;
+}
+
+void rc_forget_unmarked(void){
+    size_t kept = 0;
+    for (size_t i = 0; i < table.count; ++i){
+        Object *object = table.items[i];
+        if (geece_is_marked(object)){
+            table.items[kept++] = object;
+        } else {
+            object->flags &= (uint16_t)~OBJECT_ZCT;
+        }
+    }
+    table.count = kept;
+    backlog = backlog && kept > 0;
+}
+
+void rc_forward(Object *(*forward)(Object *object)){
+    for (size_t i = 0; i < table.count; ++i){
+        table.items[i] = forward(table.items[i]);
+    }
+}
@@ -2,10 +2,21 @@
 // Created by Jacob on 3/24/2023.
 //
 
+#include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include "object.h"
 #include "root_table.h"
+#include "configuration.h"
+#include "epoch.h"
+#include "nursery.h"
+#include "arena.h"
+#include "mark_and_sweep.h"
+#include "reference.h"
+#include "reference_counting.h"
 
 // FNV-1a algorithm
 unsigned int geece_hash(const char *key) {
@@ -19,8 +30,787 @@ unsigned int geece_hash(const char *key) {
 }
 
 
+#define ROOT_TABLE_MIN_CAPACITY 8
+#define ROOT_TABLE_MIGRATE_STEP 8   /* Old slots an operation moves during a resize. */
+#define ROOT_TABLE_SHARD_ALIGN 64   /* Shards are kept on cache lines of their own. */
+#define ROOT_TABLE_READ_SPINS 64    /* Retries of a lock-free read before it yields to the writer. */
+
+/*
+ * A shard of a sharded table, a table of its own under a lock. The keys are also read without the
+ * lock: the sequence is odd while a writer changes them, and a read that saw it move is retried.
+ * The key arrays and key copies a writer drops go to its garbage until no read can hold them.
+ *
+ * A snapshot sets the root set aside in frozen_slots and frozen_old_slots. Writers leave frozen
+ * arrays alone: the first one to change the shard copies them, and they are the snapshot's to free.
+ */
+typedef struct RootShard {
+    _Alignas(ROOT_TABLE_SHARD_ALIGN) pthread_mutex_t lock;
+    unsigned int sequence;
+    RootTable table;
+    EpochGarbage garbage;
+    RootSlot *frozen_slots;         /* The slots of the snapshot, NULL when none is held. */
+    size_t frozen_capacity;
+    RootSlot *frozen_old_slots;     /* The old slots of a resize running at the snapshot. */
+    size_t frozen_old_capacity;
+    bool copied;                    /* The table works on copies, the frozen arrays are the snapshot's. */
+} RootShard;
+
+typedef struct RootShards {
+    RootShard *shards;
+    size_t count;
+    unsigned int bits;              /* count is 1 << bits. */
+    pthread_mutex_t snapshot_lock;  /* Held by the snapshot, and by whatever changes every shard. */
+} RootShards;
+
+// Tables grow past three quarters full, linear probing degrades quickly beyond that
+static inline bool over_load(size_t count, size_t capacity){
+    return count + 1 > capacity / 4 * 3;
+}
+
+// Tables shrink below an eighth full, so that a table just grown or shrunk is far from both limits
+static inline bool under_load(size_t count, size_t capacity, size_t min_capacity){
+    return capacity > min_capacity && count < capacity / 8;
+}
+
+static size_t round_capacity(size_t capacity){
+    size_t rounded = ROOT_TABLE_MIN_CAPACITY;
+    while (rounded < capacity){
+        rounded <<= 1;
+    }
+    return rounded;
+}
+
+// Arena objects are told when a root holds them, so that the end of their arena keeps them
+static void root_object(Object *object){
+    if ((object->flags & (OBJECT_ARENA | OBJECT_ROOTED)) == OBJECT_ARENA){
+        arena_root(object);
+    }
+}
+
+static void unroot_object(Object *object){
+    if (object->flags & OBJECT_ARENA){
+        object->flags &= (uint16_t)~OBJECT_ROOTED;
+    }
+}
+
+static size_t find_slot(const RootSlot *slots, size_t capacity, const Object *object){
+    size_t mask = capacity - 1;
+    size_t index = geece_hash_pointer(object) & mask;
+    while (slots[index].object != NULL && slots[index].object != object){
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+// A moved entry is never compared: its key may have been removed from the new array and freed since
+static size_t find_key(const RootKey *keys, size_t capacity, const char *key, unsigned int hash){
+    size_t mask = capacity - 1;
+    size_t index = hash & mask;
+    while (keys[index].key != NULL
+           && (keys[index].moved || keys[index].hash != hash || strcmp(keys[index].key, key) != 0)){
+        index = (index + 1) & mask;
+    }
+    return index;
+}
+
+/*
+ * The keys of a shard are read without its lock, so every store to them is a release: a read that
+ * sees one also sees the odd sequence of the write it belongs to, and the key string it points to.
+ */
+static inline void store_key(RootKey *entry, RootKey value){
+    __atomic_store_n(&entry->hash, value.hash, __ATOMIC_RELEASE);
+    __atomic_store_n(&entry->moved, value.moved, __ATOMIC_RELEASE);
+    __atomic_store_n(&entry->object, value.object, __ATOMIC_RELEASE);
+    __atomic_store_n(&entry->key, value.key, __ATOMIC_RELEASE);
+}
+
+// Key arrays of a shard may still be read, they are freed through its garbage
+static void free_keys(RootKey *keys, EpochGarbage *garbage){
+    if (garbage != NULL){
+        epoch_retire(garbage, keys);
+    } else {
+        free(keys);
+    }
+}
+
+// Backward-shift deletion, the entries after the hole move up unless that would pass their home slot
+static void erase_slot(RootSlot *slots, size_t capacity, size_t index){
+    size_t mask = capacity - 1;
+    size_t hole = index;
+    for (size_t next = (hole + 1) & mask; slots[next].object != NULL; next = (next + 1) & mask){
+        size_t home = geece_hash_pointer(slots[next].object) & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)){
+            slots[hole] = slots[next];
+            hole = next;
+        }
+    }
+    slots[hole] = (RootSlot){0};
+}
+
+static void erase_key(RootKey *keys, size_t capacity, size_t index){
+    size_t mask = capacity - 1;
+    size_t hole = index;
+    for (size_t next = (hole + 1) & mask; keys[next].key != NULL; next = (next + 1) & mask){
+        size_t home = keys[next].hash & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)){
+            store_key(&keys[hole], keys[next]);
+            hole = next;
+        }
+    }
+    store_key(&keys[hole], (RootKey){0});
+}
+
+/*
+ * A resize allocates the new array and leaves the entries in the old one, the operations that
+ * follow move ROOT_TABLE_MIGRATE_STEP old slots each. Old entries are never erased, which would
+ * break the probe sequences going through them: a moved entry keeps its place with no holds, or
+ * flagged moved for keys, and is skipped from then on.
+ */
+
+// The live old slot of an object, NULL if it has none
+static RootSlot *old_slot(const RootTable *table, const Object *object){
+    if (table->old_slots == NULL){
+        return NULL;
+    }
+    RootSlot *slot = &table->old_slots[find_slot(table->old_slots, table->old_capacity, object)];
+    return slot->holds > 0 ? slot : NULL;
+}
+
+static RootKey *old_key(const RootTable *table, const char *key, unsigned int hash){
+    if (table->old_keys == NULL){
+        return NULL;
+    }
+    RootKey *entry = &table->old_keys[find_key(table->old_keys, table->old_key_capacity, key, hash)];
+    return entry->key != NULL && !entry->moved ? entry : NULL;
+}
+
+static void migrate_slots(RootTable *table, size_t steps){
+    for (; steps > 0 && table->migrated < table->old_capacity; --steps){
+        RootSlot *slot = &table->old_slots[table->migrated++];
+        if (slot->holds > 0){
+            table->slots[find_slot(table->slots, table->capacity, slot->object)] = *slot;
+            slot->holds = 0;
+        }
+    }
+    if (table->old_slots != NULL && table->migrated == table->old_capacity){
+        free(table->old_slots);
+        table->old_slots = NULL;
+        table->old_capacity = 0;
+    }
+}
+
+static void migrate_keys(RootTable *table, size_t steps, EpochGarbage *garbage){
+    for (; steps > 0 && table->keys_migrated < table->old_key_capacity; --steps){
+        RootKey *entry = &table->old_keys[table->keys_migrated++];
+        if (entry->key != NULL && !entry->moved){
+            size_t mask = table->key_capacity - 1;
+            size_t index = entry->hash & mask;
+            while (table->keys[index].key != NULL){
+                index = (index + 1) & mask;
+            }
+            store_key(&table->keys[index], *entry);
+            __atomic_store_n(&entry->moved, true, __ATOMIC_RELEASE);
+        }
+    }
+    if (table->old_keys != NULL && table->keys_migrated == table->old_key_capacity){
+        RootKey *old_keys = table->old_keys;
+        __atomic_store_n(&table->old_keys, NULL, __ATOMIC_RELEASE);
+        __atomic_store_n(&table->old_key_capacity, 0, __ATOMIC_RELEASE);
+        free_keys(old_keys, garbage);
+    }
+}
+
+static bool start_slots_resize(RootTable *table, size_t capacity){
+    // Resizes are paced to end before the next one is due, one still running is finished first
+    migrate_slots(table, SIZE_MAX);
+    RootSlot *slots = calloc(capacity, sizeof(RootSlot));
+    if (slots == NULL){
+        return false;
+    }
+    table->old_slots = table->slots;
+    table->old_capacity = table->capacity;
+    table->migrated = 0;
+    table->slots = slots;
+    table->capacity = capacity;
+    return true;
+}
+
+static bool start_keys_resize(RootTable *table, size_t capacity, EpochGarbage *garbage){
+    migrate_keys(table, SIZE_MAX, garbage);
+    RootKey *keys = calloc(capacity, sizeof(RootKey));
+    if (keys == NULL){
+        return false;
+    }
+    __atomic_store_n(&table->old_keys, table->keys, __ATOMIC_RELEASE);
+    __atomic_store_n(&table->old_key_capacity, table->key_capacity, __ATOMIC_RELEASE);
+    table->keys_migrated = 0;
+    __atomic_store_n(&table->keys, keys, __ATOMIC_RELEASE);
+    __atomic_store_n(&table->key_capacity, capacity, __ATOMIC_RELEASE);
+    return true;
+}
+
+// The slot of an object in the new array, moved there first if it was still in the old one
+static RootSlot *take_slot(RootTable *table, const Object *object){
+    RootSlot *slot = &table->slots[find_slot(table->slots, table->capacity, object)];
+    if (slot->object != NULL){
+        return slot;
+    }
+    RootSlot *old = old_slot(table, object);
+    if (old == NULL){
+        return NULL;
+    }
+    *slot = *old;
+    old->holds = 0;
+    return slot;
+}
+
+static RootKey *take_key(RootTable *table, const char *key, unsigned int hash){
+    RootKey *entry = &table->keys[find_key(table->keys, table->key_capacity, key, hash)];
+    if (entry->key != NULL){
+        return entry;
+    }
+    RootKey *old = old_key(table, key, hash);
+    if (old == NULL){
+        return NULL;
+    }
+    store_key(entry, *old);
+    __atomic_store_n(&old->moved, true, __ATOMIC_RELEASE);
+    return entry;
+}
+
+// The holds of an object, 0 if it is not rooted
+static size_t holds_of(const RootTable *table, const Object *object){
+    const RootSlot *slot = &table->slots[find_slot(table->slots, table->capacity, object)];
+    if (slot->object == NULL){
+        slot = old_slot(table, object);
+    }
+    return slot != NULL ? slot->holds : 0;
+}
+
+static Object *lookup_key(const RootTable *table, const char *key, unsigned int hash){
+    RootKey *entry = &table->keys[find_key(table->keys, table->key_capacity, key, hash)];
+    if (entry->key == NULL){
+        entry = old_key(table, key, hash);
+    }
+    return entry != NULL ? entry->object : NULL;
+}
+
+static void finish_resize(RootTable *table, EpochGarbage *garbage){
+    migrate_slots(table, SIZE_MAX);
+    migrate_keys(table, SIZE_MAX, garbage);
+}
+
+static bool rehash(RootTable *table, EpochGarbage *garbage){
+    if (!start_slots_resize(table, table->capacity * 2) || !start_keys_resize(table, table->key_capacity * 2, garbage)) {
+        fprintf(stderr, "Out of memory.");
+        return false;
+    }
+    // A manual rehash keeps its all-at-once behaviour, and the table keeps the larger size
+    finish_resize(table, garbage);
+    table->min_capacity = table->capacity;
+    return true;
+}
+
+// Moved objects leave their slot, to come back under their new address with their holds
+static void take_moved_slots(RootTable *table, Object *(*forward)(Object *object), RootSlot **moved, size_t *moved_count,
+                             size_t *moved_capacity){
+    for (size_t i = 0; i < table->capacity;){
+        RootSlot slot = table->slots[i];
+        Object *object = slot.object != NULL ? forward(slot.object) : NULL;
+        if (object == slot.object){
+            i++;
+            continue;
+        }
+        if (*moved_count == *moved_capacity){
+            *moved_capacity = *moved_capacity == 0 ? 64 : *moved_capacity * 2;
+            RootSlot *grown = realloc(*moved, *moved_capacity * sizeof(RootSlot));
+            if (grown == NULL){
+                fprintf(stderr, "Error: Failed to allocate memory for moved roots.\n");
+                exit(EXIT_FAILURE);
+            }
+            *moved = grown;
+        }
+        (*moved)[(*moved_count)++] = (RootSlot){object, slot.holds};
+        // The shift may pull a later entry into this slot, so it is looked at again
+        erase_slot(table->slots, table->capacity, i);
+        table->count--;
+    }
+}
+
+static void put_slot(RootTable *table, RootSlot moved){
+    RootSlot *slot = &table->slots[find_slot(table->slots, table->capacity, moved.object)];
+    if (slot->object == NULL){
+        // A table gets back what it gave, but the shard of a new address may get more
+        if (over_load(table->count, table->capacity)){
+            if (!start_slots_resize(table, table->capacity * 2)){
+                fprintf(stderr, "Error: Failed to allocate memory for moved roots.\n");
+                exit(EXIT_FAILURE);
+            }
+            migrate_slots(table, SIZE_MAX);
+            slot = &table->slots[find_slot(table->slots, table->capacity, moved.object)];
+        }
+        slot->object = moved.object;
+        table->count++;
+    }
+    slot->holds += moved.holds;
+}
+
+static void forward_keys(RootTable *table, Object *(*forward)(Object *object)){
+    for (size_t i = 0; i < table->key_capacity; ++i){
+        if (table->keys[i].object != NULL){
+            __atomic_store_n(&table->keys[i].object, forward(table->keys[i].object), __ATOMIC_RELEASE);
+        }
+    }
+}
+
+static void visit_keys(const RootTable *table, void (*visit)(const char *key, Object *object)){
+    for (size_t i = 0; i < table->key_capacity; ++i){
+        if (table->keys[i].key != NULL){
+            visit(table->keys[i].key, table->keys[i].object);
+        }
+    }
+    for (size_t i = 0; i < table->old_key_capacity; ++i){
+        if (table->old_keys[i].key != NULL && !table->old_keys[i].moved){
+            visit(table->old_keys[i].key, table->old_keys[i].object);
+        }
+    }
+}
+
+/*
+ * Sharded tables. Every operation locks the one shard it works on, so none ever holds two: a key
+ * roots its object in the object's shard before it is added, and drops the hold of the object it
+ * replaced once it was. In between, the object is held once more than needed, which only keeps it
+ * a little longer. Only the snapshot and what changes every shard lock them all, in order.
+ */
+
+static inline RootShard *slot_shard(const RootTable *table, const Object *object){
+    const RootShards *shards = table->shards;
+    // The low bits of a hash pick the slot within the shard, the high bits the shard
+    size_t index = shards->bits == 0 ? 0 : geece_hash_pointer(object) >> (sizeof(size_t) * 8 - shards->bits);
+    return &shards->shards[index];
+}
+
+static inline RootShard *key_shard(const RootTable *table, unsigned int hash){
+    const RootShards *shards = table->shards;
+    size_t index = shards->bits == 0 ? 0 : hash >> (sizeof(unsigned int) * 8 - shards->bits);
+    return &shards->shards[index];
+}
+
+static inline void begin_key_write(RootShard *shard){
+    __atomic_store_n(&shard->sequence, shard->sequence + 1, __ATOMIC_RELAXED);
+}
+
+static inline void end_key_write(RootShard *shard){
+    __atomic_store_n(&shard->sequence, shard->sequence + 1, __ATOMIC_RELEASE);
+}
+
+// Before the first change of a shard under a snapshot, the table moves to copies of its arrays
+static bool thaw(RootShard *shard){
+    if (shard->frozen_slots == NULL || shard->copied){
+        return true;
+    }
+    RootTable *table = &shard->table;
+    RootSlot *slots = malloc(table->capacity * sizeof(RootSlot));
+    RootSlot *old_slots = table->old_slots != NULL ? malloc(table->old_capacity * sizeof(RootSlot)) : NULL;
+    if (slots == NULL || (table->old_slots != NULL && old_slots == NULL)){
+        free(slots);
+        free(old_slots);
+        return false;
+    }
+    memcpy(slots, table->slots, table->capacity * sizeof(RootSlot));
+    if (old_slots != NULL){
+        memcpy(old_slots, table->old_slots, table->old_capacity * sizeof(RootSlot));
+    }
+    table->slots = slots;
+    table->old_slots = old_slots;
+    shard->copied = true;
+    return true;
+}
+
+static bool lock_slots(RootShard *shard){
+    pthread_mutex_lock(&shard->lock);
+    if (!thaw(shard)){
+        pthread_mutex_unlock(&shard->lock);
+        fprintf(stderr, "Error: Failed to copy the roots of a snapshot.\n");
+        return false;
+    }
+    return true;
+}
+
+// What changes every shard waits for the snapshot to be released, frozen arrays are never copied
+static void lock_all(RootShards *shards){
+    pthread_mutex_lock(&shards->snapshot_lock);
+    for (size_t i = 0; i < shards->count; ++i){
+        pthread_mutex_lock(&shards->shards[i].lock);
+    }
+}
+
+static void unlock_all(RootShards *shards){
+    for (size_t i = shards->count; i-- > 0;){
+        pthread_mutex_unlock(&shards->shards[i].lock);
+    }
+    pthread_mutex_unlock(&shards->snapshot_lock);
+}
+
+static bool sharded_add(RootTable *table, Object *object){
+    RootShard *shard = slot_shard(table, object);
+    if (!lock_slots(shard)){
+        return false;
+    }
+    bool added = root_table_add(&shard->table, object);
+    pthread_mutex_unlock(&shard->lock);
+    return added;
+}
+
+static bool sharded_remove(RootTable *table, Object *object){
+    RootShard *shard = slot_shard(table, object);
+    if (!lock_slots(shard)){
+        return false;
+    }
+    bool removed = root_table_remove(&shard->table, object);
+    pthread_mutex_unlock(&shard->lock);
+    return removed;
+}
+
+static size_t sharded_holds(const RootTable *table, const Object *object){
+    RootShard *shard = slot_shard(table, object);
+    pthread_mutex_lock(&shard->lock);
+    size_t holds = holds_of(&shard->table, object);
+    pthread_mutex_unlock(&shard->lock);
+    return holds;
+}
+
+static char *copy_key(const char *key){
+    size_t length = strlen(key) + 1;
+    char *copy = malloc(length);
+    if (copy != NULL){
+        memcpy(copy, key, length);
+    }
+    return copy;
+}
+
+static bool sharded_add_key(RootTable *table, const char *key, Object *object){
+    if (object != NULL && !sharded_add(table, object)){
+        fprintf(stderr, "Out of memory.");
+        return false;
+    }
+    unsigned int hash = geece_hash(key);
+    RootShard *shard = key_shard(table, hash);
+    RootTable *keys = &shard->table;
+    pthread_mutex_lock(&shard->lock);
+    begin_key_write(shard);
+    migrate_keys(keys, ROOT_TABLE_MIGRATE_STEP, &shard->garbage);
+    // The hold dropped at the end: the replaced object's, or the new one's if the key was not added
+    Object *dropped = object;
+    bool added = false;
+    RootKey *entry = take_key(keys, key, hash);
+    if (entry != NULL){
+        dropped = entry->object;
+        __atomic_store_n(&entry->object, object, __ATOMIC_RELEASE);
+        added = true;
+    } else if (!over_load(keys->key_count, keys->key_capacity)
+               || start_keys_resize(keys, keys->key_capacity * 2, &shard->garbage)){
+        char *copy = copy_key(key);
+        if (copy != NULL){
+            store_key(&keys->keys[find_key(keys->keys, keys->key_capacity, key, hash)], (RootKey){copy, hash, false, object});
+            keys->key_count++;
+            dropped = NULL;
+            added = true;
+        }
+    }
+    end_key_write(shard);
+    pthread_mutex_unlock(&shard->lock);
+    if (dropped != NULL){
+        sharded_remove(table, dropped);
+    }
+    if (!added){
+        fprintf(stderr, "Out of memory.");
+    }
+    return added;
+}
+
+static bool sharded_remove_key(RootTable *table, const char *key){
+    unsigned int hash = geece_hash(key);
+    RootShard *shard = key_shard(table, hash);
+    RootTable *keys = &shard->table;
+    pthread_mutex_lock(&shard->lock);
+    begin_key_write(shard);
+    migrate_keys(keys, ROOT_TABLE_MIGRATE_STEP, &shard->garbage);
+    RootKey *entry = take_key(keys, key, hash);
+    Object *object = NULL;
+    if (entry != NULL){
+        object = entry->object;
+        char *copy = entry->key;
+        erase_key(keys->keys, keys->key_capacity, (size_t)(entry - keys->keys));
+        keys->key_count--;
+        if (keys->old_keys == NULL && under_load(keys->key_count, keys->key_capacity, keys->min_capacity)){
+            start_keys_resize(keys, keys->key_capacity / 2, &shard->garbage);
+        }
+        epoch_retire(&shard->garbage, copy);
+    }
+    end_key_write(shard);
+    pthread_mutex_unlock(&shard->lock);
+    if (entry == NULL){
+        printf("Key '%s' not found in table.\n", key);
+        return false;
+    }
+    if (object != NULL){
+        sharded_remove(table, object);
+    }
+    return true;
+}
+
+// A read of keys a writer may be changing: every load is atomic, and the probe is bounded
+static bool probe_key(const RootKey *keys, size_t capacity, const char *key, unsigned int hash, Object **object){
+    size_t mask = capacity - 1;
+    size_t index = hash & mask;
+    for (size_t probes = 0; probes < capacity; ++probes){
+        const RootKey *entry = &keys[index];
+        bool moved = __atomic_load_n(&entry->moved, __ATOMIC_ACQUIRE);
+        const char *stored = __atomic_load_n(&entry->key, __ATOMIC_ACQUIRE);
+        if (stored == NULL){
+            return false;
+        }
+        if (!moved && __atomic_load_n(&entry->hash, __ATOMIC_ACQUIRE) == hash && strcmp(stored, key) == 0){
+            *object = __atomic_load_n(&entry->object, __ATOMIC_ACQUIRE);
+            return true;
+        }
+        index = (index + 1) & mask;
+    }
+    return false;
+}
+
+static Object *sharded_get(RootTable *table, const char *key){
+    unsigned int hash = geece_hash(key);
+    RootShard *shard = key_shard(table, hash);
+    RootTable *keys = &shard->table;
+    if (!epoch_enter()){
+        // A thread that could not register reads under the lock
+        pthread_mutex_lock(&shard->lock);
+        Object *object = lookup_key(keys, key, hash);
+        pthread_mutex_unlock(&shard->lock);
+        return object;
+    }
+    Object *object = NULL;
+    for (unsigned int retries = 0;; ++retries){
+        if (retries >= ROOT_TABLE_READ_SPINS){
+            sched_yield();
+        }
+        unsigned int sequence = __atomic_load_n(&shard->sequence, __ATOMIC_ACQUIRE);
+        if (sequence & 1){
+            continue;
+        }
+        // An array and its capacity are only used together if no write came in between; the loads
+        // are acquires, so the sequence is read again after them
+        RootKey *array = __atomic_load_n(&keys->keys, __ATOMIC_ACQUIRE);
+        size_t capacity = __atomic_load_n(&keys->key_capacity, __ATOMIC_ACQUIRE);
+        RootKey *old_array = __atomic_load_n(&keys->old_keys, __ATOMIC_ACQUIRE);
+        size_t old_capacity = __atomic_load_n(&keys->old_key_capacity, __ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shard->sequence, __ATOMIC_RELAXED) != sequence){
+            continue;
+        }
+        object = NULL;
+        if (!probe_key(array, capacity, key, hash, &object) && old_array != NULL){
+            probe_key(old_array, old_capacity, key, hash, &object);
+        }
+        if (__atomic_load_n(&shard->sequence, __ATOMIC_RELAXED) == sequence){
+            break;
+        }
+    }
+    epoch_exit();
+    return object;
+}
+
+static void sharded_forward(RootTable *table, Object *(*forward)(Object *object)){
+    RootShards *shards = table->shards;
+    lock_all(shards);
+    // A new address may hash to another shard, and one that moved in must not be forwarded again
+    RootSlot *moved = NULL;
+    size_t moved_count = 0;
+    size_t moved_capacity = 0;
+    for (size_t i = 0; i < shards->count; ++i){
+        RootShard *shard = &shards->shards[i];
+        begin_key_write(shard);
+        finish_resize(&shard->table, &shard->garbage);
+        forward_keys(&shard->table, forward);
+        end_key_write(shard);
+        take_moved_slots(&shard->table, forward, &moved, &moved_count, &moved_capacity);
+    }
+    for (size_t i = 0; i < moved_count; ++i){
+        put_slot(&slot_shard(table, moved[i].object)->table, moved[i]);
+    }
+    free(moved);
+    unlock_all(shards);
+}
+
+// Key copies go with the keys, to the garbage as readers may be on them
+static void clear_shard(RootShard *shard){
+    RootTable *table = &shard->table;
+    root_table_for_each(table, unroot_object);
+    free(table->old_slots);
+    table->old_slots = NULL;
+    table->old_capacity = 0;
+    memset(table->slots, 0, table->capacity * sizeof(RootSlot));
+    table->count = 0;
+    begin_key_write(shard);
+    RootKey *old_keys = table->old_keys;
+    size_t old_key_capacity = table->old_key_capacity;
+    __atomic_store_n(&table->old_keys, NULL, __ATOMIC_RELEASE);
+    __atomic_store_n(&table->old_key_capacity, 0, __ATOMIC_RELEASE);
+    for (size_t i = 0; i < old_key_capacity; ++i){
+        if (old_keys[i].key != NULL && !old_keys[i].moved){
+            epoch_retire(&shard->garbage, old_keys[i].key);
+        }
+    }
+    free_keys(old_keys, &shard->garbage);
+    for (size_t i = 0; i < table->key_capacity; ++i){
+        char *key = table->keys[i].key;
+        if (key != NULL){
+            store_key(&table->keys[i], (RootKey){0});
+            epoch_retire(&shard->garbage, key);
+        }
+    }
+    table->key_count = 0;
+    end_key_write(shard);
+}
+
+static void free_shards(RootShards *shards, size_t count){
+    for (size_t i = 0; i < count; ++i){
+        RootShard *shard = &shards->shards[i];
+        epoch_free_all(&shard->garbage);
+        free(shard->table.slots);
+        free(shard->table.keys);
+        pthread_mutex_destroy(&shard->lock);
+    }
+    pthread_mutex_destroy(&shards->snapshot_lock);
+    free(shards->shards);
+    free(shards);
+}
+
+RootTable *init_sharded_root_table(RootTable *table, size_t shard_count, size_t initial_capacity){
+    unsigned int bits = 0;
+    while (((size_t)1 << bits) < shard_count && ((size_t)1 << bits) < GEECE_ROOT_TABLE_MAX_SHARDS){
+        bits++;
+    }
+    size_t count = (size_t)1 << bits;
+    RootShards *shards = malloc(sizeof(RootShards));
+    RootShard *array = shards != NULL ? aligned_alloc(ROOT_TABLE_SHARD_ALIGN, count * sizeof(RootShard)) : NULL;
+    if (array == NULL){
+        fprintf(stderr, "Out of memory.");
+        free(shards);
+        return NULL;
+    }
+    *shards = (RootShards){.shards = array, .count = 0, .bits = bits};
+    pthread_mutex_init(&shards->snapshot_lock, NULL);
+    for (; shards->count < count; ++shards->count){
+        RootShard *shard = &array[shards->count];
+        memset(shard, 0, sizeof(RootShard));
+        if (init_root_table(&shard->table, initial_capacity / count) == NULL){
+            free_shards(shards, shards->count);
+            return NULL;
+        }
+        pthread_mutex_init(&shard->lock, NULL);
+    }
+    if (table == NULL){
+        table = malloc(sizeof(RootTable));
+        if (table == NULL){
+            fprintf(stderr, "Out of memory.");
+            free_shards(shards, count);
+            return NULL;
+        }
+    }
+    *table = (RootTable){0};
+    table->shards = shards;
+    return table;
+}
+
+void root_table_snapshot(const RootTable *table){
+    if (table == NULL || table->shards == NULL){
+        return;
+    }
+    RootShards *shards = table->shards;
+    pthread_mutex_lock(&shards->snapshot_lock);
+    // The handshake: between the first lock and the last, no shard changes
+    for (size_t i = 0; i < shards->count; ++i){
+        pthread_mutex_lock(&shards->shards[i].lock);
+    }
+    for (size_t i = 0; i < shards->count; ++i){
+        RootShard *shard = &shards->shards[i];
+        shard->frozen_slots = shard->table.slots;
+        shard->frozen_capacity = shard->table.capacity;
+        shard->frozen_old_slots = shard->table.old_slots;
+        shard->frozen_old_capacity = shard->table.old_capacity;
+        shard->copied = false;
+    }
+    for (size_t i = shards->count; i-- > 0;){
+        pthread_mutex_unlock(&shards->shards[i].lock);
+    }
+}
+
+static void visit_slots(const RootSlot *slots, size_t capacity, void (*visit)(Object *object)){
+    for (size_t i = 0; i < capacity; ++i){
+        if (slots[i].holds > 0){
+            visit(slots[i].object);
+        }
+    }
+}
+
+void root_table_snapshot_for_each(const RootTable *table, void (*visit)(Object *object)){
+    if (table == NULL || table->shards == NULL){
+        root_table_for_each(table, visit);
+        return;
+    }
+    // Writers never touch frozen arrays, they are read without a lock
+    const RootShards *shards = table->shards;
+    for (size_t i = 0; i < shards->count; ++i){
+        const RootShard *shard = &shards->shards[i];
+        visit_slots(shard->frozen_slots, shard->frozen_capacity, visit);
+        visit_slots(shard->frozen_old_slots, shard->frozen_old_capacity, visit);
+    }
+}
+
+void root_table_release_snapshot(const RootTable *table){
+    if (table == NULL || table->shards == NULL){
+        return;
+    }
+    RootShards *shards = table->shards;
+    for (size_t i = 0; i < shards->count; ++i){
+        RootShard *shard = &shards->shards[i];
+        pthread_mutex_lock(&shard->lock);
+        if (shard->copied){
+            free(shard->frozen_slots);
+            free(shard->frozen_old_slots);
+        }
+        shard->frozen_slots = NULL;
+        shard->frozen_old_slots = NULL;
+        shard->frozen_capacity = 0;
+        shard->frozen_old_capacity = 0;
+        shard->copied = false;
+        pthread_mutex_unlock(&shard->lock);
+    }
+    pthread_mutex_unlock(&shards->snapshot_lock);
+}
+
+void root_table_for_each_key(const RootTable *table, void (*visit)(const char *key, Object *object)){
+    if (table == NULL){
+        return;
+    }
+    if (table->shards == NULL){
+        visit_keys(table, visit);
+        return;
+    }
+    const RootShards *shards = table->shards;
+    for (size_t i = 0; i < shards->count; ++i){
+        RootShard *shard = &shards->shards[i];
+        pthread_mutex_lock(&shard->lock);
+        visit_keys(&shard->table, visit);
+        pthread_mutex_unlock(&shard->lock);
+    }
+}
+
 RootTable *init_root_table(RootTable *table, size_t initial_capacity) {
-    if (table == NULL) {
+    bool allocated = table == NULL;
+    if (allocated) {
         // Dynamically allocate memory for the table
         table = malloc(sizeof(RootTable));
         if (table == NULL) {
@@ -29,20 +819,152 @@ RootTable *init_root_table(RootTable *table, size_t initial_capacity) {
         }
     }
 
-    table->bucket_count = initial_capacity;
-
-    // Allocate memory for bucket_heads array and initialize to NULL
-    table->bucket_heads = calloc(initial_capacity, sizeof(Bucket*));
-    if (table->bucket_heads == NULL) {
+    size_t capacity = round_capacity(initial_capacity);
+    *table = (RootTable){0};
+    table->slots = calloc(capacity, sizeof(RootSlot));
+    table->keys = calloc(capacity, sizeof(RootKey));
+    if (table->slots == NULL || table->keys == NULL) {
         fprintf(stderr, "Out of memory.");
-        free(table); // Free the dynamically allocated memory for the table
+        free(table->slots);
+        free(table->keys);
+        if (allocated) {
+            free(table); // Free the dynamically allocated memory for the table
+        }
         return NULL;
     }
-
+    table->capacity = capacity;
+    table->key_capacity = capacity;
+    table->min_capacity = capacity;
     return table;
 }
 
+bool root_table_add(RootTable *table, Object *object){
+    if (table == NULL || object == NULL){
+        return false;
+    }
+    if (table->shards != NULL){
+        return sharded_add(table, object);
+    }
+    migrate_slots(table, ROOT_TABLE_MIGRATE_STEP);
+    RootSlot *slot = take_slot(table, object);
+    if (slot != NULL){
+        slot->holds++;
+        return true;
+    }
+    if (over_load(table->count, table->capacity) && !start_slots_resize(table, table->capacity * 2)){
+        return false;
+    }
+    slot = &table->slots[find_slot(table->slots, table->capacity, object)];
+    *slot = (RootSlot){object, 1};
+    table->count++;
+    root_object(object);
+    return true;
+}
+
+bool root_table_remove(RootTable *table, Object *object){
+    if (table == NULL || object == NULL){
+        return false;
+    }
+    if (table->shards != NULL){
+        return sharded_remove(table, object);
+    }
+    migrate_slots(table, ROOT_TABLE_MIGRATE_STEP);
+    RootSlot *slot = take_slot(table, object);
+    if (slot == NULL){
+        return false;
+    }
+    if (--slot->holds == 0){
+        unroot_object(object);
+        erase_slot(table->slots, table->capacity, (size_t)(slot - table->slots));
+        table->count--;
+        // A failed shrink only leaves the table larger than it needs to be
+        if (table->old_slots == NULL && under_load(table->count, table->capacity, table->min_capacity)){
+            start_slots_resize(table, table->capacity / 2);
+        }
+    }
+    return true;
+}
 
+bool root_table_contains(const RootTable *table, const Object *object){
+    if (table == NULL || object == NULL){
+        return false;
+    }
+    if (table->shards != NULL){
+        return sharded_holds(table, object) > 0;
+    }
+    return table->slots[find_slot(table->slots, table->capacity, object)].object != NULL
+           || old_slot(table, object) != NULL;
+}
+
+void root_table_for_each(const RootTable *table, void (*visit)(Object *object)){
+    if (table != NULL && table->shards != NULL){
+        root_table_snapshot(table);
+        root_table_snapshot_for_each(table, visit);
+        root_table_release_snapshot(table);
+        return;
+    }
+    size_t count = table != NULL ? root_table_slot_count(table) : 0;
+    for (size_t i = 0; i < count; ++i){
+        Object *object = root_table_slot(table, i);
+        if (object != NULL){
+            visit(object);
+        }
+    }
+}
+
+// The callbacks of root_table_for_each() take no context, the scan keeps it per thread
+static _Thread_local const Object *scanned_target;
+static _Thread_local size_t scanned_referrers;
+
+static void count_edge_to_target(Object *object){
+    scanned_referrers += object_has_reference(object, scanned_target);
+}
+
+size_t root_table_count_referrers(const RootTable *table, const Object *object){
+    scanned_target = object;
+    scanned_referrers = 0;
+    root_table_for_each(table, count_edge_to_target);
+    return scanned_referrers;
+}
+
+void root_table_finish_resize(RootTable *table){
+    if (table == NULL){
+        return;
+    }
+    if (table->shards == NULL){
+        finish_resize(table, NULL);
+        return;
+    }
+    lock_all(table->shards);
+    for (size_t i = 0; i < table->shards->count; ++i){
+        RootShard *shard = &table->shards->shards[i];
+        begin_key_write(shard);
+        finish_resize(&shard->table, &shard->garbage);
+        end_key_write(shard);
+    }
+    unlock_all(table->shards);
+}
+
+void root_table_forward(RootTable *table, Object *(*forward)(Object *object)){
+    if (table == NULL){
+        return;
+    }
+    if (table->shards != NULL){
+        sharded_forward(table, forward);
+        return;
+    }
+    // The collection walks every root anyway, a single array keeps the rehash below simple
+    root_table_finish_resize(table);
+    RootSlot *moved = NULL;
+    size_t moved_count = 0;
+    size_t moved_capacity = 0;
+    take_moved_slots(table, forward, &moved, &moved_count, &moved_capacity);
+    for (size_t i = 0; i < moved_count; ++i){
+        put_slot(table, moved[i]);
+    }
+    free(moved);
+    forward_keys(table, forward);
+}
 
 bool add_to_root_table(RootTable *table, char *key, Object *object){
     if (table == NULL){
@@ -53,40 +975,38 @@ bool add_to_root_table(RootTable *table, char *key, Object *object){
         fprintf(stderr, "Key is NULL.");
         return false;
     }
-    unsigned int index = geece_hash(key) % table->bucket_count;
-    Bucket *currentBucketHead = table->bucket_heads[index];
+    if (table->shards != NULL){
+        return sharded_add_key(table, key, object);
+    }
+    migrate_keys(table, ROOT_TABLE_MIGRATE_STEP, NULL);
+    unsigned int hash = geece_hash(key);
 
     // Check if key already exists
-    Bucket *currentBucket = currentBucketHead;
-    while (currentBucket != NULL) {
-        if (currentBucket->key != NULL && strcmp(currentBucket->key, key) == 0) {
-            currentBucket->object = object;
+    RootKey *entry = take_key(table, key, hash);
+    if (entry != NULL) {
+        Object *previous = entry->object;
+        if (previous == object) {
             return true;
         }
-        currentBucket = currentBucket->next;
-    }
-
-    // Key does not exist, find the next available bucket
-    currentBucket = currentBucketHead;
-    while (currentBucket != NULL) {
-        if (currentBucket->key == NULL) {
-            // Add the new bucket to the table
-            currentBucket->key = key;
-            currentBucket->object = object;
-            return true;
+        if (object != NULL && !root_table_add(table, object)) {
+            fprintf(stderr, "Out of memory.");
+            return false;
         }
-        currentBucket = currentBucket->next;
+        __atomic_store_n(&entry->object, object, __ATOMIC_RELEASE);
+        root_table_remove(table, previous);
+        return true;
     }
 
-    Bucket *newBucket = malloc(sizeof(Bucket));
-    if (newBucket == NULL){
+    if (over_load(table->key_count, table->key_capacity) && !start_keys_resize(table, table->key_capacity * 2, NULL)) {
+        fprintf(stderr, "Out of memory.");
+        return false;
+    }
+    if (object != NULL && !root_table_add(table, object)) {
         fprintf(stderr, "Out of memory.");
         return false;
     }
-    newBucket->key = key;
-    newBucket->object = object;
-    newBucket->next = currentBucket;
-    table->bucket_heads[index] = newBucket;
+    store_key(&table->keys[find_key(table->keys, table->key_capacity, key, hash)], (RootKey){key, hash, false, object});
+    table->key_count++;
     return true;
 }
 
@@ -95,26 +1015,23 @@ bool remove_from_root_table(RootTable *table, char *key){
         fprintf(stderr, "Root table not initialized.");
         return false;
     }
-    for (size_t i = 0; i < table->bucket_count; ++i){
-        Bucket *currentBucket = table->bucket_heads[i];
-        Bucket *previousBucket = currentBucket;
-        while (currentBucket != NULL){
-            if (currentBucket->key != NULL && strcmp(currentBucket->key, key) == 0){
-                if (previousBucket == currentBucket){
-                    table->bucket_heads[i] = currentBucket->next;
-                } else {
-                    previousBucket->next = currentBucket->next;
-                }
-                free(currentBucket);
-                table->bucket_count--;
-                return true;
-            }
-            previousBucket = currentBucket;
-            currentBucket = currentBucket->next;
-        }
+    if (table->shards != NULL){
+        return sharded_remove_key(table, key);
     }
-    printf("Key '%s' not found in table.\n", key);
-    return false;
+    migrate_keys(table, ROOT_TABLE_MIGRATE_STEP, NULL);
+    RootKey *entry = take_key(table, key, geece_hash(key));
+    if (entry == NULL){
+        printf("Key '%s' not found in table.\n", key);
+        return false;
+    }
+    Object *object = entry->object;
+    erase_key(table->keys, table->key_capacity, (size_t)(entry - table->keys));
+    table->key_count--;
+    if (table->old_keys == NULL && under_load(table->key_count, table->key_capacity, table->min_capacity)){
+        start_keys_resize(table, table->key_capacity / 2, NULL);
+    }
+    root_table_remove(table, object);
+    return true;
 }
 
 Object *get_from_root_table(RootTable *table, char *key){
@@ -126,16 +1043,10 @@ Object *get_from_root_table(RootTable *table, char *key){
         fprintf(stderr, "Key is NULL.");
         return NULL;
     }
-    for (size_t i = 0; i < table->bucket_count; ++i){
-        Bucket *currentBucketHead = table->bucket_heads[i];
-        while (currentBucketHead != NULL){
-            if (currentBucketHead->key != NULL && strcmp(currentBucketHead->key, key) == 0){
-                return currentBucketHead->object;
-            }
-            currentBucketHead = currentBucketHead ->next;
-        }
+    if (table->shards != NULL){
+        return sharded_get(table, key);
     }
-    return NULL;
+    return lookup_key(table, key, geece_hash(key));
 }
 
 bool clear_root_table(RootTable *table) {
@@ -143,25 +1054,26 @@ bool clear_root_table(RootTable *table) {
         fprintf(stderr, "Root table not initialized.");
         return false;
     }
-    for (size_t i = 0; i < table->bucket_count; ++i) {
-        Bucket *currentBucket = table->bucket_heads[i];
-        while (currentBucket != NULL) {
-            Bucket *tempBucket = currentBucket;
-            currentBucket = currentBucket->next;
-
-            // Free the object nodes for this bucket
-            ObjectNode *currentNode = tempBucket->object->references;
-            while (currentNode != NULL) {
-                ObjectNode *tempNode = currentNode;
-                currentNode = currentNode->next;
-                free(tempNode);
-            }
-            free(tempBucket->key);
-            free(tempBucket);
+    if (table->shards != NULL){
+        lock_all(table->shards);
+        for (size_t i = 0; i < table->shards->count; ++i){
+            clear_shard(&table->shards->shards[i]);
         }
-        table->bucket_heads[i] = NULL;
+        unlock_all(table->shards);
+        return true;
     }
-    table->bucket_count = 0;
+    root_table_for_each(table, unroot_object);
+    // Keys belong to the caller and edges to their objects, only the slots are ours
+    free(table->old_slots);
+    free(table->old_keys);
+    table->old_slots = NULL;
+    table->old_keys = NULL;
+    table->old_capacity = 0;
+    table->old_key_capacity = 0;
+    memset(table->slots, 0, table->capacity * sizeof(RootSlot));
+    memset(table->keys, 0, table->key_capacity * sizeof(RootKey));
+    table->count = 0;
+    table->key_count = 0;
     return true;
 }
 
@@ -172,7 +1084,11 @@ bool destroy_root_table(RootTable *table){
         return false;
     }
     clear_root_table(table);
-    free(table->bucket_heads);
+    if (table->shards != NULL){
+        free_shards(table->shards, table->shards->count);
+    }
+    free(table->slots);
+    free(table->keys);
     free(table);
     return true;
 }
@@ -180,96 +1096,51 @@ bool destroy_root_table(RootTable *table){
 bool rehash_root_table(RootTable *table) {
     if (table == NULL) {
         fprintf(stderr, "Root table not initialized.");
-        return false
-    }
-
-    size_t new_capacity = table->bucket_count * 2;
-
-    RootTable new_table;
-    if (init_root_table(&new_table, new_capacity) == NULL) {
-        fprintf(stderr, "Out of memory.");
         return false;
     }
-
-    // Copy over all of the key-value pairs from the old table to the new table
-    for (size_t i = 0; i < table->bucket_count; ++i) {
-        Bucket *currentBucketHead = table->bucket_heads[i];
-        Bucket *currentBucket = currentBucketHead;
-
-        while (currentBucket != NULL) {
-            if (currentBucket->key != NULL) {
-                add_to_root_table(&new_table, currentBucket->key, currentBucket->object);
-            }
-            currentBucket = currentBucket->next;
-        }
+    if (table->shards == NULL) {
+        return rehash(table, NULL);
     }
-
-    // Free the memory used by the old table
-    clear_root_table(table);
-
-    // Allocate a new memory block for bucket_heads
-    Bucket **new_bucket_heads = malloc(new_table.bucket_count * sizeof(Bucket*));
-    if (new_bucket_heads == NULL) {
-        fprintf(stderr, "Out of memory.");
-        return false;
+    bool rehashed = true;
+    lock_all(table->shards);
+    for (size_t i = 0; i < table->shards->count && rehashed; ++i){
+        RootShard *shard = &table->shards->shards[i];
+        begin_key_write(shard);
+        rehashed = rehash(&shard->table, &shard->garbage);
+        end_key_write(shard);
     }
-
-    // Copy the contents of new_table.bucket_heads to the new memory block
-    memcpy(new_bucket_heads, new_table.bucket_heads, new_table.bucket_count * sizeof(Bucket*));
-
-    // Free the memory used by the new table
-    free(new_table.bucket_heads);
-
-    // Update the table's bucket count and bucket_heads to those of the new table
-    table->bucket_count = new_table.bucket_count;
-    table->bucket_heads = new_bucket_heads;
-
-    return true;
-
+    unlock_all(table->shards);
+    return rehashed;
 }
+
 bool add_reference(RootTable *table, Object *object, Object *referenced_object) {
     if (table == NULL) {
         fprintf(stderr, "Root table not initialized.");
         return false;
     }
 
-    uintptr_t address_of_object = (uintptr_t)object;
-    char key[20];
-    sprintf(key, "%llu", address_of_object);
-
-    Object *existing_object = get_from_root_table(table, key);
-    if (existing_object == NULL) {
+    if (!root_table_contains(table, object)) {
         fprintf(stderr, "Object not found in root table.");
         return false;
     }
 
-    ObjectNode *currentNode = existing_object->references;
-    ObjectNode *previousNode = NULL;
-    while (currentNode != NULL) {
-        if (currentNode->object == referenced_object) {
-            return true; // Reference already exists
-        }
-        previousNode = currentNode;
-        currentNode = currentNode->next;
+    if (object_has_reference(object, referenced_object)) {
+        return true; // Reference already exists
     }
-
-    // Reference does not already exist
-    ObjectNode *newNode = malloc(sizeof(ObjectNode));
-    if (newNode == NULL) {
+    if (!object_add_reference(object, referenced_object)) {
         fprintf(stderr, "Out of memory.");
         return false;
     }
-    newNode->object = referenced_object;
-    newNode->next = NULL;
-
-    if (existing_object->references == NULL) {
-        existing_object->references = newNode;
-    } else {
-        previousNode->next = newNode;
+    if (!reference_link(object, referenced_object)) {
+        object_remove_reference(object, referenced_object);
+        fprintf(stderr, "Out of memory.");
+        return false;
     }
+    nursery_record_reference(object, referenced_object);
+    arena_record_reference(object, referenced_object);
+    geece_shade(referenced_object);
 
-    existing_object->referenced_ptrs_count++;
-    referenced_object->ref_count++;
+    object_ref_increment(referenced_object);
     return true;
 }
 
@@ -280,52 +1151,29 @@ bool remove_reference(RootTable *table, Object *object, Object *reference) {
         return false;
     }
 
-    uintptr_t address_of_object = (uintptr_t)object;
-    char key[20];
-    sprintf(key, "%llu", address_of_object);
-
-    Object *existing_object = get_from_root_table(table, key);
-    if (existing_object == NULL) {
+    if (!root_table_contains(table, object)) {
         fprintf(stderr, "Object not found in root table.");
         return false;
     }
 
-    ObjectNode *currentNode = existing_object->references;
-    ObjectNode *previousNode = NULL;
-    while (currentNode != NULL) {
-        if (currentNode->object == reference) {
-            if (previousNode == NULL) {
-                existing_object->references = currentNode->next;
-            } else {
-                previousNode->next = currentNode->next;
-            }
-            free(currentNode);
-
-            existing_object->referenced_ptrs_count--;
-            reference->ref_count--;
-            return true;
-        }
-        previousNode = currentNode;
-        currentNode = currentNode->next;
+    if (!object_remove_reference(object, reference)) {
+        return false; // Reference not found
     }
-
-    return false; // Reference not found
+    // Concurrent marking traces the heap as it was when it started, edges included
+    geece_shade(reference);
+    reference_unlink(object, reference);
+    rc_decrement(reference);
+    return true;
 }
 
 
-ObjectNode *get_references(RootTable *table, Object *object) {
+Object **get_references(RootTable *table, Object *object, size_t *count) {
+    *count = 0;
     if (table == NULL) {
         fprintf(stderr, "Root table not initialized.");
         return NULL;
     }
-    Bucket *currentBucket = table->bucket_heads[0];
-    while (currentBucket != NULL){
-       if (currentBucket->object == object){
-           return currentBucket->object->references;
-       }
-       currentBucket = currentBucket->next;
-    }
-    return NULL;
+    return root_table_contains(table, object) ? object_references(object, count) : NULL;
 }
 
 int get_reference_count(RootTable *table, Object *object){
@@ -333,22 +1181,13 @@ int get_reference_count(RootTable *table, Object *object){
         fprintf(stderr, "Root table not initialized.");
         return false;
     }
-    uintptr_t address_of_object = (uintptr_t)object;
-
-    char key[20];
-    sprintf(key, "%llu", address_of_object);
-    Object *existing_object = get_from_root_table(table, key);
-    if (existing_object == NULL){
+    if (!root_table_contains(table, object)){
         fprintf(stderr, "Object not found in root table.");
         return false;
     }
-    int count = 0;
-    ObjectNode *currentNode = existing_object->references;
-    while (currentNode != NULL){
-        count++;
-        currentNode = currentNode->next;
-    }
-    return count;
+    size_t count;
+    object_references(object, &count);
+    return (int)count;
 }
 
 bool remove_object(RootTable *table, Object *object){
@@ -356,25 +1195,21 @@ bool remove_object(RootTable *table, Object *object){
         fprintf(stderr, "Root table not initialized.");
         return false;
     }
-    uintptr_t address_of_object = (uintptr_t)object;
-
-    char key[20];
-    sprintf(key, "%llu", address_of_object);
-    Object *existing_object = get_from_root_table(table, key);
-    if (existing_object == NULL){
+    if (!root_table_contains(table, object)){
         fprintf(stderr, "Object not found in root table.");
         return false;
     }
-    ObjectNode *currentNode = existing_object->references;
-    while (currentNode != NULL){
-        ObjectNode *tempNode = currentNode->next;
-        free(currentNode);
-        currentNode = tempNode;
+    size_t count;
+    Object **references = object_references(object, &count);
+    for (size_t i = 0; i < count; i++) {
+        geece_shade(references[i]);
     }
-    existing_object->references = NULL;
-
-    clear_reference_ptrs(object);
-    object->referenced_ptrs_count = 0;
+    reference_unlink_all(object);
+    // Every edge counted in its target, the counts drop as in remove_reference()
+    for (size_t i = 0; i < count; i++) {
+        rc_decrement(references[i]);
+    }
+    object_clear_references(object);
     return true;
 }
 
@@ -383,39 +1218,17 @@ int get_object_count(RootTable *table, Object *object){
         fprintf(stderr, "Root table not initialized.");
         return false;
     }
-    uintptr_t address_of_object = (uintptr_t)object;
-
-    char key[20];
-    sprintf(key, "%llu", address_of_object);
-    Object *existing_object = get_from_root_table(table, key);
-    if (existing_object == NULL){
+    if (!root_table_contains(table, object)){
         fprintf(stderr, "Object not found in root table.");
         return false;
     }
-    //Iterate through bucket heads and for each head, iterate through all the nodes
-    int count = 0;
-    // Iterate through all bucket heads
-    for (size_t i = 0; i < table->bucket_count; i++) {
-        Bucket *currentBucket = table->bucket_heads[i];
-
-        // Iterate through all nodes in the current bucket head
-        while (currentBucket != NULL) {
-            Object *currentObject = currentBucket->object;
-
-            // Check if the current object is equal to the input object
-            if (currentObject == object) {
-                count++;
-            }
-            // Iterate through all referenced objects and count any references to the input object
-            ObjectNode *reference = currentObject->references;
-            while (reference != NULL) {
-                if (reference->object == object) {
-                    count++;
-                }
-                reference = reference->next;
-            }
-            currentBucket = currentBucket->next;
-        }
+    // Each hold of the object counts, then every edge pointing to it
+    size_t holds = table->shards != NULL ? sharded_holds(table, object) : holds_of(table, object);
+    size_t count;
+    if (geece_config.track_referrers){
+        reference_referrers(object, &count);
+    } else {
+        count = root_table_count_referrers(table, object);
     }
-    return count;
-}
\ No newline at end of file
+    return (int)(count + holds);
+}
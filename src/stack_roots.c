@@ -0,0 +1,300 @@
+/**
+ * @file stack_roots.c
+ * @brief Implementation of the conservative stack scanner.
+ */
+#define _GNU_SOURCE
+#include "stack_roots.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "heap.h"
+#include "large_object.h"
+#include "nursery.h"
+
+/* Signals stopping a registered thread and letting it go again. */
+#ifdef SIGPWR
+#define STOP_SIGNAL SIGPWR
+#define RESUME_SIGNAL SIGXCPU
+#else
+#define STOP_SIGNAL SIGUSR1
+#define RESUME_SIGNAL SIGUSR2
+#endif
+
+/* Stack words that point into the heap, collected while the threads are stopped. */
+#define INITIAL_CANDIDATE_CAPACITY 4096
+
+/* Stacks are read word by word, redzones and slots the sanitizers track included. */
+#define NO_SANITIZE __attribute__((no_sanitize_address, no_sanitize_thread))
+
+typedef struct StackThread {
+    pthread_t thread;
+    char *base;                 /**< Highest address of the thread's stack. */
+    char *volatile sp;          /**< Lowest address to scan, recorded by the thread once stopped. */
+    bool stopped;               /**< The collector stopped the thread and reads its stack. */
+    struct StackThread *next;
+} StackThread;
+
+static pthread_mutex_t threads_lock = PTHREAD_MUTEX_INITIALIZER;
+static StackThread *threads = NULL;
+static _Thread_local StackThread *current_thread = NULL;
+static pthread_once_t setup_once = PTHREAD_ONCE_INIT;
+static bool set_up = false;
+static pthread_key_t thread_key;
+static sem_t stop_ack;
+
+/* Stopped threads wait for the resume generation to catch up with the stop that stopped them, a
+ * flag could be set again by the next stop before they see it cleared. */
+static atomic_uint stop_generation;
+static atomic_uint resume_generation;
+
+/* Mapped directly, since a stopped thread may hold the allocator's locks. */
+static uintptr_t *candidates = NULL;
+static size_t candidate_count = 0;
+static size_t candidate_capacity = 0;
+
+static void push_candidate(uintptr_t word){
+    if (candidate_count == candidate_capacity){
+        size_t capacity = candidate_capacity == 0 ? INITIAL_CANDIDATE_CAPACITY : candidate_capacity * 2;
+        uintptr_t *grown = mmap(NULL, capacity * sizeof(uintptr_t), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (grown == MAP_FAILED){
+            fprintf(stderr, "Error: Failed to grow the stack root candidates.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (candidates != NULL){
+            memcpy(grown, candidates, candidate_count * sizeof(uintptr_t));
+            munmap(candidates, candidate_capacity * sizeof(uintptr_t));
+        }
+        candidates = grown;
+        candidate_capacity = capacity;
+    }
+    candidates[candidate_count++] = word;
+}
+
+NO_SANITIZE static void scan_range(const char *low, const char *high){
+    const uintptr_t *word = (const uintptr_t *)(((uintptr_t)low + sizeof(uintptr_t) - 1) & ~(uintptr_t)(sizeof(uintptr_t) - 1));
+    for (; (const char *)(word + 1) <= high; ++word){
+        if (page_directory_lookup((const void *)*word) != PAGE_DIRECTORY_NONE){
+            push_candidate(*word);
+        }
+    }
+}
+
+/* Everything above the marker belongs to the callers, the registers they spilled included. */
+static __attribute__((noinline)) void scan_from_here(const char *base){
+    volatile char marker = 0;
+    scan_range((const char *)&marker, base);
+}
+
+static __attribute__((noinline)) void scan_current_thread(const char *base){
+    jmp_buf registers;
+    // Callee-saved registers may hold the only pointer to an object, setjmp puts them on the stack
+    __builtin_unwind_init();
+    setjmp(registers);
+    scan_from_here(base);
+}
+
+static void stop_handler(int signal){
+    (void)signal;
+    int saved_errno = errno;
+    StackThread *self = current_thread;
+    if (self != NULL){
+        unsigned int generation = atomic_load(&stop_generation);
+        // The kernel saved the interrupted registers above this frame
+        jmp_buf registers;
+        setjmp(registers);
+        self->sp = (char *)&registers;
+        sigset_t mask;
+        pthread_sigmask(SIG_SETMASK, NULL, &mask);
+        sigdelset(&mask, RESUME_SIGNAL);
+        sem_post(&stop_ack);
+        // The resume signal stays blocked until sigsuspend, so it cannot be missed
+        while (atomic_load(&resume_generation) != generation){
+            sigsuspend(&mask);
+        }
+    }
+    errno = saved_errno;
+}
+
+static void resume_handler(int signal){
+    (void)signal;
+}
+
+static void unregister(StackThread *record){
+    pthread_mutex_lock(&threads_lock);
+    StackThread **link = &threads;
+    while (*link != record){
+        link = &(*link)->next;
+    }
+    *link = record->next;
+    pthread_mutex_unlock(&threads_lock);
+    free(record);
+}
+
+static void unregister_at_exit(void *arg){
+    unregister(arg);
+    current_thread = NULL;
+}
+
+static void set_up_signals(void){
+    if (sem_init(&stop_ack, 0, 0) != 0){
+        return;
+    }
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = stop_handler;
+    sigemptyset(&action.sa_mask);
+    sigaddset(&action.sa_mask, RESUME_SIGNAL);
+    action.sa_flags = SA_RESTART;
+    if (sigaction(STOP_SIGNAL, &action, NULL) != 0){
+        return;
+    }
+    action.sa_handler = resume_handler;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(RESUME_SIGNAL, &action, NULL) != 0){
+        return;
+    }
+    set_up = pthread_key_create(&thread_key, unregister_at_exit) == 0;
+}
+
+bool geece_register_thread(void){
+    if (current_thread != NULL){
+        return true;
+    }
+    if (heap == NULL){
+        heap_init();
+    }
+    if (nursery_enabled()){
+        fprintf(stderr, "Error: Stacks cannot be scanned for roots while the nursery is enabled.\n");
+        return false;
+    }
+    pthread_once(&setup_once, set_up_signals);
+    if (!set_up){
+        fprintf(stderr, "Error: Failed to install the signals stopping threads.\n");
+        return false;
+    }
+    pthread_attr_t attr;
+    void *stack_address;
+    size_t stack_size;
+    if (pthread_getattr_np(pthread_self(), &attr) != 0){
+        fprintf(stderr, "Error: Failed to locate the stack of the thread.\n");
+        return false;
+    }
+    int located = pthread_attr_getstack(&attr, &stack_address, &stack_size);
+    pthread_attr_destroy(&attr);
+    StackThread *record = located == 0 ? calloc(1, sizeof(StackThread)) : NULL;
+    if (record == NULL){
+        fprintf(stderr, "Error: Failed to register the thread.\n");
+        return false;
+    }
+    record->thread = pthread_self();
+    record->base = (char *)stack_address + stack_size;
+
+    pthread_mutex_lock(&threads_lock);
+    record->next = threads;
+    threads = record;
+    current_thread = record;
+    pthread_mutex_unlock(&threads_lock);
+    pthread_setspecific(thread_key, record);
+    return true;
+}
+
+void geece_unregister_thread(void){
+    StackThread *record = current_thread;
+    if (record == NULL){
+        return;
+    }
+    pthread_setspecific(thread_key, NULL);
+    current_thread = NULL;
+    unregister(record);
+}
+
+/* Collects the stack words of every registered thread that point into the heap, with the
+ * threads lock held. */
+static void collect_candidates(void){
+    StackThread *self = current_thread;
+    unsigned int generation = atomic_fetch_add(&stop_generation, 1) + 1;
+    unsigned int stopping = 0;
+    for (StackThread *thread = threads; thread != NULL; thread = thread->next){
+        thread->stopped = thread != self && pthread_kill(thread->thread, STOP_SIGNAL) == 0;
+        stopping += thread->stopped;
+    }
+    while (stopping > 0){
+        if (sem_wait(&stop_ack) == 0){
+            stopping--;
+        }
+    }
+
+    candidate_count = 0;
+    if (self != NULL){
+        scan_current_thread(self->base);
+    }
+    for (StackThread *thread = threads; thread != NULL; thread = thread->next){
+        if (thread->stopped){
+            scan_range(thread->sp, thread->base);
+        }
+    }
+    atomic_store(&resume_generation, generation);
+    for (StackThread *thread = threads; thread != NULL; thread = thread->next){
+        if (thread->stopped){
+            thread->stopped = false;
+            pthread_kill(thread->thread, RESUME_SIGNAL);
+        }
+    }
+}
+
+static int compare_candidates(const void *a, const void *b){
+    uintptr_t x = *(const uintptr_t *)a;
+    uintptr_t y = *(const uintptr_t *)b;
+    return (x > y) - (x < y);
+}
+
+void stack_roots_scan(void (*visit)(Object *object)){
+    pthread_mutex_lock(&threads_lock);
+    if (threads == NULL){
+        pthread_mutex_unlock(&threads_lock);
+        return;
+    }
+    collect_candidates();
+    pthread_mutex_unlock(&threads_lock);
+
+    // Sorted, the words pointing into one page or object come together
+    qsort(candidates, candidate_count, sizeof(uintptr_t), compare_candidates);
+    uint64_t free_blocks[GEECE_PAGE_BITMAP_WORDS];
+    const Page *bitmap_page = NULL;
+    Object *last = NULL;
+    for (size_t i = 0; i < candidate_count; ++i){
+        const char *address = (const char *)candidates[i];
+        uint8_t entry = page_directory_lookup(address);
+        Object *object = NULL;
+        if (entry == PAGE_DIRECTORY_SMALL){
+            Page *page = page_of(address);
+            size_t index = page_block_index(page, address);
+            if (address < page->blocks || index >= page->block_count){
+                continue;
+            }
+            // Blocks on the free lists are not objects
+            if (page != bitmap_page){
+                page_free_bitmap(page, free_blocks);
+                bitmap_page = page;
+            }
+            if (page_bitmap_test(free_blocks, index)){
+                continue;
+            }
+            object = (Object *)(page->blocks + index * page->block_size);
+        } else if (entry != PAGE_DIRECTORY_NONE){
+            object = large_object_containing(address);
+        }
+        if (object != NULL && object != last){
+            visit(object);
+            last = object;
+        }
+    }
+}
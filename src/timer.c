@@ -0,0 +1,17 @@
+/**
+ * @file timer.c
+ * @brief Implementation of the monotonic timing helpers.
+ */
+#include "timer.h"
+
+#include <time.h>
+
+uint64_t timer_now_ns(void){
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+}
+
+uint64_t timer_elapsed_ns(uint64_t start){
+    return timer_now_ns() - start;
+}
@@ -0,0 +1,197 @@
+/**
+ * @file tlab.c
+ * @brief Implementation of the thread-local allocation buffers.
+ */
+#include "tlab.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "heap.h"
+#include "mark_and_sweep.h"
+
+static pthread_key_t tlab_key;
+static pthread_once_t tlab_key_once = PTHREAD_ONCE_INIT;
+static _Thread_local Tlab *current_tlab = NULL;
+
+static void retire_list(Page *page){
+    while (page != NULL){
+        Page *next = page->next;
+        heap_retire_page(page);
+        page = next;
+    }
+}
+
+/* Hands every page of an allocation buffer back to the shared heap, with the heap lock held. */
+static void retire_pages(Tlab *tlab){
+    // Retiring collects the remote frees, so pending notifications can be dropped
+    atomic_store(&tlab->remote_pages, NULL);
+    for (unsigned int i = 0; i < GEECE_SIZE_CLASS_COUNT; ++i){
+        if (tlab->pages[i] != NULL){
+            heap_retire_page(tlab->pages[i]);
+        }
+        if (tlab->spare[i] != NULL){
+            heap_retire_page(tlab->spare[i]);
+        }
+        retire_list(tlab->partial[i]);
+        retire_list(tlab->full[i]);
+        tlab->pages[i] = NULL;
+        tlab->spare[i] = NULL;
+        tlab->partial[i] = NULL;
+        tlab->full[i] = NULL;
+    }
+}
+
+/* Hands the pages and shaded objects of an exiting thread back to the heap and the marker, and
+ * folds its counters into the heap. */
+static void tlab_release(void *arg){
+    Tlab *tlab = arg;
+    geece_mark_flush(tlab);
+    heap_lock();
+    retire_pages(tlab);
+    heap->used += atomic_load(&tlab->allocated) - atomic_load(&tlab->freed);
+    Tlab **link = &heap->tlabs;
+    while (*link != tlab){
+        link = &(*link)->next;
+    }
+    *link = tlab->next;
+    heap_unlock();
+    current_tlab = NULL;
+    free(tlab);
+}
+
+static void tlab_create_key(void){
+    pthread_key_create(&tlab_key, tlab_release);
+}
+
+Tlab *tlab_current(void){
+    if (current_tlab != NULL){
+        return current_tlab;
+    }
+    heap_init();
+    pthread_once(&tlab_key_once, tlab_create_key);
+    Tlab *tlab = calloc(1, sizeof(Tlab));
+    if (tlab == NULL){
+        fprintf(stderr, "Out of memory.");
+        return NULL;
+    }
+    heap_lock();
+    tlab->next = heap->tlabs;
+    heap->tlabs = tlab;
+    heap_unlock();
+    pthread_setspecific(tlab_key, tlab);
+    current_tlab = tlab;
+    return tlab;
+}
+
+/* Reclaims the blocks other threads freed into owned pages, moving full pages back to partial. */
+static void tlab_collect_remote_pages(Tlab *tlab){
+    if (atomic_load_explicit(&tlab->remote_pages, memory_order_relaxed) == NULL){
+        return;
+    }
+    Page *page = atomic_exchange_explicit(&tlab->remote_pages, NULL, memory_order_acquire);
+    while (page != NULL){
+        Page *next = page->remote_next;
+        // Clear the notification first, so that frees racing with the collection notify again
+        atomic_store(&page->remote_notified, false);
+        if (page_collect_remote(page) > 0 && page->full){
+            page->full = false;
+            page_list_remove(&tlab->full[page->size_class], page);
+            page_list_push(&tlab->partial[page->size_class], page);
+        }
+        page = next;
+    }
+}
+
+Page *tlab_refill(Tlab *tlab, unsigned int size_class){
+    Page *page = tlab->pages[size_class];
+    if (page != NULL){
+        if (page_collect_remote(page) > 0){
+            return page;
+        }
+        page->full = true;
+        page_list_push(&tlab->full[size_class], page);
+    }
+    tlab_collect_remote_pages(tlab);
+
+    page = tlab->partial[size_class];
+    if (page != NULL){
+        page_list_remove(&tlab->partial[size_class], page);
+    } else if (tlab->spare[size_class] != NULL){
+        page = tlab->spare[size_class];
+        tlab->spare[size_class] = NULL;
+    } else {
+        heap_lock();
+        page = heap_acquire_page(size_class);
+        if (page != NULL){
+            page->owner = tlab;
+        }
+        heap_unlock();
+    }
+    tlab->pages[size_class] = page;
+    return page;
+}
+
+void tlab_free_block(Tlab *tlab, Page *page, void *block){
+    unsigned int size_class = page->size_class;
+    page_free_block(page, block);
+    if (page == tlab->pages[size_class]){
+        return;
+    }
+    if (page->full){
+        page->full = false;
+        page_list_remove(&tlab->full[size_class], page);
+        page_list_push(&tlab->partial[size_class], page);
+    }
+    if (page->used_count == 0 && atomic_load_explicit(&page->remote_free, memory_order_relaxed) == NULL
+        && !atomic_load_explicit(&page->remote_notified, memory_order_relaxed)){
+        // Keep one empty page per class for the next refill, give the others back
+        page_list_remove(&tlab->partial[size_class], page);
+        if (tlab->spare[size_class] == NULL){
+            tlab->spare[size_class] = page;
+        } else {
+            heap_lock();
+            page->owner = NULL;
+            heap_release_page(page);
+            heap_unlock();
+        }
+    }
+}
+
+void tlab_notify_remote_free(Page *page){
+    if (atomic_exchange(&page->remote_notified, true)){
+        return;
+    }
+    Tlab *owner = page->owner;
+    Page *head = atomic_load_explicit(&owner->remote_pages, memory_order_relaxed);
+    do {
+        page->remote_next = head;
+    } while (!atomic_compare_exchange_weak_explicit(&owner->remote_pages, &head, page,
+                                                    memory_order_release, memory_order_relaxed));
+}
+
+void tlab_retire_all(void){
+    heap_lock();
+    for (Tlab *tlab = heap->tlabs; tlab != NULL; tlab = tlab->next){
+        retire_pages(tlab);
+    }
+    heap_unlock();
+}
+
+void tlab_reset_nursery_chunks(void){
+    heap_lock();
+    for (Tlab *tlab = heap->tlabs; tlab != NULL; tlab = tlab->next){
+        tlab->nursery_top = NULL;
+        tlab->nursery_end = NULL;
+    }
+    heap_unlock();
+}
+
+size_t tlab_net_allocated(void){
+    size_t net = 0;
+    for (Tlab *tlab = heap->tlabs; tlab != NULL; tlab = tlab->next){
+        net += atomic_load_explicit(&tlab->allocated, memory_order_relaxed)
+             - atomic_load_explicit(&tlab->freed, memory_order_relaxed);
+    }
+    return net;
+}
@@ -0,0 +1,111 @@
+/**
+ * @file type.c
+ * @brief Implementation of the type registry and of typed field stores.
+ */
+#include "type.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "heap.h"
+#include "mark_and_sweep.h"
+#include "nursery.h"
+#include "arena.h"
+#include "reference_counting.h"
+
+TypeInfo type_table[GEECE_MAX_TYPES];
+
+static pthread_mutex_t type_lock = PTHREAD_MUTEX_INITIALIZER;
+static GeeceType type_count = 1;
+
+static int compare_offsets(const void *a, const void *b){
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+/* Takes ownership of `offsets`, sorted here, and returns the id of the new type or 0. */
+static GeeceType add_type(const char *name, size_t size, uint32_t *offsets, size_t count){
+    qsort(offsets, count, sizeof(uint32_t), compare_offsets);
+    pthread_mutex_lock(&type_lock);
+    if (type_count == GEECE_MAX_TYPES){
+        pthread_mutex_unlock(&type_lock);
+        fprintf(stderr, "Error: Too many types registered.\n");
+        free(offsets);
+        return 0;
+    }
+    GeeceType type = type_count++;
+    type_table[type] = (TypeInfo){.name = name, .size = size, .offsets = offsets, .field_count = count};
+    pthread_mutex_unlock(&type_lock);
+    return type;
+}
+
+GeeceType geece_register_type(const char *name, size_t size, const uint64_t *pointer_map){
+    size_t words = size / sizeof(Object *);
+    size_t count = 0;
+    for (size_t i = 0; pointer_map != NULL && i < words; ++i){
+        count += (pointer_map[i / 64] >> (i % 64)) & 1;
+    }
+    uint32_t *offsets = malloc((count > 0 ? count : 1) * sizeof(uint32_t));
+    if (offsets == NULL){
+        return 0;
+    }
+    count = 0;
+    for (size_t i = 0; pointer_map != NULL && i < words; ++i){
+        if ((pointer_map[i / 64] >> (i % 64)) & 1){
+            offsets[count++] = (uint32_t)(i * sizeof(Object *));
+        }
+    }
+    return add_type(name, size, offsets, count);
+}
+
+GeeceType geece_register_type_fields(const char *name, size_t size, const size_t *offsets, size_t count){
+    uint32_t *sorted = malloc((count > 0 ? count : 1) * sizeof(uint32_t));
+    if (sorted == NULL){
+        return 0;
+    }
+    for (size_t i = 0; i < count; ++i){
+        if (offsets[i] % sizeof(Object *) != 0 || offsets[i] + sizeof(Object *) > size || offsets[i] > UINT32_MAX){
+            fprintf(stderr, "Error: Invalid reference offset %zu in type %s.\n", offsets[i], name);
+            free(sorted);
+            return 0;
+        }
+        sorted[i] = (uint32_t)offsets[i];
+    }
+    return add_type(name, size, sorted, count);
+}
+
+Object *geece_malloc_typed(GeeceType type, Destructor destructor){
+    if (type == 0 || type >= GEECE_MAX_TYPES || type_table[type].offsets == NULL){
+        fprintf(stderr, "Error: Type %u is not registered.\n", (unsigned int)type);
+        exit(EXIT_FAILURE);
+    }
+    Object *object = geece_malloc(type_table[type].size, destructor);
+    object_set_type(object, type);
+#ifdef GEECE_COMPACT_HEADER
+    // The type is kept in a side table record, which a young object dying has to free
+    if ((object->flags & (OBJECT_YOUNG | OBJECT_TRACKED)) == OBJECT_YOUNG){
+        nursery_track_cleanup(object);
+    }
+#endif
+    return object;
+}
+
+void geece_write_field(Object *object, Object **field, Object *value){
+    Object *old = *field;
+    if (old == value){
+        return;
+    }
+    if (value != NULL){
+        nursery_record_field(object, value);
+        arena_record_field(object, value);
+        geece_shade(value);
+        object_ref_increment(value);
+    }
+    // Concurrent marking traces the heap as it was when it started, fields included
+    geece_shade(old);
+    __atomic_store_n(field, value, __ATOMIC_RELAXED);
+    if (old != NULL){
+        rc_decrement(old);
+    }
+}
@@ -0,0 +1,40 @@
+/**
+ * @file utils.c
+ * @brief Implementation of the shared collector helpers.
+ */
+#include "utils.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+bool pointer_array_push(PointerArray *array, void *item){
+    if (array->count == array->capacity){
+        size_t new_capacity = array->capacity == 0 ? 64 : array->capacity * 2;
+        void **new_items = realloc(array->items, new_capacity * sizeof(void *));
+        if (new_items == NULL){
+            fprintf(stderr, "Out of memory.");
+            return false;
+        }
+        array->items = new_items;
+        array->capacity = new_capacity;
+    }
+    array->items[array->count++] = item;
+    return true;
+}
+
+bool pointer_array_remove(PointerArray *array, const void *item){
+    for (size_t i = 0; i < array->count; ++i){
+        if (array->items[i] == item){
+            array->items[i] = array->items[--array->count];
+            return true;
+        }
+    }
+    return false;
+}
+
+void pointer_array_free(PointerArray *array){
+    free(array->items);
+    array->items = NULL;
+    array->count = 0;
+    array->capacity = 0;
+}
@@ -0,0 +1,120 @@
+/**
+ * @file work_deque.c
+ * @brief Implementation of the Chase-Lev work-stealing deques.
+ */
+#include "work_deque.h"
+
+#include <stdlib.h>
+
+static WorkDequeArray *new_array(size_t capacity){
+    WorkDequeArray *array = malloc(sizeof(WorkDequeArray) + capacity * sizeof(_Atomic(void *)));
+    if (array != NULL){
+        array->capacity = capacity;
+        array->previous = NULL;
+    }
+    return array;
+}
+
+bool work_deque_init(WorkDeque *deque, size_t capacity, size_t limit){
+    size_t slots = 1;
+    while (slots < capacity){
+        slots *= 2;
+    }
+    WorkDequeArray *array = new_array(slots);
+    if (array == NULL){
+        return false;
+    }
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+    atomic_init(&deque->array, array);
+    deque->limit = limit;
+    return true;
+}
+
+void work_deque_destroy(WorkDeque *deque){
+    WorkDequeArray *array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+    while (array != NULL){
+        WorkDequeArray *previous = array->previous;
+        free(array);
+        array = previous;
+    }
+    atomic_store_explicit(&deque->array, NULL, memory_order_relaxed);
+}
+
+static WorkDequeArray *grow(WorkDeque *deque, WorkDequeArray *array, int64_t top, int64_t bottom){
+    size_t capacity = array->capacity * 2;
+    if (capacity > deque->limit){
+        return NULL;
+    }
+    WorkDequeArray *grown = new_array(capacity);
+    if (grown == NULL){
+        return NULL;
+    }
+    for (int64_t i = top; i < bottom; ++i){
+        void *item = atomic_load_explicit(&array->items[(size_t)i & (array->capacity - 1)], memory_order_relaxed);
+        atomic_store_explicit(&grown->items[(size_t)i & (capacity - 1)], item, memory_order_relaxed);
+    }
+    grown->previous = array;
+    atomic_store_explicit(&deque->array, grown, memory_order_release);
+    return grown;
+}
+
+bool work_deque_push(WorkDeque *deque, void *item){
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    WorkDequeArray *array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+    if ((size_t)(bottom - top) >= array->capacity){
+        array = grow(deque, array, top, bottom);
+        if (array == NULL){
+            return false;
+        }
+    }
+    atomic_store_explicit(&array->items[(size_t)bottom & (array->capacity - 1)], item, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    return true;
+}
+
+void *work_deque_take(WorkDeque *deque){
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    WorkDequeArray *array = atomic_load_explicit(&deque->array, memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+    if (top > bottom){
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return NULL;
+    }
+    void *item = atomic_load_explicit(&array->items[(size_t)bottom & (array->capacity - 1)], memory_order_relaxed);
+    if (top == bottom){
+        // Last item, race the thieves for it
+        if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                     memory_order_seq_cst, memory_order_relaxed)){
+            item = NULL;
+        }
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+    return item;
+}
+
+void *work_deque_steal(WorkDeque *deque){
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    if (top >= bottom){
+        return NULL;
+    }
+    WorkDequeArray *array = atomic_load_explicit(&deque->array, memory_order_acquire);
+    void *item = atomic_load_explicit(&array->items[(size_t)top & (array->capacity - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed)){
+        return NULL;
+    }
+    return item;
+}
+
+bool work_deque_empty(WorkDeque *deque){
+    int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    return top >= bottom;
+}
@@ -0,0 +1,96 @@
+/**
+ * @file workers.c
+ * @brief Implementation of the collector worker pool.
+ */
+#include "workers.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t run_started = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t run_done = PTHREAD_COND_INITIALIZER;
+static unsigned int thread_count = 0;       /* Pool threads started, the collecting thread excluded. */
+static unsigned long generation = 0;        /* Incremented by every run. */
+static unsigned int participants = 0;       /* Threads taking part in the current run. */
+static unsigned int remaining = 0;          /* Pool threads still busy with the current run. */
+static WorkerTask current_task = NULL;
+static void *current_arg = NULL;
+
+typedef struct {
+    unsigned int index;
+    unsigned long generation;   /* Generation when the thread was started, later runs are its to join. */
+} WorkerStart;
+
+static void *worker_main(void *arg){
+    WorkerStart *start = arg;
+    unsigned int index = start->index;
+    unsigned long seen = start->generation;
+    free(start);
+    pthread_mutex_lock(&lock);
+    for (;;){
+        while (generation == seen){
+            pthread_cond_wait(&run_started, &lock);
+        }
+        seen = generation;
+        if (index >= participants){
+            continue;
+        }
+        WorkerTask task = current_task;
+        void *task_arg = current_arg;
+        pthread_mutex_unlock(&lock);
+        task(index, task_arg);
+        pthread_mutex_lock(&lock);
+        if (--remaining == 0){
+            pthread_cond_signal(&run_done);
+        }
+    }
+    return NULL;
+}
+
+unsigned int workers_start(unsigned int count){
+    if (count <= 1){
+        return 1;
+    }
+    pthread_mutex_lock(&lock);
+    while (thread_count < count - 1){
+        pthread_t thread;
+        WorkerStart *start = malloc(sizeof(WorkerStart));
+        if (start != NULL){
+            start->index = thread_count + 1;
+            start->generation = generation;
+        }
+        if (start == NULL || pthread_create(&thread, NULL, worker_main, start) != 0){
+            free(start);
+            fprintf(stderr, "Error: Failed to start a collector worker thread.\n");
+            break;
+        }
+        pthread_detach(thread);
+        thread_count++;
+    }
+    unsigned int available = thread_count + 1 < count ? thread_count + 1 : count;
+    pthread_mutex_unlock(&lock);
+    return available;
+}
+
+void workers_run(unsigned int count, WorkerTask task, void *arg){
+    if (count > 1){
+        pthread_mutex_lock(&lock);
+        current_task = task;
+        current_arg = arg;
+        participants = count;
+        remaining = count - 1;
+        generation++;
+        pthread_cond_broadcast(&run_started);
+        pthread_mutex_unlock(&lock);
+    }
+    task(0, arg);
+    if (count > 1){
+        pthread_mutex_lock(&lock);
+        while (remaining > 0){
+            pthread_cond_wait(&run_done, &lock);
+        }
+        pthread_mutex_unlock(&lock);
+    }
+}
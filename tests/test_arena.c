@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "geece.h"
+#include "test_helpers.h"
+#include "arena.h"
+#include "mark_and_sweep.h"
+
+void test_bump_allocation() {
+    printf("test_bump_allocation\n");
+    Arena *arena = geece_arena_begin();
+    Object *first = geece_malloc_in(arena, 24, NULL);
+    Object *second = geece_malloc_in(arena, 24, NULL);
+    assert(first->flags & OBJECT_ARENA);
+    assert(arena_of(first) == arena);
+    assert((char *)second == (char *)first + GEECE_ALIGN_UP(sizeof(Object) + 24, GEECE_MIN_BLOCK_SIZE));
+
+    // Objects too big for a chunk come from the heap
+    Object *large = geece_malloc_in(arena, GEECE_PAGE_SIZE, NULL);
+    assert(!(large->flags & OBJECT_ARENA));
+    geece_release(large);
+    geece_arena_end(arena);
+    printf("test_bump_allocation passed\n");
+}
+
+void test_end_releases_everything() {
+    printf("test_end_releases_everything\n");
+    size_t available = geece_available_memory();
+    Arena *arena = geece_arena_begin();
+    for (int i = 0; i < 10000; ++i){
+        geece_malloc_in(arena, 32, i % 10 == 0 ? count_destroyed : NULL);
+    }
+    assert(geece_available_memory() < available);
+
+    destroyed = 0;
+    geece_arena_end(arena);
+    assert(destroyed == 1000);
+    assert(geece_available_memory() == available);
+    printf("test_end_releases_everything passed\n");
+}
+
+void test_open_arena_survives_collection() {
+    printf("test_open_arena_survives_collection\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    Arena *arena = geece_arena_begin();
+    Object *parent = geece_malloc_in(arena, 16, count_destroyed);
+    Object *heap_child = geece_malloc(16, count_destroyed);
+    char key[ADDRESS_KEY_LENGTH];
+    add_root_by_address(roots, parent, key);
+    assert(add_reference(roots, parent, heap_child));
+    remove_from_root_table(roots, key);
+
+    assert(!(parent->flags & OBJECT_ROOTED));
+
+    // Arena objects are roots, and so keep heap objects alive, until the arena ends
+    destroyed = 0;
+    geece_collect();
+    assert(destroyed == 0);
+    assert(!geece_is_marked(parent) && !geece_is_marked(heap_child));
+
+    geece_arena_end(arena);
+    assert(destroyed == 1);
+    geece_collect();
+    assert(destroyed == 2);
+
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_open_arena_survives_collection passed\n");
+}
+
+void test_escaped_objects_outlive_arena() {
+    printf("test_escaped_objects_outlive_arena\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    size_t available = geece_available_memory();
+    Arena *arena = geece_arena_begin();
+
+    Object *escaping = geece_malloc_in(arena, sizeof(int), count_destroyed);
+    Object *child = geece_malloc_in(arena, sizeof(int), count_destroyed);
+    geece_malloc_in(arena, sizeof(int), count_destroyed);
+    *(int *)(child + 1) = 42;
+    char key[ADDRESS_KEY_LENGTH];
+    add_root_by_address(roots, escaping, key);
+    assert(escaping->flags & OBJECT_ROOTED);
+    assert(add_reference(roots, escaping, child));
+    assert(!(child->flags & OBJECT_ESCAPED));
+
+    // Only the object nothing outside the arena reaches is finalized
+    destroyed = 0;
+    geece_arena_end(arena);
+    assert(destroyed == 1);
+    assert(arena_of(escaping) == NULL);
+    assert(child->flags & OBJECT_ESCAPED);
+    size_t count;
+    assert(*(int *)(object_references(get_from_root_table(roots, key), &count)[0] + 1) == 42);
+
+    // Objects referenced from outside the arena escape too
+    Object *holder = geece_malloc(0, NULL);
+    char holder_key[ADDRESS_KEY_LENGTH];
+    add_root_by_address(roots, holder, holder_key);
+    Arena *second = geece_arena_begin();
+    Object *referenced = geece_malloc_in(second, 0, count_destroyed);
+    assert(add_reference(roots, holder, referenced));
+    assert(referenced->flags & OBJECT_ESCAPED);
+    geece_arena_end(second);
+    assert(destroyed == 1);
+
+    // It dies with the object that held it
+    remove_from_root_table(roots, holder_key);
+    geece_collect();
+    assert(destroyed == 2);
+
+    // The retained chunk goes back to the heap once the escaped objects die
+    remove_from_root_table(roots, key);
+    geece_collect();
+    assert(destroyed == 4);
+    assert(geece_available_memory() == available);
+
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_escaped_objects_outlive_arena passed\n");
+}
+
+int main(){
+    test_bump_allocation();
+    test_end_releases_everything();
+    test_open_arena_survives_collection();
+    test_escaped_objects_outlive_arena();
+    return 0;
+}
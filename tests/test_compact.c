@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "geece.h"
+#include "test_helpers.h"
+
+#define KEPT_EVERY 8
+#define MAX_KEPT 8192
+
+static char keys[MAX_KEPT][16];
+static int kept_count = 0;
+
+// Fills pages with objects and keeps every eighth one, enough to fill two pages when compacted
+static void fragment_heap(RootTable *roots) {
+    Object *probe = geece_malloc(sizeof(int), NULL);
+    kept_count = (int)page_of(probe)->block_count * 2;
+    assert(kept_count <= MAX_KEPT);
+    for (int i = 0; i < kept_count * KEPT_EVERY; ++i){
+        Object *object = geece_malloc(sizeof(int), NULL);
+        *(int *)(object + 1) = i;
+        if (i % KEPT_EVERY == 0){
+            sprintf(keys[i / KEPT_EVERY], "kept%d", i);
+            add_to_root_table(roots, keys[i / KEPT_EVERY], object);
+        }
+    }
+    geece_collect();
+}
+
+void test_compaction_slides_objects_together() {
+    printf("test_compaction_slides_objects_together\n");
+    RootTable *roots = init_root_table(NULL, 64);
+    geece_set_roots(roots);
+    fragment_heap(roots);
+    assert(heap_fragmentation() > 0.5);
+    Object *first = get_from_root_table(roots, keys[0]);
+    Object *last = get_from_root_table(roots, keys[kept_count - 1]);
+
+    size_t available = geece_available_memory();
+    geece_compact();
+    assert(geece_stats()->compactions == 1);
+    assert(geece_stats()->moved_bytes > 0);
+    assert(heap_fragmentation() < 0.01);
+    assert(geece_available_memory() == available);
+
+    // Objects keep their order and contents, and the root table follows them
+    assert(get_from_root_table(roots, keys[0]) <= first);
+    assert(get_from_root_table(roots, keys[kept_count - 1]) < last);
+    for (int i = 0; i < kept_count; ++i){
+        Object *object = get_from_root_table(roots, keys[i]);
+        assert(*(int *)(object + 1) == i * KEPT_EVERY);
+        assert(i == 0 || get_from_root_table(roots, keys[i - 1]) < object);
+    }
+
+    clear_root_table(roots);
+    geece_collect();
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_compaction_slides_objects_together passed\n");
+}
+
+void test_pinned_objects_stay() {
+    printf("test_pinned_objects_stay\n");
+    RootTable *roots = init_root_table(NULL, 64);
+    geece_set_roots(roots);
+    fragment_heap(roots);
+
+    // Objects registered under their address stay, the objects their edges point to may move
+    Object *last = get_from_root_table(roots, keys[kept_count - 1]);
+    Object *pinned = get_from_root_table(roots, keys[kept_count - 2]);
+    geece_pin(pinned);
+    Object *parent = geece_malloc(sizeof(int), NULL);
+    char key[ADDRESS_KEY_LENGTH];
+    add_root_by_address(roots, parent, key);
+    assert(add_reference(roots, parent, last));
+
+    geece_compact();
+    assert(get_from_root_table(roots, keys[kept_count - 2]) == pinned);
+    assert(get_from_root_table(roots, key) == parent);
+    assert(!(parent->flags & OBJECT_PINNED));
+    Object *moved = get_from_root_table(roots, keys[kept_count - 1]);
+    assert(moved != last);
+    size_t count;
+    assert(object_references(parent, &count)[0] == moved);
+    assert(*(int *)(moved + 1) == (kept_count - 1) * KEPT_EVERY);
+
+    geece_unpin(pinned);
+    clear_root_table(roots);
+    geece_collect();
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_pinned_objects_stay passed\n");
+}
+
+void test_fragmentation_triggers_compaction() {
+    printf("test_fragmentation_triggers_compaction\n");
+    RootTable *roots = init_root_table(NULL, 64);
+    geece_set_roots(roots);
+    size_t compactions = geece_stats()->compactions;
+
+    geece_config.compaction_threshold = 0.5;
+    fragment_heap(roots);
+    assert(geece_stats()->compactions == compactions + 1);
+    assert(heap_fragmentation() < 0.5);
+
+    // A compacted heap is left alone
+    geece_collect();
+    assert(geece_stats()->compactions == compactions + 1);
+    geece_config.compaction_threshold = 0.0;
+
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_fragmentation_triggers_compaction passed\n");
+}
+
+void test_finished_cycle_checks_fragmentation() {
+    printf("test_finished_cycle_checks_fragmentation\n");
+    RootTable *roots = init_root_table(NULL, 64);
+    geece_set_roots(roots);
+    fragment_heap(roots);
+    assert(heap_fragmentation() > 0.5);
+    size_t compactions = geece_stats()->compactions;
+    uint64_t compaction_ns = geece_stats()->compaction_ns;
+
+    // A collection finishing an incremental cycle compacts as one that ran the whole cycle would
+    geece_config.compaction_threshold = 0.5;
+    geece_collect_start();
+    geece_collect();
+    assert(geece_stats()->compactions == compactions + 1);
+    assert(heap_fragmentation() < 0.5);
+    assert(geece_stats()->max_pause_ns >= geece_stats()->compaction_ns - compaction_ns);
+    geece_config.compaction_threshold = 0.0;
+
+    clear_root_table(roots);
+    geece_collect();
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_finished_cycle_checks_fragmentation passed\n");
+}
+
+void test_sharded_roots_follow_compaction() {
+    printf("test_sharded_roots_follow_compaction\n");
+    RootTable *roots = init_sharded_root_table(NULL, 16, 64);
+    geece_set_roots(roots);
+    fragment_heap(roots);
+    Object *pinned = get_from_root_table(roots, keys[kept_count - 1]);
+    char key[ADDRESS_KEY_LENGTH];
+    add_root_by_address(roots, pinned, key);
+
+    // Moved objects change shards, their keys follow them, and address keys pin in every shard
+    geece_compact();
+    assert(geece_stats()->moved_bytes > 0);
+    assert(get_from_root_table(roots, key) == pinned);
+    for (int i = 0; i < kept_count; ++i){
+        Object *object = get_from_root_table(roots, keys[i]);
+        assert(root_table_contains(roots, object));
+        assert(*(int *)(object + 1) == i * KEPT_EVERY);
+    }
+
+    clear_root_table(roots);
+    geece_collect();
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_sharded_roots_follow_compaction passed\n");
+}
+
+int main(){
+    test_compaction_slides_objects_together();
+    test_pinned_objects_stay();
+    test_fragmentation_triggers_compaction();
+    test_finished_cycle_checks_fragmentation();
+    test_sharded_roots_follow_compaction();
+    return 0;
+}
@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include "geece.h"
+#include "test_helpers.h"
+#include "mark_and_sweep.h"
+
+#define LIST_LENGTH 20000
+#define MOVES 5000
+#define THREAD_OBJECTS 1000
+
+static void run_to_end(void) {
+    while (!geece_collect_step()){
+        sched_yield();
+    }
+}
+
+void test_moves_during_concurrent_marking() {
+    printf("test_moves_during_concurrent_marking\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    geece_config.concurrent_marking = true;
+
+    static Object *nodes[LIST_LENGTH];
+    nodes[0] = geece_malloc(8, count_destroyed);
+    for (int i = 1; i < LIST_LENGTH; ++i){
+        nodes[i] = geece_malloc(8, count_destroyed);
+        link_objects(roots, nodes[i - 1], nodes[i]);
+    }
+    char list_key[ADDRESS_KEY_LENGTH];
+    add_root_by_address(roots, nodes[0], list_key);
+    Object *moved = geece_malloc(8, count_destroyed);
+    link_objects(roots, nodes[LIST_LENGTH - 1], moved);
+
+    // `moved` keeps hopping along the list while the background thread marks it
+    destroyed = 0;
+    size_t marked = geece_stats()->marked_bytes;
+    geece_collect_start();
+    assert(geece_mark_in_progress());
+    int holder = LIST_LENGTH - 1;
+    for (int i = 0; i < MOVES; ++i){
+        int next = (int)(((unsigned int)i * 7919u) % LIST_LENGTH);
+        if (next == holder){
+            continue;
+        }
+        link_objects(roots, nodes[next], moved);
+        unlink_objects(roots, nodes[holder], moved);
+        holder = next;
+    }
+    run_to_end();
+    assert(!geece_mark_in_progress());
+    assert(destroyed == 0);
+    assert(geece_stats()->marked_bytes - marked == (size_t)(LIST_LENGTH + 1) * (sizeof(Object) + 8));
+    assert(geece_stats()->cycle_slices == 2);
+    assert(geece_stats()->concurrent_mark_ns > 0);
+
+    geece_config.concurrent_marking = false;
+    remove_from_root_table(roots, list_key);
+    geece_collect();
+    assert(destroyed == LIST_LENGTH + 1);
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_moves_during_concurrent_marking passed\n");
+}
+
+static void *shade_and_allocate(void *arg) {
+    // Recorded in the thread's buffer, which is handed over when the thread exits
+    geece_shade(arg);
+    for (int i = 0; i < THREAD_OBJECTS; ++i){
+        geece_malloc(8, count_destroyed);
+    }
+    return NULL;
+}
+
+void test_exiting_thread_hands_over_buffer() {
+    printf("test_exiting_thread_hands_over_buffer\n");
+    geece_set_roots(NULL);
+    geece_config.concurrent_marking = true;
+    Object *shaded = geece_malloc(8, count_destroyed);
+    geece_malloc(8, count_destroyed);
+
+    destroyed = 0;
+    geece_collect_start();
+    pthread_t thread;
+    assert(pthread_create(&thread, NULL, shade_and_allocate, shaded) == 0);
+    pthread_join(thread, NULL);
+    run_to_end();
+
+    // The shaded object and the thread's black allocations survive, the other object does not
+    assert(destroyed == 1);
+    geece_config.concurrent_marking = false;
+    geece_collect();
+    assert(destroyed == 2 + THREAD_OBJECTS);
+    printf("test_exiting_thread_hands_over_buffer passed\n");
+}
+
+void test_collect_finishes_concurrent_cycle() {
+    printf("test_collect_finishes_concurrent_cycle\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    geece_config.concurrent_marking = true;
+    Object *kept = geece_malloc(8, count_destroyed);
+    char key[ADDRESS_KEY_LENGTH];
+    add_root_by_address(roots, kept, key);
+    geece_malloc(8, count_destroyed);
+
+    destroyed = 0;
+    geece_collect_start();
+    geece_collect();
+    assert(!geece_mark_in_progress());
+    assert(destroyed == 1);
+
+    geece_config.concurrent_marking = false;
+    remove_from_root_table(roots, key);
+    geece_collect();
+    assert(destroyed == 2);
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_collect_finishes_concurrent_cycle passed\n");
+}
+
+static Object *shaded_roots[LIST_LENGTH];
+static atomic_bool collected;
+
+static void *shade_roots(void *arg) {
+    (void)arg;
+    for (int i = 0; i < LIST_LENGTH; ++i){
+        geece_shade(shaded_roots[i]);
+    }
+    // The thread's buffers go back to the heap when it exits, which must not race the sweep
+    while (!atomic_load(&collected)){
+        sched_yield();
+    }
+    return NULL;
+}
+
+void test_remark_while_threads_shade() {
+    printf("test_remark_while_threads_shade\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    geece_config.concurrent_marking = true;
+    for (int i = 0; i < LIST_LENGTH; ++i){
+        shaded_roots[i] = geece_malloc(8, count_destroyed);
+        root_table_add(roots, shaded_roots[i]);
+    }
+
+    // The marker waits while the thread fills its buffer, the collector takes it as the thread goes on
+    destroyed = 0;
+    geece_collect_start();
+    geece_mark_pause();
+    pthread_t thread;
+    assert(pthread_create(&thread, NULL, shade_roots, NULL) == 0);
+    geece_mark_resume();
+    geece_collect();
+    atomic_store(&collected, true);
+    pthread_join(thread, NULL);
+    assert(!geece_mark_in_progress());
+    assert(destroyed == 0);
+
+    geece_config.concurrent_marking = false;
+    clear_root_table(roots);
+    geece_collect();
+    assert(destroyed == LIST_LENGTH);
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_remark_while_threads_shade passed\n");
+}
+
+int main(){
+    test_moves_during_concurrent_marking();
+    test_exiting_thread_hands_over_buffer();
+    test_collect_finishes_concurrent_cycle();
+    test_remark_while_threads_shade();
+    return 0;
+}
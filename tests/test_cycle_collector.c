@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+#include "geece.h"
+#include "test_helpers.h"
+#include "cycle_collector.h"
+
+#define RING_LENGTH 100000
+#define SMALL_CYCLES 100
+#define BUFFER_LIMIT 16
+
+typedef struct {
+    long value;
+    Object *next;
+} Node;
+
+static GeeceType node_type;
+static Node *node_of(Object *object) {
+    return geece_payload(object);
+}
+
+static Object *new_node(long value) {
+    Object *object = geece_malloc_typed(node_type, count_destroyed);
+    node_of(object)->value = value;
+    return object;
+}
+
+static void link_nodes(Object *from, Object *to) {
+    geece_write_field(from, &node_of(from)->next, to);
+}
+
+void test_field_cycle_is_collected() {
+    printf("test_field_cycle_is_collected\n");
+    destroyed = 0;
+    Object *first = new_node(1);
+    Object *second = new_node(2);
+    link_nodes(first, second);
+    link_nodes(second, first);
+
+    // Each count stays at one, held by the other node
+    geece_release(first);
+    geece_release(second);
+    assert(destroyed == 0);
+    assert(cycle_pending() == 2);
+    assert(geece_collect_cycles() == 2);
+    assert(destroyed == 2);
+    assert(cycle_pending() == 0);
+    printf("test_field_cycle_is_collected passed\n");
+}
+
+void test_edge_cycle_is_collected() {
+    printf("test_edge_cycle_is_collected\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    destroyed = 0;
+    Object *first = geece_malloc(16, count_destroyed);
+    Object *second = geece_malloc(16, count_destroyed);
+    char first_key[ADDRESS_KEY_LENGTH];
+    char second_key[ADDRESS_KEY_LENGTH];
+    add_root_by_address(roots, first, first_key);
+    add_root_by_address(roots, second, second_key);
+    assert(add_reference(roots, first, second));
+    assert(add_reference(roots, second, first));
+    remove_from_root_table(roots, first_key);
+    remove_from_root_table(roots, second_key);
+
+    geece_release(first);
+    geece_release(second);
+    assert(geece_collect_cycles() == 2);
+    assert(destroyed == 2);
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_edge_cycle_is_collected passed\n");
+}
+
+void test_held_cycles_survive() {
+    printf("test_held_cycles_survive\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    destroyed = 0;
+    Object *first = new_node(1);
+    Object *second = new_node(2);
+    link_nodes(first, second);
+    link_nodes(second, first);
+    Object *holder = new_node(3);
+    link_nodes(holder, second);
+
+    // The root table holds the first node, the holder the second, either keeps the cycle
+    add_to_root_table(roots, "first", first);
+    geece_release(first);
+    geece_release(second);
+    assert(geece_collect_cycles() == 0);
+    assert(destroyed == 0);
+    assert(get_refcount(first) == 1 && get_refcount(second) == 2);
+    assert(node_of(node_of(first)->next)->value == 2);
+
+    remove_from_root_table(roots, "first");
+    retain_object(first);
+    geece_release(first);
+    assert(geece_collect_cycles() == 0);
+    assert(get_refcount(first) == 1 && get_refcount(second) == 2);
+
+    // Once the holder lets go, nothing outside holds the cycle
+    link_nodes(holder, NULL);
+    assert(cycle_pending() == 1);
+    assert(geece_collect_cycles() == 2);
+    assert(destroyed == 2);
+    geece_release(holder);
+    assert(destroyed == 3);
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_held_cycles_survive passed\n");
+}
+
+void test_long_cycles_are_collected() {
+    printf("test_long_cycles_are_collected\n");
+    geece_config.cycle_buffer_limit = SIZE_MAX;
+    destroyed = 0;
+    static Object *nodes[RING_LENGTH];
+    for (int i = 0; i < RING_LENGTH; ++i){
+        nodes[i] = new_node(i);
+    }
+    for (int i = 0; i < RING_LENGTH; ++i){
+        link_nodes(nodes[i], nodes[(i + 1) % RING_LENGTH]);
+    }
+    for (int i = 0; i < RING_LENGTH; ++i){
+        geece_release(nodes[i]);
+    }
+    assert(cycle_pending() == RING_LENGTH);
+    assert(geece_collect_cycles() == RING_LENGTH);
+    assert(destroyed == RING_LENGTH);
+    geece_config.cycle_buffer_limit = GEECE_DEFAULT_CYCLE_BUFFER_LIMIT;
+    printf("test_long_cycles_are_collected passed\n");
+}
+
+void test_allocations_collect_cycles() {
+    printf("test_allocations_collect_cycles\n");
+    geece_config.cycle_buffer_limit = BUFFER_LIMIT;
+    const GeeceStats *stats = geece_stats();
+    size_t collections = stats->cycle_collections;
+    size_t freed = stats->cycle_destroyed;
+    destroyed = 0;
+
+    for (int i = 0; i < SMALL_CYCLES; ++i){
+        Object *first = new_node(i);
+        Object *second = new_node(i);
+        link_nodes(first, second);
+        link_nodes(second, first);
+        geece_release(first);
+        geece_release(second);
+        // The buffer never grows far past its limit
+        assert(cycle_pending() <= BUFFER_LIMIT + 2);
+    }
+    assert(stats->cycle_collections - collections >= 2 * SMALL_CYCLES / BUFFER_LIMIT - 1);
+    assert(stats->cycle_destroyed - freed == (size_t)destroyed);
+    geece_collect_cycles();
+    assert(destroyed == 2 * SMALL_CYCLES);
+    assert(cycle_pending() == 0);
+    geece_config.cycle_buffer_limit = GEECE_DEFAULT_CYCLE_BUFFER_LIMIT;
+    printf("test_allocations_collect_cycles passed\n");
+}
+
+void test_collections_update_the_buffer() {
+    printf("test_collections_update_the_buffer\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    destroyed = 0;
+    Object *first = new_node(1);
+    Object *second = new_node(2);
+    link_nodes(first, second);
+    link_nodes(second, first);
+    geece_release(first);
+    geece_release(second);
+    Object *kept = new_node(3);
+    Object *holder = new_node(4);
+    link_nodes(holder, kept);
+    add_to_root_table(roots, "holder", holder);
+    geece_release(kept);
+    assert(cycle_pending() == 3);
+
+    // The swept cycle leaves the buffer, the candidate that moved is followed to its new address
+    geece_compact();
+    assert(destroyed == 2);
+    assert(cycle_pending() == 1);
+    kept = node_of(get_from_root_table(roots, "holder"))->next;
+    assert(node_of(kept)->value == 3);
+    assert(geece_collect_cycles() == 0);
+    assert(get_refcount(kept) == 1);
+
+    remove_from_root_table(roots, "holder");
+    geece_collect();
+    assert(destroyed == 4);
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_collections_update_the_buffer passed\n");
+}
+
+void test_deferred_cycles_are_collected() {
+    printf("test_deferred_cycles_are_collected\n");
+    geece_config.deferred_rc = true;
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    destroyed = 0;
+    Object *holder = new_node(0);
+    add_to_root_table(roots, "holder", holder);
+    Object *first = new_node(1);
+    Object *second = new_node(2);
+    link_nodes(holder, first);
+    link_nodes(first, second);
+    link_nodes(second, first);
+    assert(geece_rc_reconcile(SIZE_MAX) == 0);
+
+    // Dropping the field leaves the count at one, only the cycle collector can tell it is garbage
+    link_nodes(holder, NULL);
+    assert(cycle_pending() == 1);
+    assert(geece_rc_reconcile(SIZE_MAX) == 0);
+    assert(geece_collect_cycles() == 2);
+    assert(destroyed == 2);
+    assert(node_of(get_from_root_table(roots, "holder"))->value == 0);
+
+    remove_from_root_table(roots, "holder");
+    assert(geece_rc_reconcile(SIZE_MAX) == 1);
+    assert(rc_pending() == 0);
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    geece_config.deferred_rc = false;
+    printf("test_deferred_cycles_are_collected passed\n");
+}
+
+int main(){
+    geece_config.cycle_collection = true;
+    node_type = GEECE_REGISTER_STRUCT(Node, next);
+    test_field_cycle_is_collected();
+    test_edge_cycle_is_collected();
+    test_held_cycles_survive();
+    test_long_cycles_are_collected();
+    test_allocations_collect_cycles();
+    test_collections_update_the_buffer();
+    test_deferred_cycles_are_collected();
+    return 0;
+}
@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "geece.h"
+#include "test_helpers.h"
+#include "large_object.h"
+#include "mark_and_sweep.h"
+
+void test_collect_frees_unreachable() {
+    printf("test_collect_frees_unreachable\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+
+    Object *parent = geece_malloc(16, count_destroyed);
+    Object *child = geece_malloc(16, count_destroyed);
+    Object *garbage = geece_malloc(16, count_destroyed);
+    char key[ADDRESS_KEY_LENGTH];
+    add_root_by_address(roots, parent, key);
+    assert(add_reference(roots, parent, child));
+    size_t available = geece_available_memory();
+
+    destroyed = 0;
+    geece_collect();
+    assert(destroyed == 1);
+    assert(!geece_is_marked(parent) && !geece_is_marked(child));
+    assert(geece_available_memory() == available + page_of(garbage)->block_size);
+
+    // Dropping the root frees the rest
+    remove_from_root_table(roots, key);
+    geece_collect();
+    assert(destroyed == 3);
+    assert(geece_stats()->collections == 2);
+
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_collect_frees_unreachable passed\n");
+}
+
+void test_large_objects_are_unmapped() {
+    printf("test_large_objects_are_unmapped\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    size_t total = geece_total_memory();
+    size_t count = large_object_count();
+
+    Object *kept = geece_malloc(1024 * 1024, NULL);
+    Object *garbage = geece_malloc(4 * 1024 * 1024, count_destroyed);
+    assert((kept->flags & OBJECT_LARGE) && (garbage->flags & OBJECT_LARGE));
+    assert(large_object_count() == count + 2);
+    add_to_root_table(roots, "kept", kept);
+    ((char *)(kept + 1))[1024 * 1024 - 1] = 'x';
+
+    destroyed = 0;
+    geece_collect();
+    assert(destroyed == 1);
+    assert(large_object_count() == count + 1);
+    assert(geece_total_memory() < total + 2 * 1024 * 1024);
+
+    // Large objects are never moved
+    assert(get_from_root_table(roots, "kept") == kept);
+    assert(((char *)(kept + 1))[1024 * 1024 - 1] == 'x');
+
+    remove_from_root_table(roots, "kept");
+    geece_collect();
+    assert(large_object_count() == count);
+    assert(geece_total_memory() == total);
+
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_large_objects_are_unmapped passed\n");
+}
+
+void test_large_object_threshold() {
+    printf("test_large_object_threshold\n");
+    size_t threshold = geece_config.large_object_threshold;
+    geece_config.large_object_threshold = 1024;
+
+    Object *small = geece_malloc(1024 - sizeof(Object), NULL);
+    Object *large = geece_malloc(1024, NULL);
+    assert(!(small->flags & OBJECT_LARGE));
+    assert(large->flags & OBJECT_LARGE);
+    geece_release(small);
+    geece_release(large);
+
+    geece_config.large_object_threshold = threshold;
+    printf("test_large_object_threshold passed\n");
+}
+
+int main(){
+    test_collect_frees_unreachable();
+    test_large_objects_are_unmapped();
+    test_large_object_threshold();
+    return 0;
+}
@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+#include <pthread.h>
+#include "geece.h"
+#include "test_helpers.h"
+
+#define KEPT_EVERY 8
+#define MAX_KEPT 8192
+#define MANY_HANDLES (3 * GEECE_HANDLE_BLOCK_SIZE + 5)
+
+static int value_of(Object *object) {
+    return *(int *)(object + 1);
+}
+
+static Object *new_value(int value, Destructor destructor) {
+    Object *object = geece_malloc(sizeof(int), destructor);
+    *(int *)(object + 1) = value;
+    return object;
+}
+
+void test_handles_keep_objects_alive() {
+    printf("test_handles_keep_objects_alive\n");
+    destroyed = 0;
+    GEECE_SCOPE_BEGIN
+        Object **outer = geece_handle(new_value(1, count_destroyed));
+        GEECE_SCOPE_BEGIN
+            Object **inner = geece_handle(new_value(2, count_destroyed));
+            geece_handle(NULL);
+            assert(geece_handle_count() == 3);
+            geece_collect();
+            assert(destroyed == 0);
+            assert(value_of(*inner) == 2);
+        GEECE_SCOPE_END
+
+        // Closing the inner scope drops its handles only
+        assert(geece_handle_count() == 1);
+        geece_collect();
+        assert(destroyed == 1);
+        assert(value_of(*outer) == 1);
+
+        // A handle can be pointed at another object
+        *outer = new_value(3, count_destroyed);
+        geece_collect();
+        assert(destroyed == 2);
+        assert(value_of(*outer) == 3);
+    GEECE_SCOPE_END
+    assert(geece_handle_count() == 0);
+    geece_collect();
+    assert(destroyed == 3);
+    printf("test_handles_keep_objects_alive passed\n");
+}
+
+void test_stack_grows_by_blocks() {
+    printf("test_stack_grows_by_blocks\n");
+    static Object **slots[MANY_HANDLES];
+    destroyed = 0;
+    GEECE_SCOPE_BEGIN
+        for (int i = 0; i < MANY_HANDLES; ++i){
+            slots[i] = geece_handle(new_value(i, count_destroyed));
+        }
+        assert(geece_handle_count() == MANY_HANDLES);
+        geece_collect();
+        assert(destroyed == 0);
+
+        // Slots never move, the first handle is still where it was pushed
+        for (int i = 0; i < MANY_HANDLES; ++i){
+            assert(value_of(*slots[i]) == i);
+        }
+    GEECE_SCOPE_END
+    geece_collect();
+    assert(destroyed == MANY_HANDLES);
+
+    // The blocks the closed scope left are reused
+    GEECE_SCOPE_BEGIN
+        for (int i = 0; i < MANY_HANDLES; ++i){
+            assert(geece_handle(NULL) == slots[i]);
+        }
+    GEECE_SCOPE_END
+    assert(geece_handle_count() == 0);
+    printf("test_stack_grows_by_blocks passed\n");
+}
+
+void test_compaction_updates_handles() {
+    printf("test_compaction_updates_handles\n");
+    Object *probe = geece_malloc(sizeof(int), NULL);
+    int count = (int)page_of(probe)->block_count * 2 * KEPT_EVERY;
+    static Object **kept[MAX_KEPT];
+    static Object *before[MAX_KEPT];
+    assert(count / KEPT_EVERY <= MAX_KEPT);
+    GEECE_SCOPE_BEGIN
+        for (int i = 0; i < count; ++i){
+            Object *object = new_value(i, NULL);
+            if (i % KEPT_EVERY == 0){
+                kept[i / KEPT_EVERY] = geece_handle(object);
+                before[i / KEPT_EVERY] = object;
+            }
+        }
+        geece_collect();
+        geece_compact();
+        assert(geece_stats()->moved_bytes > 0);
+
+        // Handles are precise, so their objects move and the slots follow them
+        int moved = 0;
+        for (int i = 0; i < count / KEPT_EVERY; ++i){
+            assert(value_of(*kept[i]) == i * KEPT_EVERY);
+            moved += *kept[i] != before[i];
+        }
+        assert(moved > 0);
+    GEECE_SCOPE_END
+    geece_collect();
+    printf("test_compaction_updates_handles passed\n");
+}
+
+void test_handles_hold_deferred_counts() {
+    printf("test_handles_hold_deferred_counts\n");
+    geece_config.deferred_rc = true;
+    destroyed = 0;
+    GEECE_SCOPE_BEGIN
+        Object **handle = geece_handle(new_value(4, count_destroyed));
+        assert(rc_pending() == 1);
+        assert(geece_rc_reconcile(SIZE_MAX) == 0);
+        assert(destroyed == 0);
+        assert(value_of(*handle) == 4);
+    GEECE_SCOPE_END
+    assert(geece_rc_reconcile(SIZE_MAX) == 1);
+    assert(destroyed == 1);
+    geece_config.deferred_rc = false;
+    printf("test_handles_hold_deferred_counts passed\n");
+}
+
+static pthread_barrier_t barrier;
+static Object *shared = NULL;
+
+static void *hold_in_thread(void *arg) {
+    (void)arg;
+    GEECE_SCOPE_BEGIN
+        geece_handle(shared);
+        pthread_barrier_wait(&barrier);
+        pthread_barrier_wait(&barrier);
+    GEECE_SCOPE_END
+    // The thread exits with a handle left outside any scope
+    geece_handle(shared);
+    return NULL;
+}
+
+void test_handles_of_other_threads() {
+    printf("test_handles_of_other_threads\n");
+    destroyed = 0;
+    shared = new_value(5, count_destroyed);
+    pthread_barrier_init(&barrier, NULL, 2);
+    pthread_t thread;
+    assert(pthread_create(&thread, NULL, hold_in_thread, NULL) == 0);
+    pthread_barrier_wait(&barrier);
+    shared = NULL;
+    assert(geece_handle_count() == 1);
+    geece_collect();
+    assert(destroyed == 0);
+    pthread_barrier_wait(&barrier);
+    pthread_join(thread, NULL);
+
+    // The stack of the thread went away with it
+    assert(geece_handle_count() == 0);
+    geece_collect();
+    assert(destroyed == 1);
+    pthread_barrier_destroy(&barrier);
+    printf("test_handles_of_other_threads passed\n");
+}
+
+int main(){
+    test_handles_keep_objects_alive();
+    test_stack_grows_by_blocks();
+    test_compaction_updates_handles();
+    test_handles_hold_deferred_counts();
+    test_handles_of_other_threads();
+    return 0;
+}
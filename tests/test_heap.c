@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <string.h>
+#include <pthread.h>
+#include "heap.h"
+#include "tlab.h"
+
+void test_size_classes() {
+    printf("test_size_classes\n");
+    for (unsigned int i = 0; i < GEECE_SIZE_CLASS_COUNT; ++i) {
+        size_t block_size = page_class_block_size(i);
+        // Every class maps back to itself and is the smallest class that fits its block size
+        assert(page_size_class(block_size) == i);
+        if (i > 0) {
+            assert(page_size_class(page_class_block_size(i - 1) + 1) == i);
+        }
+    }
+    assert(page_class_block_size(GEECE_SIZE_CLASS_COUNT - 1) == GEECE_MAX_SMALL_SIZE);
+    printf("test_size_classes passed\n");
+}
+
+void test_geece_malloc_reuses_blocks() {
+    printf("test_geece_malloc_reuses_blocks\n");
+    Object *first = geece_malloc(32, NULL);
+    Page *page = page_of(first);
+    unsigned int used = page->used_count;
+
+    char *payload = (char *)(first + 1);
+    memset(payload, 0xAB, 32);
+    geece_release(first);
+    assert(page->used_count == used - 1);
+
+    // The freed block is handed out again, with its payload cleared
+    Object *second = geece_malloc(32, NULL);
+    assert(second == first);
+    assert(geece_size(second) == 32);
+    payload = (char *)(second + 1);
+    for (int i = 0; i < 32; ++i) {
+        assert(payload[i] == 0);
+    }
+    geece_release(second);
+    printf("test_geece_malloc_reuses_blocks passed\n");
+}
+
+void test_geece_malloc_fills_pages() {
+    printf("test_geece_malloc_fills_pages\n");
+    Object *objects[4096];
+    for (int i = 0; i < 4096; ++i) {
+        objects[i] = geece_malloc(100, NULL);
+        assert(page_of(objects[i])->block_size >= sizeof(Object) + 100);
+    }
+    // Objects of one class never overlap
+    for (int i = 1; i < 4096; ++i) {
+        assert(objects[i] != objects[i - 1]);
+    }
+    for (int i = 0; i < 4096; ++i) {
+        geece_release(objects[i]);
+    }
+    printf("test_geece_malloc_fills_pages passed\n");
+}
+
+void test_large_objects() {
+    printf("test_large_objects\n");
+    size_t available = geece_available_memory();
+    Object *object = geece_malloc(GEECE_MAX_SMALL_SIZE, NULL);
+    assert(object->flags & OBJECT_LARGE);
+    assert(geece_available_memory() == available);
+    geece_release(object);
+    printf("test_large_objects passed\n");
+}
+
+void test_memory_accounting() {
+    printf("test_memory_accounting\n");
+    Object *object = geece_malloc(16, NULL);
+    size_t total = geece_total_memory();
+    size_t available = geece_available_memory();
+    assert(total >= GEECE_PAGE_SIZE);
+    assert(available < total);
+
+    geece_release(object);
+    assert(geece_total_memory() == total);
+    assert(geece_available_memory() == available + page_of(object)->block_size);
+    printf("test_memory_accounting passed\n");
+}
+
+#define CROSS_THREAD_OBJECTS 2048
+
+static Object *cross_thread_objects[CROSS_THREAD_OBJECTS];
+
+static void *allocate_objects(void *arg) {
+    (void)arg;
+    for (int i = 0; i < CROSS_THREAD_OBJECTS; ++i) {
+        cross_thread_objects[i] = geece_malloc(48, NULL);
+    }
+    return NULL;
+}
+
+static void *release_objects(void *arg) {
+    (void)arg;
+    for (int i = 0; i < CROSS_THREAD_OBJECTS; ++i) {
+        geece_release(cross_thread_objects[i]);
+    }
+    return NULL;
+}
+
+static void *retain_objects(void *arg) {
+    (void)arg;
+    for (int i = 0; i < CROSS_THREAD_OBJECTS; ++i) {
+        retain_object(cross_thread_objects[i]);
+    }
+    return NULL;
+}
+
+void test_cross_thread_release() {
+    printf("test_cross_thread_release\n");
+    size_t available = geece_available_memory();
+
+    // Objects of a live thread are freed remotely, and its buffer reclaims them on the next refill
+    pthread_t thread;
+    pthread_create(&thread, NULL, allocate_objects, NULL);
+    pthread_join(thread, NULL);
+    assert(geece_available_memory() < available);
+    Page *page = page_of(cross_thread_objects[0]);
+    assert(page->owner == NULL);
+
+    release_objects(NULL);
+    assert(geece_available_memory() == available);
+
+    // Frees into a page owned by another running thread go through its remote free list. The
+    // other thread holds the last reference, so that it is the one destroying the objects
+    allocate_objects(NULL);
+    page = page_of(cross_thread_objects[0]);
+    assert(page->owner == tlab_current());
+    pthread_create(&thread, NULL, retain_objects, NULL);
+    pthread_join(thread, NULL);
+    release_objects(NULL);
+    assert(geece_available_memory() < available);
+    pthread_create(&thread, NULL, release_objects, NULL);
+    pthread_join(thread, NULL);
+    assert(atomic_load(&page->remote_free) != NULL);
+    assert(atomic_load(&tlab_current()->remote_pages) != NULL);
+    assert(geece_available_memory() == available);
+
+    Object *objects[CROSS_THREAD_OBJECTS];
+    for (int i = 0; i < CROSS_THREAD_OBJECTS; ++i) {
+        objects[i] = geece_malloc(48, NULL);
+    }
+    assert(atomic_load(&tlab_current()->remote_pages) == NULL);
+    for (int i = 0; i < CROSS_THREAD_OBJECTS; ++i) {
+        geece_release(objects[i]);
+    }
+    printf("test_cross_thread_release passed\n");
+}
+
+int main(){
+    test_size_classes();
+    test_geece_malloc_reuses_blocks();
+    test_geece_malloc_fills_pages();
+    test_large_objects();
+    test_memory_accounting();
+    test_cross_thread_release();
+    return 0;
+}
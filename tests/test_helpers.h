@@ -0,0 +1,45 @@
+/**
+ * @file test_helpers.h
+ * @brief Fixtures shared by the tests for counting destroyed objects and rooting and linking them.
+ */
+
+#ifndef GEECE_TEST_HELPERS_H
+#define GEECE_TEST_HELPERS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <assert.h>
+#include "geece.h"
+
+// The 20 digits of the largest address and the NUL
+#define ADDRESS_KEY_LENGTH 21
+
+// Counts the objects destroyed, from whichever thread sweeps them
+static int destroyed = 0;
+
+static inline void count_destroyed(void *object) {
+    (void)object;
+    __atomic_fetch_add(&destroyed, 1, __ATOMIC_RELAXED);
+}
+
+// Edges are looked up through the root table by the referrer's address
+static inline void add_root_by_address(RootTable *roots, Object *object, char *key) {
+    snprintf(key, ADDRESS_KEY_LENGTH, "%llu", (unsigned long long)(uintptr_t)object);
+    add_to_root_table(roots, key, object);
+}
+
+static inline void link_objects(RootTable *roots, Object *parent, Object *child) {
+    char key[ADDRESS_KEY_LENGTH];
+    add_root_by_address(roots, parent, key);
+    assert(add_reference(roots, parent, child));
+    remove_from_root_table(roots, key);
+}
+
+static inline void unlink_objects(RootTable *roots, Object *parent, Object *child) {
+    char key[ADDRESS_KEY_LENGTH];
+    add_root_by_address(roots, parent, key);
+    assert(remove_reference(roots, parent, child));
+    remove_from_root_table(roots, key);
+}
+
+#endif /* GEECE_TEST_HELPERS_H */
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "geece.h"
+#include "test_helpers.h"
+#include "mark_and_sweep.h"
+
+#define LIST_LENGTH 2000
+
+// Returns the tail of a rooted list of `length` objects
+static Object *build_list(RootTable *roots, int length, char *key) {
+    Object *head = geece_malloc(8, count_destroyed);
+    Object *tail = head;
+    for (int i = 1; i < length; ++i){
+        Object *node = geece_malloc(8, count_destroyed);
+        link_objects(roots, tail, node);
+        tail = node;
+    }
+    add_root_by_address(roots, head, key);
+    return tail;
+}
+
+static void run_to_end(void) {
+    while (!geece_collect_step()){
+    }
+}
+
+void test_write_barrier_keeps_moved_object() {
+    printf("test_write_barrier_keeps_moved_object\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    size_t budget = geece_config.mark_slice_bytes;
+    geece_config.mark_slice_bytes = 1024;
+
+    // `moved` hangs off the end of a long list
+    char list_key[ADDRESS_KEY_LENGTH];
+    Object *tail = build_list(roots, LIST_LENGTH, list_key);
+    Object *head = get_from_root_table(roots, list_key);
+    Object *moved = geece_malloc(8, count_destroyed);
+    link_objects(roots, tail, moved);
+
+    destroyed = 0;
+    geece_collect_start();
+    assert(geece_mark_in_progress());
+    while (!geece_is_marked(head)){
+        assert(!geece_collect_step());
+    }
+    assert(!geece_is_marked(moved));
+
+    // Moving the only edge to a white object behind a black one must not lose it
+    char tail_key[ADDRESS_KEY_LENGTH];
+    add_root_by_address(roots, tail, tail_key);
+    assert(add_reference(roots, head, moved));
+    assert(remove_reference(roots, tail, moved));
+    remove_from_root_table(roots, tail_key);
+    run_to_end();
+    assert(!geece_mark_in_progress());
+    assert(destroyed == 0);
+
+    remove_from_root_table(roots, list_key);
+    geece_collect();
+    assert(destroyed == LIST_LENGTH + 1);
+
+    geece_config.mark_slice_bytes = budget;
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_write_barrier_keeps_moved_object passed\n");
+}
+
+void test_allocation_drives_slices() {
+    printf("test_allocation_drives_slices\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    size_t budget = geece_config.mark_slice_bytes;
+    geece_config.mark_slice_bytes = 4096;
+
+    char list_key[ADDRESS_KEY_LENGTH];
+    build_list(roots, LIST_LENGTH, list_key);
+    Object *garbage = geece_malloc(8, count_destroyed);
+    Object *released = geece_malloc(8, count_destroyed);
+
+    destroyed = 0;
+    size_t cycles = geece_stats()->incremental_cycles;
+    size_t collections = geece_stats()->collections;
+    geece_collect_start();
+    geece_release(released);
+    assert(destroyed == 0);
+
+    // Objects allocated during the cycle survive it even though nothing references them
+    Object *fresh = NULL;
+    int allocations = 0;
+    while (geece_stats()->incremental_cycles == cycles){
+        fresh = geece_malloc(8, count_destroyed);
+        allocations++;
+    }
+    assert(destroyed == 2);
+    assert(geece_stats()->collections == collections + 1);
+    assert(geece_stats()->cycle_slices > 3);
+    assert(geece_stats()->cycle_p99_pause_ns > 0);
+    assert(geece_stats()->cycle_max_pause_ns >= geece_stats()->cycle_p99_pause_ns);
+    (void)garbage;
+    (void)fresh;
+
+    remove_from_root_table(roots, list_key);
+    geece_collect();
+    assert(destroyed == 2 + LIST_LENGTH + allocations);
+
+    geece_config.mark_slice_bytes = budget;
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_allocation_drives_slices passed\n");
+}
+
+void test_collect_finishes_cycle() {
+    printf("test_collect_finishes_cycle\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    char list_key[ADDRESS_KEY_LENGTH];
+    build_list(roots, LIST_LENGTH, list_key);
+    geece_malloc(8, count_destroyed);
+
+    destroyed = 0;
+    geece_collect_start();
+    geece_collect();
+    assert(!geece_mark_in_progress());
+    assert(destroyed == 1);
+    assert(geece_collect_step());
+
+    remove_from_root_table(roots, list_key);
+    geece_collect();
+    assert(destroyed == 1 + LIST_LENGTH);
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_collect_finishes_cycle passed\n");
+}
+
+int main(){
+    test_write_barrier_keeps_moved_object();
+    test_allocation_drives_slices();
+    test_collect_finishes_cycle();
+    return 0;
+}
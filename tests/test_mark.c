@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "geece.h"
+#include "test_helpers.h"
+#include "mark_and_sweep.h"
+
+// Deep enough that marking on the C stack would overflow it
+#define LIST_LENGTH (1 << 19)
+#define FAN_OUT 1000
+#define TREES 16
+#define TREE_SIZE 1000
+
+void test_long_list() {
+    printf("test_long_list\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    Object *head = geece_malloc(8, count_destroyed);
+    Object *tail = head;
+    for (int i = 1; i < LIST_LENGTH; ++i){
+        Object *node = geece_malloc(8, count_destroyed);
+        link_objects(roots, tail, node);
+        tail = node;
+    }
+    char key[ADDRESS_KEY_LENGTH];
+    add_root_by_address(roots, head, key);
+
+    destroyed = 0;
+    size_t marked = geece_stats()->marked_bytes;
+    geece_collect();
+    assert(destroyed == 0);
+    assert(geece_stats()->marked_bytes - marked == (size_t)LIST_LENGTH * (sizeof(Object) + 8));
+
+    remove_from_root_table(roots, key);
+    geece_collect();
+    assert(destroyed == LIST_LENGTH);
+
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_long_list passed\n");
+}
+
+void test_mark_stack_overflow() {
+    printf("test_mark_stack_overflow\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+
+    // A wide object and a list hanging off each of its children, far more than the stack holds
+    Object *parent = geece_malloc(8, count_destroyed);
+    for (int i = 0; i < FAN_OUT; ++i){
+        Object *child = geece_malloc(8, count_destroyed);
+        Object *grandchild = geece_malloc(8, count_destroyed);
+        link_objects(roots, parent, child);
+        link_objects(roots, child, grandchild);
+    }
+    geece_malloc(8, count_destroyed);
+    char key[ADDRESS_KEY_LENGTH];
+    add_root_by_address(roots, parent, key);
+
+    size_t limit = geece_config.mark_stack_limit;
+    geece_config.mark_stack_limit = 4;
+    destroyed = 0;
+    geece_collect();
+    assert(destroyed == 1);
+
+    geece_config.mark_stack_limit = limit;
+    remove_from_root_table(roots, key);
+    geece_collect();
+    assert(destroyed == 2 + 2 * FAN_OUT);
+
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_mark_stack_overflow passed\n");
+}
+
+void test_parallel_marking() {
+    printf("test_parallel_marking\n");
+    RootTable *roots = init_root_table(NULL, 256);
+    geece_set_roots(roots);
+
+    // A forest of binary trees, rooted across many slots
+    static char keys[TREES][ADDRESS_KEY_LENGTH];
+    Object *nodes[TREE_SIZE];
+    for (int tree = 0; tree < TREES; ++tree){
+        for (int i = 0; i < TREE_SIZE; ++i){
+            nodes[i] = geece_malloc(8, count_destroyed);
+            if (i > 0){
+                link_objects(roots, nodes[(i - 1) / 2], nodes[i]);
+            }
+        }
+        add_root_by_address(roots, nodes[0], keys[tree]);
+    }
+    geece_malloc(8, count_destroyed);
+
+    unsigned int threads = geece_config.mark_threads;
+    size_t limit = geece_config.mark_stack_limit;
+    geece_config.mark_threads = 4;
+    destroyed = 0;
+    size_t marked = geece_stats()->marked_bytes;
+    geece_collect();
+    assert(destroyed == 1);
+    assert(geece_stats()->marked_bytes - marked == (size_t)TREES * TREE_SIZE * (sizeof(Object) + 8));
+
+    // Worker deques overflow too, and are recovered from the same way
+    geece_config.mark_stack_limit = 8;
+    geece_collect();
+    assert(destroyed == 1);
+
+    geece_config.mark_stack_limit = limit;
+    for (int tree = 0; tree < TREES; tree += 2){
+        remove_from_root_table(roots, keys[tree]);
+    }
+    geece_collect();
+    assert(destroyed == 1 + TREES / 2 * TREE_SIZE);
+    geece_config.mark_threads = threads;
+
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    geece_collect();
+    printf("test_parallel_marking passed\n");
+}
+
+int main(){
+    test_long_list();
+    test_mark_stack_overflow();
+    test_parallel_marking();
+    return 0;
+}
@@ -0,0 +1,223 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <string.h>
+#include "geece.h"
+#include "test_helpers.h"
+#include "mark_and_sweep.h"
+#include "nursery.h"
+#include "reference.h"
+#include "utils.h"
+
+#define KEPT_EVERY 8
+#define MAX_KEPT 8192
+
+void test_bump_allocation() {
+    printf("test_bump_allocation\n");
+    Object *first = geece_malloc(16, NULL);
+    Object *second = geece_malloc(16, NULL);
+    assert(first->flags & OBJECT_YOUNG);
+    size_t block_size = GEECE_ALIGN_UP(sizeof(Object) + 16, GEECE_MIN_BLOCK_SIZE);
+    assert((char *)second == (char *)first + block_size);
+    assert((char *)heap->top >= (char *)second + block_size);
+    printf("test_bump_allocation passed\n");
+}
+
+void test_minor_collection_moves_survivors() {
+    printf("test_minor_collection_moves_survivors\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+
+    Object *survivor = geece_malloc(sizeof(int), count_destroyed);
+    *(int *)(survivor + 1) = 42;
+    add_to_root_table(roots, "survivor", survivor);
+    geece_malloc(sizeof(int), count_destroyed);
+
+    destroyed = 0;
+    geece_collect_minor();
+    assert(destroyed == 1);
+    assert(heap->top == heap->objects);
+
+    Object *moved = get_from_root_table(roots, "survivor");
+    assert(moved != survivor);
+    assert(moved->flags & OBJECT_YOUNG);
+    assert(moved->age == 1);
+    assert(*(int *)(moved + 1) == 42);
+
+    // The second survival reaches the promotion age and moves the object into the old space
+    geece_collect_minor();
+    Object *promoted = get_from_root_table(roots, "survivor");
+    assert(!(promoted->flags & OBJECT_YOUNG));
+    assert(page_of(promoted)->block_size >= sizeof(Object) + sizeof(int));
+    assert(*(int *)(promoted + 1) == 42);
+    assert(destroyed == 1);
+
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_minor_collection_moves_survivors passed\n");
+}
+
+void test_remembered_set() {
+    printf("test_remembered_set\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+
+    Object *old = new_object(0, NULL);
+    char key[ADDRESS_KEY_LENGTH];
+    add_root_by_address(roots, old, key);
+
+    Object *young = geece_malloc(sizeof(int), NULL);
+    *(int *)(young + 1) = 7;
+    assert(add_reference(roots, old, young));
+    assert(old->flags & OBJECT_REMEMBERED);
+
+    // The young object is only reachable through the old object's edge
+    geece_collect_minor();
+    size_t count;
+    Object *moved = object_references(old, &count)[0];
+    assert(moved != young);
+    assert(*(int *)(moved + 1) == 7);
+    assert(old->flags & OBJECT_REMEMBERED);
+
+    // Once the target is promoted, the old object no longer needs to be remembered
+    geece_collect_minor();
+    assert(!(object_references(old, &count)[0]->flags & OBJECT_YOUNG));
+    assert(!(old->flags & OBJECT_REMEMBERED));
+
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_remembered_set passed\n");
+}
+
+void test_young_edges_are_freed() {
+    printf("test_young_edges_are_freed\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+
+    Object *parent = geece_malloc(0, NULL);
+    char key[ADDRESS_KEY_LENGTH];
+    add_root_by_address(roots, parent, key);
+    Object *child = geece_malloc(0, count_destroyed);
+    assert(add_reference(roots, parent, child));
+    assert(parent->flags & OBJECT_TRACKED);
+
+    // Both die once the parent is no longer a root
+    remove_from_root_table(roots, key);
+    destroyed = 0;
+    geece_collect_minor();
+    assert(destroyed == 1);
+
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_young_edges_are_freed passed\n");
+}
+
+void test_handles_follow_survivors() {
+    printf("test_handles_follow_survivors\n");
+    destroyed = 0;
+    GEECE_SCOPE_BEGIN
+        Object *young = geece_malloc(sizeof(int), count_destroyed);
+        *(int *)(young + 1) = 9;
+        Object **handle = geece_handle(young);
+        geece_collect_minor();
+        assert(destroyed == 0);
+        assert(*handle != young);
+        assert(*(int *)(*handle + 1) == 9);
+    GEECE_SCOPE_END
+    geece_collect_minor();
+    assert(destroyed == 1);
+    printf("test_handles_follow_survivors passed\n");
+}
+
+void test_referrers_follow_survivors() {
+    printf("test_referrers_follow_survivors\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+
+    Object *target = geece_malloc(0, NULL);
+    Object *survivor = geece_malloc(0, NULL);
+    Object *dead = geece_malloc(0, count_destroyed);
+    add_to_root_table(roots, "target", target);
+    add_to_root_table(roots, "survivor", survivor);
+    add_to_root_table(roots, "dead", dead);
+    assert(add_reference(roots, survivor, target));
+    assert(add_reference(roots, dead, target));
+    assert(target->flags & OBJECT_TRACKED);
+
+    // The target and its surviving referrer move, the dead referrer leaves its referrers
+    remove_from_root_table(roots, "dead");
+    destroyed = 0;
+    geece_collect_minor();
+    assert(destroyed == 1);
+    Object *moved_target = get_from_root_table(roots, "target");
+    Object *moved_survivor = get_from_root_table(roots, "survivor");
+    assert(moved_target != target && moved_survivor != survivor);
+    size_t count;
+    Object **referrers = reference_referrers(moved_target, &count);
+    assert(count == 1 && referrers[0] == moved_survivor);
+    assert(remove_reference(roots, moved_survivor, moved_target));
+    assert(object_get_reference_count_ptrs(roots, moved_target) == 0);
+
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_referrers_follow_survivors passed\n");
+}
+
+void test_compaction_during_cycle() {
+    printf("test_compaction_during_cycle\n");
+    static char keys[MAX_KEPT][16];
+    RootTable *roots = init_root_table(NULL, 64);
+    geece_set_roots(roots);
+
+    // Old pages with one object kept out of eight, so compaction moves the kept ones
+    Object *probe = new_object(sizeof(int), NULL);
+    int kept_count = (int)page_of(probe)->block_count * 2;
+    assert(kept_count <= MAX_KEPT);
+    for (int i = 0; i < kept_count * KEPT_EVERY; ++i){
+        Object *object = new_object(sizeof(int), NULL);
+        *(int *)(object + 1) = i;
+        if (i % KEPT_EVERY == 0){
+            sprintf(keys[i / KEPT_EVERY], "kept%d", i);
+            add_to_root_table(roots, keys[i / KEPT_EVERY], object);
+        }
+    }
+    geece_collect();
+
+    // Objects allocated while a cycle runs live in eden when it is finished by the compaction
+    geece_collect_start();
+    assert(geece_mark_in_progress());
+    Object *target = get_from_root_table(roots, keys[kept_count - 1]);
+    Object *young = geece_malloc(0, NULL);
+    add_to_root_table(roots, "young", young);
+    assert(add_reference(roots, young, target));
+
+    geece_compact();
+    assert(!geece_mark_in_progress());
+    Object *moved = get_from_root_table(roots, keys[kept_count - 1]);
+    assert(moved != target);
+    size_t count;
+    assert(object_references(get_from_root_table(roots, "young"), &count)[0] == moved);
+    assert(*(int *)(moved + 1) == (kept_count - 1) * KEPT_EVERY);
+
+    clear_root_table(roots);
+    geece_collect();
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_compaction_during_cycle passed\n");
+}
+
+int main(){
+    geece_config.nursery_size = 1024 * 1024;
+    geece_config.track_referrers = true;
+    test_bump_allocation();
+    test_minor_collection_moves_survivors();
+    test_remembered_set();
+    test_young_edges_are_freed();
+    test_handles_follow_survivors();
+    test_referrers_follow_survivors();
+    test_compaction_during_cycle();
+    geece_config.concurrent_marking = true;
+    test_compaction_during_cycle();
+    geece_config.concurrent_marking = false;
+    return 0;
+}
@@ -0,0 +1,234 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <pthread.h>
+#include "geece.h"
+#include "test_helpers.h"
+
+#define MANY_EDGES 1000
+
+void test_header_size() {
+    printf("test_header_size\n");
+#ifdef GEECE_COMPACT_HEADER
+    assert(sizeof(Object) == sizeof(uint64_t));
+    // A 16 byte payload fits a 32 byte block instead of a 96 byte one
+    Object *object = geece_malloc(16, NULL);
+    assert(page_of(object)->block_size == 32);
+    geece_release(object);
+#endif
+    Object *small = geece_malloc(3, NULL);
+    assert(small->size == 3);
+    assert(small->ref_count == 1);
+    assert(object_destructor(small) == NULL);
+    size_t count;
+    object_references(small, &count);
+    assert(count == 0);
+    geece_release(small);
+    printf("test_header_size passed\n");
+}
+
+void test_destructor_and_edges() {
+    printf("test_destructor_and_edges\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    Object *parent = geece_malloc(8, count_destroyed);
+    Object *child = geece_malloc(8, NULL);
+    assert(object_destructor(parent) == count_destroyed);
+
+    char key[ADDRESS_KEY_LENGTH];
+    add_root_by_address(roots, parent, key);
+    assert(add_reference(roots, parent, child));
+    size_t count;
+    assert(object_references(parent, &count)[0] == child && count == 1);
+    assert(child->ref_count == 2);
+    assert(remove_reference(roots, parent, child));
+    object_references(parent, &count);
+    assert(count == 0);
+    assert(child->ref_count == 1);
+
+    // Finalizing runs the destructor once and drops the metadata
+    destroyed = 0;
+    object_finalize(parent);
+    object_finalize(parent);
+    assert(destroyed == 1);
+    assert(object_destructor(parent) == NULL);
+#ifdef GEECE_COMPACT_HEADER
+    assert(!(parent->flags & OBJECT_META));
+#endif
+    // The child keeps the record of its referrers, emptied by the removal, until it is collected
+    assert(object_get_reference_count_ptrs(roots, child) == 0);
+
+    geece_release(child);
+    destroy_root_table(roots);
+    printf("test_destructor_and_edges passed\n");
+}
+
+void test_many_edges() {
+    printf("test_many_edges\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    Object *parent = geece_malloc(8, NULL);
+    add_to_root_table(roots, "parent", parent);
+    static Object *children[MANY_EDGES];
+    for (int i = 0; i < MANY_EDGES; ++i){
+        children[i] = geece_malloc(sizeof(int), NULL);
+        *(int *)(children[i] + 1) = i;
+        assert(add_reference(roots, parent, children[i]));
+        geece_release(children[i]);
+    }
+    // Adding an edge again keeps the one there is
+    assert(add_reference(roots, parent, children[0]));
+    assert(get_reference_count(roots, parent) == MANY_EDGES);
+
+    // The edges come back as one array, in the order they were added
+    Object **references;
+    assert(object_get_references(roots, parent, &references) == MANY_EDGES);
+    for (int i = 0; i < MANY_EDGES; ++i){
+        assert(references[i] == children[i]);
+    }
+
+    // Removing an edge moves the last one into its place
+    assert(remove_reference(roots, parent, children[10]));
+    size_t count;
+    references = object_references(parent, &count);
+    assert(count == MANY_EDGES - 1);
+    assert(references[10] == children[MANY_EDGES - 1]);
+    assert(object_has_reference(parent, children[MANY_EDGES - 1]));
+
+    // Compaction moves the children and every edge is still found at its new address
+    geece_compact();
+    assert(geece_stats()->moved_bytes > 0);
+    parent = get_from_root_table(roots, "parent");
+    references = object_references(parent, &count);
+    assert(count == MANY_EDGES - 1);
+    long sum = 0;
+    for (size_t i = 0; i < count; ++i){
+        assert(object_has_reference(parent, references[i]));
+        sum += *(int *)(references[i] + 1);
+    }
+    assert(sum == (long)MANY_EDGES * (MANY_EDGES - 1) / 2 - 10);
+
+    while (count > 0){
+        assert(remove_reference(roots, parent, references[count / 2]));
+        references = object_references(parent, &count);
+    }
+    assert(get_reference_count(roots, parent) == 0);
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    geece_collect();
+    printf("test_many_edges passed\n");
+}
+
+void test_reference_count_saturates() {
+    printf("test_reference_count_saturates\n");
+#ifdef GEECE_COMPACT_HEADER
+    Object *object = geece_malloc(8, count_destroyed);
+    for (int i = 0; i < 1000; ++i){
+        retain_object(object);
+    }
+    assert(object->ref_count == OBJECT_REF_COUNT_MAX);
+
+    // A saturated count sticks, leaving the object to the tracing collector
+    destroyed = 0;
+    for (int i = 0; i < 2000; ++i){
+        geece_release(object);
+    }
+    assert(destroyed == 0);
+    assert(object->ref_count == OBJECT_REF_COUNT_MAX);
+#endif
+    printf("test_reference_count_saturates passed\n");
+}
+
+#define SHARING_THREADS 4
+#define SHARING_ROUNDS 100000
+
+static Object *shared_object;
+
+static void *retain_shared(void *arg) {
+    (void)arg;
+    retain_object(shared_object);
+    return NULL;
+}
+
+static void *release_shared(void *arg) {
+    (void)arg;
+    geece_release(shared_object);
+    return NULL;
+}
+
+static void *allocate_shared(void *arg) {
+    (void)arg;
+    shared_object = geece_malloc(8, count_destroyed);
+    return NULL;
+}
+
+static void *retain_and_release_shared(void *arg) {
+    (void)arg;
+    for (int i = 0; i < SHARING_ROUNDS; ++i){
+        retain_object(shared_object);
+        geece_release(shared_object);
+    }
+    return NULL;
+}
+
+static void run_thread(void *(*function)(void *)) {
+    pthread_t thread;
+    assert(pthread_create(&thread, NULL, function, NULL) == 0);
+    pthread_join(thread, NULL);
+}
+
+void test_counts_shared_between_threads() {
+    printf("test_counts_shared_between_threads\n");
+    destroyed = 0;
+
+    // The owner counts on its own, another thread's reference goes to the shared count
+    shared_object = geece_malloc(8, count_destroyed);
+    run_thread(retain_shared);
+#ifndef GEECE_COMPACT_HEADER
+    assert(shared_object->ref_count == 1);
+    assert(shared_object->shared_count == OBJECT_SHARED_ONE);
+#endif
+    assert(get_refcount(shared_object) == 2);
+    geece_release(shared_object);
+    assert(destroyed == 0);
+    run_thread(release_shared);
+    assert(destroyed == 1);
+
+    // Released by another thread only, the object waits for its owner to merge the counts
+    shared_object = geece_malloc(8, count_destroyed);
+    run_thread(release_shared);
+#ifndef GEECE_COMPACT_HEADER
+    assert(destroyed == 1);
+    geece_rc_merge();
+#endif
+    assert(destroyed == 2);
+
+    // Objects of a thread that exited are merged by the thread releasing them
+    run_thread(allocate_shared);
+    geece_release(shared_object);
+    assert(destroyed == 3);
+
+    // No count is lost while threads share an object
+    shared_object = geece_malloc(8, count_destroyed);
+    pthread_t threads[SHARING_THREADS];
+    for (int i = 0; i < SHARING_THREADS; ++i){
+        assert(pthread_create(&threads[i], NULL, retain_and_release_shared, NULL) == 0);
+    }
+    retain_and_release_shared(NULL);
+    for (int i = 0; i < SHARING_THREADS; ++i){
+        pthread_join(threads[i], NULL);
+    }
+    assert(get_refcount(shared_object) == 1);
+    assert(destroyed == 3);
+    geece_release(shared_object);
+    assert(destroyed == 4);
+    printf("test_counts_shared_between_threads passed\n");
+}
+
+int main(){
+    test_header_size();
+    test_destructor_and_edges();
+    test_many_edges();
+    test_reference_count_saturates();
+    test_counts_shared_between_threads();
+    return 0;
+}
@@ -0,0 +1,278 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <pthread.h>
+#include "geece.h"
+#include "test_helpers.h"
+#include "reference.h"
+
+#define MANY_REFERRERS 1000
+#define KEPT_EVERY 8
+#define MAX_KEPT 8192
+#define THREADS 8
+#define THREAD_PARENTS 64
+#define SHARED_TARGETS 16
+
+static bool has_referrer(Object *object, Object *referrer) {
+    size_t count;
+    Object **referrers = reference_referrers(object, &count);
+    for (size_t i = 0; i < count; ++i){
+        if (referrers[i] == referrer){
+            return true;
+        }
+    }
+    return false;
+}
+
+void test_in_degree() {
+    printf("test_in_degree\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    Object *first = geece_malloc(0, NULL);
+    Object *second = geece_malloc(0, NULL);
+    Object *target = geece_malloc(0, NULL);
+    root_table_add(roots, first);
+    root_table_add(roots, second);
+    root_table_add(roots, target);
+    assert(object_get_reference_count_ptrs(roots, target) == 0);
+    assert(get_object_count(roots, target) == 1);
+
+    assert(add_reference(roots, first, target));
+    assert(add_reference(roots, second, target));
+    assert(add_reference(roots, first, target));
+    assert(object_get_reference_count_ptrs(roots, target) == 2);
+    assert(get_object_count(roots, target) == 3);
+    assert(has_referrer(target, first) && has_referrer(target, second));
+    assert(object_get_data(target) == reference_referrers(target, &(size_t){0}));
+
+    // The edges of the referrers count, not the referrers: the target points nowhere
+    assert(object_get_reference_count_ptrs(roots, first) == 0);
+
+    assert(remove_reference(roots, first, target));
+    assert(object_get_reference_count_ptrs(roots, target) == 1);
+    assert(!has_referrer(target, first));
+
+    // Removing an object drops its edges from the index
+    assert(remove_object(roots, second));
+    assert(object_get_reference_count_ptrs(roots, target) == 0);
+    assert(get_object_count(roots, target) == 1);
+
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    geece_collect();
+    printf("test_in_degree passed\n");
+}
+
+void test_many_referrers() {
+    printf("test_many_referrers\n");
+    static Object *referrers[MANY_REFERRERS];
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    Object *target = geece_malloc(0, NULL);
+    root_table_add(roots, target);
+    for (int i = 0; i < MANY_REFERRERS; ++i){
+        referrers[i] = geece_malloc(0, NULL);
+        root_table_add(roots, referrers[i]);
+        assert(add_reference(roots, referrers[i], target));
+    }
+    assert(object_get_reference_count_ptrs(roots, target) == MANY_REFERRERS);
+
+    for (int i = 0; i < MANY_REFERRERS; i += 2){
+        assert(remove_reference(roots, referrers[i], target));
+    }
+    assert(object_get_reference_count_ptrs(roots, target) == MANY_REFERRERS / 2);
+    for (int i = 0; i < MANY_REFERRERS; ++i){
+        assert(has_referrer(target, referrers[i]) == (i % 2 == 1));
+    }
+
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    geece_collect();
+    printf("test_many_referrers passed\n");
+}
+
+void test_dead_referrers_leave() {
+    printf("test_dead_referrers_leave\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    Object *target = geece_malloc(0, NULL);
+    root_table_add(roots, target);
+    Object *released = geece_malloc(0, NULL);
+    Object *swept = geece_malloc(0, count_destroyed);
+    Object *dying = geece_malloc(0, count_destroyed);
+    root_table_add(roots, released);
+    root_table_add(roots, swept);
+    root_table_add(roots, dying);
+    assert(add_reference(roots, released, target));
+    assert(add_reference(roots, swept, target));
+    assert(add_reference(roots, swept, dying));
+    assert(add_reference(roots, dying, target));
+    assert(object_get_reference_count_ptrs(roots, target) == 3);
+    size_t indexed = reference_indexed();
+
+    // Reference counting unlinks what it destroys
+    root_table_remove(roots, released);
+    geece_release(released);
+    assert(object_get_reference_count_ptrs(roots, target) == 2);
+
+    // A full collection unlinks what it sweeps, a dead referrer of a dead object included
+    root_table_remove(roots, swept);
+    root_table_remove(roots, dying);
+    destroyed = 0;
+    geece_collect();
+    assert(destroyed == 2);
+    assert(object_get_reference_count_ptrs(roots, target) == 0);
+    assert(reference_indexed() == indexed - 2);
+
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    geece_collect();
+    assert(reference_indexed() == 0);
+    printf("test_dead_referrers_leave passed\n");
+}
+
+void test_compaction_updates_referrers() {
+    printf("test_compaction_updates_referrers\n");
+    static Object **kept[MAX_KEPT];
+    Object *probe = geece_malloc(0, NULL);
+    int count = (int)page_of(probe)->block_count * 2 * KEPT_EVERY;
+    assert(count / KEPT_EVERY <= MAX_KEPT);
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    GEECE_SCOPE_BEGIN
+        Object **target = geece_handle(geece_malloc(0, NULL));
+        for (int i = 0; i < count; ++i){
+            Object *object = geece_malloc(0, NULL);
+            if (i % KEPT_EVERY == 0){
+                kept[i / KEPT_EVERY] = geece_handle(object);
+                root_table_add(roots, object);
+                assert(add_reference(roots, object, *target));
+                root_table_remove(roots, object);
+            }
+        }
+        geece_collect();
+        geece_compact();
+        assert(geece_stats()->moved_bytes > 0);
+
+        // The referrers were forwarded and rehashed with the edges
+        assert(object_get_reference_count_ptrs(roots, *target) == count / KEPT_EVERY);
+        for (int i = 0; i < count / KEPT_EVERY; ++i){
+            assert(has_referrer(*target, *kept[i]));
+            root_table_add(roots, *kept[i]);
+            assert(remove_reference(roots, *kept[i], *target));
+            root_table_remove(roots, *kept[i]);
+        }
+        assert(object_get_reference_count_ptrs(roots, *target) == 0);
+    GEECE_SCOPE_END
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    geece_collect();
+    printf("test_compaction_updates_referrers passed\n");
+}
+
+// Builds a rooted chain of objects, each the only referrer of the next, and lets it die
+static void kill_chain(int length) {
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    Object *head = geece_malloc(0, count_destroyed);
+    root_table_add(roots, head);
+    Object *tail = head;
+    for (int i = 1; i < length; ++i){
+        Object *node = geece_malloc(0, count_destroyed);
+        root_table_add(roots, node);
+        assert(add_reference(roots, tail, node));
+        root_table_remove(roots, tail);
+        tail = node;
+    }
+    root_table_remove(roots, tail);
+    assert(reference_indexed() == (size_t)length - 1);
+    destroyed = 0;
+    geece_collect();
+    heap_finish_sweep();
+    assert(destroyed == length);
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+}
+
+void test_sweeps_free_referrers() {
+    printf("test_sweeps_free_referrers\n");
+    // Whichever way the pages are swept, the referrers of the dead are freed, leak checkers agree
+    kill_chain(MANY_REFERRERS);
+    geece_config.lazy_sweep = true;
+    kill_chain(MANY_REFERRERS);
+    geece_config.lazy_sweep = false;
+    unsigned int threads = geece_config.sweep_threads;
+    geece_config.sweep_threads = 4;
+    kill_chain(MANY_REFERRERS);
+    geece_config.sweep_threads = threads;
+    assert(reference_indexed() == 0);
+    printf("test_sweeps_free_referrers passed\n");
+}
+
+static RootTable *shared_roots;
+static Object *shared_targets[SHARED_TARGETS];
+static Object *thread_parents[THREADS][THREAD_PARENTS];
+
+// Every parent points to every shared target, then the even parents let go of theirs
+static void *write_edges(void *arg) {
+    Object **parents = arg;
+    for (int i = 0; i < THREAD_PARENTS; ++i){
+        for (int t = 0; t < SHARED_TARGETS; ++t){
+            assert(add_reference(shared_roots, parents[i], shared_targets[t]));
+        }
+    }
+    for (int i = 0; i < THREAD_PARENTS; i += 2){
+        for (int t = 0; t < SHARED_TARGETS; ++t){
+            assert(remove_reference(shared_roots, parents[i], shared_targets[t]));
+        }
+    }
+    return NULL;
+}
+
+void test_concurrent_edges() {
+    printf("test_concurrent_edges\n");
+    shared_roots = init_sharded_root_table(NULL, 16, 64);
+    geece_set_roots(shared_roots);
+    for (int t = 0; t < SHARED_TARGETS; ++t){
+        shared_targets[t] = geece_malloc(0, NULL);
+        root_table_add(shared_roots, shared_targets[t]);
+    }
+    for (int i = 0; i < THREADS; ++i){
+        for (int j = 0; j < THREAD_PARENTS; ++j){
+            thread_parents[i][j] = geece_malloc(0, NULL);
+            root_table_add(shared_roots, thread_parents[i][j]);
+        }
+    }
+
+    // The threads write edges to the same targets at once
+    pthread_t threads[THREADS];
+    for (int i = 0; i < THREADS; ++i){
+        pthread_create(&threads[i], NULL, write_edges, thread_parents[i]);
+    }
+    for (int i = 0; i < THREADS; ++i){
+        pthread_join(threads[i], NULL);
+    }
+    for (int t = 0; t < SHARED_TARGETS; ++t){
+        assert(object_get_reference_count_ptrs(shared_roots, shared_targets[t]) == THREADS * THREAD_PARENTS / 2);
+        for (int i = 0; i < THREADS; ++i){
+            assert(!has_referrer(shared_targets[t], thread_parents[i][0]));
+            assert(has_referrer(shared_targets[t], thread_parents[i][1]));
+        }
+    }
+
+    geece_set_roots(NULL);
+    destroy_root_table(shared_roots);
+    geece_collect();
+    printf("test_concurrent_edges passed\n");
+}
+
+int main(){
+    geece_config.track_referrers = true;
+    test_in_degree();
+    test_many_referrers();
+    test_dead_referrers_leave();
+    test_compaction_updates_referrers();
+    test_sweeps_free_referrers();
+    test_concurrent_edges();
+    return 0;
+}
@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+#include "geece.h"
+#include "test_helpers.h"
+#include "reference_counting.h"
+
+#define LIST_LENGTH 2000
+#define CHUNK 100
+#define GARBAGE 1000
+
+typedef struct {
+    long value;
+    Object *next;
+} Node;
+
+static GeeceType node_type;
+static Node *node_of(Object *object) {
+    return geece_payload(object);
+}
+
+static Object *new_node(long value) {
+    Object *object = geece_malloc_typed(node_type, count_destroyed);
+    node_of(object)->value = value;
+    return object;
+}
+
+static Object *build_list(int length) {
+    Object *head = new_node(0);
+    Object *tail = head;
+    for (int i = 1; i < length; ++i){
+        Object *node = new_node(i);
+        geece_write_field(tail, &node_of(tail)->next, node);
+        tail = node;
+    }
+    return head;
+}
+
+static void check_list(Object *head, int length) {
+    int count = 0;
+    for (Object *node = head; node != NULL; node = node_of(node)->next){
+        assert(node_of(node)->value == count);
+        count++;
+    }
+    assert(count == length);
+}
+
+static __attribute__((noinline)) void allocate_garbage(int count) {
+    for (int i = 0; i < count; ++i){
+        new_node(-1);
+    }
+}
+
+void test_unreferenced_objects_are_destroyed() {
+    printf("test_unreferenced_objects_are_destroyed\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    destroyed = 0;
+
+    // New objects start at zero, the root table is not counted
+    add_to_root_table(roots, "kept", new_node(1));
+    assert(get_refcount(get_from_root_table(roots, "kept")) == 0);
+    allocate_garbage(GARBAGE);
+    assert(rc_pending() == GARBAGE + 1);
+    geece_release(get_from_root_table(roots, "kept"));
+    assert(destroyed == 0);
+
+    assert(geece_rc_reconcile(SIZE_MAX) == GARBAGE);
+    assert(destroyed == GARBAGE);
+    assert(node_of(get_from_root_table(roots, "kept"))->value == 1);
+    // Only the root holds it, so it waits in the table for the next reconciliation
+    assert(rc_pending() == 1);
+
+    remove_from_root_table(roots, "kept");
+    assert(geece_rc_reconcile(SIZE_MAX) == 1);
+    assert(rc_pending() == 0);
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_unreferenced_objects_are_destroyed passed\n");
+}
+
+void test_heap_references_keep_objects() {
+    printf("test_heap_references_keep_objects\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    destroyed = 0;
+
+    Object *parent = new_node(1);
+    add_to_root_table(roots, "parent", parent);
+    geece_write_field(parent, &node_of(parent)->next, new_node(2));
+    assert(get_refcount(node_of(parent)->next) == 1);
+    geece_rc_reconcile(SIZE_MAX);
+    assert(destroyed == 0);
+    assert(node_of(node_of(parent)->next)->value == 2);
+
+    // Dropping the field puts the child in the table, the next reconciliation destroys it
+    geece_write_field(parent, &node_of(parent)->next, NULL);
+    assert(destroyed == 0);
+    assert(geece_rc_reconcile(SIZE_MAX) == 1);
+    assert(destroyed == 1);
+
+    remove_from_root_table(roots, "parent");
+    geece_rc_reconcile(SIZE_MAX);
+    assert(destroyed == 2);
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_heap_references_keep_objects passed\n");
+}
+
+void test_removed_edges_are_dropped() {
+    printf("test_removed_edges_are_dropped\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    destroyed = 0;
+
+    Object *parent = new_node(1);
+    add_to_root_table(roots, "parent", parent);
+    Object *first = new_node(2);
+    Object *second = new_node(3);
+    assert(add_reference(roots, parent, first));
+    assert(add_reference(roots, parent, second));
+    assert(get_refcount(first) == 1 && get_refcount(second) == 1);
+    geece_rc_reconcile(SIZE_MAX);
+    assert(destroyed == 0);
+
+    // Removing every edge of the parent drops what only it referenced into the table
+    assert(remove_object(roots, parent));
+    assert(get_refcount(first) == 0 && get_refcount(second) == 0);
+    assert(geece_rc_reconcile(SIZE_MAX) == 2);
+    assert(destroyed == 2);
+
+    remove_from_root_table(roots, "parent");
+    geece_rc_reconcile(SIZE_MAX);
+    assert(destroyed == 3);
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_removed_edges_are_dropped passed\n");
+}
+
+void test_release_is_destroyed_in_chunks() {
+    printf("test_release_is_destroyed_in_chunks\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    add_to_root_table(roots, "list", build_list(LIST_LENGTH));
+    geece_rc_reconcile(SIZE_MAX);
+    check_list(get_from_root_table(roots, "list"), LIST_LENGTH);
+    destroyed = 0;
+
+    // Each node is only reached once its predecessor is destroyed, the chunks still fill up
+    remove_from_root_table(roots, "list");
+    int reconciliations = 0;
+    while (rc_pending() > 0){
+        size_t chunk = geece_rc_reconcile(CHUNK);
+        assert(chunk == CHUNK);
+        reconciliations++;
+        assert(destroyed == reconciliations * CHUNK);
+    }
+    assert(destroyed == LIST_LENGTH);
+    assert(reconciliations == LIST_LENGTH / CHUNK);
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_release_is_destroyed_in_chunks passed\n");
+}
+
+void test_allocations_reconcile() {
+    printf("test_allocations_reconcile\n");
+    geece_config.rc_table_limit = 64;
+    geece_config.rc_chunk_objects = 16;
+    const GeeceStats *stats = geece_stats();
+    size_t reconciliations = stats->rc_reconciliations;
+    size_t freed = stats->rc_destroyed;
+    destroyed = 0;
+
+    allocate_garbage(GARBAGE);
+    reconciliations = stats->rc_reconciliations - reconciliations;
+    freed = stats->rc_destroyed - freed;
+    assert(reconciliations > 0);
+    assert(freed == (size_t)destroyed);
+    assert(freed <= reconciliations * geece_config.rc_chunk_objects);
+    // Left behind reconciliations come back on the next allocations, the table does not pile up
+    assert(rc_pending() < GARBAGE / 2);
+
+    geece_config.rc_table_limit = GEECE_DEFAULT_RC_TABLE_LIMIT;
+    geece_config.rc_chunk_objects = GEECE_DEFAULT_RC_CHUNK_OBJECTS;
+    geece_rc_reconcile(SIZE_MAX);
+    assert(destroyed == GARBAGE);
+    printf("test_allocations_reconcile passed\n");
+}
+
+void test_local_variables_are_held() {
+    printf("test_local_variables_are_held\n");
+    assert(geece_register_thread());
+    geece_set_roots(NULL);
+    destroyed = 0;
+    Object *local = new_node(7);
+    allocate_garbage(GARBAGE);
+
+    geece_rc_reconcile(SIZE_MAX);
+    assert(node_of(local)->value == 7);
+    // A few stale words may still point at garbage, most of it is destroyed
+    assert(destroyed > GARBAGE * 9 / 10 && destroyed <= GARBAGE);
+    assert(node_of(local)->value == 7);
+    geece_unregister_thread();
+    printf("test_local_variables_are_held passed\n");
+}
+
+void test_collections_update_the_table() {
+    printf("test_collections_update_the_table\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    geece_rc_reconcile(SIZE_MAX);
+    geece_config.rc_table_limit = SIZE_MAX;
+    destroyed = 0;
+
+    // Swept objects leave the table, moved ones are followed to their new address
+    allocate_garbage(GARBAGE);
+    add_to_root_table(roots, "list", build_list(LIST_LENGTH));
+    allocate_garbage(GARBAGE);
+    // Linked nodes leave the table at the next reconciliation, where their count is found above zero
+    assert(rc_pending() == 2 * GARBAGE + LIST_LENGTH);
+    geece_compact();
+    assert(destroyed == 2 * GARBAGE);
+    assert(rc_pending() == LIST_LENGTH);
+    assert(geece_rc_reconcile(SIZE_MAX) == 0);
+    assert(rc_pending() == 1);
+    check_list(get_from_root_table(roots, "list"), LIST_LENGTH);
+
+    remove_from_root_table(roots, "list");
+    assert(geece_rc_reconcile(SIZE_MAX) == LIST_LENGTH);
+    geece_config.rc_table_limit = GEECE_DEFAULT_RC_TABLE_LIMIT;
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_collections_update_the_table passed\n");
+}
+
+int main(){
+    geece_config.deferred_rc = true;
+    node_type = GEECE_REGISTER_STRUCT(Node, next);
+    test_unreferenced_objects_are_destroyed();
+    test_heap_references_keep_objects();
+    test_removed_edges_are_dropped();
+    test_release_is_destroyed_in_chunks();
+    test_allocations_reconcile();
+    test_local_variables_are_held();
+    test_collections_update_the_table();
+    return 0;
+}
@@ -4,14 +4,23 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include <assert.h>
+#include <pthread.h>
+#include "geece.h"
+#include "test_helpers.h"
 #include "object.h"
 #include "root_table.h"
 
+#define ROOT_COUNT 10000
+#define SHARDS 16
+#define THREADS 8
+#define THREAD_ROOTS 2000
+#define STABLE_KEYS 64
+
 void test_init_root_table() {
     printf("test_init_root_table\n");
-    RootTable table;
-    RootTable *result = init_root_table(&table, 10);
+    RootTable *result = init_root_table(malloc(sizeof(RootTable)), 10);
 
     // Check that the function returns a non-NULL pointer
     if (result == NULL) {
@@ -19,26 +28,27 @@ void test_init_root_table() {
         return;
     }
 
-    // Check that the bucket_count is set correctly
-    if (result->bucket_count != 10) {
-        printf("Error: init_root_table did not set bucket_count correctly\n");
+    // Check that the capacity is rounded up to a power of two
+    if (result->capacity != 16 || result->key_capacity != 16) {
+        printf("Error: init_root_table did not set the capacity correctly\n");
         return;
     }
 
-    // Check that bucket_heads is a non-NULL pointer
-    if (result->bucket_heads == NULL) {
-        printf("Error: init_root_table did not allocate memory for bucket_heads\n");
+    // Check that slots and keys are non-NULL pointers
+    if (result->slots == NULL || result->keys == NULL) {
+        printf("Error: init_root_table did not allocate memory for the slots\n");
         return;
     }
 
-    // Check that all of the elements in bucket_heads are NULL
-    for (size_t i = 0; i < result->bucket_count; i++) {
-        if (result->bucket_heads[i] != NULL) {
-            printf("Error: init_root_table did not set bucket_heads[%zu] to NULL\n", i);
+    // Check that all of the slots are empty
+    for (size_t i = 0; i < result->capacity; i++) {
+        if (result->slots[i].object != NULL || result->keys[i].key != NULL) {
+            printf("Error: init_root_table did not empty slot %zu\n", i);
             return;
         }
     }
 
+    destroy_root_table(result);
     printf("test_init_root_table passed\n");
 }
 
@@ -49,9 +59,9 @@ void test_add_to_root_table() {
     init_root_table(table, 16);
 
     // Create some objects to add to the root table
-    Object *obj1 = new_object(1, free);
-    Object *obj2 = new_object(1, free);
-    Object *obj3 = new_object(1, free);
+    Object *obj1 = new_object(1, NULL);
+    Object *obj2 = new_object(1, NULL);
+    Object *obj3 = new_object(1, NULL);
 
     // Add objects to the root table
     bool added = add_to_root_table(table, "1", obj1);
@@ -99,9 +109,9 @@ void test_remove_from_root_table() {
     init_root_table(table, 8);
 
     // Create test objects
-    Object *obj1 = new_object(1, free);
-    Object *obj2 = new_object(1, free);
-    Object *obj3 = new_object(1, free);
+    Object *obj1 = new_object(1, NULL);
+    Object *obj2 = new_object(1, NULL);
+    Object *obj3 = new_object(1, NULL);
 
     // Add objects to table
     add_to_root_table(table, "obj1", obj1);
@@ -162,8 +172,7 @@ void test_get_from_root_table() {
 void test_clear_root_table() {
     printf("test_clear_root_table\n");
     // Create a root table
-    RootTable table;
-    init_root_table(&table, 16);
+    RootTable *table = init_root_table(malloc(sizeof(RootTable)), 16);
 
     // Create some objects to store in the table
     Object *object1 = new_object(sizeof(int), NULL);
@@ -171,12 +180,12 @@ void test_clear_root_table() {
     Object *object3 = new_object(sizeof(char), NULL);
 
     // Add the objects to the table
-    add_to_root_table(&table, "int", object1);
-    add_to_root_table(&table, "double", object2);
-    add_to_root_table(&table, "char", object3);
+    add_to_root_table(table, "int", object1);
+    add_to_root_table(table, "double", object2);
+    add_to_root_table(table, "char", object3);
 
     // Clear the table
-    bool success = clear_root_table(&table);
+    bool success = clear_root_table(table);
 
     // Check that the table was successfully cleared
     if (!success) {
@@ -185,15 +194,18 @@ void test_clear_root_table() {
     }
 
     // Check that the table is empty
-    for (size_t i = 0; i < table.bucket_count; ++i) {
-        Bucket *currentBucket = table.bucket_heads[i];
-        while (currentBucket != NULL) {
+    if (table->count != 0 || table->key_count != 0 || get_from_root_table(table, "int") != NULL) {
+        printf("test_clear_root_table FAILED: table was not cleared\n");
+        return;
+    }
+    for (size_t i = 0; i < table->capacity; ++i) {
+        if (table->slots[i].object != NULL) {
             printf("test_clear_root_table FAILED: table was not cleared\n");
             return;
         }
     }
 
-    clear_root_table(&table);
+    destroy_root_table(table);
 
     printf("test_clear_root_table PASSED\n");
 }
@@ -221,16 +233,15 @@ void test_destroy_root_table() {
 
 void test_rehash_root_table() {
     printf("test_rehash_root_table\n");
-    RootTable table;
-    init_root_table(&table, 10);
+    RootTable *table = init_root_table(malloc(sizeof(RootTable)), 10);
 
-    Object obj1;
-    add_to_root_table(&table, "key1", &obj1);
+    Object obj1 = {0};
+    add_to_root_table(table, "key1", &obj1);
 
-    bool result = rehash_root_table(&table);
+    bool result = rehash_root_table(table);
 
     if (result) {
-        Object *obj = get_from_root_table(&table, "key1");
+        Object *obj = get_from_root_table(table, "key1");
         if (obj != NULL) {
             printf("rehash_root_table test passed.\n");
         } else {
@@ -239,9 +250,342 @@ void test_rehash_root_table() {
     } else {
         printf("rehash_root_table test failed.\n");
     }
+    destroy_root_table(table);
 }
 
 
+void test_pointer_roots() {
+    printf("test_pointer_roots\n");
+    RootTable *table = init_root_table(NULL, 4);
+    static Object objects[ROOT_COUNT];
+
+    // The set grows as it fills, without losing a root
+    for (int i = 0; i < ROOT_COUNT; ++i) {
+        assert(root_table_add(table, &objects[i]));
+    }
+    assert(table->count == ROOT_COUNT);
+    assert(table->capacity >= ROOT_COUNT);
+    for (int i = 0; i < ROOT_COUNT; ++i) {
+        assert(root_table_contains(table, &objects[i]));
+    }
+
+    // Removing every other root shifts the probe sequences back, the rest stay reachable
+    for (int i = 0; i < ROOT_COUNT; i += 2) {
+        assert(root_table_remove(table, &objects[i]));
+    }
+    assert(table->count == ROOT_COUNT / 2);
+    for (int i = 0; i < ROOT_COUNT; ++i) {
+        assert(root_table_contains(table, &objects[i]) == (i % 2 == 1));
+    }
+    assert(!root_table_remove(table, &objects[0]));
+
+    // An object stays rooted until every hold is dropped, keys included
+    assert(add_to_root_table(table, "first", &objects[1]));
+    assert(add_to_root_table(table, "second", &objects[1]));
+    assert(root_table_remove(table, &objects[1]));
+    assert(remove_from_root_table(table, "first"));
+    assert(root_table_contains(table, &objects[1]));
+    assert(add_to_root_table(table, "second", &objects[0]));
+    assert(!root_table_contains(table, &objects[1]));
+    assert(root_table_contains(table, &objects[0]));
+    assert(get_from_root_table(table, "second") == &objects[0]);
+    destroy_root_table(table);
+    printf("test_pointer_roots passed\n");
+}
+
+static Object *forward_to_next(Object *object) {
+    return object + 1;
+}
+
+void test_forward_roots() {
+    printf("test_forward_roots\n");
+    RootTable *table = init_root_table(NULL, 4);
+    static Object objects[ROOT_COUNT + 1];
+    char keys[ROOT_COUNT][8];
+    for (int i = 0; i < ROOT_COUNT; ++i) {
+        sprintf(keys[i], "%d", i);
+        assert(add_to_root_table(table, keys[i], &objects[i]));
+    }
+    assert(root_table_add(table, &objects[0]));
+
+    // Every object moves up by one, the set is rehashed under the new addresses
+    root_table_forward(table, forward_to_next);
+    assert(table->count == ROOT_COUNT);
+    assert(!root_table_contains(table, &objects[0]));
+    for (int i = 0; i < ROOT_COUNT; ++i) {
+        assert(root_table_contains(table, &objects[i + 1]));
+        assert(get_from_root_table(table, keys[i]) == &objects[i + 1]);
+    }
+    assert(root_table_remove(table, &objects[1]));
+    assert(remove_from_root_table(table, keys[0]));
+    assert(!root_table_contains(table, &objects[1]));
+    destroy_root_table(table);
+    printf("test_forward_roots passed\n");
+}
+
+static size_t visited = 0;
+
+static void count_visit(Object *object) {
+    (void)object;
+    visited++;
+}
+
+void test_incremental_resize() {
+    printf("test_incremental_resize\n");
+    RootTable *table = init_root_table(NULL, 8);
+    static Object objects[ROOT_COUNT];
+    static char keys[ROOT_COUNT][8];
+    bool resized = false;
+
+    // Each insert moves a few old slots over, every root stays reachable meanwhile
+    for (int i = 0; i < ROOT_COUNT; ++i) {
+        sprintf(keys[i], "%d", i);
+        assert(add_to_root_table(table, keys[i], &objects[i]));
+        resized = resized || table->old_slots != NULL;
+        assert(root_table_contains(table, &objects[i / 2]));
+        assert(get_from_root_table(table, keys[i / 3]) == &objects[i / 3]);
+    }
+    assert(resized);
+    assert(table->count == ROOT_COUNT && table->key_count == ROOT_COUNT);
+    assert(table->capacity >= ROOT_COUNT && table->key_capacity >= ROOT_COUNT);
+    visited = 0;
+    root_table_for_each(table, count_visit);
+    assert(visited == ROOT_COUNT);
+
+    // Removals shrink both tables back, a root removed and added again mid-resize is not lost
+    for (int i = ROOT_COUNT - 1; i >= 10; --i) {
+        assert(remove_from_root_table(table, keys[i]));
+        if (i % 1000 == 0) {
+            assert(root_table_add(table, &objects[i]));
+            assert(root_table_contains(table, &objects[i]));
+            assert(root_table_remove(table, &objects[i]));
+        }
+        assert(root_table_contains(table, &objects[i / 2]));
+    }
+    // A shrink ends a few operations at a time too, the next ones start the following shrink
+    for (int i = 0; i < ROOT_COUNT; ++i) {
+        assert(add_to_root_table(table, "churn", &objects[ROOT_COUNT - 1]));
+        assert(remove_from_root_table(table, "churn"));
+    }
+    root_table_finish_resize(table);
+    assert(table->capacity <= 128 && table->key_capacity <= 128);
+    assert(table->old_slots == NULL && table->old_keys == NULL);
+    for (int i = 0; i < ROOT_COUNT; ++i) {
+        assert(root_table_contains(table, &objects[i]) == (i < 10));
+    }
+    destroy_root_table(table);
+    printf("test_incremental_resize passed\n");
+}
+
+void test_sharded_roots() {
+    printf("test_sharded_roots\n");
+    RootTable *table = init_sharded_root_table(NULL, SHARDS, 4);
+    assert(table != NULL && root_table_is_sharded(table));
+    assert(root_table_slot_count(table) == 0);
+    static Object objects[ROOT_COUNT + 1];
+    static char keys[ROOT_COUNT][8];
+
+    // The same operations behave as on a table of one thread, spread over the shards
+    for (int i = 0; i < ROOT_COUNT; ++i) {
+        sprintf(keys[i], "%d", i);
+        assert(add_to_root_table(table, keys[i], &objects[i]));
+        assert(root_table_add(table, &objects[i]));
+    }
+    for (int i = 0; i < ROOT_COUNT; i += 2) {
+        assert(root_table_remove(table, &objects[i]));
+        assert(remove_from_root_table(table, keys[i]));
+    }
+    for (int i = 0; i < ROOT_COUNT; ++i) {
+        assert(root_table_contains(table, &objects[i]) == (i % 2 == 1));
+        assert(get_from_root_table(table, keys[i]) == (i % 2 == 1 ? &objects[i] : NULL));
+    }
+    assert(get_object_count(table, &objects[1]) == 2);
+    visited = 0;
+    root_table_for_each(table, count_visit);
+    assert(visited == ROOT_COUNT / 2);
+
+    // Keys are copied, the caller's string may change
+    char key[8] = "copied";
+    assert(add_to_root_table(table, key, &objects[0]));
+    strcpy(key, "changed");
+    assert(get_from_root_table(table, "copied") == &objects[0]);
+    assert(get_from_root_table(table, key) == NULL);
+
+    // Objects moving to another shard are rehashed there, with their holds and keys
+    root_table_forward(table, forward_to_next);
+    assert(!root_table_contains(table, &objects[0]));
+    assert(get_from_root_table(table, "copied") == &objects[1]);
+    for (int i = 1; i < ROOT_COUNT; i += 2) {
+        assert(root_table_contains(table, &objects[i + 1]));
+        assert(get_from_root_table(table, keys[i]) == &objects[i + 1]);
+        assert(get_object_count(table, &objects[i + 1]) == 2);
+    }
+
+    assert(clear_root_table(table));
+    assert(get_from_root_table(table, keys[1]) == NULL);
+    assert(!root_table_contains(table, &objects[2]));
+    destroy_root_table(table);
+    printf("test_sharded_roots passed\n");
+}
+
+void test_remove_object() {
+    printf("test_remove_object\n");
+    RootTable *table = init_root_table(NULL, 16);
+    geece_set_roots(table);
+    Object *parent = geece_malloc(0, NULL);
+    Object *child = geece_malloc(0, NULL);
+    assert(add_to_root_table(table, "parent", parent));
+    assert(root_table_add(table, parent));
+    assert(root_table_add(table, child));
+    assert(add_reference(table, parent, child));
+    assert(get_object_count(table, child) == 2);
+
+    // The edges go, the object stays with its holds and keys
+    assert(remove_object(table, parent));
+    assert(get_reference_count(table, parent) == 0);
+    assert(get_object_count(table, child) == 1);
+    assert(root_table_contains(table, parent));
+    assert(get_object_count(table, parent) == 2);
+    assert(get_from_root_table(table, "parent") == parent);
+
+    geece_set_roots(NULL);
+    destroy_root_table(table);
+    geece_collect();
+    printf("test_remove_object passed\n");
+}
+
+static RootTable *shared_table;
+static Object stable_objects[STABLE_KEYS];
+static char stable_keys[STABLE_KEYS][16];
+
+static void *churn_roots(void *arg) {
+    int thread = (int)(intptr_t)arg;
+    static Object objects[THREADS][THREAD_ROOTS];
+    char key[32];
+    for (int round = 0; round < 4; ++round) {
+        for (int i = 0; i < THREAD_ROOTS; ++i) {
+            sprintf(key, "t%d-%d", thread, i);
+            assert(add_to_root_table(shared_table, key, &objects[thread][i]));
+            assert(root_table_add(shared_table, &objects[thread][i]));
+            assert(get_from_root_table(shared_table, key) == &objects[thread][i]);
+            int stable = (thread * THREAD_ROOTS + i) % STABLE_KEYS;
+            assert(get_from_root_table(shared_table, stable_keys[stable]) == &stable_objects[stable]);
+        }
+        for (int i = 0; i < THREAD_ROOTS; ++i) {
+            sprintf(key, "t%d-%d", thread, i);
+            assert(remove_from_root_table(shared_table, key));
+            assert(root_table_contains(shared_table, &objects[thread][i]));
+            assert(root_table_remove(shared_table, &objects[thread][i]));
+            assert(get_from_root_table(shared_table, key) == NULL);
+        }
+    }
+    return NULL;
+}
+
+void test_sharded_threads() {
+    printf("test_sharded_threads\n");
+    shared_table = init_sharded_root_table(NULL, SHARDS, 16);
+    for (int i = 0; i < STABLE_KEYS; ++i) {
+        sprintf(stable_keys[i], "stable%d", i);
+        assert(add_to_root_table(shared_table, stable_keys[i], &stable_objects[i]));
+    }
+
+    // Threads add and remove their own roots while every thread reads the stable keys
+    pthread_t threads[THREADS];
+    for (int i = 0; i < THREADS; ++i) {
+        pthread_create(&threads[i], NULL, churn_roots, (void *)(intptr_t)i);
+    }
+    for (int i = 0; i < THREADS; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    visited = 0;
+    root_table_for_each(shared_table, count_visit);
+    assert(visited == STABLE_KEYS);
+    for (int i = 0; i < STABLE_KEYS; ++i) {
+        assert(get_from_root_table(shared_table, stable_keys[i]) == &stable_objects[i]);
+    }
+    destroy_root_table(shared_table);
+    printf("test_sharded_threads passed\n");
+}
+
+static Object snapshot_objects[2 * ROOT_COUNT];
+static int snapshot_seen[2 * ROOT_COUNT];
+
+static void see_object(Object *object) {
+    snapshot_seen[object - snapshot_objects]++;
+}
+
+static void *change_roots(void *arg) {
+    (void)arg;
+    for (int i = 0; i < ROOT_COUNT; ++i) {
+        assert(root_table_remove(shared_table, &snapshot_objects[i]));
+        assert(root_table_add(shared_table, &snapshot_objects[ROOT_COUNT + i]));
+    }
+    return NULL;
+}
+
+void test_sharded_snapshot() {
+    printf("test_sharded_snapshot\n");
+    shared_table = init_sharded_root_table(NULL, SHARDS, 16);
+    for (int i = 0; i < ROOT_COUNT; ++i) {
+        assert(root_table_add(shared_table, &snapshot_objects[i]));
+    }
+
+    // Writers go on while the snapshot is held, and it keeps the roots it was taken with
+    root_table_snapshot(shared_table);
+    pthread_t writer;
+    pthread_create(&writer, NULL, change_roots, NULL);
+    pthread_join(writer, NULL);
+    memset(snapshot_seen, 0, sizeof(snapshot_seen));
+    root_table_snapshot_for_each(shared_table, see_object);
+    for (int i = 0; i < 2 * ROOT_COUNT; ++i) {
+        assert(snapshot_seen[i] == (i < ROOT_COUNT));
+    }
+    root_table_release_snapshot(shared_table);
+
+    // The next walk sees the roots as the writer left them
+    memset(snapshot_seen, 0, sizeof(snapshot_seen));
+    root_table_for_each(shared_table, see_object);
+    for (int i = 0; i < 2 * ROOT_COUNT; ++i) {
+        assert(snapshot_seen[i] == (i >= ROOT_COUNT));
+    }
+    destroy_root_table(shared_table);
+    printf("test_sharded_snapshot passed\n");
+}
+
+void test_sharded_collection() {
+    printf("test_sharded_collection\n");
+    RootTable *roots = init_sharded_root_table(NULL, SHARDS, 16);
+    geece_set_roots(roots);
+    char key[16];
+    for (int i = 0; i < 300; ++i) {
+        Object *object = geece_malloc(0, count_destroyed);
+        sprintf(key, "%d", i);
+        if (i % 3 == 0) {
+            assert(add_to_root_table(roots, key, object));
+        } else if (i % 3 == 1) {
+            assert(root_table_add(roots, object));
+        }
+    }
+
+    // Both the serial and the parallel mark find the roots of every shard
+    destroyed = 0;
+    geece_collect();
+    assert(destroyed == 100);
+    unsigned int mark_threads = geece_config.mark_threads;
+    geece_config.mark_threads = 4;
+    geece_collect();
+    geece_config.mark_threads = mark_threads;
+    assert(destroyed == 100);
+
+    clear_root_table(roots);
+    geece_collect();
+    assert(destroyed == 300);
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_sharded_collection passed\n");
+}
+
 int main(){
     test_add_to_root_table();
     test_clear_root_table();
@@ -250,5 +594,13 @@ int main(){
     test_rehash_root_table();
     test_remove_from_root_table();
     test_destroy_root_table();
+    test_pointer_roots();
+    test_forward_roots();
+    test_incremental_resize();
+    test_remove_object();
+    test_sharded_roots();
+    test_sharded_threads();
+    test_sharded_snapshot();
+    test_sharded_collection();
     return 0;
 }
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include "geece.h"
+#include "test_helpers.h"
+
+#define GARBAGE 1000
+#define PAYLOAD 24
+
+static int kept_destroyed = 0;
+
+static void count_kept_destroyed(void *object) {
+    (void)object;
+    __atomic_fetch_add(&kept_destroyed, 1, __ATOMIC_RELAXED);
+}
+
+static int held_destroyed = 0;
+
+static void count_held_destroyed(void *object) {
+    (void)object;
+    __atomic_fetch_add(&held_destroyed, 1, __ATOMIC_RELAXED);
+}
+
+static __attribute__((noinline)) void allocate_garbage(void) {
+    for (int i = 0; i < GARBAGE; ++i){
+        geece_malloc(PAYLOAD, count_destroyed);
+    }
+}
+
+void test_local_variables_are_roots() {
+    printf("test_local_variables_are_roots\n");
+    assert(geece_register_thread());
+    geece_set_roots(NULL);
+    Object *kept = geece_malloc(PAYLOAD, count_kept_destroyed);
+    strcpy((char *)(kept + 1), "kept");
+    // Only an interior pointer is left to the second object
+    char *inner = (char *)(geece_malloc(PAYLOAD, count_kept_destroyed) + 1) + 8;
+    strcpy(inner, "inner");
+    Object *large = geece_malloc(64 * 1024, count_kept_destroyed);
+    assert(large->flags & OBJECT_LARGE);
+    strcpy((char *)(large + 1), "large");
+    allocate_garbage();
+
+    destroyed = 0;
+    geece_collect();
+    assert(kept_destroyed == 0);
+    assert(strcmp((char *)(kept + 1), "kept") == 0);
+    assert(strcmp(inner, "inner") == 0);
+    // A few stale words may still point at garbage, most of it is freed
+    assert(destroyed > GARBAGE * 9 / 10);
+
+    // Compaction leaves objects found on the stack where they are, behind the holes of the garbage
+    allocate_garbage();
+    Object *late = geece_malloc(PAYLOAD, count_kept_destroyed);
+    strcpy((char *)(late + 1), "late");
+    geece_collect();
+    geece_compact();
+    assert(!(late->flags & OBJECT_PINNED));
+    // Had it moved, its old block would be handed out and zeroed again
+    allocate_garbage();
+    assert(strcmp((char *)(late + 1), "late") == 0);
+    assert(strcmp((char *)(kept + 1), "kept") == 0);
+    assert(strcmp(inner, "inner") == 0);
+    assert(strcmp((char *)(large + 1), "large") == 0);
+    assert(kept_destroyed == 0);
+
+    geece_unregister_thread();
+    printf("test_local_variables_are_roots passed\n");
+}
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t changed = PTHREAD_COND_INITIALIZER;
+static bool allocated = false;
+static bool done = false;
+
+static void *hold_object(void *arg) {
+    (void)arg;
+    assert(geece_register_thread());
+    Object *held = geece_malloc(PAYLOAD, count_held_destroyed);
+    strcpy((char *)(held + 1), "held");
+    pthread_mutex_lock(&lock);
+    allocated = true;
+    pthread_cond_signal(&changed);
+    while (!done){
+        pthread_cond_wait(&changed, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+    assert(strcmp((char *)(held + 1), "held") == 0);
+    // Unregistered when the thread exits
+    return NULL;
+}
+
+void test_other_threads_are_stopped_and_scanned() {
+    printf("test_other_threads_are_stopped_and_scanned\n");
+    assert(geece_register_thread());
+    pthread_t thread;
+    assert(pthread_create(&thread, NULL, hold_object, NULL) == 0);
+    pthread_mutex_lock(&lock);
+    while (!allocated){
+        pthread_cond_wait(&changed, &lock);
+    }
+    pthread_mutex_unlock(&lock);
+
+    // The object is only referenced from the other thread's stack
+    geece_collect();
+    geece_collect();
+    assert(held_destroyed == 0);
+
+    pthread_mutex_lock(&lock);
+    done = true;
+    pthread_cond_signal(&changed);
+    pthread_mutex_unlock(&lock);
+    pthread_join(thread, NULL);
+    geece_unregister_thread();
+    geece_collect();
+    assert(held_destroyed == 1);
+    printf("test_other_threads_are_stopped_and_scanned passed\n");
+}
+
+int main(){
+    test_local_variables_are_roots();
+    test_other_threads_are_stopped_and_scanned();
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <assert.h>
+#include "geece.h"
+#include "test_helpers.h"
+#include "heap.h"
+
+#define KEPT 2000
+#define PAYLOAD 24
+#define SIZES 8
+
+void test_lazy_sweep_on_allocation() {
+    printf("test_lazy_sweep_on_allocation\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    geece_config.lazy_sweep = true;
+
+    // Live list nodes, dead objects without a destructor and dead ones with one, interleaved
+    static Object *plain[KEPT];
+    Object *head = geece_malloc(PAYLOAD, count_destroyed);
+    Object *tail = head;
+    for (int i = 1; i < KEPT; ++i){
+        Object *node = geece_malloc(PAYLOAD, count_destroyed);
+        link_objects(roots, tail, node);
+        tail = node;
+        plain[i] = geece_malloc(PAYLOAD, NULL);
+        geece_malloc(PAYLOAD, count_destroyed);
+    }
+    char key[ADDRESS_KEY_LENGTH];
+    add_root_by_address(roots, head, key);
+
+    destroyed = 0;
+    geece_collect();
+    assert(destroyed == 0);
+
+    // The first allocation sweeps a page and reuses a block the sweep just freed
+    Object *first = geece_malloc(PAYLOAD, NULL);
+    bool reused = false;
+    for (int i = 1; i < KEPT; ++i){
+        reused |= plain[i] == first;
+    }
+    assert(reused);
+
+    // Destructors of dead objects run as allocations sweep their pages
+    for (int i = 0; i < 3 * KEPT && destroyed < KEPT - 1; ++i){
+        geece_malloc(PAYLOAD, NULL);
+    }
+    assert(destroyed == KEPT - 1);
+
+    // The next collection sweeps what is left before it marks
+    remove_from_root_table(roots, key);
+    geece_collect();
+    assert(destroyed == KEPT - 1);
+    geece_collect();
+    assert(destroyed == 2 * KEPT - 1);
+
+    geece_config.lazy_sweep = false;
+    geece_collect();
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_lazy_sweep_on_allocation passed\n");
+}
+
+void test_release_into_unswept_page() {
+    printf("test_release_into_unswept_page\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    geece_config.lazy_sweep = true;
+    Object *kept = geece_malloc(PAYLOAD, count_destroyed);
+    char key[ADDRESS_KEY_LENGTH];
+    add_root_by_address(roots, kept, key);
+    geece_malloc(PAYLOAD, count_destroyed);
+
+    destroyed = 0;
+    geece_collect();
+    assert(page_of(kept)->unswept);
+    remove_from_root_table(roots, key);
+    geece_release(kept);
+    assert(destroyed == 1);
+
+    // The sweep finds the released block free and leaves it alone
+    geece_collect();
+    assert(destroyed == 2);
+
+    geece_config.lazy_sweep = false;
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_release_into_unswept_page passed\n");
+}
+
+void test_parallel_sweep() {
+    printf("test_parallel_sweep\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    unsigned int threads = geece_config.sweep_threads;
+    geece_config.sweep_threads = 4;
+
+    // Live and dead objects of several size classes, enough pages for every thread to get some
+    static Object *dead[KEPT];
+    Object *head = geece_malloc(PAYLOAD, count_destroyed);
+    Object *tail = head;
+    for (int i = 0; i < KEPT; ++i){
+        for (int size = 1; size <= SIZES; ++size){
+            Object *node = geece_malloc(size * PAYLOAD, count_destroyed);
+            link_objects(roots, tail, node);
+            tail = node;
+            Object *garbage = geece_malloc(size * PAYLOAD, size % 2 == 0 ? count_destroyed : NULL);
+            if (size == 1){
+                dead[i] = garbage;
+            }
+        }
+    }
+    char key[ADDRESS_KEY_LENGTH];
+    add_root_by_address(roots, head, key);
+
+    destroyed = 0;
+    size_t freed = geece_stats()->freed_bytes;
+    geece_collect();
+    assert(destroyed == KEPT * SIZES / 2);
+    assert(geece_stats()->freed_bytes - freed >= (size_t)KEPT * SIZES * (sizeof(Object) + PAYLOAD));
+
+    // The freed blocks are filed back for allocation
+    int reused = 0;
+    for (int i = 0; i < KEPT; ++i){
+        Object *object = geece_malloc(PAYLOAD, count_destroyed);
+        for (int j = 0; j < KEPT; ++j){
+            reused += dead[j] == object;
+        }
+    }
+    assert(reused > 0);
+
+    remove_from_root_table(roots, key);
+    geece_collect();
+    assert(destroyed == KEPT * SIZES / 2 + KEPT * SIZES + KEPT + 1);
+
+    geece_config.sweep_threads = threads;
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_parallel_sweep passed\n");
+}
+
+int main(){
+    test_lazy_sweep_on_allocation();
+    test_release_into_unswept_page();
+    test_parallel_sweep();
+    return 0;
+}
@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <sched.h>
+#include "geece.h"
+#include "test_helpers.h"
+#include "mark_and_sweep.h"
+
+#define LIST_LENGTH 2000
+#define MOVES 2000
+
+typedef struct {
+    long value;
+    Object *next;
+    Object *other;
+} Node;
+
+static GeeceType node_type;
+static Node *node_of(Object *object) {
+    return geece_payload(object);
+}
+
+static Object *new_node(long value) {
+    Object *object = geece_malloc_typed(node_type, count_destroyed);
+    node_of(object)->value = value;
+    return object;
+}
+
+// Returns the head of a list of `length` nodes linked through their `next` field
+static Object *build_list(int length) {
+    Object *head = new_node(0);
+    Object *tail = head;
+    for (int i = 1; i < length; ++i){
+        Object *node = new_node(i);
+        geece_write_field(tail, &node_of(tail)->next, node);
+        tail = node;
+    }
+    return head;
+}
+
+static void check_list(Object *head, int length) {
+    int count = 0;
+    for (Object *node = head; node != NULL; node = node_of(node)->next){
+        assert(node_of(node)->value == count);
+        count++;
+    }
+    assert(count == length);
+}
+
+static void promote(void) {
+    for (unsigned int i = 0; i < geece_config.promotion_age; ++i){
+        geece_collect_minor();
+    }
+}
+
+void test_registration() {
+    printf("test_registration\n");
+    assert(node_type != 0);
+    const TypeInfo *info = &type_table[node_type];
+    assert(info->size == sizeof(Node));
+    assert(info->field_count == 2);
+    assert(info->offsets[0] == offsetof(Node, next));
+    assert(info->offsets[1] == offsetof(Node, other));
+
+    // Words 0 and 2 of a four-word payload, and an offset that is not pointer-aligned
+    uint64_t map = 0x5;
+    GeeceType type = geece_register_type("pair", 4 * sizeof(Object *), &map);
+    assert(type != 0 && type != node_type);
+    assert(type_table[type].field_count == 2);
+    assert(type_table[type].offsets[1] == 2 * sizeof(Object *));
+    assert(geece_register_type_fields("bad", 16, (const size_t[]){3}, 1) == 0);
+
+    Object *object = geece_malloc_typed(type, NULL);
+    assert(object_type(object) == type);
+    assert(object_type(geece_malloc(8, NULL)) == 0);
+    printf("test_registration passed\n");
+}
+
+void test_fields_survive_collections() {
+    printf("test_fields_survive_collections\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    destroyed = 0;
+
+    // Young nodes move with every minor collection, their fields are updated along
+    add_to_root_table(roots, "list", build_list(LIST_LENGTH));
+    geece_collect_minor();
+    check_list(get_from_root_table(roots, "list"), LIST_LENGTH);
+    geece_collect_minor();
+    geece_collect();
+    assert(destroyed == 0);
+    Object *head = get_from_root_table(roots, "list");
+    check_list(head, LIST_LENGTH);
+
+    // Cutting the list in the middle frees the second half
+    Object *middle = head;
+    for (int i = 1; i < LIST_LENGTH / 2; ++i){
+        middle = node_of(middle)->next;
+    }
+    geece_write_field(middle, &node_of(middle)->next, NULL);
+    geece_collect();
+    assert(destroyed == LIST_LENGTH / 2);
+    check_list(head, LIST_LENGTH / 2);
+
+    remove_from_root_table(roots, "list");
+    geece_collect();
+    assert(destroyed == LIST_LENGTH);
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_fields_survive_collections passed\n");
+}
+
+void test_old_field_to_young_object() {
+    printf("test_old_field_to_young_object\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    destroyed = 0;
+    add_to_root_table(roots, "old", new_node(1));
+    promote();
+    Object *old = get_from_root_table(roots, "old");
+    assert(!(old->flags & OBJECT_YOUNG));
+
+    // Only the remembered set keeps the young node alive
+    Object *young = new_node(2);
+    assert(young->flags & OBJECT_YOUNG);
+    geece_write_field(old, &node_of(old)->other, young);
+    assert(old->flags & OBJECT_REMEMBERED);
+    geece_collect_minor();
+    young = node_of(old)->other;
+    assert(young != NULL && node_of(young)->value == 2);
+    assert(destroyed == 0);
+
+    remove_from_root_table(roots, "old");
+    geece_collect();
+    assert(destroyed == 2);
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_old_field_to_young_object passed\n");
+}
+
+void test_compaction_forwards_fields() {
+    printf("test_compaction_forwards_fields\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    destroyed = 0;
+
+    // Every other node dies, leaving holes for the survivors to slide into
+    add_to_root_table(roots, "list", build_list(LIST_LENGTH));
+    promote();
+    for (Object *node = get_from_root_table(roots, "list"); node != NULL; node = node_of(node)->next){
+        Object *next = node_of(node)->next;
+        if (next != NULL){
+            geece_write_field(node, &node_of(node)->next, node_of(next)->next);
+        }
+    }
+    size_t moved = geece_stats()->moved_bytes;
+    geece_compact();
+    assert(geece_stats()->moved_bytes > moved);
+    assert(destroyed == LIST_LENGTH / 2);
+    long expected = 0;
+    for (Object *node = get_from_root_table(roots, "list"); node != NULL; node = node_of(node)->next){
+        assert(node_of(node)->value == expected);
+        expected += 2;
+    }
+    assert(expected == LIST_LENGTH);
+
+    remove_from_root_table(roots, "list");
+    geece_collect();
+    assert(destroyed == LIST_LENGTH);
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_compaction_forwards_fields passed\n");
+}
+
+void test_field_moves_during_concurrent_marking() {
+    printf("test_field_moves_during_concurrent_marking\n");
+    RootTable *roots = init_root_table(NULL, 16);
+    geece_set_roots(roots);
+    Object *head = build_list(LIST_LENGTH);
+    add_to_root_table(roots, "list", head);
+    geece_write_field(head, &node_of(head)->other, new_node(-1));
+
+    // Promoted, so that the cycle marks them instead of scanning them as roots
+    promote();
+    static Object *nodes[LIST_LENGTH];
+    nodes[0] = get_from_root_table(roots, "list");
+    for (int i = 1; i < LIST_LENGTH; ++i){
+        nodes[i] = node_of(nodes[i - 1])->next;
+    }
+    Object *moved = node_of(nodes[0])->other;
+    assert(!(moved->flags & OBJECT_YOUNG));
+
+    // `moved` hops between the nodes' `other` fields while the background thread marks them
+    destroyed = 0;
+    geece_config.concurrent_marking = true;
+    geece_collect_start();
+    int holder = 0;
+    for (int i = 0; i < MOVES; ++i){
+        int next = (int)(((unsigned int)i * 7919u) % LIST_LENGTH);
+        if (next == holder){
+            continue;
+        }
+        geece_write_field(nodes[next], &node_of(nodes[next])->other, moved);
+        geece_write_field(nodes[holder], &node_of(nodes[holder])->other, NULL);
+        holder = next;
+    }
+    while (!geece_collect_step()){
+        sched_yield();
+    }
+    assert(destroyed == 0);
+    assert(node_of(node_of(nodes[holder])->other)->value == -1);
+
+    geece_config.concurrent_marking = false;
+    remove_from_root_table(roots, "list");
+    geece_collect();
+    assert(destroyed == LIST_LENGTH + 1);
+    geece_set_roots(NULL);
+    destroy_root_table(roots);
+    printf("test_field_moves_during_concurrent_marking passed\n");
+}
+
+int main(){
+    geece_config.nursery_size = 1024 * 1024;
+    node_type = GEECE_REGISTER_STRUCT(Node, next, other);
+    test_registration();
+    test_fields_survive_collections();
+    test_old_field_to_young_object();
+    test_compaction_forwards_fields();
+    test_field_moves_during_concurrent_marking();
+    return 0;
+}
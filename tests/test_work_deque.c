@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <assert.h>
+#include <pthread.h>
+#include "work_deque.h"
+#include "workers.h"
+
+#define ITEMS 200000
+#define THIEVES 3
+
+static WorkDeque deque;
+static atomic_int taken[ITEMS + 1];
+static atomic_bool done;
+
+static void *steal_items(void *arg) {
+    (void)arg;
+    while (!atomic_load(&done) || !work_deque_empty(&deque)){
+        void *item = work_deque_steal(&deque);
+        if (item != NULL){
+            atomic_fetch_add(&taken[(uintptr_t)item], 1);
+        }
+    }
+    return NULL;
+}
+
+void test_owner_order() {
+    printf("test_owner_order\n");
+    assert(work_deque_init(&deque, 2, 1024));
+    assert(work_deque_take(&deque) == NULL);
+    for (uintptr_t i = 1; i <= 100; ++i){
+        assert(work_deque_push(&deque, (void *)i));
+    }
+    // The owner takes the newest item, thieves the oldest
+    assert(work_deque_take(&deque) == (void *)100);
+    assert(work_deque_steal(&deque) == (void *)1);
+    work_deque_destroy(&deque);
+
+    // Pushing past the limit fails
+    assert(work_deque_init(&deque, 4, 8));
+    for (uintptr_t i = 1; i <= 8; ++i){
+        assert(work_deque_push(&deque, (void *)i));
+    }
+    assert(!work_deque_push(&deque, (void *)9));
+    work_deque_destroy(&deque);
+    printf("test_owner_order passed\n");
+}
+
+void test_concurrent_steals() {
+    printf("test_concurrent_steals\n");
+    // The array grows by doubling, the limit leaves room for every item even if no thief runs
+    assert(work_deque_init(&deque, 16, 2 * ITEMS));
+    atomic_store(&done, false);
+    pthread_t thieves[THIEVES];
+    for (int i = 0; i < THIEVES; ++i){
+        pthread_create(&thieves[i], NULL, steal_items, NULL);
+    }
+    // The owner pushes and takes while the thieves steal, every item must come out exactly once
+    for (uintptr_t i = 1; i <= ITEMS; ++i){
+        assert(work_deque_push(&deque, (void *)i));
+        if (i % 3 == 0){
+            void *item = work_deque_take(&deque);
+            if (item != NULL){
+                atomic_fetch_add(&taken[(uintptr_t)item], 1);
+            }
+        }
+    }
+    atomic_store(&done, true);
+    void *item;
+    while ((item = work_deque_take(&deque)) != NULL){
+        atomic_fetch_add(&taken[(uintptr_t)item], 1);
+    }
+    for (int i = 0; i < THIEVES; ++i){
+        pthread_join(thieves[i], NULL);
+    }
+    for (int i = 1; i <= ITEMS; ++i){
+        assert(atomic_load(&taken[i]) == 1);
+    }
+    work_deque_destroy(&deque);
+    printf("test_concurrent_steals passed\n");
+}
+
+static atomic_uint ran[4];
+
+static void record_run(unsigned int index, void *arg) {
+    (void)arg;
+    atomic_fetch_add(&ran[index], 1);
+}
+
+void test_workers_run() {
+    printf("test_workers_run\n");
+    unsigned int count = workers_start(4);
+    assert(count >= 1 && count <= 4);
+    for (int run = 0; run < 100; ++run){
+        workers_run(count, record_run, NULL);
+    }
+    workers_run(1, record_run, NULL);
+    assert(atomic_load(&ran[0]) == 101);
+    for (unsigned int i = 1; i < count; ++i){
+        assert(atomic_load(&ran[i]) == 100);
+    }
+    printf("test_workers_run passed\n");
+}
+
+int main(){
+    test_owner_order();
+    test_concurrent_steals();
+    test_workers_run();
+    return 0;
+}